@@ -0,0 +1,298 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Composite frame builder - planning, tile cache, and assembly.
+
+
+//
+// Includes
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compositor.h"
+#include "framelog.h"
+
+
+//
+// Private macros
+
+// ImageMagick's "grey30".
+#define COMPOSITE_BACKGROUND 77
+
+
+//
+// Private variables
+
+// Annotations are orange.
+static const uint8_t composite_text_colour[3] = { 255, 165, 0 };
+
+
+
+//
+// Layout methods
+
+
+// Constructor.
+
+CompositeLayout::CompositeLayout()
+{
+  static const CompositeSlot default_slots[] =
+  {
+    { "SceneA", "Scene A", 0, 0 },
+    { "SceneB", "Scene B", 0, 1 },
+    { "SceneC", "Scene C", 0, 2 },
+    { "FaceA", "Face A", 1, 0 },
+    { "FaceB", "Face B", 1, 1 },
+    { "Game", "Game", 1, 2 }
+  };
+
+  width = 1280;
+  height = 960;
+  tile_width = 640;
+  tile_height = 320;
+  step_x = 640;
+  step_y = 320;
+  offset_x = 0;
+  offset_y = 0;
+  fontsize = 20;
+
+  slots.assign(default_slots,
+    default_slots + (sizeof(default_slots) / sizeof(default_slots[0])));
+}
+
+
+
+//
+// Tile cache methods
+
+
+// Constructor.
+
+TileCache::TileCache(const CompositePlan &new_plan,
+  const CompositeLayout &new_layout, const TextRenderer &new_labelfont,
+  bool new_fast)
+  : plan(new_plan), layout(new_layout), labelfont(new_labelfont),
+  fast(new_fast), decodes(0)
+{
+  size_t sidx;
+
+  entries.resize(plan.sources.size());
+  for (sidx = 0; sidx < entries.size(); sidx++)
+  {
+    entries[sidx].reset(new entry_t);
+    entries[sidx]->is_loaded = false;
+    entries[sidx]->remaining = plan.uses[sidx];
+  }
+}
+
+
+
+// Returns a source's tile, decoding it if need be.
+
+std::shared_ptr<const RGBImage> TileCache::Acquire(long source)
+{
+  entry_t *entry;
+  const CompositeSource *info;
+  RGBImage frame;
+  std::shared_ptr<RGBImage> tile;
+  struct stat fileinfo;
+
+  entry = entries[source].get();
+
+  // Other threads wanting this tile wait while it's decoded.
+  std::lock_guard<std::mutex> guard(entry->lock);
+
+  if (entry->is_loaded)
+    return entry->tile;
+
+  entry->is_loaded = true;
+  info = &(plan.sources[source]);
+
+  // Missing and empty files leave the slot empty, as in the Perl version.
+  if ( (0 != stat(info->path.c_str(), &fileinfo)) || (0 == fileinfo.st_size) )
+  {
+    fprintf(stderr, "-- Can't find \"%s\".\n", info->path.c_str());
+    return entry->tile;
+  }
+
+  decodes++;
+
+  if (!ReadJPEG(info->path.c_str(), fast ? layout.tile_width : 0,
+    fast ? layout.tile_height : 0, frame))
+  {
+    fprintf(stderr, "-- Can't read \"%s\".\n", info->path.c_str());
+    return entry->tile;
+  }
+
+  tile.reset(new RGBImage);
+  SampleToFit(frame, layout.tile_width, layout.tile_height, *tile);
+  labelfont.DrawText(*tile, layout.slots[info->slot].label, TEXT_NORTH,
+    composite_text_colour);
+
+  entry->tile = tile;
+
+  return entry->tile;
+}
+
+
+
+// Notes that one output frame is done with a source.
+
+void TileCache::Release(long source)
+{
+  entry_t *entry;
+
+  entry = entries[source].get();
+
+  if (1 == entry->remaining.fetch_sub(1))
+  {
+    // Frames still holding the tile keep their own reference.
+    std::lock_guard<std::mutex> guard(entry->lock);
+    entry->tile.reset();
+  }
+}
+
+
+
+//
+// Functions
+
+
+// Builds the output frame list from a log.
+
+bool BuildCompositePlan(const std::string &logname,
+  const std::string &repodir, const CompositeLayout &layout, double period,
+  CompositePlan &plan)
+{
+  int fd;
+  struct stat info;
+  const char *data, *line, *next, *end;
+  double time, nexttime;
+  std::string label, file;
+  std::vector<long> recent;
+  CompositeSource source;
+  unsigned long framecount;
+  size_t slot;
+  long sidx;
+
+  plan.sources.clear();
+  plan.frames.clear();
+  plan.uses.clear();
+  plan.frame_max = 0;
+
+  fd = open(logname.c_str(), O_RDONLY);
+  if (0 > fd)
+    return false;
+
+  if ( (0 != fstat(fd, &info)) || (0 == info.st_size) )
+  {
+    close(fd);
+    return (0 == info.st_size);
+  }
+
+  data = (const char *) mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE,
+    fd, 0);
+  close(fd);
+  if (MAP_FAILED == data)
+    return false;
+
+  end = data + info.st_size;
+
+  recent.assign(layout.slots.size(), -1);
+  framecount = 0;
+  nexttime = 0;
+
+  for (line = data; line < end; line = next + 1)
+  {
+    next = (const char *) memchr(line, '\n', end - line);
+    if (NULL == next)
+      next = end;
+
+    if (!ParseFrameLine(line, next - line, time, label, file))
+      continue;
+
+    // The frame estimate uses the last frame line, whatever its feed.
+    plan.frame_max = (unsigned long) ((0.999 + time) / period);
+
+    for (slot = 0; slot < layout.slots.size(); slot++)
+      if (layout.slots[slot].name == label)
+        break;
+
+    if (slot >= layout.slots.size())
+      continue;
+
+    source.path = repodir + "/" + file;
+    source.slot = slot;
+    recent[slot] = plan.sources.size();
+    plan.sources.push_back(source);
+    plan.uses.push_back(0);
+
+    if (time >= nexttime)
+    {
+      // Frame numbers are sparse, so that they track time.
+      do
+      {
+        nexttime += period;
+        framecount++;
+      }
+      while (nexttime <= time);
+
+      plan.frames.push_back(CompositeFrame());
+      plan.frames.back().time = time;
+      plan.frames.back().number = framecount;
+      plan.frames.back().sources = recent;
+
+      for (slot = 0; slot < recent.size(); slot++)
+      {
+        sidx = recent[slot];
+        if (0 <= sidx)
+          plan.uses[sidx]++;
+      }
+    }
+  }
+
+  munmap((void *) data, info.st_size);
+
+  return true;
+}
+
+
+
+// Assembles one output frame.
+
+void AssembleCompositeFrame(const CompositeLayout &layout,
+  const std::vector< std::shared_ptr<const RGBImage> > &tiles,
+  const TextRenderer &captionfont, const std::string &caption,
+  RGBImage &image)
+{
+  const RGBImage *tile;
+  size_t slot;
+  int x, y;
+
+  image.Fill(layout.width, layout.height, COMPOSITE_BACKGROUND);
+
+  for (slot = 0; slot < tiles.size(); slot++)
+  {
+    tile = tiles[slot].get();
+    if (NULL == tile)
+      continue;
+
+    // Centre the tile in its cell.
+    x = ((layout.step_x - tile->width) >> 1) + layout.offset_x
+      + layout.step_x * layout.slots[slot].x;
+    y = ((layout.step_y - tile->height) >> 1) + layout.offset_y
+      + layout.step_y * layout.slots[slot].y;
+
+    image.Paste(*tile, x, y);
+  }
+
+  if (!caption.empty())
+    captionfont.DrawText(image, caption, TEXT_SOUTH, composite_text_colour);
+}
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,147 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Composite frame builder - planning, tile cache, and assembly.
+
+
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rgbimage.h"
+#include "textrender.h"
+
+
+//
+// Classes
+
+// Where one feed goes in the composite.
+
+struct CompositeSlot
+{
+  std::string name;
+  std::string label;
+  int x, y;
+};
+
+
+// Composite geometry. The defaults match "stitchinfo_2x3_lg" and
+// "stitchslots_2x3" in neurocam-libstitch.pl.
+
+struct CompositeLayout
+{
+  CompositeLayout();
+
+  int width, height;
+  int tile_width, tile_height;
+  int step_x, step_y;
+  int offset_x, offset_y;
+  int fontsize;
+
+  std::vector<CompositeSlot> slots;
+};
+
+
+// One source image: a slot's frame file.
+
+struct CompositeSource
+{
+  std::string path;
+  size_t slot;
+};
+
+
+// One output frame.
+
+struct CompositeFrame
+{
+  double time;
+  unsigned long number;
+
+  // Index into the plan's source list for each slot, or -1.
+  std::vector<long> sources;
+};
+
+
+// Every output frame, and which source frames each one uses.
+
+struct CompositePlan
+{
+  std::vector<CompositeSource> sources;
+  std::vector<CompositeFrame> frames;
+
+  // Number of output frames using each source.
+  std::vector<unsigned> uses;
+
+  // The Perl script's estimate of the frame count, for progress reports.
+  unsigned long frame_max;
+};
+
+
+// Decoded, scaled, and labelled slot images. Each is decoded once, kept
+// while any output frame still needs it, and freed after its last use.
+// Any number of threads may use the cache at once.
+
+class TileCache
+{
+public:
+  TileCache(const CompositePlan &new_plan, const CompositeLayout &new_layout,
+    const TextRenderer &new_labelfont, bool new_fast);
+
+  // Returns a source's tile, decoding it if need be. Returns an empty
+  // pointer if the file couldn't be read.
+  std::shared_ptr<const RGBImage> Acquire(long source);
+
+  // Notes that one output frame is done with a source.
+  void Release(long source);
+
+  // Returns the number of decodes performed.
+  unsigned long DecodeCount() const
+  {
+    return decodes;
+  }
+
+protected:
+  struct entry_t
+  {
+    std::mutex lock;
+    bool is_loaded;
+    std::shared_ptr<const RGBImage> tile;
+    std::atomic<unsigned> remaining;
+  };
+
+  const CompositePlan &plan;
+  const CompositeLayout &layout;
+  const TextRenderer &labelfont;
+  bool fast;
+
+  std::vector< std::unique_ptr<entry_t> > entries;
+  std::atomic<unsigned long> decodes;
+};
+
+
+//
+// Functions
+
+// Builds the output frame list from a log, the same way
+// NCAM_BuildCompositeFrames() does. Paths are relative to repodir.
+// Returns false if the log couldn't be read.
+bool BuildCompositePlan(const std::string &logname,
+  const std::string &repodir, const CompositeLayout &layout, double period,
+  CompositePlan &plan);
+
+// Assembles one output frame, the way NCAM_CreateStitchedImage() does.
+void AssembleCompositeFrame(const CompositeLayout &layout,
+  const std::vector< std::shared_ptr<const RGBImage> > &tiles,
+  const TextRenderer &captionfont, const std::string &caption,
+  RGBImage &image);
+
+
+#endif
+
+//
+// This is the end of the file.
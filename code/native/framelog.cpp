@@ -0,0 +1,93 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Log file frame-line parsing.
+
+
+//
+// Includes
+
+#include <ctype.h>
+#include <string.h>
+
+#include "framelog.h"
+
+
+
+//
+// Functions
+
+
+// Parses "(time) [label] frame <number> <file>".
+
+bool ParseFrameLine(const char *text, size_t length, double &time,
+  std::string &label, std::string &file)
+{
+  const char *scan, *end, *start;
+
+  end = text + length;
+
+  if ( (0 == length) || ('(' != text[0]) )
+    return false;
+
+  time = 0;
+  for (scan = text + 1; (scan < end) && ('0' <= *scan) && ('9' >= *scan);
+    scan++)
+    time = (time * 10) + (*scan - '0');
+
+  if ( (scan >= end) || (')' != *scan) || ((text + 1) == scan) )
+    return false;
+  scan++;
+
+  start = scan;
+  while ( (scan < end) && isspace((unsigned char) *scan) )
+    scan++;
+  if ( (start == scan) || (scan >= end) || ('[' != *scan) )
+    return false;
+  scan++;
+
+  start = scan;
+  while ( (scan < end) && ( isalnum((unsigned char) *scan) || ('_' == *scan) ) )
+    scan++;
+  if ( (start == scan) || (scan >= end) || (']' != *scan) )
+    return false;
+  label.assign(start, scan - start);
+  scan++;
+
+  start = scan;
+  while ( (scan < end) && isspace((unsigned char) *scan) )
+    scan++;
+  if ( (start == scan) || ((end - scan) < 5)
+    || (0 != memcmp(scan, "frame", 5)) )
+    return false;
+  scan += 5;
+
+  start = scan;
+  while ( (scan < end) && isspace((unsigned char) *scan) )
+    scan++;
+  if (start == scan)
+    return false;
+
+  start = scan;
+  while ( (scan < end) && ('0' <= *scan) && ('9' >= *scan) )
+    scan++;
+  if (start == scan)
+    return false;
+
+  start = scan;
+  while ( (scan < end) && isspace((unsigned char) *scan) )
+    scan++;
+  if (start == scan)
+    return false;
+
+  start = scan;
+  while ( (scan < end) && (!isspace((unsigned char) *scan)) )
+    scan++;
+  if (start == scan)
+    return false;
+  file.assign(start, scan - start);
+
+  return true;
+}
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,25 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Log file frame-line parsing.
+
+
+#ifndef FRAMELOG_H
+#define FRAMELOG_H
+
+#include <stddef.h>
+#include <string>
+
+
+//
+// Functions
+
+// Parses "(time) [label] frame <number> <file>", the way the Perl scripts'
+// m/^\((\d+)\)\s+\[(\w+)\]\s+frame\s+\d+\s+(\S+)/ does.
+// Returns false if the line isn't a frame line.
+bool ParseFrameLine(const char *text, size_t length, double &time,
+  std::string &label, std::string &file);
+
+
+#endif
+
+//
+// This is the end of the file.
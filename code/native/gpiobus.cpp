@@ -0,0 +1,518 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO event bus - shared-memory ring from the GPIO monitor to consumers.
+
+
+//
+// Includes
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "gpiobus.h"
+
+
+//
+// Private prototypes
+
+static std::string GetBusName(const std::string &label);
+static bool HeaderIsUsable(const gpiobus_header_t &header,
+  size_t map_bytes);
+static uint64_t FindNewestSequence(const gpiobus_record_t *slots,
+  uint32_t capacity);
+static uint64_t LoadSlotWord(const gpiobus_record_t *slot, int widx);
+
+
+// The bus is used by mapping these structures directly, so they have to
+// come out exactly the sizes in shared memory.
+static_assert(GPIOBUS_HEADER_BYTES == sizeof(gpiobus_header_t),
+  "gpiobus_header_t must be 64 bytes");
+static_assert(GPIOBUS_RECORD_BYTES == sizeof(gpiobus_record_t),
+  "gpiobus_record_t must be 32 bytes");
+
+
+
+//
+// Private functions
+
+
+// Returns the shared memory object name for a device label.
+
+static std::string GetBusName(const std::string &label)
+{
+  return "/" GPIOBUS_NAME_PREFIX + label.substr(0, GPIOBUS_LABEL_CHARS);
+}
+
+
+
+// Checks a mapped header against the size of the mapping.
+
+static bool HeaderIsUsable(const gpiobus_header_t &header,
+  size_t map_bytes)
+{
+  if (0 != memcmp(header.magic, GPIOBUS_MAGIC, 8))
+    return false;
+  if ( (GPIOBUS_VERSION != header.version)
+    || (GPIOBUS_RECORD_BYTES != header.record_bytes) )
+    return false;
+
+  // The capacity has to be a power of two that fills the mapping.
+  if ( (0 == header.capacity)
+    || (0 != (header.capacity & (header.capacity - 1))) )
+    return false;
+
+  return (map_bytes == GPIOBUS_HEADER_BYTES
+    + ((size_t) header.capacity) * GPIOBUS_RECORD_BYTES);
+}
+
+
+
+// Finds the highest sequence number with a valid record (0 if there are
+// none).
+
+static uint64_t FindNewestSequence(const gpiobus_record_t *slots,
+  uint32_t capacity)
+{
+  gpiobus_record_t record;
+  uint64_t newest;
+  uint32_t sidx;
+
+  newest = 0;
+
+  for (sidx = 0; sidx < capacity; sidx++)
+  {
+    memcpy(&record, &slots[sidx], sizeof(record));
+
+    // A record only counts if it's in the slot it belongs in.
+    if ( (newest < record.sequence)
+      && (sidx == ((record.sequence - 1) & (capacity - 1)))
+      && (GetGPIOBusCheck(record) == record.check) )
+      newest = record.sequence;
+  }
+
+  return newest;
+}
+
+
+
+// Reads one 64-bit word of a slot that may be changing under us.
+
+static uint64_t LoadSlotWord(const gpiobus_record_t *slot, int widx)
+{
+  return __atomic_load_n(((const uint64_t *) slot) + widx,
+    __ATOMIC_RELAXED);
+}
+
+
+
+//
+// Writer methods
+
+
+// Constructor.
+
+GPIOBusWriter::GPIOBusWriter()
+{
+  map = NULL;
+  map_bytes = 0;
+  slots = NULL;
+  mask = 0;
+  next_sequence = 1;
+}
+
+
+
+// Destructor.
+
+GPIOBusWriter::~GPIOBusWriter()
+{
+  Close();
+}
+
+
+
+// Creates or takes over a device's bus.
+
+bool GPIOBusWriter::Open(const std::string &label, uint32_t capacity)
+{
+  gpiobus_header_t *header;
+  struct stat info;
+  size_t want_bytes;
+  uint32_t rounded;
+  int fd;
+  void *data;
+
+  Close();
+
+  rounded = 2;
+  while (rounded < capacity)
+    rounded <<= 1;
+  want_bytes = GPIOBUS_HEADER_BYTES
+    + ((size_t) rounded) * GPIOBUS_RECORD_BYTES;
+
+  fd = shm_open(GetBusName(label).c_str(), O_RDWR | O_CREAT, 0644);
+  if (0 > fd)
+    return false;
+
+  if (0 != fstat(fd, &info))
+  {
+    close(fd);
+    return false;
+  }
+
+  // Anything that isn't a bus of the right size is started over.
+  if ((size_t) info.st_size != want_bytes)
+  {
+    if ( (0 != ftruncate(fd, 0)) || (0 != ftruncate(fd, want_bytes)) )
+    {
+      close(fd);
+      return false;
+    }
+  }
+
+  data = mmap(NULL, want_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (MAP_FAILED == data)
+    return false;
+
+  map = (uint8_t *) data;
+  map_bytes = want_bytes;
+  header = (gpiobus_header_t *) map;
+  slots = (gpiobus_record_t *) (map + GPIOBUS_HEADER_BYTES);
+  mask = rounded - 1;
+
+  if ( HeaderIsUsable(*header, map_bytes) && (rounded == header->capacity) )
+  {
+    // Carry on from where the last writer stopped.
+    next_sequence = FindNewestSequence(slots, rounded) + 1;
+  }
+  else
+  {
+    // Readers only look at a bus once its header checks out, so the slots
+    // are cleared before the magic goes in.
+    memset(map, 0, map_bytes);
+    header->version = GPIOBUS_VERSION;
+    header->record_bytes = GPIOBUS_RECORD_BYTES;
+    header->capacity = rounded;
+    memcpy(header->label, label.c_str(),
+      std::min(label.size(), (size_t) GPIOBUS_LABEL_CHARS));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, GPIOBUS_MAGIC, 8);
+
+    next_sequence = 1;
+  }
+
+  __atomic_store_n(&header->writer_pid, (uint32_t) getpid(),
+    __ATOMIC_RELAXED);
+
+  return true;
+}
+
+
+
+// Unmaps the bus.
+
+void GPIOBusWriter::Close()
+{
+  if (NULL != map)
+    munmap(map, map_bytes);
+
+  map = NULL;
+  map_bytes = 0;
+  slots = NULL;
+}
+
+
+
+// Publishes one record.
+
+void GPIOBusWriter::Publish(gpiobus_record_t &record)
+{
+  gpiobus_record_t *slot;
+  uint64_t words[4];
+  uint64_t *slot_words;
+
+  if (NULL == map)
+    return;
+
+  record.sequence = next_sequence;
+  record.check = GetGPIOBusCheck(record);
+  memcpy(words, &record, sizeof(words));
+
+  slot = &slots[(next_sequence - 1) & mask];
+  slot_words = (uint64_t *) slot;
+
+  // Readers that see 0 know the slot is being rewritten.
+  __atomic_store_n(&slot->sequence, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  __atomic_store_n(slot_words + 1, words[1], __ATOMIC_RELAXED);
+  __atomic_store_n(slot_words + 2, words[2], __ATOMIC_RELAXED);
+  __atomic_store_n(slot_words + 3, words[3], __ATOMIC_RELAXED);
+
+  __atomic_store_n(&slot->sequence, next_sequence, __ATOMIC_RELEASE);
+
+  next_sequence++;
+}
+
+
+
+// Removes a device's bus.
+
+bool GPIOBusWriter::Remove(const std::string &label)
+{
+  return (0 == shm_unlink(GetBusName(label).c_str()));
+}
+
+
+
+//
+// Reader methods
+
+
+// Constructor.
+
+GPIOBusReader::GPIOBusReader()
+{
+  map = NULL;
+  map_bytes = 0;
+  header = NULL;
+  slots = NULL;
+  mask = 0;
+  next_sequence = 1;
+  lost = 0;
+}
+
+
+
+// Destructor.
+
+GPIOBusReader::~GPIOBusReader()
+{
+  Close();
+}
+
+
+
+// Maps a device's bus.
+
+bool GPIOBusReader::Open(const std::string &label, bool from_oldest)
+{
+  struct stat info;
+  uint64_t newest;
+  int fd;
+  void *data;
+
+  Close();
+
+  fd = shm_open(GetBusName(label).c_str(), O_RDONLY, 0);
+  if (0 > fd)
+    return false;
+
+  if ( (0 != fstat(fd, &info)) || (GPIOBUS_HEADER_BYTES > info.st_size) )
+  {
+    close(fd);
+    return false;
+  }
+
+  data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (MAP_FAILED == data)
+    return false;
+
+  map = (const uint8_t *) data;
+  map_bytes = info.st_size;
+  header = (const gpiobus_header_t *) map;
+
+  if (!HeaderIsUsable(*header, map_bytes))
+  {
+    Close();
+    return false;
+  }
+
+  slots = (const gpiobus_record_t *) (map + GPIOBUS_HEADER_BYTES);
+  mask = header->capacity - 1;
+  lost = 0;
+
+  newest = FindNewestSequence(slots, header->capacity);
+  if (!from_oldest)
+    next_sequence = newest + 1;
+  else if (newest > header->capacity)
+    next_sequence = newest - header->capacity + 1;
+  else
+    next_sequence = 1;
+
+  return true;
+}
+
+
+
+// Unmaps the bus.
+
+void GPIOBusReader::Close()
+{
+  if (NULL != map)
+    munmap((void *) map, map_bytes);
+
+  map = NULL;
+  map_bytes = 0;
+  header = NULL;
+  slots = NULL;
+}
+
+
+
+// Copies out the next record, if there is one.
+
+bool GPIOBusReader::Next(gpiobus_record_t &record)
+{
+  const gpiobus_record_t *slot;
+  uint64_t words[4];
+  uint64_t before, after;
+
+  if (NULL == map)
+    return false;
+
+  while (1)
+  {
+    slot = &slots[(next_sequence - 1) & mask];
+
+    before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+    // Still an older pass, or being rewritten.
+    if (before < next_sequence)
+      return false;
+
+    // The writer has lapped us. Skip to what's in this slot now.
+    if (before > next_sequence)
+    {
+      lost += before - next_sequence;
+      next_sequence = before;
+      continue;
+    }
+
+    words[1] = LoadSlotWord(slot, 1);
+    words[2] = LoadSlotWord(slot, 2);
+    words[3] = LoadSlotWord(slot, 3);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+
+    // Changed while we were copying; look again.
+    if (after != before)
+      continue;
+
+    words[0] = before;
+    memcpy(&record, words, sizeof(words));
+
+    // A record written in one piece can show its new sequence number
+    // before the rest has landed. It'll check out once it has.
+    if (GetGPIOBusCheck(record) != record.check)
+      return false;
+
+    next_sequence++;
+    return true;
+  }
+}
+
+
+
+// Returns the label stored in the bus header.
+
+std::string GPIOBusReader::Label() const
+{
+  if (NULL == header)
+    return std::string();
+
+  return std::string(header->label,
+    strnlen(header->label, GPIOBUS_LABEL_CHARS));
+}
+
+
+
+// Returns true if the bus's writer is still running.
+
+bool GPIOBusReader::WriterAlive() const
+{
+  pid_t pid;
+
+  if (NULL == header)
+    return false;
+
+  pid = (pid_t) __atomic_load_n(&header->writer_pid, __ATOMIC_RELAXED);
+  if (0 >= pid)
+    return false;
+
+  return ( (0 == kill(pid, 0)) || (EPERM == errno) );
+}
+
+
+
+//
+// Functions
+
+
+// Computes a record's check word.
+
+uint32_t GetGPIOBusCheck(const gpiobus_record_t &record)
+{
+  uint32_t words[7];
+  uint32_t sum;
+  int widx;
+
+  // This is Perl's "unpack('%32V7', ...)", so the monitor can do it cheaply.
+  memcpy(words, &record, sizeof(words));
+
+  sum = GPIOBUS_CHECK_SEED;
+  for (widx = 0; widx < 7; widx++)
+    sum += words[widx];
+
+  return sum;
+}
+
+
+
+// Returns a record's full device tick.
+
+uint64_t GetGPIOBusTick(const gpiobus_record_t &record)
+{
+  return (((uint64_t) record.device_tick_high) << 32) | record.device_tick;
+}
+
+
+
+// Lists the device labels that have buses.
+
+std::vector<std::string> ListGPIOBuses()
+{
+  std::vector<std::string> labels;
+  DIR *dir;
+  struct dirent *entry;
+  size_t prefix_chars;
+
+  prefix_chars = strlen(GPIOBUS_NAME_PREFIX);
+
+  dir = opendir(GPIOBUS_DIR);
+  if (NULL == dir)
+    return labels;
+
+  while (NULL != (entry = readdir(dir)))
+    if ( (0 == strncmp(entry->d_name, GPIOBUS_NAME_PREFIX, prefix_chars))
+      && (prefix_chars < strlen(entry->d_name)) )
+      labels.push_back(entry->d_name + prefix_chars);
+
+  closedir(dir);
+
+  return labels;
+}
+
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,203 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO event bus - shared-memory ring from the GPIO monitor to consumers.
+
+
+#ifndef GPIOBUS_H
+#define GPIOBUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+//
+// Macros
+
+// Each GPIO device gets its own bus, written only by the monitor process
+// talking to that device and read by any number of consumers. A bus is a
+// POSIX shared memory object named "/ncam-gpio-<label>" (so on Linux, the
+// file "/dev/shm/ncam-gpio-<label>"). It holds a 64-byte header followed by
+// a power-of-two number of fixed 32-byte records, all little-endian.
+// The Perl side of this is in neurocam-libnetwork.pl.
+
+#define GPIOBUS_MAGIC "NCGPIOBS"
+#define GPIOBUS_VERSION 1
+
+#define GPIOBUS_DIR "/dev/shm"
+#define GPIOBUS_NAME_PREFIX "ncam-gpio-"
+
+#define GPIOBUS_HEADER_BYTES 64
+#define GPIOBUS_RECORD_BYTES 32
+
+#define GPIOBUS_DEFAULT_CAPACITY 4096
+
+// Device labels longer than this are truncated.
+#define GPIOBUS_LABEL_CHARS 16
+
+// Record flags.
+#define GPIOBUS_FLAG_HAS_TICK 0x01
+// The upper four bits are the number of hex digits the device printed the
+// value with (0 if unknown), so that it can be logged the same way.
+#define GPIOBUS_FLAG_DIGITS_SHIFT 4
+
+// Added to the record checksum, so that a zeroed slot never checks out.
+#define GPIOBUS_CHECK_SEED 0x4e434742ul
+
+
+//
+// Types
+
+// The bus header. This is written when the bus is created, and only the
+// writer's PID changes after that.
+
+struct gpiobus_header_t
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_bytes;
+  // Number of record slots (a power of two).
+  uint32_t capacity;
+  // PID of the process writing to the bus. Consumers ignore buses whose
+  // writer has gone away.
+  uint32_t writer_pid;
+  // Device label (e.g. "A0"), NUL-padded.
+  char label[GPIOBUS_LABEL_CHARS];
+  uint8_t reserved[24];
+};
+
+// One register report. Record n (counting from 1) goes in slot
+// (n - 1) % capacity, so a slot's sequence number says which pass of the
+// ring it belongs to. 0 means the slot has never been written.
+//
+// Slots are overwritten in place while readers may be looking at them.
+// The writer clears "sequence" before changing a slot and sets it last;
+// readers check it before and after copying, and also check "check", which
+// is GPIOBUS_CHECK_SEED plus the sum of the record's first seven 32-bit
+// words. The checksum is what catches torn copies from writers that can
+// only write a slot in one piece (the Perl monitor).
+
+struct gpiobus_record_t
+{
+  uint64_t sequence;
+  // Host wall-clock time when the monitor read the report, in microseconds
+  // since 1970 (gettimeofday()), so that it matches the Perl timestamps.
+  int64_t host_time_us;
+  // Device tick (only with GPIOBUS_FLAG_HAS_TICK). This is the lower 32
+  // bits; device_tick_high has the next 16.
+  uint32_t device_tick;
+  uint16_t device_tick_high;
+  // Register: 'I', 'O', or 'U'.
+  uint8_t reg;
+  uint8_t flags;
+  uint32_t value;
+  uint32_t check;
+};
+
+
+//
+// Classes
+
+// Publishes records to a bus. There must only be one of these per bus.
+
+class GPIOBusWriter
+{
+public:
+  GPIOBusWriter();
+  ~GPIOBusWriter();
+
+  // Creates the bus for a device label, or takes over an existing one with
+  // the same layout, carrying on from its last record so that readers
+  // don't notice. Returns false on failure.
+  bool Open(const std::string &label,
+    uint32_t capacity = GPIOBUS_DEFAULT_CAPACITY);
+
+  // Unmaps the bus. The bus itself is left for readers.
+  void Close();
+
+  // Fills in the record's sequence number and check word and publishes it.
+  void Publish(gpiobus_record_t &record);
+
+  // Removes a device's bus.
+  static bool Remove(const std::string &label);
+
+protected:
+  uint8_t *map;
+  size_t map_bytes;
+  gpiobus_record_t *slots;
+  uint32_t mask;
+  uint64_t next_sequence;
+};
+
+
+// Reads records from a bus. Reading doesn't touch the bus, so there can be
+// any number of readers, and a slow reader only loses records itself.
+
+class GPIOBusReader
+{
+public:
+  GPIOBusReader();
+  ~GPIOBusReader();
+
+  // Maps a device's bus. By default, reading starts after the newest
+  // record; with "from_oldest", it starts at the oldest one still in the
+  // ring. Returns false on failure.
+  bool Open(const std::string &label, bool from_oldest = false);
+
+  void Close();
+
+  // Copies out the next record. Returns false if there isn't one yet.
+  // Records that were overwritten before they could be read are counted
+  // in Lost() and skipped.
+  bool Next(gpiobus_record_t &record);
+
+  uint64_t Lost() const
+  {
+    return lost;
+  }
+
+  // The sequence number of the record Next() will return.
+  uint64_t NextSequence() const
+  {
+    return next_sequence;
+  }
+
+  uint32_t Capacity() const
+  {
+    return mask + 1;
+  }
+
+  // The label stored in the bus header.
+  std::string Label() const;
+
+  // Returns true if the bus's writer is still running.
+  bool WriterAlive() const;
+
+protected:
+  const uint8_t *map;
+  size_t map_bytes;
+  const gpiobus_header_t *header;
+  const gpiobus_record_t *slots;
+  uint32_t mask;
+  uint64_t next_sequence;
+  uint64_t lost;
+};
+
+
+//
+// Functions
+
+// Computes a record's check word.
+uint32_t GetGPIOBusCheck(const gpiobus_record_t &record);
+
+// Returns a record's full device tick.
+uint64_t GetGPIOBusTick(const gpiobus_record_t &record);
+
+// Lists the device labels that have buses.
+std::vector<std::string> ListGPIOBuses();
+
+
+#endif
+
+//
+// This is the end of the file.
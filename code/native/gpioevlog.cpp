@@ -0,0 +1,417 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Binary GPIO event log - record format, writer, and mapped reader.
+
+
+//
+// Includes
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "gpioevlog.h"
+
+
+//
+// Private prototypes
+
+static bool WriteHeader(FILE *outfile, const char *magic, uint32_t extra);
+static bool CheckHeader(const uint8_t *header, const char *magic,
+  uint32_t &extra);
+static bool RecordIsBefore(const gpioevlog_record_t &record,
+  int64_t host_time_ms);
+
+
+// The files are read and written by mapping these structures directly, so
+// they have to come out exactly the sizes on disk.
+static_assert(GPIOEVLOG_RECORD_BYTES == sizeof(gpioevlog_record_t),
+  "gpioevlog_record_t must be 32 bytes");
+static_assert(GPIOEVLOG_INDEX_ENTRY_BYTES == sizeof(gpioevlog_index_entry_t),
+  "gpioevlog_index_entry_t must be 16 bytes");
+
+
+
+//
+// Writer methods
+
+
+// Constructor.
+
+GPIOEventLogWriter::GPIOEventLogWriter()
+{
+  events = NULL;
+  index = NULL;
+  stride = GPIOEVLOG_DEFAULT_STRIDE;
+  count = 0;
+}
+
+
+
+// Destructor.
+
+GPIOEventLogWriter::~GPIOEventLogWriter()
+{
+  Close();
+}
+
+
+
+// Creates the event and index files.
+
+bool GPIOEventLogWriter::Open(const std::string &basename,
+  uint32_t new_stride)
+{
+  Close();
+
+  stride = (0 < new_stride) ? new_stride : 1;
+  count = 0;
+
+  events = fopen((basename + ".bin").c_str(), "wb");
+  index = fopen((basename + ".idx").c_str(), "wb");
+
+  // The record size goes in the event header, so readers can tell if a
+  // later version adds fields.
+  if ( (NULL == events) || (NULL == index)
+    || (!WriteHeader(events, GPIOEVLOG_EVENT_MAGIC, GPIOEVLOG_RECORD_BYTES))
+    || (!WriteHeader(index, GPIOEVLOG_INDEX_MAGIC, stride)) )
+  {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+
+
+// Closes the files.
+
+void GPIOEventLogWriter::Close()
+{
+  if (NULL != events)
+    fclose(events);
+  if (NULL != index)
+    fclose(index);
+
+  events = NULL;
+  index = NULL;
+}
+
+
+
+// Appends one record.
+
+bool GPIOEventLogWriter::Append(gpioevlog_record_t &record)
+{
+  gpioevlog_index_entry_t entry;
+
+  if (NULL == events)
+    return false;
+
+  record.sequence = count;
+
+  if (1 != fwrite(&record, sizeof(record), 1, events))
+    return false;
+
+  if (0 == (count % stride))
+  {
+    entry.host_time_ms = record.host_time_ms;
+    entry.record = count;
+
+    if (1 != fwrite(&entry, sizeof(entry), 1, index))
+      return false;
+  }
+
+  count++;
+
+  return true;
+}
+
+
+
+// Pushes buffered records out to the files.
+
+bool GPIOEventLogWriter::Flush()
+{
+  if (NULL == events)
+    return false;
+
+  return ( (0 == fflush(events)) && (0 == fflush(index)) );
+}
+
+
+
+//
+// Reader methods
+
+
+// Constructor.
+
+GPIOEventLogReader::GPIOEventLogReader()
+{
+  event_map = NULL;
+  event_bytes = 0;
+  index_map = NULL;
+  index_bytes = 0;
+
+  records = NULL;
+  record_count = 0;
+  entries = NULL;
+  entry_count = 0;
+  stride = 0;
+}
+
+
+
+// Destructor.
+
+GPIOEventLogReader::~GPIOEventLogReader()
+{
+  Close();
+}
+
+
+
+// Maps a file read-only. Returns NULL on failure.
+
+const uint8_t *GPIOEventLogReader::MapFile(const std::string &path,
+  size_t &bytes)
+{
+  int fd;
+  struct stat info;
+  void *data;
+
+  bytes = 0;
+
+  fd = open(path.c_str(), O_RDONLY);
+  if (0 > fd)
+    return NULL;
+
+  if ( (0 != fstat(fd, &info)) || (GPIOEVLOG_HEADER_BYTES > info.st_size) )
+  {
+    close(fd);
+    return NULL;
+  }
+
+  data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (MAP_FAILED == data)
+    return NULL;
+
+  bytes = info.st_size;
+  return (const uint8_t *) data;
+}
+
+
+
+// Maps an event file and its index.
+
+bool GPIOEventLogReader::Open(const std::string &name)
+{
+  std::string basename;
+  uint32_t extra;
+  size_t eidx;
+
+  Close();
+
+  basename = name;
+  if ( (4 <= basename.size())
+    && (0 == basename.compare(basename.size() - 4, 4, ".bin")) )
+    basename.resize(basename.size() - 4);
+
+  event_map = MapFile(basename + ".bin", event_bytes);
+  if (NULL == event_map)
+    return false;
+
+  if ( (!CheckHeader(event_map, GPIOEVLOG_EVENT_MAGIC, extra))
+    || (GPIOEVLOG_RECORD_BYTES != extra) )
+  {
+    Close();
+    return false;
+  }
+
+  // A partly-written last record (from a crash) is ignored.
+  records = (const gpioevlog_record_t *) (event_map + GPIOEVLOG_HEADER_BYTES);
+  record_count =
+    (event_bytes - GPIOEVLOG_HEADER_BYTES) / GPIOEVLOG_RECORD_BYTES;
+
+  // The index is optional. Entries past the end of the records are
+  // ignored, as are indexes that don't match.
+  index_map = MapFile(basename + ".idx", index_bytes);
+  if (NULL != index_map)
+  {
+    if ( CheckHeader(index_map, GPIOEVLOG_INDEX_MAGIC, extra) && (0 < extra) )
+    {
+      stride = extra;
+      entries = (const gpioevlog_index_entry_t *)
+        (index_map + GPIOEVLOG_HEADER_BYTES);
+      entry_count =
+        (index_bytes - GPIOEVLOG_HEADER_BYTES) / GPIOEVLOG_INDEX_ENTRY_BYTES;
+
+      // Only the index is checked, so that opening doesn't fault in the
+      // whole event file.
+      for (eidx = 0; eidx < entry_count; eidx++)
+        if ( (entries[eidx].record != (eidx * stride))
+          || (entries[eidx].record >= record_count) )
+          break;
+
+      entry_count = eidx;
+    }
+  }
+
+  return true;
+}
+
+
+
+// Unmaps the files.
+
+void GPIOEventLogReader::Close()
+{
+  if (NULL != event_map)
+    munmap((void *) event_map, event_bytes);
+  if (NULL != index_map)
+    munmap((void *) index_map, index_bytes);
+
+  event_map = NULL;
+  event_bytes = 0;
+  index_map = NULL;
+  index_bytes = 0;
+
+  records = NULL;
+  record_count = 0;
+  entries = NULL;
+  entry_count = 0;
+  stride = 0;
+}
+
+
+
+// Returns the first record at or after a time.
+
+size_t GPIOEventLogReader::FindTime(int64_t host_time_ms) const
+{
+  size_t low, high, eidx;
+
+  low = 0;
+  high = record_count;
+
+  if (0 < entry_count)
+  {
+    // Find the first index entry at or after this time. The record we
+    // want is between the entry before it and that entry.
+    low = 0;
+    high = entry_count;
+    while (low < high)
+    {
+      eidx = (low + high) / 2;
+      if (entries[eidx].host_time_ms < host_time_ms)
+        low = eidx + 1;
+      else
+        high = eidx;
+    }
+
+    eidx = low;
+
+    low = (0 < eidx) ? entries[eidx - 1].record : 0;
+    high = (eidx < entry_count) ? entries[eidx].record : record_count;
+  }
+
+  return std::lower_bound(records + low, records + high, host_time_ms,
+    RecordIsBefore) - records;
+}
+
+
+
+// Finds the records within a time range.
+
+void GPIOEventLogReader::FindRange(int64_t first_ms, int64_t last_ms,
+  size_t &first, size_t &last) const
+{
+  first = FindTime(first_ms);
+  last = FindTime(last_ms);
+
+  if (last < first)
+    last = first;
+}
+
+
+
+//
+// Functions
+
+
+// Writes a file header.
+
+static bool WriteHeader(FILE *outfile, const char *magic, uint32_t extra)
+{
+  uint8_t header[GPIOEVLOG_HEADER_BYTES];
+  uint32_t version;
+
+  version = GPIOEVLOG_VERSION;
+
+  memcpy(header, magic, 8);
+  memcpy(header + 8, &version, 4);
+  memcpy(header + 12, &extra, 4);
+
+  return (1 == fwrite(header, sizeof(header), 1, outfile));
+}
+
+
+
+// Checks a file header, and fetches its last field.
+
+static bool CheckHeader(const uint8_t *header, const char *magic,
+  uint32_t &extra)
+{
+  uint32_t version;
+
+  memcpy(&version, header + 8, 4);
+  memcpy(&extra, header + 12, 4);
+
+  return ( (0 == memcmp(header, magic, 8))
+    && (GPIOEVLOG_VERSION == version) );
+}
+
+
+
+// Orders records by time, for std::lower_bound.
+
+static bool RecordIsBefore(const gpioevlog_record_t &record,
+  int64_t host_time_ms)
+{
+  return (record.host_time_ms < host_time_ms);
+}
+
+
+
+// Copies a record's device label into a string.
+
+std::string GetGPIOEventDevice(const gpioevlog_record_t &record)
+{
+  size_t length;
+
+  length = 0;
+  while ( (GPIOEVLOG_DEVICE_CHARS > length) && (0 != record.device[length]) )
+    length++;
+
+  return std::string(record.device, length);
+}
+
+
+
+
+// Returns a record's full device tick.
+
+uint64_t GetGPIOEventTick(const gpioevlog_record_t &record)
+{
+  return (((uint64_t) record.device_tick_high) << 32) | record.device_tick;
+}
+
+
+//
+// This is the end of the file.
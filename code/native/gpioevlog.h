@@ -0,0 +1,175 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Binary GPIO event log - record format, writer, and mapped reader.
+
+
+#ifndef GPIOEVLOG_H
+#define GPIOEVLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+
+//
+// Macros
+
+// The event file is a 16-byte header followed by fixed 32-byte records,
+// all little-endian. The index file is a 16-byte header followed by
+// 16-byte (time, record number) entries, one for every "stride" records.
+// The daemon's logger writes both alongside "logfile.txt"; see
+// neurocam-daemon.pl.
+
+#define GPIOEVLOG_EVENT_MAGIC "NCGPIOEV"
+#define GPIOEVLOG_INDEX_MAGIC "NCGPIOIX"
+#define GPIOEVLOG_VERSION 1
+
+#define GPIOEVLOG_HEADER_BYTES 16
+#define GPIOEVLOG_RECORD_BYTES 32
+#define GPIOEVLOG_INDEX_ENTRY_BYTES 16
+
+// Records per index entry.
+#define GPIOEVLOG_DEFAULT_STRIDE 256
+
+// Device labels longer than this are truncated.
+#define GPIOEVLOG_DEVICE_CHARS 8
+
+// Record flags.
+#define GPIOEVLOG_FLAG_HAS_TICK 0x01
+
+
+//
+// Types
+
+// One register report. Host time is the session log's timebase
+// (milliseconds since the daemon started the session).
+
+struct gpioevlog_record_t
+{
+  int64_t host_time_ms;
+  // Events written to this file before this one.
+  uint32_t sequence;
+  // Device tick (only with GPIOEVLOG_FLAG_HAS_TICK). This is the lower 32
+  // bits; device_tick_high has the next 16.
+  uint32_t device_tick;
+  uint32_t value;
+  // Device label (e.g. "A0"), NUL-padded but not always NUL-terminated.
+  char device[GPIOEVLOG_DEVICE_CHARS];
+  // Register: 'I', 'O', or 'U'.
+  uint8_t reg;
+  uint8_t flags;
+  // Upper bits of the device tick. Logs from before devices had 64-bit
+  // ticks have 0 here, as it used to be padding.
+  uint16_t device_tick_high;
+};
+
+struct gpioevlog_index_entry_t
+{
+  int64_t host_time_ms;
+  uint64_t record;
+};
+
+
+//
+// Classes
+
+// Appends records to an event file and its index. Records must be added
+// in time order.
+
+class GPIOEventLogWriter
+{
+public:
+  GPIOEventLogWriter();
+  ~GPIOEventLogWriter();
+
+  // Creates (or replaces) "<basename>.bin" and "<basename>.idx".
+  // Returns false on failure.
+  bool Open(const std::string &basename,
+    uint32_t stride = GPIOEVLOG_DEFAULT_STRIDE);
+
+  void Close();
+
+  // Appends one record, filling in its sequence number.
+  bool Append(gpioevlog_record_t &record);
+
+  // Pushes buffered records out to the files.
+  bool Flush();
+
+protected:
+  FILE *events;
+  FILE *index;
+  uint32_t stride;
+  uint32_t count;
+};
+
+
+// Maps an event file (and its index, if present) for reading. Searches
+// use the index to narrow things down, then look only at the records in
+// one stride; without an index, they binary-search the records.
+
+class GPIOEventLogReader
+{
+public:
+  GPIOEventLogReader();
+  ~GPIOEventLogReader();
+
+  // Maps "<name>.bin", and "<name>.idx" if it's there. The name may be
+  // given with or without the ".bin". Returns false on failure.
+  bool Open(const std::string &name);
+
+  void Close();
+
+  size_t Count() const
+  {
+    return record_count;
+  }
+
+  const gpioevlog_record_t &Record(size_t ridx) const
+  {
+    return records[ridx];
+  }
+
+  // Returns the number of the first record at or after a time (or Count()
+  // if there isn't one).
+  size_t FindTime(int64_t host_time_ms) const;
+
+  // Finds the records with first_ms <= time < last_ms, as [first, last).
+  void FindRange(int64_t first_ms, int64_t last_ms, size_t &first,
+    size_t &last) const;
+
+  // Returns true if the index was found and is usable.
+  bool HasIndex() const
+  {
+    return (0 < entry_count);
+  }
+
+protected:
+  const uint8_t *event_map;
+  size_t event_bytes;
+  const uint8_t *index_map;
+  size_t index_bytes;
+
+  const gpioevlog_record_t *records;
+  size_t record_count;
+  const gpioevlog_index_entry_t *entries;
+  size_t entry_count;
+  uint32_t stride;
+
+  static const uint8_t *MapFile(const std::string &path, size_t &bytes);
+};
+
+
+//
+// Functions
+
+// Copies a record's device label into a string.
+std::string GetGPIOEventDevice(const gpioevlog_record_t &record);
+
+// Returns a record's full device tick.
+uint64_t GetGPIOEventTick(const gpioevlog_record_t &record);
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,173 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO device link library - C interface.
+
+
+#ifndef GPIOLINK_H
+#define GPIOLINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//
+// Macros
+
+// Bumped whenever a structure below changes layout or a function changes
+// meaning. Callers should check gpiolink_abi_version() against this.
+#define GPIOLINK_ABI_VERSION 2
+
+// Event types.
+#define GPIOLINK_EVENT_REGISTER 1
+#define GPIOLINK_EVENT_QUERY 2
+
+// Register event flags.
+#define GPIOLINK_FLAG_HAS_TICK 0x01
+
+// Longest identity strings kept from "IDQ", including the NUL.
+#define GPIOLINK_IDENT_CHARS 32
+
+
+//
+// Types
+
+// Opaque handle for one device link.
+typedef struct gpiolink_s gpiolink_t;
+
+// One report from the device. This is 32 bytes, with no padding.
+typedef struct
+{
+  // Host time when the bytes were read (CLOCK_MONOTONIC, nanoseconds).
+  uint64_t host_time_ns;
+  // Events parsed by this link so far, counting from 0.
+  uint64_t sequence;
+  // Device tick (only for timestamped reports, "REP 2"). Devices extend
+  // this past 32 bits, so it doesn't wrap.
+  uint64_t device_tick;
+  // Register value.
+  uint32_t value;
+  // GPIOLINK_EVENT_xxx.
+  uint8_t type;
+  // Register: 'I', 'O', or 'U'.
+  uint8_t reg;
+  // GPIOLINK_FLAG_xxx.
+  uint8_t flags;
+  uint8_t reserved;
+} gpiolink_event_t;
+
+// Device identity, from "IDQ".
+typedef struct
+{
+  char devicetype[GPIOLINK_IDENT_CHARS];
+  char subtype[GPIOLINK_IDENT_CHARS];
+  char task[GPIOLINK_IDENT_CHARS];
+  uint32_t confighash;
+  int has_confighash;
+} gpiolink_ident_t;
+
+// Decoded binary state query ("QRB").
+typedef struct
+{
+  char version[9];
+  // Older firmware only sends the lower 32 bits.
+  uint64_t device_tick;
+  uint32_t ticks_per_second;
+  uint8_t input_count;
+  uint8_t output_count;
+  uint8_t user_count;
+  uint8_t flags;
+  uint32_t input_bits;
+  uint32_t output_bits;
+  uint32_t user_bits;
+  uint32_t strobe_period;
+  uint32_t strobe_duration;
+  uint32_t confighash;
+} gpiolink_query_t;
+
+// Called with each complete text line that isn't a register report,
+// without the line ending. The text is not NUL-terminated and is only
+// valid during the call.
+typedef void (*gpiolink_line_callback_t)(void *context, const char *text,
+  size_t length);
+
+
+//
+// Functions
+
+// Returns GPIOLINK_ABI_VERSION as built into the library.
+int gpiolink_abi_version(void);
+
+// Opens a serial port, in raw mode at the given baud rate.
+// Returns NULL (with errno set) on failure.
+gpiolink_t *gpiolink_open(const char *path, uint32_t baud);
+
+// Wraps an already-open descriptor (a pipe, pseudo-terminal, or the
+// host-native firmware build). Pass -1 for a link that's only fed with
+// gpiolink_feed(). The link takes ownership of the descriptor and makes
+// it non-blocking.
+gpiolink_t *gpiolink_open_fd(int fd);
+
+// Closes the link and frees it.
+void gpiolink_close(gpiolink_t *link);
+
+// Returns the link's descriptor, for poll() or select().
+int gpiolink_fd(gpiolink_t *link);
+
+// Sets the number of events buffered (rounded up to a power of two).
+// This discards buffered events. Returns 0, or -1 on failure.
+int gpiolink_set_capacity(gpiolink_t *link, size_t events);
+
+// Sets the callback for other text lines (NULL to ignore them).
+void gpiolink_set_line_callback(gpiolink_t *link,
+  gpiolink_line_callback_t callback, void *context);
+
+// Sends a command. The opcode is three letters. Returns 0, or -1 on
+// failure.
+int gpiolink_send_command(gpiolink_t *link, const char *opcode);
+int gpiolink_send_command_arg(gpiolink_t *link, const char *opcode,
+  uint32_t argument);
+
+// Sends "IDQ" and waits for the device to identify itself, resending
+// every few hundred milliseconds. Reports that arrive meanwhile are
+// buffered as usual. Returns 0, or -1 on timeout or error.
+int gpiolink_identify(gpiolink_t *link, gpiolink_ident_t *ident,
+  int timeout_ms);
+
+// Reads whatever is waiting (waiting up to timeout_ms for something to
+// arrive), and parses it. Returns the number of events added, 0 on
+// timeout, or -1 on error or end of file.
+int gpiolink_poll(gpiolink_t *link, int timeout_ms);
+
+// Parses bytes from some other source (a capture or a log).
+// Returns the number of events added.
+int gpiolink_feed(gpiolink_t *link, const void *data, size_t length,
+  uint64_t host_time_ns);
+
+// Fetches the oldest buffered event. Returns 1 if there was one, or 0.
+// One thread may call this while another calls gpiolink_poll().
+int gpiolink_next_event(gpiolink_t *link, gpiolink_event_t *event);
+
+// Fetches the most recent binary state query. Returns 1 if there's been
+// one, or 0.
+int gpiolink_last_query(gpiolink_t *link, gpiolink_query_t *query);
+
+// Returns the number of events dropped because the buffer was full, and
+// the number of malformed lines and frames.
+uint64_t gpiolink_dropped_events(gpiolink_t *link);
+uint64_t gpiolink_bad_records(gpiolink_t *link);
+
+// Returns CLOCK_MONOTONIC in nanoseconds (the event timebase).
+uint64_t gpiolink_host_time_ns(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,49 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO device link library - non-standard baud rates (Linux).
+
+
+//
+// Includes
+
+// This has to stay out of files that use <termios.h>; the two headers
+// define the same structures differently.
+#include <sys/ioctl.h>
+
+#ifdef __linux__
+#include <asm/termbits.h>
+#endif
+
+#include "gpiolink_serial.h"
+
+
+//
+// Functions
+
+
+// Sets a baud rate that has no standard termios constant.
+
+bool SetCustomBaud(int fd, uint32_t baud)
+{
+#if defined(__linux__) && defined(BOTHER)
+  struct termios2 settings;
+
+  if (0 != ioctl(fd, TCGETS2, &settings))
+    return false;
+
+  settings.c_cflag &= ~CBAUD;
+  settings.c_cflag |= BOTHER;
+  settings.c_ispeed = baud;
+  settings.c_ospeed = baud;
+
+  return (0 == ioctl(fd, TCSETS2, &settings));
+#else
+  // FIXME - Other platforms need their own ioctl for this.
+  (void) fd;
+  (void) baud;
+  return false;
+#endif
+}
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,713 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO device link library - C interface.
+
+
+//
+// Includes
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <new>
+
+#include "gpiolink.h"
+#include "gpiolink_parser.h"
+#include "gpiolink_ring.h"
+#include "gpiolink_serial.h"
+
+
+//
+// Private macros
+
+// Default event buffer size.
+#define GPIOLINK_DEFAULT_CAPACITY 4096
+
+// Bytes read from the descriptor at a time.
+#define GPIOLINK_READ_CHUNK 4096
+
+// How often "IDQ" is resent, and how long to wait for the "confighash"
+// line after the identity line (older firmware doesn't send one). These
+// match the Perl monitor.
+#define GPIOLINK_IDQ_INTERVAL_MS 300
+#define GPIOLINK_HASH_WAIT_MS 100
+
+// How long a blocked write waits before giving up.
+#define GPIOLINK_WRITE_TIMEOUT_MS 1000
+
+// Callers (and XS glue) rely on this layout.
+static_assert(32 == sizeof(gpiolink_event_t), "gpiolink_event_t layout");
+
+
+//
+// Private types
+
+// The link is also the parser's sink, so parsed records go straight into
+// the ring without an intermediate copy.
+
+struct gpiolink_s : public GPIOParserSink
+{
+  int fd;
+  GPIOParser parser;
+  GPIORing<gpiolink_event_t> events;
+
+  uint64_t sequence;
+  std::atomic<uint64_t> dropped;
+  std::atomic<uint64_t> bad;
+
+  gpiolink_line_callback_t line_callback;
+  void *line_context;
+
+  gpiolink_query_t query;
+  bool has_query;
+
+  // Host time of the chunk being parsed, and events it produced.
+  uint64_t chunk_time_ns;
+  int chunk_events;
+
+  // Set while gpiolink_identify() is waiting.
+  gpiolink_ident_t *ident;
+  bool saw_ident;
+  bool saw_hash;
+
+  gpiolink_s(int new_fd);
+
+  void PushEvent(gpiolink_event_t &event);
+
+  void OnRegister(char reg, uint32_t value, bool has_tick, uint64_t tick);
+  void OnLine(const char *text, size_t length);
+  void OnFrame(uint8_t type, const uint8_t *payload, size_t length);
+  void OnBadRecord();
+};
+
+
+//
+// Private prototypes
+
+static int ElapsedMS(uint64_t since_ns);
+static bool FindIdentField(const char *text, size_t length, const char *key,
+  size_t &start);
+static void CopyIdentWord(const char *text, size_t length, size_t start,
+  bool to_end, char *dest);
+static int WriteAll(int fd, const char *text, size_t length);
+static bool IsValidOpcode(const char *opcode);
+
+
+
+//
+// Link state methods
+
+
+// Constructor.
+
+gpiolink_s::gpiolink_s(int new_fd)
+  : events(GPIOLINK_DEFAULT_CAPACITY)
+{
+  fd = new_fd;
+  sequence = 0;
+  dropped.store(0);
+  bad.store(0);
+  line_callback = NULL;
+  line_context = NULL;
+  memset(&query, 0, sizeof(query));
+  has_query = false;
+  chunk_time_ns = 0;
+  chunk_events = 0;
+  ident = NULL;
+  saw_ident = false;
+  saw_hash = false;
+}
+
+
+
+// Stamps an event and adds it to the ring.
+
+void gpiolink_s::PushEvent(gpiolink_event_t &event)
+{
+  event.host_time_ns = chunk_time_ns;
+  event.sequence = sequence;
+  sequence++;
+
+  if (events.Push(event))
+    chunk_events++;
+  else
+    dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+// A register report.
+
+void gpiolink_s::OnRegister(char reg, uint32_t value, bool has_tick,
+  uint64_t tick)
+{
+  gpiolink_event_t event;
+
+  memset(&event, 0, sizeof(event));
+  event.type = GPIOLINK_EVENT_REGISTER;
+  event.reg = reg;
+  event.value = value;
+  if (has_tick)
+  {
+    event.flags |= GPIOLINK_FLAG_HAS_TICK;
+    event.device_tick = tick;
+  }
+
+  PushEvent(event);
+}
+
+
+
+// Any other text line.
+
+void gpiolink_s::OnLine(const char *text, size_t length)
+{
+  size_t start;
+  uint32_t hash;
+  int digit;
+
+  if (NULL != ident)
+  {
+    if (FindIdentField(text, length, "devicetype", start))
+    {
+      CopyIdentWord(text, length, start, false, ident->devicetype);
+
+      if (FindIdentField(text, length, "subtype", start))
+        CopyIdentWord(text, length, start, false, ident->subtype);
+      if (FindIdentField(text, length, "task", start))
+        CopyIdentWord(text, length, start, true, ident->task);
+
+      saw_ident = true;
+    }
+    else if ( saw_ident && FindIdentField(text, length, "confighash", start) )
+    {
+      hash = 0;
+      for (digit = 0; (start < length) && (8 > digit); start++, digit++)
+      {
+        if ( ('0' <= text[start]) && ('9' >= text[start]) )
+          hash = (hash << 4) | (text[start] - '0');
+        else if ( ('a' <= text[start]) && ('f' >= text[start]) )
+          hash = (hash << 4) | (text[start] - 'a' + 10);
+        else if ( ('A' <= text[start]) && ('F' >= text[start]) )
+          hash = (hash << 4) | (text[start] - 'A' + 10);
+        else
+          break;
+      }
+
+      if (0 < digit)
+      {
+        ident->confighash = hash;
+        ident->has_confighash = 1;
+        saw_hash = true;
+      }
+    }
+  }
+
+  if (NULL != line_callback)
+    (*line_callback)(line_context, text, length);
+}
+
+
+
+// A binary record.
+
+void gpiolink_s::OnFrame(uint8_t type, const uint8_t *payload, size_t length)
+{
+  gpiolink_event_t event;
+
+  if (GPIOLINK_FRAME_QUERY == type)
+  {
+    if (!DecodeGPIOQuery(payload, length, query))
+    {
+      OnBadRecord();
+      return;
+    }
+
+    has_query = true;
+
+    memset(&event, 0, sizeof(event));
+    event.type = GPIOLINK_EVENT_QUERY;
+    event.device_tick = query.device_tick;
+    event.flags = GPIOLINK_FLAG_HAS_TICK;
+    PushEvent(event);
+  }
+
+  // Other frame types are reserved; skip them quietly.
+}
+
+
+
+// A malformed line or frame.
+
+void gpiolink_s::OnBadRecord()
+{
+  bad.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+//
+// Private functions
+
+
+// Returns milliseconds elapsed since a host timestamp.
+
+static int ElapsedMS(uint64_t since_ns)
+{
+  return (int) ((gpiolink_host_time_ns() - since_ns) / 1000000ull);
+}
+
+
+
+// Finds "key :" in an identity line, and returns the position after the
+// colon and any whitespace.
+
+static bool FindIdentField(const char *text, size_t length, const char *key,
+  size_t &start)
+{
+  size_t keylen, pos, scan;
+
+  keylen = strlen(key);
+
+  for (pos = 0; (pos + keylen) <= length; pos++)
+  {
+    if (0 != memcmp(text + pos, key, keylen))
+      continue;
+
+    // Don't match "subtype" inside "devicetype" and so forth.
+    if ( (0 < pos) && (' ' != text[pos-1]) && ('\t' != text[pos-1]) )
+      continue;
+
+    for (scan = pos + keylen;
+      (scan < length) && ( (' ' == text[scan]) || ('\t' == text[scan]) );
+      scan++);
+
+    if ( (scan < length) && (':' == text[scan]) )
+    {
+      for (scan++;
+        (scan < length) && ( (' ' == text[scan]) || ('\t' == text[scan]) );
+        scan++);
+
+      start = scan;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+
+// Copies one word (or the rest of the line, trimmed) into an identity
+// string.
+
+static void CopyIdentWord(const char *text, size_t length, size_t start,
+  bool to_end, char *dest)
+{
+  size_t end;
+
+  end = start;
+  if (to_end)
+  {
+    end = length;
+    while ( (end > start) && ( (' ' == text[end-1]) || ('\t' == text[end-1]) ) )
+      end--;
+  }
+  else
+  {
+    while ( (end < length) && (' ' != text[end]) && ('\t' != text[end]) )
+      end++;
+  }
+
+  if ((end - start) >= GPIOLINK_IDENT_CHARS)
+    end = start + GPIOLINK_IDENT_CHARS - 1;
+
+  memcpy(dest, text + start, end - start);
+  dest[end - start] = 0;
+}
+
+
+
+// Writes a whole buffer to a non-blocking descriptor.
+
+static int WriteAll(int fd, const char *text, size_t length)
+{
+  ssize_t written;
+  struct pollfd waiting;
+
+  while (0 < length)
+  {
+    written = write(fd, text, length);
+
+    if (0 < written)
+    {
+      text += written;
+      length -= written;
+    }
+    else if ( (0 > written) && (EINTR == errno) )
+      continue;
+    else if ( (0 > written) && ( (EAGAIN == errno) || (EWOULDBLOCK == errno) ) )
+    {
+      waiting.fd = fd;
+      waiting.events = POLLOUT;
+      waiting.revents = 0;
+      if (0 >= poll(&waiting, 1, GPIOLINK_WRITE_TIMEOUT_MS))
+        return -1;
+    }
+    else
+      return -1;
+  }
+
+  return 0;
+}
+
+
+
+// Returns true if the opcode is three capital letters.
+
+static bool IsValidOpcode(const char *opcode)
+{
+  int idx;
+
+  if (NULL == opcode)
+    return false;
+
+  for (idx = 0; 3 > idx; idx++)
+    if ( (opcode[idx] < 'A') || (opcode[idx] > 'Z') )
+      return false;
+
+  return (0 == opcode[3]);
+}
+
+
+
+//
+// Public functions
+
+
+// Returns the ABI version built into the library.
+
+int gpiolink_abi_version(void)
+{
+  return GPIOLINK_ABI_VERSION;
+}
+
+
+
+// Opens a serial port.
+
+gpiolink_t *gpiolink_open(const char *path, uint32_t baud)
+{
+  int fd;
+  gpiolink_t *link;
+
+  fd = OpenSerialPort(path, baud);
+  if (0 > fd)
+    return NULL;
+
+  link = gpiolink_open_fd(fd);
+  if (NULL == link)
+    close(fd);
+
+  return link;
+}
+
+
+
+// Wraps an already-open descriptor.
+
+gpiolink_t *gpiolink_open_fd(int fd)
+{
+  gpiolink_t *link;
+  int flags;
+
+  // Polling reads until the descriptor runs dry, so it mustn't block.
+  if (0 <= fd)
+  {
+    flags = fcntl(fd, F_GETFL);
+    if ( (0 > flags) || (0 > fcntl(fd, F_SETFL, flags | O_NONBLOCK)) )
+      return NULL;
+  }
+
+  link = new (std::nothrow) gpiolink_s(fd);
+  if (NULL == link)
+    errno = ENOMEM;
+
+  return link;
+}
+
+
+
+// Closes the link and frees it.
+
+void gpiolink_close(gpiolink_t *link)
+{
+  if (NULL == link)
+    return;
+
+  if (0 <= link->fd)
+    close(link->fd);
+
+  delete link;
+}
+
+
+
+// Returns the link's descriptor.
+
+int gpiolink_fd(gpiolink_t *link)
+{
+  return link->fd;
+}
+
+
+
+// Sets the number of events buffered.
+
+int gpiolink_set_capacity(gpiolink_t *link, size_t events)
+{
+  try
+  {
+    link->events.Resize(events);
+  }
+  catch (...)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+// Sets the callback for other text lines.
+
+void gpiolink_set_line_callback(gpiolink_t *link,
+  gpiolink_line_callback_t callback, void *context)
+{
+  link->line_callback = callback;
+  link->line_context = context;
+}
+
+
+
+// Sends a command with no argument.
+
+int gpiolink_send_command(gpiolink_t *link, const char *opcode)
+{
+  char text[8];
+
+  if ( (0 > link->fd) || (!IsValidOpcode(opcode)) )
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  snprintf(text, sizeof(text), "%s\n", opcode);
+  return WriteAll(link->fd, text, strlen(text));
+}
+
+
+
+// Sends a command with one numeric argument.
+
+int gpiolink_send_command_arg(gpiolink_t *link, const char *opcode,
+  uint32_t argument)
+{
+  char text[24];
+
+  if ( (0 > link->fd) || (!IsValidOpcode(opcode)) )
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  snprintf(text, sizeof(text), "%s %lu\n", opcode,
+    (unsigned long) argument);
+  return WriteAll(link->fd, text, strlen(text));
+}
+
+
+
+// Sends "IDQ" and waits for the device to identify itself.
+
+int gpiolink_identify(gpiolink_t *link, gpiolink_ident_t *ident,
+  int timeout_ms)
+{
+  uint64_t start_ns, sent_ns, ident_ns;
+  int result;
+
+  memset(ident, 0, sizeof(*ident));
+  link->ident = ident;
+  link->saw_ident = false;
+  link->saw_hash = false;
+
+  start_ns = gpiolink_host_time_ns();
+  sent_ns = start_ns;
+  ident_ns = 0;
+  result = -1;
+
+  if (0 > gpiolink_send_command(link, "IDQ"))
+    timeout_ms = 0;
+
+  while (ElapsedMS(start_ns) < timeout_ms)
+  {
+    if (0 > gpiolink_poll(link, 20))
+      break;
+
+    if (link->saw_ident)
+    {
+      if (0 == ident_ns)
+        ident_ns = gpiolink_host_time_ns();
+
+      if ( link->saw_hash || (ElapsedMS(ident_ns) >= GPIOLINK_HASH_WAIT_MS) )
+      {
+        result = 0;
+        break;
+      }
+    }
+    else if (ElapsedMS(sent_ns) >= GPIOLINK_IDQ_INTERVAL_MS)
+    {
+      // The device may have been busy, or still starting up.
+      if (0 > gpiolink_send_command(link, "IDQ"))
+        break;
+      sent_ns = gpiolink_host_time_ns();
+    }
+  }
+
+  // Having the identity line is enough, even if the hash wait ran over.
+  if (link->saw_ident)
+    result = 0;
+
+  link->ident = NULL;
+
+  if (0 > result)
+    errno = ETIMEDOUT;
+
+  return result;
+}
+
+
+
+// Reads whatever is waiting, and parses it.
+
+int gpiolink_poll(gpiolink_t *link, int timeout_ms)
+{
+  uint8_t buffer[GPIOLINK_READ_CHUNK];
+  struct pollfd waiting;
+  ssize_t count;
+  int total;
+
+  if (0 > link->fd)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  waiting.fd = link->fd;
+  waiting.events = POLLIN;
+  waiting.revents = 0;
+
+  count = poll(&waiting, 1, timeout_ms);
+  if (0 > count)
+    return (EINTR == errno) ? 0 : -1;
+  if (0 == count)
+    return 0;
+
+  total = 0;
+
+  while (true)
+  {
+    count = read(link->fd, buffer, sizeof(buffer));
+
+    if (0 < count)
+      total += gpiolink_feed(link, buffer, count, gpiolink_host_time_ns());
+    else if (0 == count)
+    {
+      // End of file. Report what we got before it, if anything.
+      return (0 < total) ? total : -1;
+    }
+    else if ( (EAGAIN == errno) || (EWOULDBLOCK == errno) )
+      break;
+    else if (EINTR != errno)
+      return (0 < total) ? total : -1;
+  }
+
+  return total;
+}
+
+
+
+// Parses bytes from some other source.
+
+int gpiolink_feed(gpiolink_t *link, const void *data, size_t length,
+  uint64_t host_time_ns)
+{
+  link->chunk_time_ns = host_time_ns;
+  link->chunk_events = 0;
+
+  link->parser.Feed((const uint8_t *) data, length, *link);
+
+  return link->chunk_events;
+}
+
+
+
+// Fetches the oldest buffered event.
+
+int gpiolink_next_event(gpiolink_t *link, gpiolink_event_t *event)
+{
+  return link->events.Pop(*event) ? 1 : 0;
+}
+
+
+
+// Fetches the most recent binary state query.
+
+int gpiolink_last_query(gpiolink_t *link, gpiolink_query_t *query)
+{
+  if (!link->has_query)
+    return 0;
+
+  *query = link->query;
+  return 1;
+}
+
+
+
+// Returns the number of events dropped because the buffer was full.
+
+uint64_t gpiolink_dropped_events(gpiolink_t *link)
+{
+  return link->dropped.load(std::memory_order_relaxed);
+}
+
+
+
+// Returns the number of malformed lines and frames.
+
+uint64_t gpiolink_bad_records(gpiolink_t *link)
+{
+  return link->bad.load(std::memory_order_relaxed);
+}
+
+
+
+// Returns CLOCK_MONOTONIC in nanoseconds.
+
+uint64_t gpiolink_host_time_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (((uint64_t) now.tv_sec) * 1000000000ull) + now.tv_nsec;
+}
+
+
+//
+// This is the end of the file.
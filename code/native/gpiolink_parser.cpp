@@ -0,0 +1,327 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO device link library - incremental protocol parser.
+
+
+//
+// Includes
+
+#include <string.h>
+
+#include "gpiolink_parser.h"
+
+
+//
+// Private prototypes
+
+static bool IsLineSpace(char thischar);
+static uint32_t ReadLittleEndian32(const uint8_t *bytes);
+
+
+
+//
+// Functions
+
+
+// Constructor.
+
+GPIOParser::GPIOParser()
+{
+  Reset();
+}
+
+
+
+// Forgets any partial record.
+
+void GPIOParser::Reset()
+{
+  state = PARSE_TEXT;
+  carry.clear();
+  carry_overflowed = false;
+}
+
+
+
+// Parses a chunk of the stream.
+
+void GPIOParser::Feed(const uint8_t *data, size_t length,
+  GPIOParserSink &sink)
+{
+  size_t pos, scan, take, frame_length;
+  uint8_t thisbyte;
+
+  pos = 0;
+
+  while (pos < length)
+  {
+    if (PARSE_FRAME == state)
+    {
+      // Get the type and length bytes first, then the rest.
+      frame_length = 2;
+      if (2 <= carry.size())
+        frame_length = FrameLength(carry.data());
+
+      take = frame_length - carry.size();
+      if (take > (length - pos))
+        take = length - pos;
+
+      carry.insert(carry.end(), data + pos, data + pos + take);
+      pos += take;
+
+      if ( (2 <= carry.size()) && (carry.size() == FrameLength(carry.data())) )
+      {
+        HandleFrame(carry.data(), carry.size(), sink);
+        carry.clear();
+        state = PARSE_TEXT;
+      }
+
+      continue;
+    }
+
+    // Text. Look for the end of this line, or the start of a frame.
+    for (scan = pos; scan < length; scan++)
+    {
+      thisbyte = data[scan];
+      if ( ('\r' == thisbyte) || ('\n' == thisbyte)
+        || (GPIOLINK_FRAME_START == thisbyte) )
+        break;
+    }
+
+    if ( carry.empty() && (!carry_overflowed) && (scan < length) )
+    {
+      // The whole line is in this chunk; use it in place.
+      HandleLine((const char *) (data + pos), scan - pos, sink);
+    }
+    else
+    {
+      // Keep what we have of the line, up to the size limit.
+      take = scan - pos;
+      if ( carry_overflowed || (GPIOLINK_MAX_LINE < (carry.size() + take)) )
+        carry_overflowed = true;
+      else
+        carry.insert(carry.end(), data + pos, data + scan);
+
+      if (scan < length)
+      {
+        if (carry_overflowed)
+          sink.OnBadRecord();
+        else
+          HandleLine((const char *) carry.data(), carry.size(), sink);
+
+        carry.clear();
+        carry_overflowed = false;
+      }
+    }
+
+    if (scan >= length)
+      break;
+
+    pos = scan + 1;
+
+    if (GPIOLINK_FRAME_START == data[scan])
+    {
+      // Handle frames in place if they're complete, and carry them over
+      // otherwise.
+      if ( ((length - pos) >= 2) && ((length - pos) >= FrameLength(data + pos)) )
+      {
+        frame_length = FrameLength(data + pos);
+        HandleFrame(data + pos, frame_length, sink);
+        pos += frame_length;
+      }
+      else
+      {
+        carry.assign(data + pos, data + length);
+        state = PARSE_FRAME;
+        pos = length;
+      }
+    }
+  }
+}
+
+
+
+// Handles one complete text line.
+
+void GPIOParser::HandleLine(const char *text, size_t length,
+  GPIOParserSink &sink)
+{
+  char reg;
+  uint32_t value;
+  uint64_t tick;
+  bool has_tick;
+
+  // Blank lines come from CR LF pairs.
+  if (0 == length)
+    return;
+
+  if (ParseGPIORegisterLine(text, length, reg, value, has_tick, tick))
+    sink.OnRegister(reg, value, has_tick, tick);
+  else
+    sink.OnLine(text, length);
+}
+
+
+
+// Handles one complete frame (type byte through checksum).
+
+void GPIOParser::HandleFrame(const uint8_t *frame, size_t length,
+  GPIOParserSink &sink)
+{
+  uint8_t checksum;
+  size_t idx;
+
+  checksum = 0;
+  for (idx = 0; idx < length; idx++)
+    checksum += frame[idx];
+
+  if (0 == checksum)
+    sink.OnFrame(frame[0], frame + 2, length - 3);
+  else
+    sink.OnBadRecord();
+}
+
+
+
+// Returns the full frame length (type through checksum).
+
+size_t GPIOParser::FrameLength(const uint8_t *frame)
+{
+  // Type, length, payload, checksum.
+  return 3 + frame[1];
+}
+
+
+
+// Returns true for spaces and tabs.
+
+static bool IsLineSpace(char thischar)
+{
+  return ( (' ' == thischar) || ('\t' == thischar) );
+}
+
+
+
+// Parses a register report line.
+
+bool ParseGPIORegisterLine(const char *text, size_t length, char &reg,
+  uint32_t &value, bool &has_tick, uint64_t &tick)
+{
+  size_t pos, digits;
+  char thischar;
+  uint64_t scratch;
+  unsigned digit;
+
+  pos = 0;
+  while ( (pos < length) && IsLineSpace(text[pos]) )
+    pos++;
+
+  if ( (pos >= length) || (text[pos] < 'A') || (text[pos] > 'Z') )
+    return false;
+  reg = text[pos];
+  pos++;
+
+  while ( (pos < length) && IsLineSpace(text[pos]) )
+    pos++;
+
+  if ( (pos >= length) || (':' != text[pos]) )
+    return false;
+  pos++;
+
+  while ( (pos < length) && IsLineSpace(text[pos]) )
+    pos++;
+
+  // Hex value.
+  value = 0;
+  for (digits = 0; pos < length; pos++, digits++)
+  {
+    thischar = text[pos];
+    if ( ('0' <= thischar) && ('9' >= thischar) )
+      value = (value << 4) | (thischar - '0');
+    else if ( ('a' <= thischar) && ('f' >= thischar) )
+      value = (value << 4) | (thischar - 'a' + 10);
+    else if ( ('A' <= thischar) && ('F' >= thischar) )
+      value = (value << 4) | (thischar - 'A' + 10);
+    else
+      break;
+  }
+
+  if ( (0 == digits) || (8 < digits) )
+    return false;
+
+  // Optional decimal tick, which has to be separated by whitespace.
+  has_tick = false;
+  tick = 0;
+
+  if ( (pos < length) && (!IsLineSpace(text[pos])) )
+    return false;
+
+  while ( (pos < length) && IsLineSpace(text[pos]) )
+    pos++;
+
+  if ( (pos < length) && ('0' <= text[pos]) && ('9' >= text[pos]) )
+  {
+    scratch = 0;
+    for (; (pos < length) && ('0' <= text[pos]) && ('9' >= text[pos]); pos++)
+    {
+      digit = text[pos] - '0';
+      if (scratch > ((UINT64_MAX - digit) / 10))
+        return false;
+      scratch = (scratch * 10) + digit;
+    }
+
+    tick = scratch;
+    has_tick = true;
+
+    while ( (pos < length) && IsLineSpace(text[pos]) )
+      pos++;
+  }
+
+  return (pos == length);
+}
+
+
+
+// Reads a little-endian 32-bit value.
+
+static uint32_t ReadLittleEndian32(const uint8_t *bytes)
+{
+  return ((uint32_t) bytes[0]) | (((uint32_t) bytes[1]) << 8)
+    | (((uint32_t) bytes[2]) << 16) | (((uint32_t) bytes[3]) << 24);
+}
+
+
+
+// Decodes a binary state query payload.
+
+bool DecodeGPIOQuery(const uint8_t *payload, size_t length,
+  gpiolink_query_t &query)
+{
+  if ( (GPIOLINK_QUERY_LENGTH != length)
+    && (GPIOLINK_QUERY_LENGTH_V1 != length) )
+    return false;
+
+  memcpy(query.version, payload, 8);
+  query.version[8] = 0;
+
+  query.device_tick = ReadLittleEndian32(payload + 8);
+  query.ticks_per_second = ReadLittleEndian32(payload + 12);
+  query.input_count = payload[16];
+  query.output_count = payload[17];
+  query.user_count = payload[18];
+  query.flags = payload[19];
+  query.input_bits = ReadLittleEndian32(payload + 20);
+  query.output_bits = ReadLittleEndian32(payload + 24);
+  query.user_bits = ReadLittleEndian32(payload + 28);
+  query.strobe_period = ReadLittleEndian32(payload + 32);
+  query.strobe_duration = ReadLittleEndian32(payload + 36);
+  query.confighash = ReadLittleEndian32(payload + 40);
+
+  if (GPIOLINK_QUERY_LENGTH == length)
+    query.device_tick |= ((uint64_t) ReadLittleEndian32(payload + 44)) << 32;
+
+  return true;
+}
+
+
+//
+// This is the end of the file.
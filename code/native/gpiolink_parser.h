@@ -0,0 +1,119 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO device link library - incremental protocol parser.
+
+
+#ifndef GPIOLINK_PARSER_H
+#define GPIOLINK_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "gpiolink.h"
+
+
+//
+// Macros
+
+// Binary records start with this byte, which never appears in text.
+// The frame is: start, type, payload length, payload, and a checksum byte
+// that makes type through checksum sum to zero (mod 256).
+#define GPIOLINK_FRAME_START 0x02
+
+// Binary state query record ("QRB").
+#define GPIOLINK_FRAME_QUERY 'Q'
+// Older firmware sends the shorter payload, without the tick's upper half.
+#define GPIOLINK_QUERY_LENGTH 48
+#define GPIOLINK_QUERY_LENGTH_V1 44
+
+// Longest text line kept. Longer lines are counted as bad and dropped.
+#define GPIOLINK_MAX_LINE 1024
+
+
+//
+// Classes
+
+// Receives parsed records. Pointers are only valid during the call.
+
+class GPIOParserSink
+{
+public:
+  virtual ~GPIOParserSink() {}
+
+  // A register report ("I: xx", optionally followed by a device tick).
+  virtual void OnRegister(char reg, uint32_t value, bool has_tick,
+    uint64_t tick) = 0;
+
+  // Any other non-empty text line, without its line ending.
+  virtual void OnLine(const char *text, size_t length) = 0;
+
+  // A binary record with a good checksum.
+  virtual void OnFrame(uint8_t type, const uint8_t *payload,
+    size_t length) = 0;
+
+  // A malformed line or frame.
+  virtual void OnBadRecord() = 0;
+};
+
+
+// Splits a byte stream into text lines and binary frames, in as many or
+// as few pieces as it arrives in. Records that arrive whole are passed
+// to the sink in place; only records split across calls are copied.
+
+class GPIOParser
+{
+public:
+  GPIOParser();
+
+  // Forgets any partial record.
+  void Reset();
+
+  // Parses a chunk of the stream.
+  void Feed(const uint8_t *data, size_t length, GPIOParserSink &sink);
+
+protected:
+  enum parse_state_t
+  {
+    PARSE_TEXT,
+    PARSE_FRAME
+  };
+
+  parse_state_t state;
+
+  // Partial record carried over from the last chunk. For frames, this
+  // starts with the type byte.
+  std::vector<uint8_t> carry;
+  bool carry_overflowed;
+
+  // Handles one complete text line.
+  void HandleLine(const char *text, size_t length, GPIOParserSink &sink);
+
+  // Handles one complete frame (type byte through checksum).
+  void HandleFrame(const uint8_t *frame, size_t length,
+    GPIOParserSink &sink);
+
+  // Returns the full frame length (type through checksum), given at
+  // least the type and length bytes.
+  static size_t FrameLength(const uint8_t *frame);
+};
+
+
+//
+// Functions
+
+// Parses a register report line. This accepts the same lines as the
+// Perl monitor: a capital letter, a colon, hex digits, and optionally a
+// decimal device tick (up to 64 bits), with any amount of whitespace
+// between.
+bool ParseGPIORegisterLine(const char *text, size_t length, char &reg,
+  uint32_t &value, bool &has_tick, uint64_t &tick);
+
+// Decodes a binary state query payload.
+bool DecodeGPIOQuery(const uint8_t *payload, size_t length,
+  gpiolink_query_t &query);
+
+
+#endif
+
+//
+// This is the end of the file.
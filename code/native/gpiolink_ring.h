@@ -0,0 +1,96 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO device link library - single-producer single-consumer ring buffer.
+
+
+#ifndef GPIOLINK_RING_H
+#define GPIOLINK_RING_H
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+
+//
+// Classes
+
+// A fixed-capacity queue that one thread can push to while another pops
+// from it, without locks. The capacity is a power of two.
+// Resizing and clearing aren't thread-safe.
+
+template <class item_t> class GPIORing
+{
+public:
+  GPIORing(size_t capacity = 1024)
+  {
+    Resize(capacity);
+  }
+
+  // Discards everything and sets the capacity (rounded up to a power of
+  // two).
+  void Resize(size_t capacity)
+  {
+    size_t rounded;
+
+    rounded = 2;
+    while (rounded < capacity)
+      rounded <<= 1;
+
+    items.assign(rounded, item_t());
+    mask = rounded - 1;
+    head.store(0);
+    tail.store(0);
+  }
+
+  size_t Capacity() const
+  {
+    return mask + 1;
+  }
+
+  // Producer side. Returns false if the ring is full.
+  bool Push(const item_t &item)
+  {
+    size_t this_head;
+
+    this_head = head.load(std::memory_order_relaxed);
+    if ((this_head - tail.load(std::memory_order_acquire)) > mask)
+      return false;
+
+    items[this_head & mask] = item;
+    head.store(this_head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if the ring is empty.
+  bool Pop(item_t &item)
+  {
+    size_t this_tail;
+
+    this_tail = tail.load(std::memory_order_relaxed);
+    if (this_tail == head.load(std::memory_order_acquire))
+      return false;
+
+    item = items[this_tail & mask];
+    tail.store(this_tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t Size() const
+  {
+    return head.load(std::memory_order_acquire)
+      - tail.load(std::memory_order_acquire);
+  }
+
+protected:
+  std::vector<item_t> items;
+  size_t mask;
+
+  // Free-running counts of items pushed and popped.
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+};
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,116 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO device link library - serial port setup.
+
+
+//
+// Includes
+
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "gpiolink_serial.h"
+
+
+//
+// Private types
+
+struct baud_entry_t
+{
+  uint32_t baud;
+  speed_t code;
+};
+
+
+//
+// Private variables
+
+// Rates the firmware's "BAU" command accepts that have standard codes.
+static const baud_entry_t baud_table[] =
+{
+  { 9600, B9600 },
+  { 19200, B19200 },
+  { 38400, B38400 },
+  { 57600, B57600 },
+  { 115200, B115200 },
+  { 230400, B230400 },
+#ifdef B500000
+  { 500000, B500000 },
+#endif
+#ifdef B1000000
+  { 1000000, B1000000 },
+#endif
+  { 0, B0 }
+};
+
+
+
+//
+// Functions
+
+
+// Opens a serial port in raw, non-blocking mode at the given baud rate.
+
+int OpenSerialPort(const char *path, uint32_t baud)
+{
+  int fd, saved_errno;
+  struct termios settings;
+  const baud_entry_t *entry;
+
+  fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (0 > fd)
+    return -1;
+
+  if (0 != tcgetattr(fd, &settings))
+  {
+    // Pipes and plain files have no line settings; that's fine.
+    if (ENOTTY == errno)
+      return fd;
+
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+
+  // 8N1, no flow control, no line discipline processing.
+  cfmakeraw(&settings);
+  settings.c_cflag |= CLOCAL | CREAD;
+  settings.c_cflag &= ~(CSTOPB | CRTSCTS);
+  settings.c_cc[VMIN] = 0;
+  settings.c_cc[VTIME] = 0;
+
+  for (entry = baud_table; (0 != entry->baud) && (baud != entry->baud);
+    entry++);
+
+  if (0 != entry->baud)
+  {
+    cfsetispeed(&settings, entry->code);
+    cfsetospeed(&settings, entry->code);
+  }
+
+  if (0 != tcsetattr(fd, TCSANOW, &settings))
+  {
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+
+  if ( (0 == entry->baud) && (!SetCustomBaud(fd, baud)) )
+  {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+
+  // Throw away anything left over from before we opened the port.
+  tcflush(fd, TCIOFLUSH);
+
+  return fd;
+}
+
+
+//
+// This is the end of the file.
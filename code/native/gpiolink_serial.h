@@ -0,0 +1,26 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO device link library - serial port setup.
+
+
+#ifndef GPIOLINK_SERIAL_H
+#define GPIOLINK_SERIAL_H
+
+#include <stdint.h>
+
+
+//
+// Functions
+
+// Opens a serial port in raw, non-blocking mode at the given baud rate.
+// Returns the descriptor, or -1 (with errno set) on failure.
+int OpenSerialPort(const char *path, uint32_t baud);
+
+// Sets a baud rate that has no standard termios constant (250 kbaud being
+// the one the firmware uses). Returns false if the driver refused it.
+bool SetCustomBaud(int fd, uint32_t baud);
+
+
+#endif
+
+//
+// This is the end of the file.
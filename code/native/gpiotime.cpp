@@ -0,0 +1,562 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO timing signal analysis for session logs.
+
+
+//
+// Includes
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "gpiotime.h"
+
+
+//
+// Private macros
+
+// Fewest pulses we'll fit a strobe to.
+#define GPIOTIME_MIN_PULSES 4
+
+// Fit refinement passes (outlier rejection and cycle renumbering).
+#define GPIOTIME_FIT_PASSES 5
+
+// Residuals beyond this many robust standard deviations are outliers.
+// The floor keeps millisecond log quantization from rejecting good pulses.
+#define GPIOTIME_OUTLIER_SIGMAS 4.0
+#define GPIOTIME_OUTLIER_FLOOR_MS 2.0
+
+
+//
+// Private prototypes
+
+static double Median(std::vector<double> values);
+static bool ParseHexWord(const char *text, size_t length, uint32_t &value);
+
+
+
+//
+// Functions
+
+
+// Constructor.
+
+GPIOTimeAnalyzer::GPIOTimeAnalyzer()
+{
+  Reset();
+}
+
+
+
+// Forgets everything collected so far.
+
+void GPIOTimeAnalyzer::Reset()
+{
+  channels.clear();
+}
+
+
+
+// Scans one log line.
+
+void GPIOTimeAnalyzer::AddLogLine(const char *text, size_t length)
+{
+  static const char marker[] = "MSG gpio ";
+  const char *scan, *end, *label;
+  size_t label_length;
+  double time_ms;
+  uint32_t value;
+
+  end = text + length;
+
+  // "(time)" at the start of the line.
+  if ( (0 == length) || ('(' != text[0]) )
+    return;
+
+  time_ms = 0;
+  for (scan = text + 1; (scan < end) && ('0' <= *scan) && ('9' >= *scan);
+    scan++)
+    time_ms = (time_ms * 10) + (*scan - '0');
+
+  if ( (scan >= end) || (')' != *scan) || ((text + 1) == scan) )
+    return;
+
+  // "MSG gpio <label> O: <value>" somewhere after it.
+  scan = (const char *) memmem(scan, end - scan, marker, sizeof(marker) - 1);
+  if (NULL == scan)
+    return;
+  scan += sizeof(marker) - 1;
+
+  label = scan;
+  while ( (scan < end) && (' ' != *scan) && ('\t' != *scan) )
+    scan++;
+  label_length = scan - label;
+
+  if ( (0 == label_length) || ((end - scan) < 4)
+    || (0 != memcmp(scan, " O: ", 4)) )
+    return;
+  scan += 4;
+
+  if (!ParseHexWord(scan, end - scan, value))
+    return;
+
+  AddEvent(std::string(label, label_length), time_ms, value);
+}
+
+
+
+// Scans a whole log held in memory.
+
+void GPIOTimeAnalyzer::AddLogText(const char *text, size_t length)
+{
+  const char *line, *next, *end;
+
+  end = text + length;
+
+  for (line = text; line < end; line = next + 1)
+  {
+    next = (const char *) memchr(line, '\n', end - line);
+    if (NULL == next)
+      next = end;
+
+    // Only GPIO report lines are interesting; skip the rest cheaply.
+    if ( ((next - line) > 12) && ('(' == line[0]) )
+      AddLogLine(line, next - line);
+  }
+}
+
+
+
+// Adds one output register report.
+
+void GPIOTimeAnalyzer::AddEvent(const std::string &label, double time_ms,
+  uint32_t value)
+{
+  channel_t &channel = channels[label];
+  event_t event;
+  int idx;
+
+  event.time_ms = time_ms;
+  event.value = value;
+  channel.events.push_back(event);
+
+  if (1 == channel.events.size())
+    channel.value_count = 0;
+
+  for (idx = 0; (idx < channel.value_count) && (channel.values[idx] != value);
+    idx++);
+
+  if ( (idx == channel.value_count) && (3 > channel.value_count) )
+  {
+    channel.values[idx] = value;
+    channel.value_count++;
+  }
+}
+
+
+
+// Fits the timing signal.
+
+bool GPIOTimeAnalyzer::Analyze(GPIOTimeResult &result,
+  const std::string &channel)
+{
+  std::map<std::string, channel_t>::iterator thischan;
+  GPIOTimeResult candidate;
+  double score, best_score;
+  size_t candidates;
+  bool found;
+
+  found = false;
+  best_score = -1;
+  candidates = 0;
+
+  // The strobe is an output that toggles between two values. Rather than
+  // taking the first such label, fit all of them and keep the one that
+  // looks most like a clean periodic pulse train.
+  for (thischan = channels.begin(); thischan != channels.end(); thischan++)
+  {
+    if ( (!channel.empty()) && (channel != thischan->first) )
+      continue;
+
+    if (2 != thischan->second.value_count)
+      continue;
+
+    if (!FitChannel(thischan->first, thischan->second, candidate))
+      continue;
+
+    candidates++;
+
+    score = candidate.coverage
+      * (1.0 - (candidate.jitter_ms / candidate.period_ms));
+
+    if ( (!found) || (score > best_score) || ( (score == best_score)
+      && (candidate.pulses > result.pulses) ) )
+    {
+      result = candidate;
+      best_score = score;
+      found = true;
+    }
+  }
+
+  result.candidates = candidates;
+
+  return found;
+}
+
+
+
+// Fits a pulse train to one channel's reports.
+
+bool GPIOTimeAnalyzer::FitChannel(const std::string &label,
+  channel_t &channel, GPIOTimeResult &result)
+{
+  std::vector<event_t> &events = channel.events;
+  std::vector<double> scratch, centres, residuals;
+  std::vector<long> cycle;
+  std::vector<bool> inlier;
+  double gap_sum[2], pulse_width, pending_start, last_end, period, offset;
+  double step, count, sum_t, sum_xx, sum_xt, kmean, sigma, threshold;
+  double kscale, normal[3][4], factor, quad;
+  uint32_t start_value;
+  size_t idx, jdx, used, row, col, pivot;
+  long kmin, kmax, kthis;
+  int pass;
+
+  // Reports normally arrive in order, but merged logs can shuffle ties.
+  std::stable_sort(events.begin(), events.end(),
+    [](const event_t &first, const event_t &second)
+    { return first.time_ms < second.time_ms; });
+
+  if ((2 * GPIOTIME_MIN_PULSES) > events.size())
+    return false;
+
+
+  // The value with the shorter gap before it ends the pulse; the other
+  // starts it. That shorter gap is the pulse width.
+
+  for (jdx = 0; 2 > jdx; jdx++)
+  {
+    scratch.clear();
+    for (idx = 1; idx < events.size(); idx++)
+      if ( (events[idx].value == channel.values[jdx])
+        && (events[idx-1].value != channel.values[jdx]) )
+        scratch.push_back(events[idx].time_ms - events[idx-1].time_ms);
+
+    if (scratch.empty())
+      return false;
+
+    gap_sum[jdx] = Median(scratch);
+  }
+
+  start_value = channel.values[ (gap_sum[0] < gap_sum[1]) ? 1 : 0 ];
+  pulse_width = (gap_sum[0] < gap_sum[1]) ? gap_sum[0] : gap_sum[1];
+
+
+  // Find pulse centres. If one edge's report is missing, place the centre
+  // half a pulse width from the edge we do have.
+
+  pending_start = -1;
+  last_end = -1;
+
+  for (idx = 0; idx < events.size(); idx++)
+  {
+    if (start_value == events[idx].value)
+    {
+      if (0 <= pending_start)
+      {
+        // A repeated report of the same edge.
+        if ((events[idx].time_ms - pending_start) <= pulse_width)
+          continue;
+
+        centres.push_back(pending_start + 0.5 * pulse_width);
+      }
+      pending_start = events[idx].time_ms;
+    }
+    else
+    {
+      if ( (0 <= pending_start)
+        && ((events[idx].time_ms - pending_start) <= (3 * pulse_width)) )
+        centres.push_back(0.5 * (pending_start + events[idx].time_ms));
+      else if ( (0 > last_end)
+        || ((events[idx].time_ms - last_end) > pulse_width) )
+        centres.push_back(events[idx].time_ms - 0.5 * pulse_width);
+
+      pending_start = -1;
+      last_end = events[idx].time_ms;
+    }
+  }
+
+  if (0 <= pending_start)
+    centres.push_back(pending_start + 0.5 * pulse_width);
+
+  if (GPIOTIME_MIN_PULSES > centres.size())
+    return false;
+
+
+  // Initial period: the typical spacing, refined using gaps that span
+  // several periods (from dropped packets) as well.
+
+  scratch.clear();
+  for (idx = 1; idx < centres.size(); idx++)
+    scratch.push_back(centres[idx] - centres[idx-1]);
+
+  period = Median(scratch);
+  if (!(pulse_width < period))
+    return false;
+
+  sum_t = 0;
+  count = 0;
+  for (idx = 0; idx < scratch.size(); idx++)
+  {
+    step = floor(scratch[idx] / period + 0.5);
+    if ( (1 <= step) && (fabs(scratch[idx] / step - period) < (0.25 * period)) )
+    {
+      sum_t += scratch[idx];
+      count += step;
+    }
+  }
+  if (0 < count)
+    period = sum_t / count;
+
+  // Number the cycles from local spacing; this tolerates a rough period.
+  // A stray pulse shares its neighbour's number, and is rejected below.
+  cycle.assign(centres.size(), 0);
+  for (idx = 1; idx < centres.size(); idx++)
+  {
+    step = floor((centres[idx] - centres[idx-1]) / period + 0.5);
+    cycle[idx] = cycle[idx-1] + (long) step;
+  }
+
+
+  // Robust straight-line fit of centre time against cycle number. Each pass
+  // rejects outliers and renumbers cycles against the refined fit, which
+  // keeps long sessions from accumulating numbering errors.
+
+  inlier.assign(centres.size(), true);
+  residuals.assign(centres.size(), 0);
+  offset = centres[0];
+  used = 0;
+  sigma = 0;
+  kmean = 0;
+  sum_xx = 0;
+
+  for (pass = 0; GPIOTIME_FIT_PASSES > pass; pass++)
+  {
+    count = 0;
+    kmean = 0;
+    sum_t = 0;
+    for (idx = 0; idx < centres.size(); idx++)
+      if (inlier[idx])
+      {
+        count++;
+        kmean += cycle[idx];
+        sum_t += centres[idx];
+      }
+
+    if (GPIOTIME_MIN_PULSES > count)
+      return false;
+
+    kmean /= count;
+    sum_t /= count;
+
+    sum_xx = 0;
+    sum_xt = 0;
+    for (idx = 0; idx < centres.size(); idx++)
+      if (inlier[idx])
+      {
+        sum_xx += (cycle[idx] - kmean) * (cycle[idx] - kmean);
+        sum_xt += (cycle[idx] - kmean) * (centres[idx] - sum_t);
+      }
+
+    if (0 >= sum_xx)
+      return false;
+
+    period = sum_xt / sum_xx;
+    offset = sum_t - period * kmean;
+
+    if (!(pulse_width < period))
+      return false;
+
+    scratch.clear();
+    for (idx = 0; idx < centres.size(); idx++)
+    {
+      residuals[idx] = centres[idx] - (offset + period * cycle[idx]);
+      scratch.push_back(fabs(residuals[idx]));
+    }
+
+    sigma = 1.4826 * Median(scratch);
+    threshold = GPIOTIME_OUTLIER_SIGMAS * sigma;
+    if (GPIOTIME_OUTLIER_FLOOR_MS > threshold)
+      threshold = GPIOTIME_OUTLIER_FLOOR_MS;
+    if ((0.25 * period) < threshold)
+      threshold = 0.25 * period;
+
+    used = 0;
+    for (idx = 0; idx < centres.size(); idx++)
+    {
+      inlier[idx] = (fabs(residuals[idx]) <= threshold);
+      if (inlier[idx])
+        used++;
+
+      cycle[idx] = (long) floor((centres[idx] - offset) / period + 0.5);
+      residuals[idx] = centres[idx] - (offset + period * cycle[idx]);
+    }
+  }
+
+
+  // Confidence figures, from the inliers of the final fit.
+
+  kmin = 0;
+  kmax = 0;
+  count = 0;
+  sum_xt = 0;
+  for (idx = 0; idx < centres.size(); idx++)
+    if (inlier[idx])
+    {
+      if ( (0 == count) || (cycle[idx] < kmin) )
+        kmin = cycle[idx];
+      if ( (0 == count) || (cycle[idx] > kmax) )
+        kmax = cycle[idx];
+      count++;
+      sum_xt += residuals[idx] * residuals[idx];
+    }
+
+  if (GPIOTIME_MIN_PULSES > count)
+    return false;
+
+  // Count each cycle once, even if it had stray duplicate reports.
+  used = 0;
+  kthis = kmin - 1;
+  for (idx = 0; idx < centres.size(); idx++)
+    if ( inlier[idx] && (cycle[idx] != kthis) )
+    {
+      used++;
+      kthis = cycle[idx];
+    }
+
+  result.channel = label;
+  result.period_ms = period;
+  result.offset_ms = offset + period * kmin;
+  result.pulse_width_ms = pulse_width;
+  result.jitter_ms = sqrt(sum_xt / count);
+  result.pulses = used;
+  result.outliers = centres.size() - (size_t) count;
+  result.cycles = kmax - kmin + 1;
+  result.coverage = ((double) used) / result.cycles;
+
+  // Least-squares standard errors.
+  sigma = (2 < count) ? sqrt(sum_xt / (count - 2)) : 0;
+  result.period_stderr_ms = sigma / sqrt(sum_xx);
+  result.offset_stderr_ms = sigma
+    * sqrt((1.0 / count) + ((kmean - kmin) * (kmean - kmin) / sum_xx));
+
+
+  // Drift: fit a quadratic to the residuals; the curvature is the rate of
+  // change of the period. Cycle numbers are scaled to keep the normal
+  // equations well-conditioned.
+
+  result.drift_ppm_per_hour = 0;
+  kscale = 0.5 * (kmax - kmin);
+
+  if ( (3 < count) && (0 < kscale) )
+  {
+    memset(normal, 0, sizeof(normal));
+    for (idx = 0; idx < centres.size(); idx++)
+      if (inlier[idx])
+      {
+        scratch.assign(3, 1.0);
+        scratch[1] = (cycle[idx] - kmin - kscale) / kscale;
+        scratch[2] = scratch[1] * scratch[1];
+
+        for (row = 0; 3 > row; row++)
+        {
+          for (col = 0; 3 > col; col++)
+            normal[row][col] += scratch[row] * scratch[col];
+          normal[row][3] += scratch[row] * residuals[idx];
+        }
+      }
+
+    // Gaussian elimination with partial pivoting.
+    for (col = 0; 3 > col; col++)
+    {
+      pivot = col;
+      for (row = col + 1; 3 > row; row++)
+        if (fabs(normal[row][col]) > fabs(normal[pivot][col]))
+          pivot = row;
+
+      for (jdx = 0; 4 > jdx; jdx++)
+        std::swap(normal[col][jdx], normal[pivot][jdx]);
+
+      if (0 == normal[col][col])
+        break;
+
+      for (row = 0; 3 > row; row++)
+        if (row != col)
+        {
+          factor = normal[row][col] / normal[col][col];
+          for (jdx = col; 4 > jdx; jdx++)
+            normal[row][jdx] -= factor * normal[col][jdx];
+        }
+    }
+
+    if ( (3 == col) && (0 != normal[2][2]) )
+    {
+      // Residual curvature per cycle squared; the period changes by twice
+      // this each cycle.
+      quad = normal[2][3] / normal[2][2] / (kscale * kscale);
+      result.drift_ppm_per_hour =
+        2.0 * quad * (3600000.0 / period) / period * 1.0e6;
+    }
+  }
+
+  return true;
+}
+
+
+
+// Returns the median of a list (by value, since it gets reordered).
+
+static double Median(std::vector<double> values)
+{
+  size_t middle;
+
+  if (values.empty())
+    return 0;
+
+  middle = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + middle, values.end());
+
+  return values[middle];
+}
+
+
+
+// Parses a hex word, stopping at whitespace or the end of the text.
+
+static bool ParseHexWord(const char *text, size_t length, uint32_t &value)
+{
+  size_t idx;
+  char thischar;
+
+  value = 0;
+  for (idx = 0; idx < length; idx++)
+  {
+    thischar = text[idx];
+    if ( ('0' <= thischar) && ('9' >= thischar) )
+      value = (value << 4) | (thischar - '0');
+    else if ( ('a' <= thischar) && ('f' >= thischar) )
+      value = (value << 4) | (thischar - 'a' + 10);
+    else if ( ('A' <= thischar) && ('F' >= thischar) )
+      value = (value << 4) | (thischar - 'A' + 10);
+    else if ( (' ' == thischar) || ('\t' == thischar) || ('\r' == thischar) )
+      break;
+    else
+      return false;
+  }
+
+  return ( (0 < idx) && (8 >= idx) );
+}
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,105 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO timing signal analysis for session logs.
+
+
+#ifndef GPIOTIME_H
+#define GPIOTIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+
+//
+// Types
+
+// Fitted timing signal parameters. Times are in log milliseconds.
+
+struct GPIOTimeResult
+{
+  // Device label that carries the strobe.
+  std::string channel;
+
+  // Strobe period, and the centre of the first pulse (the same quantities
+  // NCAM_AnalyzeGPIOTime returns).
+  double period_ms;
+  double offset_ms;
+  double pulse_width_ms;
+
+  // Confidence figures.
+  // RMS residual of the pulse times about the fit (host-side jitter).
+  double jitter_ms;
+  // Standard errors of the period and offset.
+  double period_stderr_ms;
+  double offset_stderr_ms;
+  // Slow change in the period over the session (host clock against the
+  // strobe clock), in parts per million per hour.
+  double drift_ppm_per_hour;
+  // Fraction of strobe cycles in the session that had a usable pulse.
+  double coverage;
+
+  // Pulses used, pulses rejected as outliers, and cycles spanned.
+  size_t pulses;
+  size_t outliers;
+  size_t cycles;
+
+  // Number of labels that looked like a strobe.
+  size_t candidates;
+};
+
+
+//
+// Classes
+
+// Collects "O:" reports from a session log in one pass, then picks out the
+// strobe channel and fits a pulse train to it.
+
+class GPIOTimeAnalyzer
+{
+public:
+  GPIOTimeAnalyzer();
+
+  void Reset();
+
+  // Scans one log line (without its line ending). Lines other than
+  // "(time) ... MSG gpio <label> O: <hex> [tick]" are ignored.
+  void AddLogLine(const char *text, size_t length);
+
+  // Scans a whole log held in memory.
+  void AddLogText(const char *text, size_t length);
+
+  // Adds one output register report directly.
+  void AddEvent(const std::string &label, double time_ms, uint32_t value);
+
+  // Fits the timing signal. If "channel" is non-empty, only that label is
+  // considered. Returns false if no strobe could be found.
+  bool Analyze(GPIOTimeResult &result, const std::string &channel);
+
+protected:
+  struct event_t
+  {
+    double time_ms;
+    uint32_t value;
+  };
+
+  struct channel_t
+  {
+    std::vector<event_t> events;
+    // Distinct values seen (up to three; more than two disqualifies it).
+    uint32_t values[3];
+    int value_count;
+  };
+
+  std::map<std::string, channel_t> channels;
+
+  bool FitChannel(const std::string &label, channel_t &channel,
+    GPIOTimeResult &result);
+};
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,914 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Live MJPEG imagecast server - one frame buffer, many HTTP clients.
+
+
+//
+// Includes
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "mjpegcast.h"
+#include "rgbimage.h"
+
+
+//
+// Private macros
+
+#define LISTEN_BACKLOG 16
+
+// Events handled per epoll_wait() call.
+#define POLL_EVENT_COUNT 64
+
+
+//
+// Private variables
+
+// Sent once to each client, before the first frame.
+static const char stream_header[] =
+  "HTTP/1.1 200 OK\r\n"
+  "Pragma: no-cache\r\n"
+  "Cache-Control: no-cache\r\n"
+  "Connection: close\r\n"
+  "Content-Type: multipart/x-mixed-replace;boundary=" MJPEGCAST_BOUNDARY
+    "\r\n"
+  "\r\n"
+  "--" MJPEGCAST_BOUNDARY "\r\n";
+
+// Sent after each frame.
+static const char frame_footer[] = "\r\n--" MJPEGCAST_BOUNDARY "\r\n";
+
+static const char busy_response[] =
+  "HTTP/1.1 503 Service Unavailable\r\n"
+  "Connection: close\r\n"
+  "\r\n";
+
+
+//
+// Private prototypes
+
+static bool VariantNameIsUsable(const std::string &name);
+static std::string GetRequestedVariant(const std::string &request);
+
+
+
+//
+// Private functions
+
+
+// Checks that a variant name can be used as a path component.
+
+static bool VariantNameIsUsable(const std::string &name)
+{
+  size_t cidx;
+  char thischar;
+
+  if ( name.empty() || (MJPEGCAST_MAX_VARIANT_CHARS < name.size()) )
+    return false;
+
+  for (cidx = 0; cidx < name.size(); cidx++)
+  {
+    thischar = name[cidx];
+    if ( !( ( ('a' <= thischar) && ('z' >= thischar) )
+      || ( ('A' <= thischar) && ('Z' >= thischar) )
+      || ( ('0' <= thischar) && ('9' >= thischar) )
+      || ('-' == thischar) || ('_' == thischar) ) )
+      return false;
+  }
+
+  return true;
+}
+
+
+
+// Returns the first path component of a GET request ("" if there isn't
+// one, or if this isn't a GET).
+
+static std::string GetRequestedVariant(const std::string &request)
+{
+  size_t start, end;
+
+  if (0 != request.compare(0, 5, "GET /"))
+    return std::string();
+
+  start = 5;
+  end = request.find_first_of("/? \r\n", start);
+  if (std::string::npos == end)
+    end = request.size();
+
+  return request.substr(start, end - start);
+}
+
+
+
+//
+// Server methods
+
+
+// Constructor.
+
+MJPEGCastServer::MJPEGCastServer()
+{
+  variant_t original;
+
+  // Stream 0 is frames as they were published.
+  original.box_width = 0;
+  original.box_height = 0;
+  original.viewers = 0;
+  variants.push_back(original);
+
+  listen_fd = -1;
+  epoll_fd = -1;
+  wake_fd = -1;
+  quality = MJPEGCAST_DEFAULT_QUALITY;
+  max_clients = MJPEGCAST_DEFAULT_MAX_CLIENTS;
+  memset(&stats, 0, sizeof(stats));
+  scaler_quit = false;
+}
+
+
+
+// Destructor.
+
+MJPEGCastServer::~MJPEGCastServer()
+{
+  Stop();
+}
+
+
+
+// Adds a pre-scaled stream.
+
+bool MJPEGCastServer::AddVariant(const std::string &name, int box_width,
+  int box_height)
+{
+  variant_t variant;
+  size_t vidx;
+
+  if ( (0 <= listen_fd) || (!VariantNameIsUsable(name))
+    || (1 > box_width) || (1 > box_height) )
+    return false;
+
+  for (vidx = 1; vidx < variants.size(); vidx++)
+    if (name == variants[vidx].name)
+      return false;
+
+  variant.name = name;
+  variant.box_width = box_width;
+  variant.box_height = box_height;
+  variant.viewers = 0;
+  variants.push_back(variant);
+
+  return true;
+}
+
+
+
+// Sets the JPEG quality for scaled variants.
+
+void MJPEGCastServer::SetQuality(int new_quality)
+{
+  quality = std::max(1, std::min(100, new_quality));
+}
+
+
+
+// Sets the number of clients to serve at once.
+
+void MJPEGCastServer::SetMaxClients(int new_max_clients)
+{
+  max_clients = std::max(1, new_max_clients);
+}
+
+
+
+// Starts listening on a TCP port.
+
+bool MJPEGCastServer::Start(int port)
+{
+  struct sockaddr_in address;
+  struct epoll_event event;
+  size_t iidx;
+  int flag;
+
+  Stop();
+
+  listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if ( (0 > listen_fd) || (0 > epoll_fd) || (0 > wake_fd) )
+  {
+    Stop();
+    return false;
+  }
+
+  // Restarting the daemon shouldn't have to wait out TIME_WAIT.
+  flag = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+
+  if ( (0 != bind(listen_fd, (struct sockaddr *) &address, sizeof(address)))
+    || (0 != listen(listen_fd, LISTEN_BACKLOG)) )
+  {
+    Stop();
+    return false;
+  }
+
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+
+  event.data.fd = listen_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+  event.data.fd = wake_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+
+  for (iidx = 0; iidx < inputs.size(); iidx++)
+  {
+    event.data.fd = inputs[iidx];
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inputs[iidx], &event);
+  }
+
+  if (1 < variants.size())
+  {
+    scaler_quit = false;
+    scaler = std::thread(&MJPEGCastServer::RunScaler, this);
+  }
+
+  return true;
+}
+
+
+
+// Disconnects all clients and stops listening.
+
+void MJPEGCastServer::Stop()
+{
+  if (scaler.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> guard(scale_lock);
+      scaler_quit = true;
+    }
+    scale_wanted.notify_one();
+    scaler.join();
+  }
+
+  while (!clients.empty())
+    CloseClient(clients.begin()->first);
+
+  if (0 <= listen_fd)
+    close(listen_fd);
+  if (0 <= epoll_fd)
+    close(epoll_fd);
+  if (0 <= wake_fd)
+    close(wake_fd);
+
+  listen_fd = -1;
+  epoll_fd = -1;
+  wake_fd = -1;
+
+  scale_job.source.reset();
+  scale_job.variants.clear();
+  scaled.clear();
+}
+
+
+
+// Adds a descriptor for Poll() to wait on.
+
+bool MJPEGCastServer::AddInput(int fd)
+{
+  struct epoll_event event;
+
+  if (0 <= epoll_fd)
+  {
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (0 != epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event))
+      return false;
+  }
+
+  inputs.push_back(fd);
+
+  return true;
+}
+
+
+
+// Waits for something to happen and handles it.
+
+bool MJPEGCastServer::Poll(int timeout_ms, std::vector<int> &ready_inputs)
+{
+  struct epoll_event events[POLL_EVENT_COUNT];
+  std::map<int, client_t>::iterator client_iter;
+  int event_count, eidx, fd;
+  bool is_ok;
+
+  ready_inputs.clear();
+
+  if (0 > epoll_fd)
+    return false;
+
+  event_count = epoll_wait(epoll_fd, events, POLL_EVENT_COUNT, timeout_ms);
+  if (0 > event_count)
+    return (EINTR == errno);
+
+  for (eidx = 0; eidx < event_count; eidx++)
+  {
+    fd = events[eidx].data.fd;
+
+    if (listen_fd == fd)
+      AcceptClients();
+    else if (wake_fd == fd)
+      CollectScaled();
+    else if (inputs.end() != std::find(inputs.begin(), inputs.end(), fd))
+      ready_inputs.push_back(fd);
+    else
+    {
+      // An earlier event in this batch may have closed it.
+      client_iter = clients.find(fd);
+      if (clients.end() == client_iter)
+        continue;
+
+      is_ok = (0 == (events[eidx].events & EPOLLERR));
+      if ( is_ok && (0 != (events[eidx].events
+        & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) )
+        is_ok = ReadClient(client_iter->second);
+      if ( is_ok && (0 != (events[eidx].events & EPOLLOUT)) )
+        is_ok = SendToClient(client_iter->second);
+
+      if (!is_ok)
+        CloseClient(fd);
+    }
+  }
+
+  return true;
+}
+
+
+
+// Sends a frame to all clients.
+
+void MJPEGCastServer::Publish(std::vector<uint8_t> &jpeg)
+{
+  mjpegcast_frame_ptr frame;
+
+  frame = MakeMJPEGCastFrame(jpeg);
+  stats.frames_in++;
+
+  FanOut(0, frame);
+  RequestScaling(frame);
+}
+
+
+
+// Reads a JPEG file and sends it to all clients.
+
+bool MJPEGCastServer::PublishFile(const char *path)
+{
+  std::vector<uint8_t> jpeg;
+  struct stat info;
+  size_t total;
+  ssize_t count;
+  int fd;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (0 > fd)
+    return false;
+
+  if (0 != fstat(fd, &info))
+  {
+    close(fd);
+    return false;
+  }
+
+  jpeg.resize(info.st_size);
+
+  total = 0;
+  while (total < jpeg.size())
+  {
+    count = read(fd, jpeg.data() + total, jpeg.size() - total);
+    if ( (0 > count) && (EINTR == errno) )
+      continue;
+    if (0 >= count)
+      break;
+    total += count;
+  }
+
+  close(fd);
+
+  // A file that's shorter than it was or doesn't start with a JPEG SOI
+  // marker is still being written, or is something else.
+  if ( (total != jpeg.size()) || (4 > total)
+    || (0xff != jpeg[0]) || (0xd8 != jpeg[1]) )
+    return false;
+
+  Publish(jpeg);
+
+  return true;
+}
+
+
+
+// Accepts pending connections.
+
+void MJPEGCastServer::AcceptClients()
+{
+  struct epoll_event event;
+  client_t client;
+  ssize_t count;
+  int fd, flag;
+
+  while (0 <= (fd = accept4(listen_fd, NULL, NULL,
+    SOCK_NONBLOCK | SOCK_CLOEXEC)))
+  {
+    if ((size_t) max_clients <= clients.size())
+    {
+      count = send(fd, busy_response, sizeof(busy_response) - 1,
+        MSG_NOSIGNAL);
+      (void) count;
+      close(fd);
+      continue;
+    }
+
+    // Frames are written whole, so there's nothing for Nagle to merge,
+    // and the tail of a frame shouldn't wait for an ACK.
+    flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    if (0 != epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event))
+    {
+      close(fd);
+      continue;
+    }
+
+    client.fd = fd;
+    client.variant = 0;
+    client.streaming = false;
+    client.want_write = false;
+    client.preamble_sent = 0;
+    client.current_sent = 0;
+    clients[fd] = client;
+
+    stats.clients_now = clients.size();
+  }
+}
+
+
+
+// Reads from a client. Returns false if the client should be dropped.
+
+bool MJPEGCastServer::ReadClient(client_t &client)
+{
+  char buffer[MJPEGCAST_MAX_REQUEST_BYTES];
+  ssize_t count;
+
+  while (1)
+  {
+    count = recv(client.fd, buffer, sizeof(buffer), 0);
+
+    if (0 < count)
+    {
+      // Once streaming, anything the client sends is ignored. (The
+      // javascript movie player keeps sending GETs.)
+      if (!client.streaming)
+        client.request.append(buffer, count);
+    }
+    else if (0 == count)
+      return false;
+    else if (EINTR == errno)
+      continue;
+    else if ( (EAGAIN == errno) || (EWOULDBLOCK == errno) )
+      break;
+    else
+      return false;
+  }
+
+  if (client.streaming)
+    return true;
+
+  if ( (std::string::npos != client.request.find("\r\n\r\n"))
+    || (std::string::npos != client.request.find("\n\n")) )
+    return StartStreaming(client);
+
+  return (MJPEGCAST_MAX_REQUEST_BYTES > client.request.size());
+}
+
+
+
+// Picks a client's stream from its request and starts sending.
+// Returns false if the client should be dropped.
+
+bool MJPEGCastServer::StartStreaming(client_t &client)
+{
+  std::string wanted;
+  size_t vidx;
+  variant_t *variant;
+
+  if (0 != client.request.compare(0, 4, "GET "))
+    return false;
+
+  wanted = GetRequestedVariant(client.request);
+  client.request.clear();
+  client.request.shrink_to_fit();
+
+  client.variant = 0;
+  for (vidx = 1; vidx < variants.size(); vidx++)
+    if (wanted == variants[vidx].name)
+      client.variant = vidx;
+
+  variant = &variants[client.variant];
+  variant->viewers++;
+
+  client.streaming = true;
+  client.preamble = stream_header;
+  client.preamble_sent = 0;
+
+  stats.clients_served++;
+
+  // Someone just started watching a variant that hasn't been scaled
+  // lately. Scale the newest frame now rather than waiting for the next.
+  if ( (0 < client.variant) && (1 == variant->viewers)
+    && (NULL != variants[0].latest) )
+    RequestScaling(variants[0].latest);
+
+  // New clients get a picture right away.
+  if (NULL != variant->latest)
+    QueueFrame(client, variant->latest);
+
+  return SendToClient(client);
+}
+
+
+
+// Disconnects a client.
+
+void MJPEGCastServer::CloseClient(int fd)
+{
+  std::map<int, client_t>::iterator client_iter;
+
+  client_iter = clients.find(fd);
+  if (clients.end() == client_iter)
+    return;
+
+  if (client_iter->second.streaming)
+    variants[client_iter->second.variant].viewers--;
+
+  if (0 <= epoll_fd)
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  close(fd);
+
+  clients.erase(client_iter);
+  stats.clients_now = clients.size();
+}
+
+
+
+// Gives a client a frame to send. A client that's still sending an
+// earlier frame keeps only the newest one waiting.
+
+void MJPEGCastServer::QueueFrame(client_t &client,
+  const mjpegcast_frame_ptr &frame)
+{
+  if (NULL == client.current)
+  {
+    client.current = frame;
+    client.current_sent = 0;
+  }
+  else
+  {
+    if (NULL != client.pending)
+      stats.frames_dropped++;
+    client.pending = frame;
+  }
+}
+
+
+
+// Writes as much as the socket will take. Returns false if the client
+// should be dropped.
+
+bool MJPEGCastServer::SendToClient(client_t &client)
+{
+  struct iovec pieces[4];
+  struct msghdr message;
+  const char *starts[3];
+  size_t sizes[3];
+  size_t piece_count, pidx, skip, total, taken;
+  ssize_t count;
+
+  while (1)
+  {
+    piece_count = 0;
+
+    if (client.preamble_sent < client.preamble.size())
+    {
+      pieces[piece_count].iov_base =
+        (void *) (client.preamble.data() + client.preamble_sent);
+      pieces[piece_count].iov_len =
+        client.preamble.size() - client.preamble_sent;
+      piece_count++;
+    }
+
+    total = 0;
+    if (NULL != client.current)
+    {
+      starts[0] = client.current->header.data();
+      sizes[0] = client.current->header.size();
+      starts[1] = (const char *) client.current->jpeg.data();
+      sizes[1] = client.current->jpeg.size();
+      starts[2] = frame_footer;
+      sizes[2] = sizeof(frame_footer) - 1;
+
+      // Skip whatever went out in earlier writes.
+      skip = client.current_sent;
+      for (pidx = 0; pidx < 3; pidx++)
+      {
+        total += sizes[pidx];
+
+        if (skip >= sizes[pidx])
+          skip -= sizes[pidx];
+        else
+        {
+          pieces[piece_count].iov_base = (void *) (starts[pidx] + skip);
+          pieces[piece_count].iov_len = sizes[pidx] - skip;
+          piece_count++;
+          skip = 0;
+        }
+      }
+    }
+
+    if (0 == piece_count)
+    {
+      SetWantWrite(client, false);
+      return true;
+    }
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = pieces;
+    message.msg_iovlen = piece_count;
+
+    count = sendmsg(client.fd, &message, MSG_NOSIGNAL);
+
+    if (0 > count)
+    {
+      if (EINTR == errno)
+        continue;
+      if ( (EAGAIN == errno) || (EWOULDBLOCK == errno) )
+      {
+        // Finish when the socket drains.
+        SetWantWrite(client, true);
+        return true;
+      }
+      return false;
+    }
+
+    stats.bytes_sent += count;
+
+    if (client.preamble_sent < client.preamble.size())
+    {
+      taken = std::min((size_t) count,
+        client.preamble.size() - client.preamble_sent);
+      client.preamble_sent += taken;
+      count -= taken;
+
+      if (client.preamble_sent == client.preamble.size())
+      {
+        client.preamble.clear();
+        client.preamble_sent = 0;
+      }
+    }
+
+    client.current_sent += count;
+
+    if ( (NULL != client.current) && (total == client.current_sent) )
+    {
+      stats.frames_sent++;
+      client.current = client.pending;
+      client.current_sent = 0;
+      client.pending.reset();
+    }
+  }
+}
+
+
+
+// Turns waiting for a client's socket to drain on or off.
+
+void MJPEGCastServer::SetWantWrite(client_t &client, bool want_write)
+{
+  struct epoll_event event;
+
+  if (want_write == client.want_write)
+    return;
+
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN | EPOLLRDHUP | (want_write ? EPOLLOUT : 0);
+  event.data.fd = client.fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client.fd, &event);
+
+  client.want_write = want_write;
+}
+
+
+
+// Makes a frame the newest one for a stream and queues it for its
+// clients.
+
+void MJPEGCastServer::FanOut(int variant, const mjpegcast_frame_ptr &frame)
+{
+  std::map<int, client_t>::iterator client_iter;
+  std::vector<int> dropped;
+  size_t didx;
+
+  variants[variant].latest = frame;
+
+  for (client_iter = clients.begin(); client_iter != clients.end();
+    client_iter++)
+  {
+    client_t &client = client_iter->second;
+
+    if ( (!client.streaming) || (variant != client.variant) )
+      continue;
+
+    QueueFrame(client, frame);
+
+    // Clients that are waiting for their socket to drain pick this up
+    // when it does.
+    if ( (!client.want_write) && (!SendToClient(client)) )
+      dropped.push_back(client.fd);
+  }
+
+  for (didx = 0; didx < dropped.size(); didx++)
+    CloseClient(dropped[didx]);
+}
+
+
+
+// Hands a frame to the scaling thread for the variants being watched.
+// A frame that hasn't been picked up yet is replaced.
+
+void MJPEGCastServer::RequestScaling(const mjpegcast_frame_ptr &source)
+{
+  std::vector<int> wanted;
+  size_t vidx;
+
+  if (!scaler.joinable())
+    return;
+
+  for (vidx = 1; vidx < variants.size(); vidx++)
+    if (0 < variants[vidx].viewers)
+      wanted.push_back(vidx);
+
+  if (wanted.empty())
+    return;
+
+  {
+    std::lock_guard<std::mutex> guard(scale_lock);
+    scale_job.source = source;
+    scale_job.variants.swap(wanted);
+  }
+
+  scale_wanted.notify_one();
+}
+
+
+
+// Sends frames that the scaling thread has finished.
+
+void MJPEGCastServer::CollectScaled()
+{
+  std::vector<std::pair<int, mjpegcast_frame_ptr> > finished;
+  uint64_t wakeups;
+  size_t fidx;
+  ssize_t count;
+
+  count = read(wake_fd, &wakeups, sizeof(wakeups));
+  (void) count;
+
+  {
+    std::lock_guard<std::mutex> guard(scale_lock);
+    finished.swap(scaled);
+  }
+
+  for (fidx = 0; fidx < finished.size(); fidx++)
+  {
+    stats.frames_scaled++;
+    FanOut(finished[fidx].first, finished[fidx].second);
+  }
+}
+
+
+
+// Scaling thread. Variant names and sizes don't change while the server
+// is running, so they're read without locking.
+
+void MJPEGCastServer::RunScaler()
+{
+  scale_job_t job;
+  RGBImage decoded, resized;
+  std::vector<uint8_t> jpeg;
+  mjpegcast_frame_ptr frame;
+  int box_width, box_height;
+  size_t vidx;
+  uint64_t wakeup;
+  ssize_t count;
+
+  while (1)
+  {
+    {
+      std::unique_lock<std::mutex> guard(scale_lock);
+
+      while ( (!scaler_quit) && (NULL == scale_job.source) )
+        scale_wanted.wait(guard);
+
+      if (scaler_quit)
+        break;
+
+      job.source.swap(scale_job.source);
+      job.variants.swap(scale_job.variants);
+      scale_job.source.reset();
+      scale_job.variants.clear();
+    }
+
+    // Decode once, shrunk as far as the largest box allows.
+    box_width = 0;
+    box_height = 0;
+    for (vidx = 0; vidx < job.variants.size(); vidx++)
+    {
+      box_width = std::max(box_width, variants[job.variants[vidx]].box_width);
+      box_height =
+        std::max(box_height, variants[job.variants[vidx]].box_height);
+    }
+
+    if (!DecodeJPEG(job.source->jpeg.data(), job.source->jpeg.size(),
+      box_width, box_height, decoded))
+      continue;
+
+    for (vidx = 0; vidx < job.variants.size(); vidx++)
+    {
+      SampleToFit(decoded, variants[job.variants[vidx]].box_width,
+        variants[job.variants[vidx]].box_height, resized);
+
+      if (EncodeJPEG(resized, quality, jpeg))
+      {
+        frame = MakeMJPEGCastFrame(jpeg);
+
+        std::lock_guard<std::mutex> guard(scale_lock);
+        scaled.push_back(std::make_pair(job.variants[vidx], frame));
+      }
+    }
+
+    wakeup = 1;
+    count = write(wake_fd, &wakeup, sizeof(wakeup));
+    (void) count;
+  }
+}
+
+
+
+//
+// Functions
+
+
+// Wraps JPEG data as a frame.
+
+mjpegcast_frame_ptr MakeMJPEGCastFrame(std::vector<uint8_t> &jpeg)
+{
+  std::shared_ptr<mjpegcast_frame_t> frame;
+  char header[128];
+
+  frame = std::make_shared<mjpegcast_frame_t>();
+  frame->jpeg.swap(jpeg);
+
+  snprintf(header, sizeof(header),
+    "Content-Type: image/jpeg\r\nContent-Length: %zu\r\n\r\n",
+    frame->jpeg.size());
+  frame->header = header;
+
+  return frame;
+}
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,204 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Live MJPEG imagecast server - one frame buffer, many HTTP clients.
+
+
+#ifndef MJPEGCAST_H
+#define MJPEGCAST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+//
+// Macros
+
+// The stream is the same multipart response that NCAM_SendMJPEGFrame()
+// sends (see neurocam-libmjpeg.pl), with a Content-Length for each part.
+#define MJPEGCAST_BOUNDARY "neurocam-boundary"
+
+#define MJPEGCAST_DEFAULT_QUALITY 75
+#define MJPEGCAST_DEFAULT_MAX_CLIENTS 32
+
+// Longest HTTP request we'll wait for before giving up on a client.
+#define MJPEGCAST_MAX_REQUEST_BYTES 4096
+
+// Longest variant name.
+#define MJPEGCAST_MAX_VARIANT_CHARS 32
+
+
+//
+// Types
+
+// One encoded frame, ready to send. Frames are shared by every client
+// that's sending them, and freed when the last one is done.
+
+struct mjpegcast_frame_t
+{
+  // Part header, with this frame's Content-Length.
+  std::string header;
+  std::vector<uint8_t> jpeg;
+};
+
+typedef std::shared_ptr<const mjpegcast_frame_t> mjpegcast_frame_ptr;
+
+// Running totals.
+
+struct mjpegcast_stats_t
+{
+  // Frames handed to the server.
+  uint64_t frames_in;
+  // Scaled frames built for variants.
+  uint64_t frames_scaled;
+  // Frames sent in full to a client (counting each client separately).
+  uint64_t frames_sent;
+  // Frames a client was too slow to get before a newer one replaced them.
+  uint64_t frames_dropped;
+  uint64_t bytes_sent;
+  uint64_t clients_served;
+  int clients_now;
+};
+
+
+//
+// Classes
+
+// Serves the most recent frame to any number of HTTP clients.
+//
+// Each frame is held once in memory and sent to each client with
+// scatter-gather writes, straight from the shared buffer. Sockets are
+// non-blocking, so a slow client never holds up the others: each client
+// has the frame it's sending and at most one frame waiting after it, and
+// a newer frame replaces the waiting one.
+//
+// Clients pick a stream by path. "/<variant>" or "/<variant>/..." gets
+// that variant, scaled to fit its box; anything else gets frames as they
+// were published. Variants are scaled on a worker thread, only while
+// someone is watching them, and each frame is scaled once no matter how
+// many clients are watching.
+
+class MJPEGCastServer
+{
+public:
+  MJPEGCastServer();
+  ~MJPEGCastServer();
+
+  // Adds a pre-scaled stream. This must be called before Start().
+  // Returns false if the name or size isn't usable.
+  bool AddVariant(const std::string &name, int box_width, int box_height);
+
+  // JPEG quality (1..100) for scaled variants. This must be called before
+  // Start().
+  void SetQuality(int new_quality);
+
+  void SetMaxClients(int new_max_clients);
+
+  // Starts listening on a TCP port. Returns false on failure.
+  bool Start(int port);
+
+  // Disconnects all clients and stops listening.
+  void Stop();
+
+  // Adds a descriptor (e.g. stdin) for Poll() to wait on along with the
+  // sockets.
+  bool AddInput(int fd);
+
+  // Waits up to timeout_ms (-1 for no limit) for something to happen and
+  // handles it. Inputs that became readable are listed in ready_inputs.
+  // Returns false if waiting failed.
+  bool Poll(int timeout_ms, std::vector<int> &ready_inputs);
+
+  // Sends a frame to all clients. The data is moved into the frame.
+  void Publish(std::vector<uint8_t> &jpeg);
+
+  // Reads a JPEG file and sends it to all clients. Returns false if the
+  // file couldn't be read or isn't a JPEG.
+  bool PublishFile(const char *path);
+
+  mjpegcast_stats_t GetStats() const
+  {
+    return stats;
+  }
+
+protected:
+  // One stream: the frames as published (index 0), or one variant.
+  struct variant_t
+  {
+    std::string name;
+    int box_width;
+    int box_height;
+    mjpegcast_frame_ptr latest;
+    int viewers;
+  };
+
+  struct client_t
+  {
+    int fd;
+    int variant;
+    bool streaming;
+    bool want_write;
+    std::string request;
+    // Response header not yet sent.
+    std::string preamble;
+    size_t preamble_sent;
+    mjpegcast_frame_ptr current;
+    size_t current_sent;
+    mjpegcast_frame_ptr pending;
+  };
+
+  // A frame waiting to be scaled for the variants that want it.
+  struct scale_job_t
+  {
+    mjpegcast_frame_ptr source;
+    std::vector<int> variants;
+  };
+
+  void AcceptClients();
+  bool ReadClient(client_t &client);
+  bool StartStreaming(client_t &client);
+  void CloseClient(int fd);
+  void QueueFrame(client_t &client, const mjpegcast_frame_ptr &frame);
+  bool SendToClient(client_t &client);
+  void SetWantWrite(client_t &client, bool want_write);
+  void FanOut(int variant, const mjpegcast_frame_ptr &frame);
+  void RequestScaling(const mjpegcast_frame_ptr &source);
+  void CollectScaled();
+  void RunScaler();
+
+  std::vector<variant_t> variants;
+  std::map<int, client_t> clients;
+  std::vector<int> inputs;
+  int listen_fd;
+  int epoll_fd;
+  int wake_fd;
+  int quality;
+  int max_clients;
+  mjpegcast_stats_t stats;
+
+  // Shared with the scaling thread.
+  std::thread scaler;
+  std::mutex scale_lock;
+  std::condition_variable scale_wanted;
+  scale_job_t scale_job;
+  std::vector<std::pair<int, mjpegcast_frame_ptr> > scaled;
+  bool scaler_quit;
+};
+
+
+//
+// Functions
+
+// Wraps JPEG data as a frame. The data is moved into the frame.
+mjpegcast_frame_ptr MakeMJPEGCastFrame(std::vector<uint8_t> &jpeg);
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,359 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Composite frame builder - command-line front end.
+
+
+//
+// Includes
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "compositor.h"
+#include "workpool.h"
+
+
+//
+// Private macros
+
+// Default font; this is what ImageMagick normally falls back to as well.
+#define COMPOSITE_DEFAULT_FONT "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"
+
+#define COMPOSITE_DEFAULT_QUALITY 92
+
+
+//
+// Private types
+
+// Tracks which frames are finished, so that log lines and progress
+// reports come out in order even though frames finish out of order.
+
+struct progress_t
+{
+  std::mutex lock;
+  std::vector<bool> done;
+  size_t frontier;
+
+  int sockfd;
+  struct sockaddr_in target;
+};
+
+
+//
+// Private prototypes
+
+static void PrintHelp(void);
+static bool ParseSize(const char *text, char separator, int &first,
+  int &second);
+static bool ParseSlot(const char *text, CompositeSlot &slot);
+static bool OpenProgressSocket(const char *text, progress_t &progress);
+static void NoteFrameDone(progress_t &progress, const CompositePlan &plan,
+  size_t fidx);
+
+
+
+//
+// Functions
+
+
+// Prints a help screen.
+
+static void PrintHelp(void)
+{
+  printf(
+"Builds the composite-view frames for a repository from its timed log.\n"
+"\n"
+"Usage:  ncam-composite [options] <repository folder>\n"
+"\n"
+"Options:\n"
+"  --log=<file>          Log to read (default: <folder>/logfile-timed.txt,\n"
+"                        or <folder>/logfile.txt if that doesn't exist).\n"
+"  --size=<w>x<h>        Composite size (default 1280x960).\n"
+"  --tile=<w>x<h>        Box each feed is scaled to fit (default 640x320).\n"
+"  --step=<dx>,<dy>      Slot spacing (default 640,320).\n"
+"  --offset=<x>,<y>      Offset of slot (0,0) (default 0,0).\n"
+"  --fontsize=<n>        Label size; captions are twice this (default 20).\n"
+"  --font=<file>         TrueType font for labels and captions.\n"
+"  --slot=<feed>:<x>:<y>:<label>\n"
+"                        Places a feed. The first of these replaces the\n"
+"                        default 2x3 layout.\n"
+"  --quality=<n>         JPEG quality (default %d).\n"
+"  --progress=<ip>:<port>\n"
+"                        Sends \"progress <n>/<max>\" datagrams there.\n"
+"  --threads=<n>         Worker threads (default: one per core).\n"
+"  --exact-decode        Decode frames at full size (slower; default shrinks\n"
+"                        frames in the JPEG decoder before sampling).\n"
+"\n"
+"Frames are written to <folder>/Composite/, which must exist. Log lines\n"
+"for them are printed in order:\n"
+"  (<time>) [Composite]  frame <n>  Composite/<n>.jpg\n"
+"The frame schedule follows NCAM_BuildCompositeFrames() exactly.\n"
+"\n", COMPOSITE_DEFAULT_QUALITY);
+}
+
+
+
+// Parses "<first><separator><second>", with positive values.
+
+static bool ParseSize(const char *text, char separator, int &first,
+  int &second)
+{
+  char *end;
+
+  first = strtol(text, &end, 10);
+  if (separator != *end)
+    return false;
+
+  second = strtol(end + 1, &end, 10);
+  if (0 != *end)
+    return false;
+
+  return true;
+}
+
+
+
+// Parses "<feed>:<x>:<y>:<label>".
+
+static bool ParseSlot(const char *text, CompositeSlot &slot)
+{
+  const char *colon;
+  char *end;
+
+  colon = strchr(text, ':');
+  if ( (NULL == colon) || (text == colon) )
+    return false;
+  slot.name.assign(text, colon - text);
+
+  slot.x = strtol(colon + 1, &end, 10);
+  if (':' != *end)
+    return false;
+
+  slot.y = strtol(end + 1, &end, 10);
+  if (':' != *end)
+    return false;
+
+  slot.label = end + 1;
+
+  return true;
+}
+
+
+
+// Sets up progress reports to "<ip>:<port>".
+
+static bool OpenProgressSocket(const char *text, progress_t &progress)
+{
+  const char *colon;
+  std::string address;
+
+  colon = strrchr(text, ':');
+  if (NULL == colon)
+    return false;
+
+  address.assign(text, colon - text);
+
+  memset(&progress.target, 0, sizeof(progress.target));
+  progress.target.sin_family = AF_INET;
+  progress.target.sin_port = htons(atoi(colon + 1));
+  if (1 != inet_pton(AF_INET, address.c_str(), &progress.target.sin_addr))
+    return false;
+
+  progress.sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+
+  return (0 <= progress.sockfd);
+}
+
+
+
+// Records a finished frame, and reports any frames that are now in order.
+
+static void NoteFrameDone(progress_t &progress, const CompositePlan &plan,
+  size_t fidx)
+{
+  const CompositeFrame *frame;
+  char message[64];
+  size_t oldfrontier;
+
+  std::lock_guard<std::mutex> guard(progress.lock);
+
+  progress.done[fidx] = true;
+  oldfrontier = progress.frontier;
+
+  while ( (progress.frontier < progress.done.size())
+    && progress.done[progress.frontier] )
+  {
+    frame = &(plan.frames[progress.frontier]);
+    printf("(%.0f) [Composite]  frame %lu  Composite/%08lu.jpg\n",
+      frame->time, frame->number, frame->number);
+    progress.frontier++;
+  }
+
+  if ( (oldfrontier != progress.frontier) && (0 <= progress.sockfd) )
+  {
+    frame = &(plan.frames[progress.frontier - 1]);
+    snprintf(message, sizeof(message), "progress %lu/%lu", frame->number,
+      plan.frame_max);
+    sendto(progress.sockfd, message, strlen(message), 0,
+      (const struct sockaddr *) &progress.target, sizeof(progress.target));
+  }
+}
+
+
+
+// Main program.
+
+int main(int argc, char **argv)
+{
+  CompositeLayout layout;
+  CompositePlan plan;
+  CompositeSlot slot;
+  TextRenderer labelfont, captionfont;
+  progress_t progress;
+  std::string repodir, logname, fontname;
+  unsigned workers;
+  int quality, aidx;
+  bool fast, have_slots, is_ok;
+
+  fontname = COMPOSITE_DEFAULT_FONT;
+  quality = COMPOSITE_DEFAULT_QUALITY;
+  workers = GetDefaultWorkerCount();
+  fast = true;
+  have_slots = false;
+  progress.sockfd = -1;
+  progress.frontier = 0;
+  is_ok = true;
+
+  for (aidx = 1; is_ok && (aidx < argc); aidx++)
+  {
+    if (0 == strncmp(argv[aidx], "--log=", 6))
+      logname = argv[aidx] + 6;
+    else if (0 == strncmp(argv[aidx], "--size=", 7))
+      is_ok = ParseSize(argv[aidx] + 7, 'x', layout.width, layout.height);
+    else if (0 == strncmp(argv[aidx], "--tile=", 7))
+      is_ok = ParseSize(argv[aidx] + 7, 'x', layout.tile_width,
+        layout.tile_height);
+    else if (0 == strncmp(argv[aidx], "--step=", 7))
+      is_ok = ParseSize(argv[aidx] + 7, ',', layout.step_x, layout.step_y);
+    else if (0 == strncmp(argv[aidx], "--offset=", 9))
+      is_ok = ParseSize(argv[aidx] + 9, ',', layout.offset_x,
+        layout.offset_y);
+    else if (0 == strncmp(argv[aidx], "--fontsize=", 11))
+      layout.fontsize = atoi(argv[aidx] + 11);
+    else if (0 == strncmp(argv[aidx], "--font=", 7))
+      fontname = argv[aidx] + 7;
+    else if (0 == strncmp(argv[aidx], "--slot=", 7))
+    {
+      if (!have_slots)
+        layout.slots.clear();
+      have_slots = true;
+
+      is_ok = ParseSlot(argv[aidx] + 7, slot);
+      if (is_ok)
+        layout.slots.push_back(slot);
+    }
+    else if (0 == strncmp(argv[aidx], "--quality=", 10))
+      quality = atoi(argv[aidx] + 10);
+    else if (0 == strncmp(argv[aidx], "--progress=", 11))
+      is_ok = OpenProgressSocket(argv[aidx] + 11, progress);
+    else if (0 == strncmp(argv[aidx], "--threads=", 10))
+      workers = atoi(argv[aidx] + 10);
+    else if (0 == strcmp(argv[aidx], "--exact-decode"))
+      fast = false;
+    else if ('-' == argv[aidx][0])
+      is_ok = false;
+    else
+      repodir = argv[aidx];
+  }
+
+  if ( (!is_ok) || repodir.empty()
+    || (1 > layout.width) || (1 > layout.height)
+    || (1 > layout.tile_width) || (1 > layout.tile_height)
+    || (1 > layout.fontsize) || (1 > quality) || (100 < quality) )
+  {
+    PrintHelp();
+    return 2;
+  }
+
+  if (1 > workers)
+    workers = 1;
+
+  if (logname.empty())
+  {
+    logname = repodir + "/logfile-timed.txt";
+    if (0 != access(logname.c_str(), F_OK))
+      logname = repodir + "/logfile.txt";
+  }
+
+  // ImageMagick's default stroke is one pixel wide.
+  if ( !( labelfont.Load(fontname.c_str(), layout.fontsize, 1)
+    && captionfont.Load(fontname.c_str(), 2 * layout.fontsize, 1) ) )
+  {
+    fprintf(stderr, "### Unable to load font \"%s\".\n", fontname.c_str());
+    return 2;
+  }
+
+  // Remember that the period is in milliseconds, not seconds.
+  if (!BuildCompositePlan(logname, repodir, layout, 1000.0 / 30, plan))
+  {
+    fprintf(stderr, "### Unable to read \"%s\".\n", logname.c_str());
+    return 2;
+  }
+
+  progress.done.assign(plan.frames.size(), false);
+
+  TileCache cache(plan, layout, labelfont, fast);
+
+  RunParallel(plan.frames.size(), workers,
+    [&plan, &layout, &cache, &captionfont, &progress, &repodir, quality]
+    (size_t fidx)
+    {
+      const CompositeFrame &frame = plan.frames[fidx];
+      std::vector< std::shared_ptr<const RGBImage> > tiles;
+      RGBImage image;
+      char caption[32];
+      char filename[32];
+      size_t slot;
+
+      tiles.resize(frame.sources.size());
+      for (slot = 0; slot < frame.sources.size(); slot++)
+        if (0 <= frame.sources[slot])
+          tiles[slot] = cache.Acquire(frame.sources[slot]);
+
+      snprintf(caption, sizeof(caption), "%.0f ms", frame.time);
+      AssembleCompositeFrame(layout, tiles, captionfont, caption, image);
+
+      // Let go of tiles as soon as we can, so memory stays bounded.
+      for (slot = 0; slot < frame.sources.size(); slot++)
+        if (0 <= frame.sources[slot])
+          cache.Release(frame.sources[slot]);
+      tiles.clear();
+
+      snprintf(filename, sizeof(filename), "/Composite/%08lu.jpg",
+        frame.number);
+      if (!WriteJPEG((repodir + filename).c_str(), image, quality))
+        fprintf(stderr, "-- Can't write \"%s%s\".\n", repodir.c_str(),
+          filename);
+
+      NoteFrameDone(progress, plan, fidx);
+    });
+
+  fprintf(stderr, "-- %lu frames from %lu decodes.\n",
+    (unsigned long) plan.frames.size(), cache.DecodeCount());
+
+  if (0 <= progress.sockfd)
+    close(progress.sockfd);
+
+  return 0;
+}
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,441 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO event bus - listing, live viewing, and benchmarking.
+
+
+//
+// Includes
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gpiobus.h"
+#include "virtualdev.h"
+
+
+//
+// Private macros
+
+// Time to sleep between polls when there's nothing to read.
+#define FOLLOW_IDLE_US 200
+
+
+//
+// Private types
+
+// One benchmark reader's results.
+struct bench_reader_t
+{
+  std::vector<uint32_t> latencies_ns;
+  uint64_t received;
+  uint64_t lost;
+};
+
+
+//
+// Private variables
+
+static volatile sig_atomic_t stop_requested = 0;
+
+
+//
+// Private prototypes
+
+static void PrintHelp(void);
+static void HandleStopSignal(int signum);
+static bool SplitLabels(const char *text, std::vector<std::string> &labels);
+static int ListBuses(void);
+static int FollowBuses(const std::vector<std::string> &labels,
+  bool from_oldest, uint64_t max_count);
+static void RunBenchReader(const std::string &label,
+  const std::atomic<bool> &writer_done, bench_reader_t &results);
+static int RunBenchmark(uint64_t event_count, int reader_count, double rate);
+
+
+
+//
+// Functions
+
+
+// Prints a help screen.
+
+static void PrintHelp(void)
+{
+  printf(
+"Lists, watches, or benchmarks the shared-memory GPIO event buses that the\n"
+"GPIO monitor publishes to.\n"
+"\n"
+"Usage:  ncam-gpiobus --list\n"
+"        ncam-gpiobus --follow=<label>[,<label>...] [options]\n"
+"        ncam-gpiobus --bench [options]\n"
+"\n"
+"Options:\n"
+"  --from-oldest   (follow) Start at the oldest record still in the ring,\n"
+"                  rather than the next new one.\n"
+"  --count=<n>     (follow) Stop after this many records.\n"
+"  --events=<n>    (bench) Records to publish (default 1000000).\n"
+"  --readers=<n>   (bench) Reader threads (default 2).\n"
+"  --rate=<n>      (bench) Records per second (default 0 = flat out).\n"
+"\n"
+"\"--list\" prints one line per bus:\n"
+"  bus <label> capacity <n> newest <sequence> writer <running|gone>\n"
+"\"--follow\" prints records the way they appear in \"logfile.txt\", with\n"
+"the monitor's time in microseconds:\n"
+"  (<time>) MSG gpio <label> <reg>: <hex> [<device tick>]\n"
+"Lost records are reported on stderr.\n"
+"\"--bench\" publishes from a native writer to a temporary bus and prints\n"
+"\"key: value\" lines: publish cost per record, and per reader the\n"
+"records seen, records lost, and p50/p99/maximum publish-to-read latency.\n"
+"\n");
+}
+
+
+
+// Signal handler for SIGINT and SIGTERM.
+
+static void HandleStopSignal(int signum)
+{
+  stop_requested = 1;
+}
+
+
+
+// Splits a comma-separated list of labels.
+
+static bool SplitLabels(const char *text, std::vector<std::string> &labels)
+{
+  const char *comma;
+
+  labels.clear();
+
+  while (0 != *text)
+  {
+    comma = strchr(text, ',');
+    if (NULL == comma)
+      comma = text + strlen(text);
+
+    if (comma > text)
+      labels.push_back(std::string(text, comma - text));
+
+    text = (0 == *comma) ? comma : (comma + 1);
+  }
+
+  return !labels.empty();
+}
+
+
+
+// Prints a line for each bus.
+
+static int ListBuses(void)
+{
+  std::vector<std::string> labels;
+  GPIOBusReader reader;
+  size_t lidx;
+
+  labels = ListGPIOBuses();
+  std::sort(labels.begin(), labels.end());
+
+  for (lidx = 0; lidx < labels.size(); lidx++)
+  {
+    if (!reader.Open(labels[lidx]))
+    {
+      fprintf(stderr, "### Couldn't read the bus for \"%s\".\n",
+        labels[lidx].c_str());
+      continue;
+    }
+
+    printf("bus %s capacity %lu newest %llu writer %s\n",
+      labels[lidx].c_str(), (unsigned long) reader.Capacity(),
+      (unsigned long long) (reader.NextSequence() - 1),
+      reader.WriterAlive() ? "running" : "gone");
+
+    reader.Close();
+  }
+
+  return 0;
+}
+
+
+
+// Prints records from one or more buses as they arrive.
+
+static int FollowBuses(const std::vector<std::string> &labels,
+  bool from_oldest, uint64_t max_count)
+{
+  std::vector<GPIOBusReader> readers(labels.size());
+  std::vector<uint64_t> reported_lost(labels.size(), 0);
+  gpiobus_record_t record;
+  uint64_t count;
+  size_t lidx;
+  int digits;
+  bool got_any;
+
+  for (lidx = 0; lidx < labels.size(); lidx++)
+    if (!readers[lidx].Open(labels[lidx], from_oldest))
+    {
+      fprintf(stderr, "### Couldn't open the bus for \"%s\".\n",
+        labels[lidx].c_str());
+      return 1;
+    }
+
+  count = 0;
+
+  while ( (!stop_requested) && ( (0 == max_count) || (count < max_count) ) )
+  {
+    got_any = false;
+
+    for (lidx = 0; lidx < readers.size(); lidx++)
+    {
+      while ( ( (0 == max_count) || (count < max_count) )
+        && readers[lidx].Next(record) )
+      {
+        got_any = true;
+        count++;
+
+        digits = record.flags >> GPIOBUS_FLAG_DIGITS_SHIFT;
+        printf("(%lld) MSG gpio %s %c: %0*x", (long long) record.host_time_us,
+          labels[lidx].c_str(), record.reg, (0 < digits) ? digits : 2,
+          record.value);
+        if (record.flags & GPIOBUS_FLAG_HAS_TICK)
+          printf(" %llu", (unsigned long long) GetGPIOBusTick(record));
+        printf("\n");
+      }
+
+      if (readers[lidx].Lost() != reported_lost[lidx])
+      {
+        fprintf(stderr, "-- Lost %llu records from \"%s\".\n",
+          (unsigned long long) (readers[lidx].Lost() - reported_lost[lidx]),
+          labels[lidx].c_str());
+        reported_lost[lidx] = readers[lidx].Lost();
+      }
+    }
+
+    // Only idle polls cost a system call.
+    if (got_any)
+      fflush(stdout);
+    else
+      usleep(FOLLOW_IDLE_US);
+  }
+
+  return 0;
+}
+
+
+
+// Reads benchmark records as fast as they come, noting their latency.
+// The writer puts its CLOCK_MONOTONIC publish time in the tick and value
+// fields.
+
+static void RunBenchReader(const std::string &label,
+  const std::atomic<bool> &writer_done, bench_reader_t &results)
+{
+  GPIOBusReader reader;
+  gpiobus_record_t record;
+  uint64_t sent_ns;
+  bool finished, got_any;
+
+  results.received = 0;
+  results.lost = 0;
+
+  if (!reader.Open(label, true))
+    return;
+
+  finished = false;
+  while (!finished)
+  {
+    // One last sweep after the writer stops.
+    finished = writer_done.load(std::memory_order_acquire);
+
+    got_any = false;
+    while (reader.Next(record))
+    {
+      got_any = true;
+      sent_ns = (((uint64_t) record.value) << 32) | record.device_tick;
+      results.latencies_ns.push_back(
+        (uint32_t) std::min<uint64_t>(GetMonotonicNanos() - sent_ns,
+        0xffffffffull));
+      results.received++;
+    }
+
+    // Spinning without yielding would starve the writer on a machine with
+    // fewer cores than threads.
+    if (!got_any)
+      std::this_thread::yield();
+  }
+
+  results.lost = reader.Lost();
+}
+
+
+
+// Publishes records to a temporary bus while threads read them.
+
+static int RunBenchmark(uint64_t event_count, int reader_count, double rate)
+{
+  GPIOBusWriter writer;
+  gpiobus_record_t record;
+  std::vector<bench_reader_t> results(reader_count);
+  std::vector<std::thread> threads;
+  std::atomic<bool> writer_done;
+  std::vector<uint32_t> *latencies;
+  std::string label;
+  uint64_t start_ns, end_ns, now_ns, eidx;
+  size_t rank;
+  int ridx;
+  char scratch[32];
+
+  snprintf(scratch, sizeof(scratch), "bench%d", (int) getpid());
+  label = scratch;
+
+  if (!writer.Open(label))
+  {
+    fprintf(stderr, "### Couldn't create a bus in \"%s\".\n", GPIOBUS_DIR);
+    return 1;
+  }
+
+  writer_done.store(false);
+  for (ridx = 0; ridx < reader_count; ridx++)
+  {
+    results[ridx].latencies_ns.reserve(event_count);
+    threads.push_back(std::thread(RunBenchReader, label,
+      std::cref(writer_done), std::ref(results[ridx])));
+  }
+
+  // Give the readers a moment to map the bus.
+  usleep(100000);
+
+  memset(&record, 0, sizeof(record));
+  record.reg = 'I';
+  record.flags = GPIOBUS_FLAG_HAS_TICK | (8 << GPIOBUS_FLAG_DIGITS_SHIFT);
+
+  start_ns = GetMonotonicNanos();
+
+  for (eidx = 0; eidx < event_count; eidx++)
+  {
+    if (0 < rate)
+      SleepUntilNanos(start_ns + (uint64_t) (eidx * (1.0e9 / rate)));
+
+    now_ns = GetMonotonicNanos();
+    record.host_time_us = (int64_t) (now_ns / 1000);
+    record.device_tick = (uint32_t) now_ns;
+    record.value = (uint32_t) (now_ns >> 32);
+    writer.Publish(record);
+  }
+
+  end_ns = GetMonotonicNanos();
+
+  writer_done.store(true, std::memory_order_release);
+  for (ridx = 0; ridx < reader_count; ridx++)
+    threads[ridx].join();
+
+  writer.Close();
+  GPIOBusWriter::Remove(label);
+
+  printf("events: %llu\n", (unsigned long long) event_count);
+  printf("readers: %d\n", reader_count);
+  printf("rate: %g\n", rate);
+  // Flat out, this is mostly the cost of publishing; paced, it includes
+  // the sleeps.
+  printf("publish_ns_per_event: %.1f\n",
+    ((double) (end_ns - start_ns)) / ((0 < event_count) ? event_count : 1));
+
+  for (ridx = 0; ridx < reader_count; ridx++)
+  {
+    latencies = &results[ridx].latencies_ns;
+    std::sort(latencies->begin(), latencies->end());
+
+    printf("reader_%d: received %llu lost %llu", ridx,
+      (unsigned long long) results[ridx].received,
+      (unsigned long long) results[ridx].lost);
+
+    if (!latencies->empty())
+    {
+      // Nearest-rank percentiles.
+      rank = (latencies->size() * 50 + 99) / 100;
+      printf(" p50_us %.2f",
+        (*latencies)[(0 < rank) ? (rank - 1) : 0] / 1000.0);
+      rank = (latencies->size() * 99 + 99) / 100;
+      printf(" p99_us %.2f",
+        (*latencies)[(0 < rank) ? (rank - 1) : 0] / 1000.0);
+      printf(" max_us %.2f", latencies->back() / 1000.0);
+    }
+
+    printf("\n");
+  }
+
+  return 0;
+}
+
+
+
+// Main program.
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> labels;
+  uint64_t max_count, event_count;
+  int reader_count;
+  double rate;
+  bool want_list, want_bench, from_oldest, is_ok;
+  int aidx;
+
+  max_count = 0;
+  event_count = 1000000;
+  reader_count = 2;
+  rate = 0;
+  want_list = false;
+  want_bench = false;
+  from_oldest = false;
+  is_ok = true;
+
+  for (aidx = 1; is_ok && (aidx < argc); aidx++)
+  {
+    if (0 == strcmp(argv[aidx], "--list"))
+      want_list = true;
+    else if (0 == strncmp(argv[aidx], "--follow=", 9))
+      is_ok = SplitLabels(argv[aidx] + 9, labels);
+    else if (0 == strcmp(argv[aidx], "--from-oldest"))
+      from_oldest = true;
+    else if (0 == strncmp(argv[aidx], "--count=", 8))
+      max_count = strtoull(argv[aidx] + 8, NULL, 10);
+    else if (0 == strcmp(argv[aidx], "--bench"))
+      want_bench = true;
+    else if (0 == strncmp(argv[aidx], "--events=", 9))
+      event_count = strtoull(argv[aidx] + 9, NULL, 10);
+    else if (0 == strncmp(argv[aidx], "--readers=", 10))
+      reader_count = atoi(argv[aidx] + 10);
+    else if (0 == strncmp(argv[aidx], "--rate=", 7))
+      rate = atof(argv[aidx] + 7);
+    else
+      is_ok = false;
+  }
+
+  if ( is_ok && (1 <= reader_count)
+    && (1 == ((want_list ? 1 : 0) + (want_bench ? 1 : 0)
+      + (labels.empty() ? 0 : 1))) )
+  {
+    signal(SIGINT, HandleStopSignal);
+    signal(SIGTERM, HandleStopSignal);
+
+    if (want_list)
+      return ListBuses();
+    if (want_bench)
+      return RunBenchmark(event_count, reader_count, rate);
+    return FollowBuses(labels, from_oldest, max_count);
+  }
+
+  PrintHelp();
+  return 1;
+}
+
+
+//
+// This is the end of the file.
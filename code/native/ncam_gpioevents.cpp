@@ -0,0 +1,140 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Binary GPIO event log - command-line extractor.
+
+
+//
+// Includes
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "gpioevlog.h"
+
+
+//
+// Private prototypes
+
+static void PrintHelp(void);
+
+
+
+//
+// Functions
+
+
+// Prints a help screen.
+
+static void PrintHelp(void)
+{
+  printf(
+"Prints events from a session's binary GPIO event log.\n"
+"\n"
+"Usage:  ncam-gpioevents [options] <gpioevents.bin>\n"
+"\n"
+"Options:\n"
+"  --from=<ms>       First time to print (log milliseconds; inclusive).\n"
+"  --to=<ms>         Last time to print (exclusive).\n"
+"  --device=<label>  Only print events from this device.\n"
+"  --reg=<I|O|U>     Only print this register.\n"
+"  --count           Print the number of matching events, not the events.\n"
+"\n"
+"Events are printed the way they appear in \"logfile.txt\":\n"
+"  (<time>) MSG gpio <label> <reg>: <hex> [<device tick>]\n"
+"Only the records in the requested time range are read.\n"
+"\n");
+}
+
+
+
+// Main program.
+
+int main(int argc, char **argv)
+{
+  GPIOEventLogReader reader;
+  std::string path, device;
+  int64_t first_ms, last_ms;
+  size_t first, last, ridx, matches;
+  char reg;
+  bool count_only;
+  int aidx;
+
+  first_ms = INT64_MIN;
+  last_ms = INT64_MAX;
+  reg = 0;
+  count_only = false;
+
+  for (aidx = 1; aidx < argc; aidx++)
+  {
+    if (0 == strncmp(argv[aidx], "--from=", 7))
+      first_ms = strtoll(argv[aidx] + 7, NULL, 10);
+    else if (0 == strncmp(argv[aidx], "--to=", 5))
+      last_ms = strtoll(argv[aidx] + 5, NULL, 10);
+    else if (0 == strncmp(argv[aidx], "--device=", 9))
+      device = argv[aidx] + 9;
+    else if (0 == strncmp(argv[aidx], "--reg=", 6))
+      reg = argv[aidx][6];
+    else if (0 == strcmp(argv[aidx], "--count"))
+      count_only = true;
+    else if ('-' == argv[aidx][0])
+    {
+      PrintHelp();
+      return 2;
+    }
+    else
+      path = argv[aidx];
+  }
+
+  if (path.empty())
+  {
+    PrintHelp();
+    return 2;
+  }
+
+  if (!reader.Open(path))
+  {
+    fprintf(stderr, "### Unable to read \"%s\".\n", path.c_str());
+    return 2;
+  }
+
+  // Labels are stored truncated, so match them that way.
+  if (GPIOEVLOG_DEVICE_CHARS < device.size())
+    device.resize(GPIOEVLOG_DEVICE_CHARS);
+
+  reader.FindRange(first_ms, last_ms, first, last);
+
+  matches = 0;
+  for (ridx = first; ridx < last; ridx++)
+  {
+    const gpioevlog_record_t &record = reader.Record(ridx);
+
+    if ( (0 != reg) && (reg != record.reg) )
+      continue;
+    if ( (!device.empty()) && (device != GetGPIOEventDevice(record)) )
+      continue;
+
+    matches++;
+
+    if (count_only)
+      continue;
+
+    printf("(%lld) MSG gpio %s %c: %02x", (long long) record.host_time_ms,
+      GetGPIOEventDevice(record).c_str(), record.reg,
+      (unsigned) record.value);
+
+    if (GPIOEVLOG_FLAG_HAS_TICK & record.flags)
+      printf(" %llu", (unsigned long long) GetGPIOEventTick(record));
+
+    printf("\n");
+  }
+
+  if (count_only)
+    printf("%lu\n", (unsigned long) matches);
+
+  return 0;
+}
+
+
+//
+// This is the end of the file.
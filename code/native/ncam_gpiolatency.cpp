@@ -0,0 +1,813 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO edge-to-event latency benchmark.
+
+
+//
+// Includes
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gpiolink.h"
+#include "virtualdev.h"
+
+
+//
+// Private macros
+
+// Device label used in relayed "MSG gpio" packets.
+#define LATENCY_LABEL "bench"
+
+// Time allowed after the last edge for stragglers, in milliseconds.
+#define LATENCY_SETTLE_MS 500
+
+// How long to wait between rates, for the link to go quiet.
+#define LATENCY_QUIET_MS 200
+
+// Fewest edges tried at any rate.
+#define LATENCY_MIN_EDGES 20
+
+// Descriptor a native device program reads input states from.
+#define LATENCY_NATIVE_INPUT_FD 3
+
+
+//
+// Private types
+
+// Times for one injected edge (0 = never seen).
+
+struct edge_t
+{
+  uint64_t sent_ns;
+  uint64_t link_ns;
+  uint64_t packet_ns;
+};
+
+// Latency figures for one stage, in microseconds.
+
+struct stage_stats_t
+{
+  size_t count;
+  double p50_us, p99_us, max_us;
+};
+
+// One rate's run. The monitor thread fills in link times, and the
+// receiver thread fills in packet times.
+
+struct run_t
+{
+  double rate;
+  std::vector<edge_t> edges;
+
+  std::atomic<size_t> sent;
+  std::atomic<bool> stop;
+
+  // Monitor's matching state.
+  long last_matched;
+};
+
+struct options_t
+{
+  std::string device;
+  std::string command;
+  int native_input_fd;
+  uint32_t baud;
+  int input_bit, output_bit;
+  VirtualDeviceParams virtual_params;
+  std::vector<double> rates;
+  double seconds;
+  double loss_limit;
+};
+
+
+//
+// Private prototypes
+
+static void PrintHelp(void);
+static bool ParseRateList(const char *text, std::vector<double> &rates);
+static int OpenReceiver(struct sockaddr_in &address);
+static pid_t SpawnNativeDevice(const std::string &command, int &link_fd,
+  int &input_fd);
+static bool SetNativeInputs(int input_fd, uint32_t bits);
+static void RunMonitor(gpiolink_t *link, run_t &run, int sockfd,
+  const struct sockaddr_in &target,
+  const std::function<long(const gpiolink_event_t &, run_t &)> &match);
+static void RunReceiver(int sockfd, run_t &run);
+static long MatchVirtualEvent(const gpiolink_event_t &event, run_t &run);
+static long MatchLoopbackEvent(const gpiolink_event_t &event, run_t &run,
+  int input_bit);
+static void GetStageStats(const run_t &run, bool packet,
+  stage_stats_t &stats);
+static bool RunOneRate(const options_t &options, gpiolink_t *device_link,
+  run_t &run);
+static void PrintRunReport(const run_t &run);
+
+
+
+//
+// Functions
+
+
+// Prints a help screen.
+
+static void PrintHelp(void)
+{
+  printf(
+"Measures how long a GPIO input edge takes to become a parsed link event\n"
+"and a \"MSG gpio\" packet, sweeping the edge rate until edges are lost.\n"
+"\n"
+"Usage:  ncam-gpiolatency [options]\n"
+"\n"
+"Options:\n"
+"  --device=<tty>     Use a real GPIO device, with an output looped back to\n"
+"                     an input. Edges are made with \"WRO\".\n"
+"  --exec=<cmd>       Run the host-native firmware build (ncam_gpio_native)\n"
+"                     and set its simulated inputs through --input-fd.\n"
+"                     Without --device or --exec, a simulated device (a\n"
+"                     model of the report loop, not firmware) is used.\n"
+"  --baud=<n>         Serial rate (default 500000; 0 = USB, unpaced).\n"
+"  --output-bit=<n>   (device) Output bit to toggle (default 0).\n"
+"  --input-bit=<n>    (device, exec) Input bit to watch (default 0).\n"
+"  --poll-us=<n>      (simulated) Firmware main loop period (default 50).\n"
+"  --tx-queue=<n>     (simulated) Transmit queue bytes (default 64).\n"
+"  --rates=<a,b,...>  Edge rates to try, per second, in increasing order.\n"
+"  --seconds=<x>      Time spent at each rate (default 2).\n"
+"  --loss-limit=<x>   Stop after the first rate losing more than this\n"
+"                     fraction of edges (default 0.001).\n"
+"\n"
+"The report is one \"key: value\" line per setting, then per rate:\n"
+"  rate <per sec> edges <n> reported <n> lost <n> loss <fraction>\n"
+"    link_p50_us <x> link_p99_us <x> link_max_us <x>\n"
+"    packet_p50_us <x> packet_p99_us <x> packet_max_us <x>\n"
+"(all on one line), and finally \"loss_onset_rate: <rate | none>\".\n"
+"\"link\" is edge to parsed event (libgpiolink); \"packet\" adds the relay\n"
+"hop to a daemon-side UDP socket. The relay is this program's stand-in for\n"
+"the GPIO monitor, not the monitor itself, so \"relay: simulated\" is always\n"
+"reported. With a real device, edge times are when \"WRO\" was written, so\n"
+"they include the command's trip to the device. With --exec, they're when\n"
+"the input state was written; the link is a socket, so it isn't paced.\n"
+"\n");
+}
+
+
+
+// Parses a comma-separated list of rates.
+
+static bool ParseRateList(const char *text, std::vector<double> &rates)
+{
+  char *end;
+  double rate;
+
+  rates.clear();
+
+  while (0 != *text)
+  {
+    rate = strtod(text, &end);
+    if ( (end == text) || (!(0 < rate)) )
+      return false;
+
+    rates.push_back(rate);
+
+    text = end;
+    if (',' == *text)
+      text++;
+    else if (0 != *text)
+      return false;
+  }
+
+  return (!rates.empty());
+}
+
+
+
+// Opens the daemon-side socket on the loopback interface.
+// Returns the descriptor, or -1.
+
+static int OpenReceiver(struct sockaddr_in &address)
+{
+  int sockfd;
+  socklen_t length;
+
+  sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (0 > sockfd)
+    return -1;
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+
+  length = sizeof(address);
+  if ( (0 != bind(sockfd, (struct sockaddr *) &address, sizeof(address)))
+    || (0 != getsockname(sockfd, (struct sockaddr *) &address, &length)) )
+  {
+    close(sockfd);
+    return -1;
+  }
+
+  return sockfd;
+}
+
+
+
+// Runs a device program with a socket for its link (its standard input
+// and output) and a pipe for its input states. Returns the child's process
+// ID, or -1 on failure.
+
+static pid_t SpawnNativeDevice(const std::string &command, int &link_fd,
+  int &input_fd)
+{
+  int linkfds[2], inputfds[2];
+  std::string full_command;
+  pid_t child;
+
+  link_fd = -1;
+  input_fd = -1;
+
+  if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, linkfds))
+    return -1;
+
+  if (0 != pipe(inputfds))
+  {
+    close(linkfds[0]);
+    close(linkfds[1]);
+    return -1;
+  }
+
+  full_command = command + " --input-fd="
+    + std::to_string(LATENCY_NATIVE_INPUT_FD);
+
+  child = fork();
+
+  if (0 == child)
+  {
+    // The parent's ends may sit on the input descriptor's number, so
+    // they go first, and nothing already moved there gets closed.
+    close(linkfds[0]);
+    close(inputfds[1]);
+    dup2(linkfds[1], STDIN_FILENO);
+    dup2(linkfds[1], STDOUT_FILENO);
+    if (LATENCY_NATIVE_INPUT_FD != inputfds[0])
+    {
+      dup2(inputfds[0], LATENCY_NATIVE_INPUT_FD);
+      close(inputfds[0]);
+    }
+    if (LATENCY_NATIVE_INPUT_FD != linkfds[1])
+      close(linkfds[1]);
+
+    execl("/bin/sh", "sh", "-c", full_command.c_str(), (char *) NULL);
+    _exit(127);
+  }
+
+  close(linkfds[1]);
+  close(inputfds[0]);
+
+  if (0 > child)
+  {
+    close(linkfds[0]);
+    close(inputfds[1]);
+    return -1;
+  }
+
+  fcntl(linkfds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(inputfds[1], F_SETFD, FD_CLOEXEC);
+
+  link_fd = linkfds[0];
+  input_fd = inputfds[1];
+
+  return child;
+}
+
+
+
+// Sets a native device program's input register. Returns false on error.
+
+static bool SetNativeInputs(int input_fd, uint32_t bits)
+{
+  char line[16];
+  int length;
+
+  length = snprintf(line, sizeof(line), "%lx\n", (unsigned long) bits);
+
+  return (length == write(input_fd, line, length));
+}
+
+
+
+// Reads events and relays them the way the GPIO monitor does. The edge
+// number rides along as the report's tick field.
+
+static void RunMonitor(gpiolink_t *link, run_t &run, int sockfd,
+  const struct sockaddr_in &target,
+  const std::function<long(const gpiolink_event_t &, run_t &)> &match)
+{
+  gpiolink_event_t event;
+  char message[64];
+  long eidx;
+  int result;
+
+  while (!run.stop)
+  {
+    result = gpiolink_poll(link, 20);
+
+    while (gpiolink_next_event(link, &event))
+    {
+      if ( (GPIOLINK_EVENT_REGISTER != event.type) || ('I' != event.reg) )
+        continue;
+
+      eidx = match(event, run);
+      if (0 > eidx)
+        continue;
+
+      run.edges[eidx].link_ns = event.host_time_ns;
+
+      snprintf(message, sizeof(message), "MSG gpio %s I: %08lx %ld",
+        LATENCY_LABEL, (unsigned long) event.value, eidx);
+      sendto(sockfd, message, strlen(message), 0,
+        (const struct sockaddr *) &target, sizeof(target));
+    }
+
+    // The simulated device closes its end when it's done.
+    if (0 > result)
+      break;
+  }
+
+  sendto(sockfd, "END", 3, 0, (const struct sockaddr *) &target,
+    sizeof(target));
+}
+
+
+
+// Timestamps relayed packets as they arrive.
+
+static void RunReceiver(int sockfd, run_t &run)
+{
+  char message[80];
+  struct pollfd waiting;
+  ssize_t count;
+  const char *field;
+  long eidx;
+  uint64_t now_ns;
+
+  waiting.fd = sockfd;
+  waiting.events = POLLIN;
+
+  while (true)
+  {
+    waiting.revents = 0;
+    if (0 >= poll(&waiting, 1, LATENCY_SETTLE_MS + 1000))
+      break;
+
+    count = recv(sockfd, message, sizeof(message) - 1, 0);
+    now_ns = GetMonotonicNanos();
+    if (0 > count)
+      break;
+    message[count] = 0;
+
+    if (0 == strcmp(message, "END"))
+      break;
+
+    field = strrchr(message, ' ');
+    if (NULL == field)
+      continue;
+
+    eidx = strtol(field + 1, NULL, 10);
+    if ( (0 <= eidx) && (eidx < (long) run.edges.size()) )
+      run.edges[eidx].packet_ns = now_ns;
+  }
+}
+
+
+
+// Matches a simulated device's report to its edge. The input register
+// holds the number of edges injected.
+
+static long MatchVirtualEvent(const gpiolink_event_t &event, run_t &run)
+{
+  long eidx;
+
+  eidx = ((long) event.value) - 1;
+
+  if ( (0 > eidx) || (eidx >= (long) run.edges.size()) )
+    return -1;
+
+  run.last_matched = eidx;
+  return eidx;
+}
+
+
+
+// Matches a looped-back report to its edge: the earliest edge not yet
+// matched that leaves the input in this state. If edges are coalesced,
+// this overstates latency rather than hiding it.
+
+static long MatchLoopbackEvent(const gpiolink_event_t &event, run_t &run,
+  int input_bit)
+{
+  long eidx, sent;
+  int state;
+
+  state = (event.value >> input_bit) & 1;
+  sent = run.sent;
+
+  // Edge n leaves the input high if n is even (the line starts low).
+  for (eidx = run.last_matched + 1; eidx < sent; eidx++)
+    if (((eidx + 1) & 1) == state)
+    {
+      run.last_matched = eidx;
+      return eidx;
+    }
+
+  return -1;
+}
+
+
+
+// Gets latency figures for one stage.
+
+static void GetStageStats(const run_t &run, bool packet,
+  stage_stats_t &stats)
+{
+  std::vector<double> latencies;
+  uint64_t seen_ns;
+  size_t eidx, rank;
+
+  for (eidx = 0; eidx < run.edges.size(); eidx++)
+  {
+    seen_ns = packet ? run.edges[eidx].packet_ns : run.edges[eidx].link_ns;
+    if ( (0 < seen_ns) && (0 < run.edges[eidx].sent_ns) )
+      latencies.push_back(
+        ((double) ((int64_t) (seen_ns - run.edges[eidx].sent_ns))) / 1000.0);
+  }
+
+  stats.count = latencies.size();
+  stats.p50_us = 0;
+  stats.p99_us = 0;
+  stats.max_us = 0;
+
+  if (latencies.empty())
+    return;
+
+  std::sort(latencies.begin(), latencies.end());
+
+  // Nearest-rank percentiles.
+  rank = (latencies.size() * 50 + 99) / 100;
+  stats.p50_us = latencies[(0 < rank) ? (rank - 1) : 0];
+  rank = (latencies.size() * 99 + 99) / 100;
+  stats.p99_us = latencies[(0 < rank) ? (rank - 1) : 0];
+  stats.max_us = latencies.back();
+}
+
+
+
+// Injects edges at one rate and collects their times.
+
+static bool RunOneRate(const options_t &options, gpiolink_t *device_link,
+  run_t &run)
+{
+  VirtualGPIODevice device;
+  VirtualDeviceParams params;
+  struct sockaddr_in target;
+  gpiolink_t *link;
+  gpiolink_event_t event;
+  std::function<long(const gpiolink_event_t &, run_t &)> match;
+  std::thread monitor, receiver;
+  int sockfd, pipefds[2], input_bit;
+  uint64_t start_ns, when_ns;
+  size_t eidx, count;
+
+  count = (size_t) (run.rate * options.seconds);
+  if (LATENCY_MIN_EDGES > count)
+    count = LATENCY_MIN_EDGES;
+
+  run.edges.assign(count, edge_t());
+  run.sent = 0;
+  run.stop = false;
+  run.last_matched = -1;
+
+  sockfd = OpenReceiver(target);
+  if (0 > sockfd)
+    return false;
+
+  link = device_link;
+
+  if (NULL == device_link)
+  {
+    if (0 != pipe(pipefds))
+    {
+      close(sockfd);
+      return false;
+    }
+
+    link = gpiolink_open_fd(pipefds[0]);
+    if (NULL == link)
+    {
+      close(pipefds[0]);
+      close(pipefds[1]);
+      close(sockfd);
+      return false;
+    }
+
+    match = MatchVirtualEvent;
+  }
+  else
+  {
+    // Flush anything left over from the last rate.
+    while (0 < gpiolink_poll(link, LATENCY_QUIET_MS))
+      while (gpiolink_next_event(link, &event))
+        ;
+
+    input_bit = options.input_bit;
+    match = [input_bit](const gpiolink_event_t &thisevent, run_t &thisrun)
+    {
+      return MatchLoopbackEvent(thisevent, thisrun, input_bit);
+    };
+  }
+
+  receiver = std::thread(RunReceiver, sockfd, std::ref(run));
+  monitor = std::thread(RunMonitor, link, std::ref(run), sockfd,
+    std::cref(target), std::cref(match));
+
+  // Give the threads a moment to get going.
+  start_ns = GetMonotonicNanos() + 20000000ull;
+
+  if (NULL == device_link)
+  {
+    params = options.virtual_params;
+    params.edge_rate = run.rate;
+    params.edges = count;
+    params.baud = options.baud;
+
+    for (eidx = 0; eidx < count; eidx++)
+    {
+      run.edges[eidx].sent_ns = start_ns
+        + (uint64_t) ((eidx * 1.0e9) / run.rate);
+    }
+    run.sent = count;
+
+    device.Start(params, pipefds[1], start_ns);
+    device.Join();
+  }
+  else
+  {
+    for (eidx = 0; eidx < count; eidx++)
+    {
+      when_ns = start_ns + (uint64_t) ((eidx * 1.0e9) / run.rate);
+      SleepUntilNanos(when_ns);
+
+      // The edge is counted before it's made, so that a quick report
+      // can't arrive before the monitor can match it.
+      run.edges[eidx].sent_ns = GetMonotonicNanos();
+      run.sent = eidx + 1;
+
+      // Edge n leaves the line high if n is even.
+      if (0 <= options.native_input_fd)
+        SetNativeInputs(options.native_input_fd,
+          (0 == (eidx & 1)) ? (1u << options.input_bit) : 0);
+      else
+        gpiolink_send_command_arg(link, "WRO",
+          (0 == (eidx & 1)) ? (1u << options.output_bit) : 0);
+    }
+
+    SleepUntilNanos(GetMonotonicNanos() + LATENCY_SETTLE_MS * 1000000ull);
+    run.stop = true;
+  }
+
+  monitor.join();
+  receiver.join();
+
+  if (NULL == device_link)
+    gpiolink_close(link);
+  close(sockfd);
+
+  return true;
+}
+
+
+
+// Prints one rate's line of the report.
+
+static void PrintRunReport(const run_t &run)
+{
+  stage_stats_t link_stats, packet_stats;
+  size_t lost;
+
+  GetStageStats(run, false, link_stats);
+  GetStageStats(run, true, packet_stats);
+
+  lost = run.edges.size() - packet_stats.count;
+
+  printf("rate %g edges %lu reported %lu lost %lu loss %.6f"
+    " link_p50_us %.1f link_p99_us %.1f link_max_us %.1f"
+    " packet_p50_us %.1f packet_p99_us %.1f packet_max_us %.1f\n",
+    run.rate, (unsigned long) run.edges.size(),
+    (unsigned long) packet_stats.count, (unsigned long) lost,
+    ((double) lost) / run.edges.size(),
+    link_stats.p50_us, link_stats.p99_us, link_stats.max_us,
+    packet_stats.p50_us, packet_stats.p99_us, packet_stats.max_us);
+  fflush(stdout);
+}
+
+
+
+// Main program.
+
+int main(int argc, char **argv)
+{
+  options_t options;
+  gpiolink_t *device_link;
+  gpiolink_ident_t ident;
+  run_t run;
+  stage_stats_t packet_stats;
+  double onset;
+  size_t ridx;
+  int aidx, link_fd;
+  pid_t child;
+  bool is_ok;
+
+  static const double default_rates[] =
+  { 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000 };
+
+  options.native_input_fd = -1;
+  options.baud = 500000;
+  options.input_bit = 0;
+  options.output_bit = 0;
+  options.rates.assign(default_rates,
+    default_rates + (sizeof(default_rates) / sizeof(default_rates[0])));
+  options.seconds = 2;
+  options.loss_limit = 0.001;
+  is_ok = true;
+
+  for (aidx = 1; is_ok && (aidx < argc); aidx++)
+  {
+    if (0 == strncmp(argv[aidx], "--device=", 9))
+      options.device = argv[aidx] + 9;
+    else if (0 == strncmp(argv[aidx], "--exec=", 7))
+      options.command = argv[aidx] + 7;
+    else if (0 == strncmp(argv[aidx], "--baud=", 7))
+      options.baud = strtoul(argv[aidx] + 7, NULL, 10);
+    else if (0 == strncmp(argv[aidx], "--output-bit=", 13))
+      options.output_bit = atoi(argv[aidx] + 13);
+    else if (0 == strncmp(argv[aidx], "--input-bit=", 12))
+      options.input_bit = atoi(argv[aidx] + 12);
+    else if (0 == strncmp(argv[aidx], "--poll-us=", 10))
+      options.virtual_params.poll_us = strtoul(argv[aidx] + 10, NULL, 10);
+    else if (0 == strncmp(argv[aidx], "--tx-queue=", 11))
+      options.virtual_params.tx_queue = strtoul(argv[aidx] + 11, NULL, 10);
+    else if (0 == strncmp(argv[aidx], "--rates=", 8))
+      is_ok = ParseRateList(argv[aidx] + 8, options.rates);
+    else if (0 == strncmp(argv[aidx], "--seconds=", 10))
+      options.seconds = atof(argv[aidx] + 10);
+    else if (0 == strncmp(argv[aidx], "--loss-limit=", 13))
+      options.loss_limit = atof(argv[aidx] + 13);
+    else
+      is_ok = false;
+  }
+
+  if ( (!is_ok) || (!(0 < options.seconds))
+    || ( (!options.device.empty()) && (!options.command.empty()) )
+    || ( (!options.command.empty()) && (7 < options.input_bit) )
+    || (0 > options.input_bit) || (31 < options.input_bit)
+    || (0 > options.output_bit) || (31 < options.output_bit) )
+  {
+    PrintHelp();
+    return 2;
+  }
+
+  device_link = NULL;
+  child = -1;
+  memset(&ident, 0, sizeof(ident));
+
+  if (!options.command.empty())
+  {
+    signal(SIGPIPE, SIG_IGN);
+
+    child = SpawnNativeDevice(options.command, link_fd,
+      options.native_input_fd);
+    if (0 > child)
+    {
+      fprintf(stderr, "### Unable to run \"%s\".\n",
+        options.command.c_str());
+      return 2;
+    }
+
+    device_link = gpiolink_open_fd(link_fd);
+    if ( (NULL == device_link)
+      || (0 != gpiolink_identify(device_link, &ident, 3000)) )
+    {
+      fprintf(stderr, "### \"%s\" didn't identify itself.\n",
+        options.command.c_str());
+      return 2;
+    }
+
+    // Untimestamped reports, with every input starting low.
+    gpiolink_send_command_arg(device_link, "REP", 1);
+    SetNativeInputs(options.native_input_fd, 0);
+  }
+  else if (!options.device.empty())
+  {
+    device_link = gpiolink_open(options.device.c_str(), options.baud);
+    if ( (NULL == device_link)
+      || (0 != gpiolink_identify(device_link, &ident, 3000)) )
+    {
+      fprintf(stderr, "### Unable to talk to a GPIO device on \"%s\".\n",
+        options.device.c_str());
+      return 2;
+    }
+
+    // Untimestamped reports, starting with the output low.
+    gpiolink_send_command_arg(device_link, "REP", 1);
+    gpiolink_send_command_arg(device_link, "WRO", 0);
+  }
+
+  printf("tool: ncam-gpiolatency\n");
+  printf("abi: %d\n", gpiolink_abi_version());
+  printf("mode: %s\n", (NULL == device_link) ? "simulated"
+    : ((0 <= child) ? "native" : "device"));
+  printf("relay: simulated\n");
+  if (0 > child)
+    printf("baud: %lu\n", (unsigned long) options.baud);
+  if (NULL == device_link)
+  {
+    printf("simulated_device: virtualdev\n");
+    printf("poll_us: %lu\n", (unsigned long) options.virtual_params.poll_us);
+    printf("tx_queue: %lu\n",
+      (unsigned long) options.virtual_params.tx_queue);
+  }
+  else
+  {
+    if (0 <= child)
+      printf("program: %s\n", options.command.c_str());
+    else
+      printf("device: %s\n", options.device.c_str());
+    printf("devicetype: %s\n", ident.devicetype);
+    printf("subtype: %s\n", ident.subtype);
+    if (ident.has_confighash)
+      printf("confighash: %08lx\n", (unsigned long) ident.confighash);
+    if (0 > child)
+      printf("output_bit: %d\n", options.output_bit);
+    printf("input_bit: %d\n", options.input_bit);
+  }
+  printf("seconds_per_rate: %g\n", options.seconds);
+  fflush(stdout);
+
+  onset = 0;
+
+  for (ridx = 0; ridx < options.rates.size(); ridx++)
+  {
+    run.rate = options.rates[ridx];
+
+    if (!RunOneRate(options, device_link, run))
+    {
+      fprintf(stderr, "### Unable to set up the run at %g edges/sec.\n",
+        run.rate);
+      break;
+    }
+
+    PrintRunReport(run);
+
+    GetStageStats(run, true, packet_stats);
+    if ((run.edges.size() - packet_stats.count)
+      > (options.loss_limit * run.edges.size()))
+    {
+      onset = run.rate;
+      break;
+    }
+  }
+
+  if (0 < onset)
+    printf("loss_onset_rate: %g\n", onset);
+  else
+    printf("loss_onset_rate: none\n");
+
+  if (NULL != device_link)
+    gpiolink_close(device_link);
+
+  // The native device exits when its link closes.
+  if (0 <= child)
+  {
+    close(options.native_input_fd);
+    waitpid(child, NULL, 0);
+  }
+
+  return 0;
+}
+
+
+//
+// This is the end of the file.
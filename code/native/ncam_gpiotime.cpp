@@ -0,0 +1,226 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// GPIO timing signal analyzer - command-line front end.
+
+
+//
+// Includes
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "gpioevlog.h"
+#include "gpiotime.h"
+
+
+//
+// Private prototypes
+
+static void PrintHelp(void);
+static bool ScanFile(const char *path, GPIOTimeAnalyzer &analyzer);
+static bool ScanEventLog(const char *path, GPIOTimeAnalyzer &analyzer);
+static bool ScanStream(FILE *stream, GPIOTimeAnalyzer &analyzer);
+
+
+
+//
+// Functions
+
+
+// Prints a help screen.
+
+static void PrintHelp(void)
+{
+  printf(
+"Finds the strobe signal in a NeuroCam session log and fits its timing.\n"
+"\n"
+"Usage:  ncam-gpiotime [--channel=<label>] <logfile | gpioevents.bin | ->\n"
+"\n"
+"Given a binary event log (\"gpioevents.bin\"), only its output register\n"
+"records are read.\n"
+"\n"
+"Output is one \"key: value\" line per figure (times in log milliseconds):\n"
+"  channel, period, offset, pulsewidth  - the fitted strobe (\"offset\" is\n"
+"    the middle of the first pulse, as NCAM_AnalyzeGPIOTime reports it)\n"
+"  jitter, period_err, offset_err       - RMS residual and standard errors\n"
+"  drift_ppm_per_hour                   - change in period over the session\n"
+"  coverage, pulses, outliers, cycles   - how much of the train was seen\n"
+"  candidates                           - labels that looked like a strobe\n"
+"\n"
+"If no strobe is found, this prints \"result: none\" and exits with 1.\n"
+"\n");
+}
+
+
+
+// Scans a log file, mapping it rather than reading it.
+
+static bool ScanFile(const char *path, GPIOTimeAnalyzer &analyzer)
+{
+  int fd;
+  struct stat info;
+  void *data;
+  FILE *stream;
+  bool result;
+
+  fd = open(path, O_RDONLY);
+  if (0 > fd)
+    return false;
+
+  if ( (0 != fstat(fd, &info)) || (!S_ISREG(info.st_mode)) )
+  {
+    // Not a plain file (a pipe, say); read it as a stream instead.
+    stream = fdopen(fd, "r");
+    if (NULL == stream)
+    {
+      close(fd);
+      return false;
+    }
+
+    result = ScanStream(stream, analyzer);
+    fclose(stream);
+    return result;
+  }
+
+  if (0 < info.st_size)
+  {
+    data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == data)
+    {
+      close(fd);
+      return false;
+    }
+
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    analyzer.AddLogText((const char *) data, info.st_size);
+    munmap(data, info.st_size);
+  }
+
+  close(fd);
+  return true;
+}
+
+
+
+// Reads output register reports from a binary event log.
+
+static bool ScanEventLog(const char *path, GPIOTimeAnalyzer &analyzer)
+{
+  GPIOEventLogReader reader;
+  size_t ridx;
+
+  if (!reader.Open(path))
+    return false;
+
+  for (ridx = 0; ridx < reader.Count(); ridx++)
+  {
+    const gpioevlog_record_t &record = reader.Record(ridx);
+
+    if ('O' == record.reg)
+      analyzer.AddEvent(GetGPIOEventDevice(record),
+        (double) record.host_time_ms, record.value);
+  }
+
+  return true;
+}
+
+
+
+// Scans a log from a stream.
+
+static bool ScanStream(FILE *stream, GPIOTimeAnalyzer &analyzer)
+{
+  std::vector<char> text;
+  char buffer[65536];
+  size_t count;
+
+  while (0 < (count = fread(buffer, 1, sizeof(buffer), stream)))
+    text.insert(text.end(), buffer, buffer + count);
+
+  if (!text.empty())
+    analyzer.AddLogText(text.data(), text.size());
+
+  return (0 == ferror(stream));
+}
+
+
+
+// Main program.
+
+int main(int argc, char **argv)
+{
+  GPIOTimeAnalyzer analyzer;
+  GPIOTimeResult result;
+  std::string channel;
+  const char *path;
+  int aidx;
+  bool ok;
+
+  path = NULL;
+
+  for (aidx = 1; aidx < argc; aidx++)
+  {
+    if (0 == strncmp(argv[aidx], "--channel=", 10))
+      channel = argv[aidx] + 10;
+    else if ( ('-' == argv[aidx][0]) && (0 != argv[aidx][1]) )
+    {
+      PrintHelp();
+      return 2;
+    }
+    else
+      path = argv[aidx];
+  }
+
+  if (NULL == path)
+  {
+    PrintHelp();
+    return 2;
+  }
+
+  if (0 == strcmp(path, "-"))
+    ok = ScanStream(stdin, analyzer);
+  else if ( (4 < strlen(path))
+    && (0 == strcmp(path + strlen(path) - 4, ".bin")) )
+    ok = ScanEventLog(path, analyzer);
+  else
+    ok = ScanFile(path, analyzer);
+
+  if (!ok)
+  {
+    fprintf(stderr, "### Unable to read \"%s\".\n", path);
+    return 2;
+  }
+
+  if (!analyzer.Analyze(result, channel))
+  {
+    printf("result: none\n");
+    return 1;
+  }
+
+  printf("result: ok\n");
+  printf("channel: %s\n", result.channel.c_str());
+  printf("period: %.4f\n", result.period_ms);
+  printf("offset: %.4f\n", result.offset_ms);
+  printf("pulsewidth: %.2f\n", result.pulse_width_ms);
+  printf("jitter: %.4f\n", result.jitter_ms);
+  printf("period_err: %.6f\n", result.period_stderr_ms);
+  printf("offset_err: %.4f\n", result.offset_stderr_ms);
+  printf("drift_ppm_per_hour: %.3f\n", result.drift_ppm_per_hour);
+  printf("coverage: %.4f\n", result.coverage);
+  printf("pulses: %lu\n", (unsigned long) result.pulses);
+  printf("outliers: %lu\n", (unsigned long) result.outliers);
+  printf("cycles: %lu\n", (unsigned long) result.cycles);
+  printf("candidates: %lu\n", (unsigned long) result.candidates);
+
+  return 0;
+}
+
+
+//
+// This is the end of the file.
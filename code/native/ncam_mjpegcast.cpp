@@ -0,0 +1,354 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Live MJPEG imagecast server - command-line front end.
+
+
+//
+// Includes
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "mjpegcast.h"
+
+
+//
+// Private macros
+
+// Longest line we'll take from the command pipe.
+#define MAX_COMMAND_CHARS 4096
+
+// Bytes of inotify events read at a time.
+#define WATCH_BUFFER_BYTES 16384
+
+
+//
+// Private types
+
+// One pre-scaled stream from the command line.
+struct variant_arg_t
+{
+  std::string name;
+  int width;
+  int height;
+};
+
+
+//
+// Private variables
+
+static volatile sig_atomic_t stop_requested = 0;
+
+
+//
+// Private prototypes
+
+static void PrintHelp(void);
+static void HandleStopSignal(int signum);
+static bool ParseVariant(const char *text, std::vector<variant_arg_t> &list);
+static bool IsJPEGName(const char *name);
+static bool ReadCommands(int fd, std::string &buffer, std::string &newest,
+  bool &want_shutdown);
+static void ReadWatchEvents(int fd, std::string &newest);
+static void PrintStats(const mjpegcast_stats_t &stats);
+
+
+
+//
+// Functions
+
+
+// Prints a help screen.
+
+static void PrintHelp(void)
+{
+  printf(
+"Serves the NeuroCam monitor stream (multipart MJPEG over HTTP) to any\n"
+"number of clients. Each frame is read once and shared between clients;\n"
+"clients that can't keep up skip frames.\n"
+"\n"
+"Usage:  ncam-mjpegcast --port=<port> [options]\n"
+"\n"
+"Options:\n"
+"  --dir=<path>        Serve new JPEGs as they're written to this folder,\n"
+"                      rather than reading filenames from stdin.\n"
+"  --variant=<name>:<width>x<height>\n"
+"                      Offer a stream scaled to fit this box, at\n"
+"                      \"/<name>\". May be given more than once.\n"
+"  --quality=<n>       JPEG quality for scaled streams (default %d).\n"
+"  --max-clients=<n>   Clients served at once (default %d).\n"
+"  --stats             Print \"key: value\" totals on exit.\n"
+"\n"
+"Without \"--dir\", this reads one JPEG filename per line from stdin, the\n"
+"same as the pipe NCAM_StartLiveImagecastSingle() returns. \"shutdown\" or\n"
+"the end of stdin stops the server. If filenames arrive faster than they\n"
+"can be read, only the newest is served.\n"
+"Any path other than a variant's gets frames as they were written.\n"
+"\n",
+    MJPEGCAST_DEFAULT_QUALITY, MJPEGCAST_DEFAULT_MAX_CLIENTS);
+}
+
+
+
+// Signal handler for SIGINT and SIGTERM.
+
+static void HandleStopSignal(int signum)
+{
+  stop_requested = 1;
+}
+
+
+
+// Parses a "name:WxH" variant argument.
+
+static bool ParseVariant(const char *text, std::vector<variant_arg_t> &list)
+{
+  variant_arg_t variant;
+  const char *colon;
+
+  colon = strchr(text, ':');
+  if (NULL == colon)
+    return false;
+
+  variant.name = std::string(text, colon - text);
+  if (2 != sscanf(colon + 1, "%dx%d", &variant.width, &variant.height))
+    return false;
+
+  list.push_back(variant);
+
+  return true;
+}
+
+
+
+// Checks for a ".jpg" or ".jpeg" suffix.
+
+static bool IsJPEGName(const char *name)
+{
+  const char *dot;
+
+  dot = strrchr(name, '.');
+
+  return ( (NULL != dot)
+    && ( (0 == strcasecmp(dot, ".jpg")) || (0 == strcasecmp(dot, ".jpeg")) ) );
+}
+
+
+
+// Reads whatever is waiting on the command pipe. The newest filename is
+// left in "newest" (earlier ones are stale). Returns false at the end of
+// input.
+
+static bool ReadCommands(int fd, std::string &buffer, std::string &newest,
+  bool &want_shutdown)
+{
+  char chunk[MAX_COMMAND_CHARS];
+  std::string line;
+  size_t end, first, last;
+  ssize_t count;
+
+  count = read(fd, chunk, sizeof(chunk));
+  if (0 == count)
+    return false;
+  if (0 > count)
+    return true;
+
+  buffer.append(chunk, count);
+
+  while (std::string::npos != (end = buffer.find('\n')))
+  {
+    line = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+
+    first = line.find_first_not_of(" \t\r");
+    if (std::string::npos == first)
+      continue;
+    last = line.find_last_not_of(" \t\r");
+    line = line.substr(first, last + 1 - first);
+
+    if (0 == strcasecmp(line.c_str(), "shutdown"))
+      want_shutdown = true;
+    else
+      newest = line;
+  }
+
+  // A line this long isn't a filename.
+  if (MAX_COMMAND_CHARS < buffer.size())
+    buffer.clear();
+
+  return true;
+}
+
+
+
+// Reads whatever is waiting from the folder watch. The newest JPEG's name
+// is left in "newest".
+
+static void ReadWatchEvents(int fd, std::string &newest)
+{
+  // inotify events have to be read into aligned storage.
+  char buffer[WATCH_BUFFER_BYTES]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *event;
+  ssize_t count, offset;
+
+  while (0 < (count = read(fd, buffer, sizeof(buffer))))
+  {
+    for (offset = 0; offset < count;
+      offset += sizeof(struct inotify_event) + event->len)
+    {
+      event = (const struct inotify_event *) (buffer + offset);
+
+      if ( (0 < event->len) && IsJPEGName(event->name) )
+        newest = event->name;
+    }
+  }
+}
+
+
+
+// Prints running totals.
+
+static void PrintStats(const mjpegcast_stats_t &stats)
+{
+  printf("frames in: %llu\n", (unsigned long long) stats.frames_in);
+  printf("frames scaled: %llu\n", (unsigned long long) stats.frames_scaled);
+  printf("frames sent: %llu\n", (unsigned long long) stats.frames_sent);
+  printf("frames dropped: %llu\n",
+    (unsigned long long) stats.frames_dropped);
+  printf("bytes sent: %llu\n", (unsigned long long) stats.bytes_sent);
+  printf("clients served: %llu\n",
+    (unsigned long long) stats.clients_served);
+}
+
+
+
+// Main program.
+
+int main(int argc, char **argv)
+{
+  MJPEGCastServer server;
+  std::vector<variant_arg_t> variant_args;
+  std::vector<int> ready;
+  std::string watch_dir, command_buffer, newest;
+  int port, quality, max_clients, watch_fd, ridx;
+  bool want_stats, want_shutdown, is_ok;
+  size_t vidx;
+  int aidx;
+
+  port = 0;
+  quality = MJPEGCAST_DEFAULT_QUALITY;
+  max_clients = MJPEGCAST_DEFAULT_MAX_CLIENTS;
+  want_stats = false;
+  is_ok = true;
+
+  for (aidx = 1; is_ok && (aidx < argc); aidx++)
+  {
+    if (0 == strncmp(argv[aidx], "--port=", 7))
+      port = atoi(argv[aidx] + 7);
+    else if (0 == strncmp(argv[aidx], "--dir=", 6))
+      watch_dir = argv[aidx] + 6;
+    else if (0 == strncmp(argv[aidx], "--variant=", 10))
+      is_ok = ParseVariant(argv[aidx] + 10, variant_args);
+    else if (0 == strncmp(argv[aidx], "--quality=", 10))
+      quality = atoi(argv[aidx] + 10);
+    else if (0 == strncmp(argv[aidx], "--max-clients=", 14))
+      max_clients = atoi(argv[aidx] + 14);
+    else if (0 == strcmp(argv[aidx], "--stats"))
+      want_stats = true;
+    else
+      is_ok = false;
+  }
+
+  if ( (!is_ok) || (1 > port) || (65535 < port) )
+  {
+    PrintHelp();
+    return 1;
+  }
+
+  for (vidx = 0; vidx < variant_args.size(); vidx++)
+    if (!server.AddVariant(variant_args[vidx].name,
+      variant_args[vidx].width, variant_args[vidx].height))
+    {
+      fprintf(stderr, "### Can't use stream variant \"%s\".\n",
+        variant_args[vidx].name.c_str());
+      return 1;
+    }
+
+  server.SetQuality(quality);
+  server.SetMaxClients(max_clients);
+
+  watch_fd = -1;
+  if (watch_dir.empty())
+  {
+    fcntl(0, F_SETFL, fcntl(0, F_GETFL) | O_NONBLOCK);
+    server.AddInput(0);
+  }
+  else
+  {
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if ( (0 > watch_fd) || (0 > inotify_add_watch(watch_fd,
+      watch_dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO)) )
+    {
+      fprintf(stderr, "### Can't watch \"%s\".\n", watch_dir.c_str());
+      return 1;
+    }
+    server.AddInput(watch_fd);
+  }
+
+  if (!server.Start(port))
+  {
+    fprintf(stderr, "### Can't listen on port %d.\n", port);
+    return 1;
+  }
+
+  signal(SIGINT, HandleStopSignal);
+  signal(SIGTERM, HandleStopSignal);
+
+  want_shutdown = false;
+
+  while ( (!stop_requested) && (!want_shutdown) )
+  {
+    if (!server.Poll(-1, ready))
+      break;
+
+    for (ridx = 0; ridx < (int) ready.size(); ridx++)
+    {
+      newest.clear();
+
+      if (watch_fd == ready[ridx])
+      {
+        ReadWatchEvents(watch_fd, newest);
+        if (!newest.empty())
+          newest = watch_dir + "/" + newest;
+      }
+      else if (!ReadCommands(ready[ridx], command_buffer, newest,
+        want_shutdown))
+        want_shutdown = true;
+
+      if ( (!newest.empty()) && (!server.PublishFile(newest.c_str())) )
+        fprintf(stderr, "-- Couldn't read frame \"%s\".\n", newest.c_str());
+    }
+  }
+
+  server.Stop();
+
+  if (0 <= watch_fd)
+    close(watch_fd);
+
+  if (want_stats)
+    PrintStats(server.GetStats());
+
+  return 0;
+}
+
+
+//
+// This is the end of the file.
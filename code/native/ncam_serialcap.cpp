@@ -0,0 +1,403 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Raw serial capture between the host and a GPIO device.
+
+
+//
+// Includes
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include <string>
+
+#include "gpiolink_serial.h"
+#include "serialcap.h"
+#include "virtualdev.h"
+
+
+//
+// Private macros
+
+// Bytes read per chunk.
+#define CAPTURE_READ_BYTES 4096
+
+// Serial rate if none is given. This also spaces out imported text lines.
+#define CAPTURE_DEFAULT_BAUD 115200
+
+
+//
+// Private types
+
+struct options_t
+{
+  std::string device;
+  std::string command;
+  std::string output;
+  std::string link;
+  std::string text;
+  uint32_t baud;
+  double seconds;
+};
+
+
+//
+// Private prototypes
+
+static void PrintHelp(void);
+static void HandleStopSignal(int signum);
+static bool ImportTextCapture(const options_t &options,
+  SerialCaptureWriter &writer);
+static void FollowPtyBaud(int slave_fd, int device_fd, speed_t &speed);
+static bool RunCaptureProxy(const options_t &options,
+  SerialCaptureWriter &writer);
+
+
+//
+// Private variables
+
+static volatile sig_atomic_t stop_requested = 0;
+
+
+//
+// Functions
+
+
+// Prints a help screen.
+
+static void PrintHelp(void)
+{
+  printf(
+"Records the byte stream between a host program and a GPIO device, in\n"
+"both directions, with host timestamps. The host program talks to a\n"
+"pseudo-terminal standing in for the device's serial port.\n"
+"\n"
+"Usage:  ncam-serialcap --output=<file> (--device=<tty> | --exec=<cmd>)\n"
+"          [options]\n"
+"        ncam-serialcap --output=<file> --text=<file> [--baud=<n>]\n"
+"\n"
+"Options:\n"
+"  --output=<file>    Capture file to write.\n"
+"  --device=<tty>     The device's serial port.\n"
+"  --baud=<n>         Serial rate (default 115200; 0 = USB, unpaced).\n"
+"  --exec=<cmd>       Run a program as the device instead, talking over its\n"
+"                     standard input and output (e.g. a driver built on\n"
+"                     the host-native firmware library).\n"
+"  --link=<path>      Make a symbolic link to the pseudo-terminal here.\n"
+"  --seconds=<x>      Stop after this long (default: on SIGINT or SIGTERM,\n"
+"                     or when the device side closes).\n"
+"  --text=<file>      Convert an old text capture instead. Each line\n"
+"                     becomes one device-to-host record, spaced by its\n"
+"                     time on the wire at the baud rate.\n"
+"\n"
+"The pseudo-terminal's name is printed as \"pty: <path>\" once it's ready.\n"
+"When capturing stops, \"bytes_from_device\", \"bytes_to_device\", and\n"
+"\"seconds\" are printed as \"key: value\" lines.\n"
+"\n");
+}
+
+
+
+// Asks the capture loop to stop.
+
+static void HandleStopSignal(int signum)
+{
+  stop_requested = 1;
+}
+
+
+
+// Converts a text capture into records.
+
+static bool ImportTextCapture(const options_t &options,
+  SerialCaptureWriter &writer)
+{
+  FILE *infile;
+  char *line;
+  size_t linesize;
+  ssize_t length;
+  uint64_t host_time_ns, ns_per_byte;
+  bool is_ok;
+
+  infile = fopen(options.text.c_str(), "r");
+  if (NULL == infile)
+  {
+    fprintf(stderr, "### Unable to read \"%s\".\n", options.text.c_str());
+    return false;
+  }
+
+  // Ten bits per byte on the wire.
+  ns_per_byte = (0 < options.baud) ? (10000000000ull / options.baud) : 0;
+  host_time_ns = 0;
+  is_ok = true;
+
+  line = NULL;
+  linesize = 0;
+  while ( is_ok && (0 < (length = getline(&line, &linesize, infile))) )
+  {
+    host_time_ns += length * ns_per_byte;
+    is_ok = writer.Append(SERIALCAP_FROM_DEVICE, host_time_ns, line, length);
+  }
+
+  free(line);
+  fclose(infile);
+
+  return is_ok;
+}
+
+
+
+// Copies the host program's baud rate changes to the device's port. The
+// monitor switches rates after probing, and the pseudo-terminal doesn't
+// care, but the real port has to follow.
+
+static void FollowPtyBaud(int slave_fd, int device_fd, speed_t &speed)
+{
+  struct termios settings;
+  speed_t newspeed;
+
+  if (0 != tcgetattr(slave_fd, &settings))
+    return;
+
+  newspeed = cfgetospeed(&settings);
+  if (newspeed == speed)
+    return;
+
+  speed = newspeed;
+
+  if (0 == tcgetattr(device_fd, &settings))
+  {
+    cfsetispeed(&settings, speed);
+    cfsetospeed(&settings, speed);
+    tcsetattr(device_fd, TCSADRAIN, &settings);
+  }
+}
+
+
+
+// Relays bytes between the device and a pseudo-terminal, logging them.
+
+static bool RunCaptureProxy(const options_t &options,
+  SerialCaptureWriter &writer)
+{
+  int pty_fd, slave_fd, device_in, device_out;
+  pid_t child;
+  std::string pty_path;
+  struct pollfd waitfds[2];
+  uint8_t buffer[CAPTURE_READ_BYTES];
+  ssize_t count;
+  uint64_t now_ns, stop_ns;
+  struct termios settings;
+  speed_t speed;
+  bool is_ok, device_open;
+
+  child = -1;
+
+  if (!options.command.empty())
+  {
+    child = SpawnPipedCommand(options.command, device_out, device_in);
+    if (0 > child)
+    {
+      fprintf(stderr, "### Unable to run \"%s\".\n", options.command.c_str());
+      return false;
+    }
+  }
+  else
+  {
+    device_in = OpenSerialPort(options.device.c_str(), options.baud);
+    device_out = device_in;
+    if (0 > device_in)
+    {
+      fprintf(stderr, "### Unable to open \"%s\".\n", options.device.c_str());
+      return false;
+    }
+  }
+
+  pty_fd = OpenCapturePty(pty_path, slave_fd);
+  if (0 > pty_fd)
+  {
+    fprintf(stderr, "### Unable to open a pseudo-terminal.\n");
+    return false;
+  }
+
+  if (!options.link.empty())
+  {
+    unlink(options.link.c_str());
+    if (0 != symlink(pty_path.c_str(), options.link.c_str()))
+      fprintf(stderr, "### Unable to link \"%s\".\n", options.link.c_str());
+  }
+
+  // The pseudo-terminal starts out at the device's rate, so that only
+  // real changes get passed on.
+  speed = B0;
+  if ( (0 > child) && (0 == tcgetattr(device_in, &settings)) )
+  {
+    speed = cfgetospeed(&settings);
+
+    if (0 == tcgetattr(slave_fd, &settings))
+    {
+      cfsetispeed(&settings, speed);
+      cfsetospeed(&settings, speed);
+      tcsetattr(slave_fd, TCSANOW, &settings);
+    }
+  }
+
+  printf("pty: %s\n", pty_path.c_str());
+  fflush(stdout);
+
+  now_ns = GetMonotonicNanos();
+  stop_ns = now_ns + (uint64_t) (options.seconds * 1.0e9);
+  is_ok = true;
+  device_open = true;
+
+  while ( is_ok && device_open && (!stop_requested)
+    && ( (0 >= options.seconds) || (now_ns < stop_ns) ) )
+  {
+    waitfds[0].fd = device_in;
+    waitfds[0].events = POLLIN;
+    waitfds[1].fd = pty_fd;
+    waitfds[1].events = POLLIN;
+
+    if (0 > poll(waitfds, 2, 100))
+      waitfds[0].revents = waitfds[1].revents = 0;
+
+    // Each read is timestamped as soon as it returns, and written to the
+    // capture before it's passed on.
+    if (0 != (waitfds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+    {
+      count = read(device_in, buffer, sizeof(buffer));
+      now_ns = GetMonotonicNanos();
+
+      if (0 < count)
+        is_ok = writer.Append(SERIALCAP_FROM_DEVICE, now_ns, buffer, count)
+          && WriteAllBytes(pty_fd, buffer, count);
+      else if (0 == count)
+        device_open = false;
+      else if ( (EAGAIN != errno) && (EINTR != errno) )
+        device_open = false;
+    }
+
+    if (0 != (waitfds[1].revents & POLLIN))
+    {
+      count = read(pty_fd, buffer, sizeof(buffer));
+      now_ns = GetMonotonicNanos();
+
+      if (0 < count)
+        is_ok = writer.Append(SERIALCAP_TO_DEVICE, now_ns, buffer, count)
+          && WriteAllBytes(device_out, buffer, count);
+    }
+
+    if (B0 != speed)
+      FollowPtyBaud(slave_fd, device_in, speed);
+
+    now_ns = GetMonotonicNanos();
+  }
+
+  if (!options.link.empty())
+    unlink(options.link.c_str());
+
+  close(pty_fd);
+  close(slave_fd);
+  close(device_in);
+  if (device_out != device_in)
+    close(device_out);
+
+  if (0 < child)
+  {
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+  }
+
+  if (!is_ok)
+    fprintf(stderr, "### Capture stopped by a write error.\n");
+
+  return is_ok;
+}
+
+
+
+// Main program.
+
+int main(int argc, char **argv)
+{
+  options_t options;
+  SerialCaptureWriter writer;
+  struct sigaction action;
+  uint64_t start_ns;
+  int aidx;
+  bool is_ok;
+
+  options.baud = CAPTURE_DEFAULT_BAUD;
+  options.seconds = 0;
+  is_ok = true;
+
+  for (aidx = 1; is_ok && (aidx < argc); aidx++)
+  {
+    if (0 == strncmp(argv[aidx], "--device=", 9))
+      options.device = argv[aidx] + 9;
+    else if (0 == strncmp(argv[aidx], "--baud=", 7))
+      options.baud = strtoul(argv[aidx] + 7, NULL, 10);
+    else if (0 == strncmp(argv[aidx], "--exec=", 7))
+      options.command = argv[aidx] + 7;
+    else if (0 == strncmp(argv[aidx], "--output=", 9))
+      options.output = argv[aidx] + 9;
+    else if (0 == strncmp(argv[aidx], "--link=", 7))
+      options.link = argv[aidx] + 7;
+    else if (0 == strncmp(argv[aidx], "--seconds=", 10))
+      options.seconds = atof(argv[aidx] + 10);
+    else if (0 == strncmp(argv[aidx], "--text=", 7))
+      options.text = argv[aidx] + 7;
+    else
+      is_ok = false;
+  }
+
+  // Exactly one source.
+  if ( (!is_ok) || options.output.empty()
+    || (1 != ( (options.device.empty() ? 0 : 1)
+      + (options.command.empty() ? 0 : 1) + (options.text.empty() ? 0 : 1) )) )
+  {
+    PrintHelp();
+    return 2;
+  }
+
+  if (!writer.Open(options.output))
+  {
+    fprintf(stderr, "### Unable to write \"%s\".\n", options.output.c_str());
+    return 1;
+  }
+
+  printf("tool: ncam-serialcap\n");
+  printf("output: %s\n", options.output.c_str());
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = HandleStopSignal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  start_ns = GetMonotonicNanos();
+
+  if (!options.text.empty())
+    is_ok = ImportTextCapture(options, writer);
+  else
+    is_ok = RunCaptureProxy(options, writer);
+
+  writer.Close();
+
+  printf("bytes_from_device: %llu\n",
+    (unsigned long long) writer.Bytes(SERIALCAP_FROM_DEVICE));
+  printf("bytes_to_device: %llu\n",
+    (unsigned long long) writer.Bytes(SERIALCAP_TO_DEVICE));
+  printf("seconds: %.3f\n", (GetMonotonicNanos() - start_ns) * 1.0e-9);
+
+  return is_ok ? 0 : 1;
+}
+
+
+//
+// This is the end of the file.
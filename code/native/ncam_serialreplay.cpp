@@ -0,0 +1,512 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Replays a raw serial capture into the link parser, a host program, or
+// a device program.
+
+
+//
+// Includes
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+
+#include "gpiolink.h"
+#include "serialcap.h"
+#include "virtualdev.h"
+
+
+//
+// Private macros
+
+// Bytes read per chunk.
+#define REPLAY_READ_BYTES 4096
+
+// Events buffered by the parser between drains. Each chunk is drained as
+// soon as it's fed, so this only has to hold one chunk's worth.
+#define REPLAY_EVENT_CAPACITY 65536
+
+
+//
+// Private types
+
+struct options_t
+{
+  std::string path;
+  std::string command;
+  std::string output;
+  std::string link;
+  double speed;
+  int settle_ms;
+  bool use_pty;
+  bool print_events;
+};
+
+// What came back from a program, compared against the capture.
+
+struct compare_t
+{
+  std::string expected;
+  uint64_t received;
+  uint64_t first_difference;
+  bool differs;
+};
+
+
+//
+// Private prototypes
+
+static void PrintHelp(void);
+static uint64_t GetDueTime(const options_t &options, uint64_t start_ns,
+  uint64_t first_ns, uint64_t chunk_ns);
+static bool ReplayIntoParser(const options_t &options,
+  const SerialCaptureReader &reader);
+static void CompareBytes(compare_t &compare, const uint8_t *data,
+  size_t length);
+static bool ReplayIntoPeer(const options_t &options,
+  const SerialCaptureReader &reader);
+
+
+//
+// Functions
+
+
+// Prints a help screen.
+
+static void PrintHelp(void)
+{
+  printf(
+"Plays back a capture made by ncam-serialcap.\n"
+"\n"
+"Usage:  ncam-serialreplay [options] <capture>\n"
+"\n"
+"Options:\n"
+"  --speed=<x>        Playback speed: 1 keeps the original timing, 10 plays\n"
+"                     ten times as fast, and 0 (the default) doesn't wait.\n"
+"  --events           (parser) Print each parsed event.\n"
+"  --pty              Act as the device: write the device's side of the\n"
+"                     capture into a pseudo-terminal for a host program\n"
+"                     (e.g. the GPIO monitor) to read. Playback starts when\n"
+"                     the program first sends something.\n"
+"  --link=<path>      (pty) Make a symbolic link to the pseudo-terminal.\n"
+"  --exec=<cmd>       Act as the host: run a device program (e.g. a driver\n"
+"                     built on the host-native firmware library) and write\n"
+"                     the host's side of the capture to its standard input.\n"
+"  --settle-ms=<n>    (pty, exec) Time to wait for more output after the\n"
+"                     last record (default 500).\n"
+"  --output=<file>    (pty, exec) Capture this replay to a new file.\n"
+"\n"
+"Without --pty or --exec, the device's side of the capture is parsed by\n"
+"libgpiolink, with the original host timestamps, and the report gives\n"
+"the event count, malformed records, and throughput.\n"
+"\n"
+"With --pty or --exec, the program's output is compared against the\n"
+"other side of the capture. The report gives \"match: yes\" or \"match: no\"\n"
+"and the offset of the first byte that differed.\n"
+"\n"
+"Reports are one \"key: value\" line per figure.\n"
+"\n");
+}
+
+
+
+// Returns when a record should be played, on the monotonic clock.
+
+static uint64_t GetDueTime(const options_t &options, uint64_t start_ns,
+  uint64_t first_ns, uint64_t chunk_ns)
+{
+  if ( (!(0 < options.speed)) || (chunk_ns < first_ns) )
+    return start_ns;
+
+  return start_ns + (uint64_t) ((chunk_ns - first_ns) / options.speed);
+}
+
+
+
+// Feeds the device's side of a capture through the link parser.
+
+static bool ReplayIntoParser(const options_t &options,
+  const SerialCaptureReader &reader)
+{
+  gpiolink_t *link;
+  gpiolink_event_t event;
+  serialcap_chunk_t chunk;
+  uint64_t start_ns, first_ns, last_ns, elapsed_ns, events;
+  size_t ridx;
+
+  link = gpiolink_open_fd(-1);
+  if ( (NULL == link)
+    || (0 != gpiolink_set_capacity(link, REPLAY_EVENT_CAPACITY)) )
+  {
+    fprintf(stderr, "### Unable to set up the link parser.\n");
+    return false;
+  }
+
+  first_ns = 0;
+  last_ns = 0;
+  events = 0;
+
+  if (0 < reader.Count())
+  {
+    reader.Chunk(0, chunk);
+    first_ns = chunk.host_time_ns;
+  }
+
+  start_ns = GetMonotonicNanos();
+
+  for (ridx = 0; ridx < reader.Count(); ridx++)
+  {
+    reader.Chunk(ridx, chunk);
+    last_ns = chunk.host_time_ns;
+
+    if (SERIALCAP_FROM_DEVICE != chunk.direction)
+      continue;
+
+    if (0 < options.speed)
+      SleepUntilNanos(GetDueTime(options, start_ns, first_ns, last_ns));
+
+    // Events get the capture's timestamps, not ours, so that two replays
+    // of the same capture give the same events.
+    gpiolink_feed(link, chunk.data, chunk.length, chunk.host_time_ns);
+
+    while (0 < gpiolink_next_event(link, &event))
+    {
+      events++;
+
+      if (options.print_events)
+        printf("event: %llu %c %08lx %llu %.6f\n",
+          (unsigned long long) event.sequence, (char) event.reg,
+          (unsigned long) event.value,
+          (unsigned long long) event.device_tick,
+          (event.host_time_ns - first_ns) * 1.0e-9);
+    }
+  }
+
+  elapsed_ns = GetMonotonicNanos() - start_ns;
+  if (0 == elapsed_ns)
+    elapsed_ns = 1;
+
+  printf("mode: parser\n");
+  printf("records: %llu\n", (unsigned long long) reader.Count());
+  printf("bytes_from_device: %llu\n",
+    (unsigned long long) reader.Bytes(SERIALCAP_FROM_DEVICE));
+  printf("bytes_to_device: %llu\n",
+    (unsigned long long) reader.Bytes(SERIALCAP_TO_DEVICE));
+  printf("capture_seconds: %.3f\n", (last_ns - first_ns) * 1.0e-9);
+  printf("replay_seconds: %.3f\n", elapsed_ns * 1.0e-9);
+  printf("events: %llu\n", (unsigned long long) events);
+  printf("bad_records: %llu\n",
+    (unsigned long long) gpiolink_bad_records(link));
+  printf("dropped_events: %llu\n",
+    (unsigned long long) gpiolink_dropped_events(link));
+  printf("mbytes_per_second: %.2f\n",
+    (reader.Bytes(SERIALCAP_FROM_DEVICE) * 1.0e3) / elapsed_ns);
+  printf("events_per_second: %.0f\n", (events * 1.0e9) / elapsed_ns);
+
+  gpiolink_close(link);
+
+  return true;
+}
+
+
+
+// Checks bytes from a program against what the capture says it sent.
+
+static void CompareBytes(compare_t &compare, const uint8_t *data,
+  size_t length)
+{
+  size_t bidx;
+
+  for (bidx = 0; (!compare.differs) && (bidx < length); bidx++)
+    if ( (compare.expected.size() <= (compare.received + bidx))
+      || (((uint8_t) compare.expected[compare.received + bidx]) != data[bidx]) )
+    {
+      compare.differs = true;
+      compare.first_difference = compare.received + bidx;
+    }
+
+  compare.received += length;
+}
+
+
+
+// Plays one side of a capture into a program, and checks what it sends
+// back against the other side.
+
+static bool ReplayIntoPeer(const options_t &options,
+  const SerialCaptureReader &reader)
+{
+  SerialCaptureWriter writer;
+  serialcap_chunk_t chunk;
+  compare_t compare;
+  std::string pty_path;
+  uint8_t buffer[REPLAY_READ_BYTES];
+  struct pollfd waitfd;
+  uint8_t send_dir, expect_dir;
+  int read_fd, write_fd, slave_fd, timeout_ms;
+  pid_t child;
+  uint64_t start_ns, first_ns, due_ns, now_ns, quiet_ns, late_ns, sent;
+  size_t ridx;
+  ssize_t count;
+  bool is_ok, is_open, started;
+
+  child = -1;
+  slave_fd = -1;
+
+  if (options.use_pty)
+  {
+    send_dir = SERIALCAP_FROM_DEVICE;
+    expect_dir = SERIALCAP_TO_DEVICE;
+
+    read_fd = OpenCapturePty(pty_path, slave_fd);
+    write_fd = read_fd;
+    if (0 > read_fd)
+    {
+      fprintf(stderr, "### Unable to open a pseudo-terminal.\n");
+      return false;
+    }
+
+    if (!options.link.empty())
+    {
+      unlink(options.link.c_str());
+      if (0 != symlink(pty_path.c_str(), options.link.c_str()))
+        fprintf(stderr, "### Unable to link \"%s\".\n", options.link.c_str());
+    }
+
+    printf("pty: %s\n", pty_path.c_str());
+    fflush(stdout);
+  }
+  else
+  {
+    send_dir = SERIALCAP_TO_DEVICE;
+    expect_dir = SERIALCAP_FROM_DEVICE;
+
+    child = SpawnPipedCommand(options.command, write_fd, read_fd);
+    if (0 > child)
+    {
+      fprintf(stderr, "### Unable to run \"%s\".\n", options.command.c_str());
+      return false;
+    }
+  }
+
+  if ( (!options.output.empty()) && (!writer.Open(options.output)) )
+    fprintf(stderr, "### Unable to write \"%s\".\n", options.output.c_str());
+
+  compare.received = 0;
+  compare.first_difference = 0;
+  compare.differs = false;
+
+  first_ns = 0;
+  for (ridx = 0; ridx < reader.Count(); ridx++)
+  {
+    reader.Chunk(ridx, chunk);
+    if (0 == ridx)
+      first_ns = chunk.host_time_ns;
+    if (expect_dir == chunk.direction)
+      compare.expected.append((const char *) chunk.data, chunk.length);
+  }
+
+  // A host program gets to speak first; a device program is started
+  // right away.
+  started = !options.use_pty;
+  start_ns = GetMonotonicNanos();
+  quiet_ns = start_ns;
+  late_ns = 0;
+  sent = 0;
+  ridx = 0;
+  is_ok = true;
+  is_open = true;
+
+  while (is_ok && is_open)
+  {
+    // Find the next record to send, if there's one.
+    for (; ridx < reader.Count(); ridx++)
+    {
+      reader.Chunk(ridx, chunk);
+      if (send_dir == chunk.direction)
+        break;
+    }
+
+    // Closing a device program's input tells it there's no more.
+    if ( (0 < child) && (0 <= write_fd) && (ridx >= reader.Count()) )
+    {
+      close(write_fd);
+      write_fd = -1;
+    }
+
+    now_ns = GetMonotonicNanos();
+
+    if (!started)
+      timeout_ms = 100;
+    else if (ridx < reader.Count())
+    {
+      due_ns = GetDueTime(options, start_ns, first_ns, chunk.host_time_ns);
+
+      if (due_ns <= now_ns)
+      {
+        if ( (0 < options.speed) && (late_ns < (now_ns - due_ns)) )
+          late_ns = now_ns - due_ns;
+
+        writer.Append(send_dir, now_ns, chunk.data, chunk.length);
+        is_ok = WriteAllBytes(write_fd, chunk.data, chunk.length);
+        sent += chunk.length;
+        ridx++;
+
+        quiet_ns = GetMonotonicNanos();
+        continue;
+      }
+
+      timeout_ms = 1 + ((due_ns - now_ns) / 1000000);
+    }
+    else if ((quiet_ns + options.settle_ms * 1000000ull) <= now_ns)
+      break;
+    else
+      timeout_ms = 1 + ((quiet_ns + options.settle_ms * 1000000ull - now_ns)
+        / 1000000);
+
+    waitfd.fd = read_fd;
+    waitfd.events = POLLIN;
+
+    if (0 < poll(&waitfd, 1, timeout_ms))
+    {
+      count = read(read_fd, buffer, sizeof(buffer));
+      now_ns = GetMonotonicNanos();
+
+      if (0 < count)
+      {
+        if (!started)
+        {
+          started = true;
+          start_ns = now_ns;
+        }
+
+        writer.Append(expect_dir, now_ns, buffer, count);
+        CompareBytes(compare, buffer, count);
+        quiet_ns = now_ns;
+      }
+      else if ( (0 == count)
+        || ( (EAGAIN != errno) && (EINTR != errno) ) )
+        is_open = false;
+    }
+  }
+
+  if ( (!compare.differs) && (compare.received < compare.expected.size()) )
+  {
+    compare.differs = true;
+    compare.first_difference = compare.received;
+  }
+
+  printf("mode: %s\n", options.use_pty ? "pty" : "exec");
+  printf("bytes_sent: %llu\n", (unsigned long long) sent);
+  printf("bytes_expected: %llu\n",
+    (unsigned long long) compare.expected.size());
+  printf("bytes_received: %llu\n", (unsigned long long) compare.received);
+  printf("match: %s\n", compare.differs ? "no" : "yes");
+  if (compare.differs)
+    printf("first_difference: %llu\n",
+      (unsigned long long) compare.first_difference);
+  else
+    printf("first_difference: none\n");
+  printf("late_max_us: %.1f\n", late_ns * 1.0e-3);
+
+  writer.Close();
+
+  if (!options.link.empty())
+    unlink(options.link.c_str());
+
+  if (0 <= slave_fd)
+    close(slave_fd);
+  close(read_fd);
+  if ( (0 <= write_fd) && (write_fd != read_fd) )
+    close(write_fd);
+
+  if (0 < child)
+  {
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+  }
+
+  if (!is_ok)
+    fprintf(stderr, "### Replay stopped by a write error.\n");
+
+  return is_ok;
+}
+
+
+
+// Main program.
+
+int main(int argc, char **argv)
+{
+  options_t options;
+  SerialCaptureReader reader;
+  int aidx;
+  bool is_ok;
+
+  options.speed = 0;
+  options.settle_ms = 500;
+  options.use_pty = false;
+  options.print_events = false;
+  is_ok = true;
+
+  for (aidx = 1; is_ok && (aidx < argc); aidx++)
+  {
+    if (0 == strncmp(argv[aidx], "--speed=", 8))
+      options.speed = atof(argv[aidx] + 8);
+    else if (0 == strcmp(argv[aidx], "--events"))
+      options.print_events = true;
+    else if (0 == strcmp(argv[aidx], "--pty"))
+      options.use_pty = true;
+    else if (0 == strncmp(argv[aidx], "--link=", 7))
+      options.link = argv[aidx] + 7;
+    else if (0 == strncmp(argv[aidx], "--exec=", 7))
+      options.command = argv[aidx] + 7;
+    else if (0 == strncmp(argv[aidx], "--settle-ms=", 12))
+      options.settle_ms = atoi(argv[aidx] + 12);
+    else if (0 == strncmp(argv[aidx], "--output=", 9))
+      options.output = argv[aidx] + 9;
+    else if ('-' == argv[aidx][0])
+      is_ok = false;
+    else if (options.path.empty())
+      options.path = argv[aidx];
+    else
+      is_ok = false;
+  }
+
+  if ( (!is_ok) || options.path.empty() || (0 > options.speed)
+    || (0 > options.settle_ms)
+    || (options.use_pty && (!options.command.empty())) )
+  {
+    PrintHelp();
+    return 2;
+  }
+
+  if (!reader.Open(options.path))
+  {
+    fprintf(stderr, "### Unable to read a capture from \"%s\".\n",
+      options.path.c_str());
+    return 1;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  printf("tool: ncam-serialreplay\n");
+  printf("capture: %s\n", options.path.c_str());
+  printf("speed: %g\n", options.speed);
+
+  if (options.use_pty || (!options.command.empty()))
+    is_ok = ReplayIntoPeer(options, reader);
+  else
+    is_ok = ReplayIntoParser(options, reader);
+
+  return is_ok ? 0 : 1;
+}
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,339 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// LED strobe time estimator - command-line front end.
+
+
+//
+// Includes
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "framelog.h"
+#include "streamtime.h"
+#include "thumbnail.h"
+#include "workpool.h"
+
+
+//
+// Private macros
+
+// Tiles per job in the blind pass.
+#define STREAMTIME_TILE_BLOCK 16
+
+
+//
+// Private types
+
+struct feed_t
+{
+  std::string name;
+
+  // Log line index and image file for each frame, in log order.
+  std::vector<size_t> lines;
+  std::vector<std::string> files;
+
+  TileSeries series;
+
+  // Blind estimate, per tile and overall.
+  std::vector<double> tile_offsets;
+  std::vector<double> tile_evidence;
+  size_t best_tile;
+  bool ok;
+
+  std::vector<long long> corrected;
+  std::vector<double> segment_offsets;
+};
+
+
+//
+// Private prototypes
+
+static void PrintHelp(void);
+static bool ReadFrameList(const std::string &logname,
+  std::vector<feed_t> &feeds);
+
+
+
+//
+// Functions
+
+
+// Prints a help screen.
+
+static void PrintHelp(void)
+{
+  printf(
+"Estimates each video feed's time shift from the LED strobe in its frames,\n"
+"and prints corrected frame timestamps.\n"
+"\n"
+"Usage:  ncam-streamtime --period=<ms> --gpio-offset=<ms> [options]\n"
+"          --feed=<label> [--feed=<label> ...]  <repository folder>\n"
+"\n"
+"Options:\n"
+"  --log=<file>     Log to read (default: <folder>/logfile.txt).\n"
+"  --threads=<n>    Worker threads (default: one per core).\n"
+"  --exact-decode   Decode frames at full size (slower; default shrinks\n"
+"                   frames in the JPEG decoder before filtering).\n"
+"\n"
+"For each feed, this prints:\n"
+"  feed <label> frames <n> tile <t> offset <ms> evidence <x>\n"
+"  segment <label> <ms>       (one per re-estimated segment)\n"
+"  line <log line index> <corrected time>\n"
+"The estimates follow NCAM_AdjustTimestampsOneStream() step for step.\n"
+"\n");
+}
+
+
+
+// Reads the frame lines for the requested feeds from the log.
+
+static bool ReadFrameList(const std::string &logname,
+  std::vector<feed_t> &feeds)
+{
+  int fd;
+  struct stat info;
+  const char *data, *line, *next, *end;
+  size_t lidx, fidx;
+  double time;
+  std::string label, file;
+
+  fd = open(logname.c_str(), O_RDONLY);
+  if (0 > fd)
+    return false;
+
+  if ( (0 != fstat(fd, &info)) || (0 == info.st_size) )
+  {
+    close(fd);
+    return (0 == info.st_size);
+  }
+
+  data = (const char *) mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE,
+    fd, 0);
+  close(fd);
+  if (MAP_FAILED == data)
+    return false;
+
+  end = data + info.st_size;
+  lidx = 0;
+
+  for (line = data; line < end; line = next + 1, lidx++)
+  {
+    next = (const char *) memchr(line, '\n', end - line);
+    if (NULL == next)
+      next = end;
+
+    if (!ParseFrameLine(line, next - line, time, label, file))
+      continue;
+
+    for (fidx = 0; fidx < feeds.size(); fidx++)
+      if (feeds[fidx].name == label)
+      {
+        feeds[fidx].lines.push_back(lidx);
+        feeds[fidx].files.push_back(file);
+        feeds[fidx].series.times.push_back(time);
+      }
+  }
+
+  munmap((void *) data, info.st_size);
+
+  return true;
+}
+
+
+
+// Main program.
+
+int main(int argc, char **argv)
+{
+  StreamTimeParams params;
+  std::vector<feed_t> feeds;
+  std::vector< std::pair<size_t, size_t> > jobs;
+  std::string repodir, logname;
+  double period, gpio_offset;
+  unsigned workers;
+  bool have_period, have_offset, fast;
+  size_t tiles, fidx, idx, blocks;
+  int aidx;
+
+  have_period = false;
+  have_offset = false;
+  fast = true;
+  period = 0;
+  gpio_offset = 0;
+  workers = GetDefaultWorkerCount();
+
+  for (aidx = 1; aidx < argc; aidx++)
+  {
+    if (0 == strncmp(argv[aidx], "--period=", 9))
+    {
+      period = atof(argv[aidx] + 9);
+      have_period = true;
+    }
+    else if (0 == strncmp(argv[aidx], "--gpio-offset=", 14))
+    {
+      gpio_offset = atof(argv[aidx] + 14);
+      have_offset = true;
+    }
+    else if (0 == strncmp(argv[aidx], "--feed=", 7))
+    {
+      feeds.push_back(feed_t());
+      feeds.back().name = argv[aidx] + 7;
+    }
+    else if (0 == strncmp(argv[aidx], "--log=", 6))
+      logname = argv[aidx] + 6;
+    else if (0 == strncmp(argv[aidx], "--threads=", 10))
+      workers = atoi(argv[aidx] + 10);
+    else if (0 == strcmp(argv[aidx], "--exact-decode"))
+      fast = false;
+    else if ('-' == argv[aidx][0])
+    {
+      PrintHelp();
+      return 2;
+    }
+    else
+      repodir = argv[aidx];
+  }
+
+  if ( repodir.empty() || feeds.empty() || (!have_period) || (!have_offset)
+    || (!(0 < period)) )
+  {
+    PrintHelp();
+    return 2;
+  }
+
+  if (1 > workers)
+    workers = 1;
+
+  if (logname.empty())
+    logname = repodir + "/logfile.txt";
+
+  tiles = params.tiles_wide * params.tiles_high;
+  for (fidx = 0; fidx < feeds.size(); fidx++)
+    feeds[fidx].series.tiles = tiles;
+
+  if (!ReadFrameList(logname, feeds))
+  {
+    fprintf(stderr, "### Unable to read \"%s\".\n", logname.c_str());
+    return 2;
+  }
+
+
+  // Decode every frame of every feed into thumbnails.
+
+  jobs.clear();
+  for (fidx = 0; fidx < feeds.size(); fidx++)
+  {
+    feeds[fidx].series.values.assign(feeds[fidx].series.Frames() * tiles, 0);
+    for (idx = 0; idx < feeds[fidx].series.Frames(); idx++)
+      jobs.push_back(std::make_pair(fidx, idx));
+  }
+
+  RunParallel(jobs.size(), workers,
+    [&feeds, &jobs, &repodir, &params, tiles, fast](size_t jidx)
+    {
+      feed_t &feed = feeds[jobs[jidx].first];
+      size_t frame = jobs[jidx].second;
+      std::string path;
+
+      path = repodir + "/" + feed.files[frame];
+      if (!MakeThumbnail(path.c_str(), params.tiles_wide, params.tiles_high,
+        fast, feed.series.values.data() + frame * tiles))
+        fprintf(stderr, "-- Can't read \"%s\"!\n", path.c_str());
+    });
+
+
+  // Blind estimate over the start of each feed, in blocks of tiles.
+
+  blocks = (tiles + STREAMTIME_TILE_BLOCK - 1) / STREAMTIME_TILE_BLOCK;
+
+  jobs.clear();
+  for (fidx = 0; fidx < feeds.size(); fidx++)
+  {
+    feeds[fidx].tile_offsets.assign(tiles, 0);
+    feeds[fidx].tile_evidence.assign(tiles, 0);
+    feeds[fidx].ok = (0 < feeds[fidx].series.Frames());
+
+    if (feeds[fidx].ok)
+      for (idx = 0; idx < blocks; idx++)
+        jobs.push_back(std::make_pair(fidx, idx));
+  }
+
+  RunParallel(jobs.size(), workers,
+    [&feeds, &jobs, &params, tiles, period](size_t jidx)
+    {
+      feed_t &feed = feeds[jobs[jidx].first];
+      size_t first, last, frames;
+
+      first = jobs[jidx].second * STREAMTIME_TILE_BLOCK;
+      last = first + STREAMTIME_TILE_BLOCK;
+      if (last > tiles)
+        last = tiles;
+
+      frames = feed.series.Frames();
+      if (frames > params.seek_frames)
+        frames = params.seek_frames;
+
+      if (!EstimateSeriesTimes(feed.series, 0, frames, first, last, period,
+        0.0, 0.0, params, feed.tile_offsets.data() + first,
+        feed.tile_evidence.data() + first))
+        feed.ok = false;
+    });
+
+
+  // Hinted pass over each whole feed, one feed per thread.
+
+  RunParallel(feeds.size(), workers,
+    [&feeds, &params, tiles, period, gpio_offset](size_t jidx)
+    {
+      feed_t &feed = feeds[jidx];
+
+      if (!feed.ok)
+        return;
+
+      feed.best_tile = PickBestTile(feed.tile_evidence.data(), tiles);
+      AdjustStreamTimes(feed.series, feed.best_tile,
+        feed.tile_offsets[feed.best_tile], period, gpio_offset, params,
+        feed.corrected, feed.segment_offsets);
+    });
+
+
+  // Report.
+
+  for (fidx = 0; fidx < feeds.size(); fidx++)
+  {
+    feed_t &feed = feeds[fidx];
+
+    if (!feed.ok)
+    {
+      printf("feed %s frames %lu none\n", feed.name.c_str(),
+        (unsigned long) feed.series.Frames());
+      continue;
+    }
+
+    printf("feed %s frames %lu tile %lu offset %.17g evidence %.17g\n",
+      feed.name.c_str(), (unsigned long) feed.series.Frames(),
+      (unsigned long) feed.best_tile, feed.tile_offsets[feed.best_tile],
+      feed.tile_evidence[feed.best_tile]);
+
+    for (idx = 0; idx < feed.segment_offsets.size(); idx++)
+      printf("segment %s %.17g\n", feed.name.c_str(),
+        feed.segment_offsets[idx]);
+
+    for (idx = 0; idx < feed.lines.size(); idx++)
+      printf("line %lu %lld\n", (unsigned long) feed.lines[idx],
+        feed.corrected[idx]);
+  }
+
+  return 0;
+}
+
+
+//
+// This is the end of the file.
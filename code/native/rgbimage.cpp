@@ -0,0 +1,348 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Packed RGB images, with JPEG reading and writing.
+
+
+//
+// Includes
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jpeglib.h>
+
+#include "rgbimage.h"
+
+
+//
+// Private types
+
+// libjpeg reports fatal errors through a callback; we jump back out.
+struct rgb_jpeg_error_t
+{
+  struct jpeg_error_mgr manager;
+  jmp_buf escape;
+};
+
+
+//
+// Private prototypes
+
+static void HandleJPEGError(j_common_ptr info);
+static bool DecodeJPEGFrom(FILE *infile, const uint8_t *data, size_t bytes,
+  int box_width, int box_height, RGBImage &image);
+static bool EncodeJPEGTo(FILE *outfile, std::vector<uint8_t> *data,
+  const RGBImage &image, int quality);
+
+
+
+//
+// Image methods
+
+
+// Constructor.
+
+RGBImage::RGBImage(int new_width, int new_height)
+{
+  Fill(new_width, new_height, 0);
+}
+
+
+
+// Resizes the image and fills it with a grey level.
+
+void RGBImage::Fill(int new_width, int new_height, uint8_t grey)
+{
+  width = new_width;
+  height = new_height;
+  pixels.assign(3 * width * height, grey);
+}
+
+
+
+// Copies another image in, clipped to this one.
+
+void RGBImage::Paste(const RGBImage &source, int x, int y)
+{
+  int first_x, last_x, row;
+
+  first_x = (0 > x) ? -x : 0;
+  last_x = source.width;
+  if ((x + last_x) > width)
+    last_x = width - x;
+
+  if (first_x >= last_x)
+    return;
+
+  for (row = 0; row < source.height; row++)
+  {
+    if ( (0 > (y + row)) || (height <= (y + row)) )
+      continue;
+
+    memcpy(Pixel(x + first_x, y + row), source.Pixel(first_x, row),
+      3 * (last_x - first_x));
+  }
+}
+
+
+
+//
+// Functions
+
+
+// Bails out of a failed decode or encode.
+
+static void HandleJPEGError(j_common_ptr info)
+{
+  rgb_jpeg_error_t *error;
+
+  error = (rgb_jpeg_error_t *) info->err;
+  longjmp(error->escape, 1);
+}
+
+
+
+// Decodes a JPEG from a file (if "infile" isn't NULL) or from memory.
+
+static bool DecodeJPEGFrom(FILE *infile, const uint8_t *data, size_t bytes,
+  int box_width, int box_height, RGBImage &image)
+{
+  struct jpeg_decompress_struct info;
+  rgb_jpeg_error_t error;
+  JSAMPROW rowptr;
+  double scale, yscale;
+  int denom, row, col;
+  uint8_t *pixel;
+
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = HandleJPEGError;
+
+  if (setjmp(error.escape))
+  {
+    jpeg_destroy_decompress(&info);
+    return false;
+  }
+
+  jpeg_create_decompress(&info);
+  if (NULL != infile)
+    jpeg_stdio_src(&info, infile);
+  else
+    jpeg_mem_src(&info, (unsigned char *) data, bytes);
+  jpeg_read_header(&info, TRUE);
+
+  if (JCS_GRAYSCALE != info.jpeg_color_space)
+    info.out_color_space = JCS_RGB;
+
+  // Shrink by the largest factor that still leaves at least as many
+  // pixels as the image will have once it's fit to the box.
+  info.scale_num = 1;
+  info.scale_denom = 1;
+  if ( (0 < box_width) && (0 < box_height) )
+  {
+    scale = ((double) box_width) / info.image_width;
+    yscale = ((double) box_height) / info.image_height;
+    if (yscale < scale)
+      scale = yscale;
+
+    for (denom = 8; denom > 1; denom >>= 1)
+      if (1.0 >= (denom * scale))
+      {
+        info.scale_denom = denom;
+        break;
+      }
+  }
+
+  jpeg_start_decompress(&info);
+
+  image.Fill(info.output_width, info.output_height, 0);
+
+  for (row = 0; row < image.height; row++)
+  {
+    rowptr = image.Pixel(0, row);
+    jpeg_read_scanlines(&info, &rowptr, 1);
+
+    // Expand greyscale in place, working backwards.
+    if (1 == info.output_components)
+      for (col = image.width - 1; col >= 0; col--)
+      {
+        pixel = image.Pixel(col, row);
+        pixel[0] = rowptr[col];
+        pixel[1] = pixel[0];
+        pixel[2] = pixel[0];
+      }
+  }
+
+  jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
+
+  return true;
+}
+
+
+
+// Encodes a JPEG to a file (if "outfile" isn't NULL) or to memory.
+
+static bool EncodeJPEGTo(FILE *outfile, std::vector<uint8_t> *data,
+  const RGBImage &image, int quality)
+{
+  struct jpeg_compress_struct info;
+  rgb_jpeg_error_t error;
+  JSAMPROW rowptr;
+  unsigned char *buffer;
+  unsigned long bytes;
+  int row;
+
+  buffer = NULL;
+  bytes = 0;
+
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = HandleJPEGError;
+
+  if (setjmp(error.escape))
+  {
+    jpeg_destroy_compress(&info);
+    if (NULL != buffer)
+      free(buffer);
+    return false;
+  }
+
+  jpeg_create_compress(&info);
+  if (NULL != outfile)
+    jpeg_stdio_dest(&info, outfile);
+  else
+    jpeg_mem_dest(&info, &buffer, &bytes);
+
+  info.image_width = image.width;
+  info.image_height = image.height;
+  info.input_components = 3;
+  info.in_color_space = JCS_RGB;
+
+  jpeg_set_defaults(&info);
+  jpeg_set_quality(&info, quality, TRUE);
+  jpeg_start_compress(&info, TRUE);
+
+  for (row = 0; row < image.height; row++)
+  {
+    rowptr = (JSAMPROW) image.Pixel(0, row);
+    jpeg_write_scanlines(&info, &rowptr, 1);
+  }
+
+  jpeg_finish_compress(&info);
+  jpeg_destroy_compress(&info);
+
+  // The memory destination is only complete once compression finishes.
+  if (NULL != data)
+    data->assign(buffer, buffer + bytes);
+  if (NULL != buffer)
+    free(buffer);
+
+  return true;
+}
+
+
+
+// Reads a JPEG.
+
+bool ReadJPEG(const char *path, int box_width, int box_height,
+  RGBImage &image)
+{
+  FILE *infile;
+  bool result;
+
+  infile = fopen(path, "rb");
+  if (NULL == infile)
+    return false;
+
+  result = DecodeJPEGFrom(infile, NULL, 0, box_width, box_height, image);
+  fclose(infile);
+
+  return result;
+}
+
+
+
+// Decodes a JPEG held in memory.
+
+bool DecodeJPEG(const uint8_t *data, size_t bytes, int box_width,
+  int box_height, RGBImage &image)
+{
+  return DecodeJPEGFrom(NULL, data, bytes, box_width, box_height, image);
+}
+
+
+
+// Writes a JPEG.
+
+bool WriteJPEG(const char *path, const RGBImage &image, int quality)
+{
+  FILE *outfile;
+  bool result;
+
+  outfile = fopen(path, "wb");
+  if (NULL == outfile)
+    return false;
+
+  result = EncodeJPEGTo(outfile, NULL, image, quality);
+
+  return ( (0 == fclose(outfile)) && result );
+}
+
+
+
+// Encodes a JPEG into memory.
+
+bool EncodeJPEG(const RGBImage &image, int quality,
+  std::vector<uint8_t> &data)
+{
+  return EncodeJPEGTo(NULL, &data, image, quality);
+}
+
+
+
+// Scales an image to fit within a box by point sampling.
+
+void SampleToFit(const RGBImage &source, int box_width, int box_height,
+  RGBImage &dest)
+{
+  double scale, yscale;
+  int new_width, new_height, row, col, src_row;
+  std::vector<int> src_cols;
+
+  if ( (1 > source.width) || (1 > source.height) )
+  {
+    dest.Fill(0, 0, 0);
+    return;
+  }
+
+  scale = ((double) box_width) / source.width;
+  yscale = ((double) box_height) / source.height;
+  if (yscale < scale)
+    scale = yscale;
+
+  new_width = (int) (source.width * scale + 0.5);
+  new_height = (int) (source.height * scale + 0.5);
+  if (1 > new_width)
+    new_width = 1;
+  if (1 > new_height)
+    new_height = 1;
+
+  dest.Fill(new_width, new_height, 0);
+
+  // Each output pixel takes the source pixel under its centre.
+  src_cols.resize(new_width);
+  for (col = 0; col < new_width; col++)
+    src_cols[col] = (int) ((col + 0.5) * source.width / new_width);
+
+  for (row = 0; row < new_height; row++)
+  {
+    src_row = (int) ((row + 0.5) * source.height / new_height);
+
+    for (col = 0; col < new_width; col++)
+      memcpy(dest.Pixel(col, row), source.Pixel(src_cols[col], src_row), 3);
+  }
+}
+
+
+//
+// This is the end of the file.
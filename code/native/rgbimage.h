@@ -0,0 +1,76 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Packed RGB images, with JPEG reading and writing.
+
+
+#ifndef RGBIMAGE_H
+#define RGBIMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+//
+// Classes
+
+// An 8-bit RGB image, stored row by row with no padding.
+
+class RGBImage
+{
+public:
+  RGBImage(int new_width = 0, int new_height = 0);
+
+  // Resizes the image and fills it with a grey level.
+  void Fill(int new_width, int new_height, uint8_t grey);
+
+  uint8_t *Pixel(int x, int y)
+  {
+    return pixels.data() + 3 * (y * width + x);
+  }
+
+  const uint8_t *Pixel(int x, int y) const
+  {
+    return pixels.data() + 3 * (y * width + x);
+  }
+
+  // Copies another image in with its top left corner at (x, y), clipping
+  // it to this image.
+  void Paste(const RGBImage &source, int x, int y);
+
+  int width;
+  int height;
+  std::vector<uint8_t> pixels;
+};
+
+
+//
+// Functions
+
+// Reads a JPEG. If box_width and box_height are nonzero, the image is going
+// to be fit to that box, and the decoder may shrink it (in the DCT domain)
+// as long as it stays at least that large. Returns false on failure.
+bool ReadJPEG(const char *path, int box_width, int box_height,
+  RGBImage &image);
+
+// Decodes a JPEG held in memory, the same way ReadJPEG() does.
+bool DecodeJPEG(const uint8_t *data, size_t bytes, int box_width,
+  int box_height, RGBImage &image);
+
+// Writes a JPEG at the given quality (1..100). Returns false on failure.
+bool WriteJPEG(const char *path, const RGBImage &image, int quality);
+
+// Encodes a JPEG into memory at the given quality (1..100). Returns false
+// on failure.
+bool EncodeJPEG(const RGBImage &image, int quality,
+  std::vector<uint8_t> &data);
+
+// Scales an image to fit within a box, keeping its aspect ratio, by point
+// sampling (ImageMagick's "Sample" with a "WxH" geometry).
+void SampleToFit(const RGBImage &source, int box_width, int box_height,
+  RGBImage &dest);
+
+
+#endif
+
+//
+// This is the end of the file.
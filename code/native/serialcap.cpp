@@ -0,0 +1,418 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Raw serial capture file - record format, writer, and mapped reader.
+
+
+//
+// Includes
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "serialcap.h"
+
+
+// Record headers are read and written by copying this structure, so it
+// has to come out exactly the size on disk.
+static_assert(SERIALCAP_RECORD_HEADER_BYTES == sizeof(serialcap_record_t),
+  "serialcap_record_t must be 16 bytes");
+
+
+
+//
+// Writer methods
+
+
+// Constructor.
+
+SerialCaptureWriter::SerialCaptureWriter()
+{
+  capture = NULL;
+  from_bytes = 0;
+  to_bytes = 0;
+}
+
+
+
+// Destructor.
+
+SerialCaptureWriter::~SerialCaptureWriter()
+{
+  Close();
+}
+
+
+
+// Creates the capture file.
+
+bool SerialCaptureWriter::Open(const std::string &path)
+{
+  uint8_t header[SERIALCAP_HEADER_BYTES];
+  uint32_t version, extra;
+
+  Close();
+
+  from_bytes = 0;
+  to_bytes = 0;
+
+  capture = fopen(path.c_str(), "wb");
+  if (NULL == capture)
+    return false;
+
+  // The record header size goes in the file header, so readers can tell
+  // if a later version adds fields.
+  version = SERIALCAP_VERSION;
+  extra = SERIALCAP_RECORD_HEADER_BYTES;
+
+  memcpy(header, SERIALCAP_MAGIC, 8);
+  memcpy(header + 8, &version, 4);
+  memcpy(header + 12, &extra, 4);
+
+  if (1 != fwrite(header, sizeof(header), 1, capture))
+  {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+
+
+// Closes the file.
+
+void SerialCaptureWriter::Close()
+{
+  if (NULL != capture)
+    fclose(capture);
+
+  capture = NULL;
+}
+
+
+
+// Appends one chunk.
+
+bool SerialCaptureWriter::Append(uint8_t direction, uint64_t host_time_ns,
+  const void *data, size_t length)
+{
+  serialcap_record_t record;
+  const uint8_t *bytes;
+  size_t thislength;
+
+  if (NULL == capture)
+    return false;
+
+  bytes = (const uint8_t *) data;
+
+  memset(&record, 0, sizeof(record));
+  record.host_time_ns = host_time_ns;
+  record.direction = direction;
+
+  while (0 < length)
+  {
+    thislength = (SERIALCAP_MAX_CHUNK < length) ? SERIALCAP_MAX_CHUNK : length;
+    record.length = thislength;
+
+    if ( (1 != fwrite(&record, sizeof(record), 1, capture))
+      || (1 != fwrite(bytes, thislength, 1, capture)) )
+      return false;
+
+    if (SERIALCAP_TO_DEVICE == direction)
+      to_bytes += thislength;
+    else
+      from_bytes += thislength;
+
+    bytes += thislength;
+    length -= thislength;
+  }
+
+  return true;
+}
+
+
+
+// Pushes buffered records out to the file.
+
+bool SerialCaptureWriter::Flush()
+{
+  if (NULL == capture)
+    return false;
+
+  return (0 == fflush(capture));
+}
+
+
+
+//
+// Reader methods
+
+
+// Constructor.
+
+SerialCaptureReader::SerialCaptureReader()
+{
+  capture_map = NULL;
+  capture_bytes = 0;
+  from_bytes = 0;
+  to_bytes = 0;
+}
+
+
+
+// Destructor.
+
+SerialCaptureReader::~SerialCaptureReader()
+{
+  Close();
+}
+
+
+
+// Maps a capture file and finds its records.
+
+bool SerialCaptureReader::Open(const std::string &path)
+{
+  int fd;
+  struct stat info;
+  void *data;
+  uint32_t version, extra;
+  serialcap_record_t record;
+  size_t offset;
+
+  Close();
+
+  fd = open(path.c_str(), O_RDONLY);
+  if (0 > fd)
+    return false;
+
+  if ( (0 != fstat(fd, &info)) || (SERIALCAP_HEADER_BYTES > info.st_size) )
+  {
+    close(fd);
+    return false;
+  }
+
+  data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (MAP_FAILED == data)
+    return false;
+
+  capture_map = (const uint8_t *) data;
+  capture_bytes = info.st_size;
+
+  memcpy(&version, capture_map + 8, 4);
+  memcpy(&extra, capture_map + 12, 4);
+
+  if ( (0 != memcmp(capture_map, SERIALCAP_MAGIC, 8))
+    || (SERIALCAP_VERSION != version)
+    || (SERIALCAP_RECORD_HEADER_BYTES != extra) )
+  {
+    Close();
+    return false;
+  }
+
+  // A partly-written last record (from a crash) is ignored.
+  offset = SERIALCAP_HEADER_BYTES;
+  while ((offset + SERIALCAP_RECORD_HEADER_BYTES) <= capture_bytes)
+  {
+    memcpy(&record, capture_map + offset, sizeof(record));
+
+    if ( (capture_bytes - offset - SERIALCAP_RECORD_HEADER_BYTES)
+      < record.length )
+      break;
+
+    offsets.push_back(offset);
+
+    if (SERIALCAP_TO_DEVICE == record.direction)
+      to_bytes += record.length;
+    else
+      from_bytes += record.length;
+
+    offset += SERIALCAP_RECORD_HEADER_BYTES + record.length;
+  }
+
+  return true;
+}
+
+
+
+// Unmaps the file.
+
+void SerialCaptureReader::Close()
+{
+  if (NULL != capture_map)
+    munmap((void *) capture_map, capture_bytes);
+
+  capture_map = NULL;
+  capture_bytes = 0;
+
+  offsets.clear();
+  from_bytes = 0;
+  to_bytes = 0;
+}
+
+
+
+// Fetches one record.
+
+void SerialCaptureReader::Chunk(size_t ridx, serialcap_chunk_t &chunk) const
+{
+  serialcap_record_t record;
+
+  memcpy(&record, capture_map + offsets[ridx], sizeof(record));
+
+  chunk.host_time_ns = record.host_time_ns;
+  chunk.direction = record.direction;
+  chunk.length = record.length;
+  chunk.data = capture_map + offsets[ridx] + SERIALCAP_RECORD_HEADER_BYTES;
+}
+
+
+
+//
+// Functions
+
+
+// Opens a raw-mode pseudo-terminal.
+
+int OpenCapturePty(std::string &slave_path, int &slave_fd)
+{
+  int master_fd;
+  const char *name;
+  struct termios settings;
+
+  slave_fd = -1;
+
+  master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (0 > master_fd)
+    return -1;
+
+  name = NULL;
+  if ( (0 == grantpt(master_fd)) && (0 == unlockpt(master_fd)) )
+    name = ptsname(master_fd);
+
+  if (NULL != name)
+  {
+    slave_path = name;
+    slave_fd = open(name, O_RDWR | O_NOCTTY);
+  }
+
+  // Programs normally set the port up themselves, but the line discipline
+  // would mangle anything that arrives before they do.
+  if ( (0 > slave_fd) || (0 != tcgetattr(slave_fd, &settings)) )
+  {
+    if (0 <= slave_fd)
+      close(slave_fd);
+    close(master_fd);
+    slave_fd = -1;
+    return -1;
+  }
+
+  cfmakeraw(&settings);
+  tcsetattr(slave_fd, TCSANOW, &settings);
+
+  return master_fd;
+}
+
+
+
+// Runs a shell command with pipes to it.
+
+pid_t SpawnPipedCommand(const std::string &command, int &to_child,
+  int &from_child)
+{
+  int inpipe[2], outpipe[2];
+  pid_t child;
+
+  to_child = -1;
+  from_child = -1;
+
+  if (0 != pipe(inpipe))
+    return -1;
+
+  if (0 != pipe(outpipe))
+  {
+    close(inpipe[0]);
+    close(inpipe[1]);
+    return -1;
+  }
+
+  child = fork();
+
+  if (0 == child)
+  {
+    dup2(inpipe[0], STDIN_FILENO);
+    dup2(outpipe[1], STDOUT_FILENO);
+    close(inpipe[0]);
+    close(inpipe[1]);
+    close(outpipe[0]);
+    close(outpipe[1]);
+
+    execl("/bin/sh", "sh", "-c", command.c_str(), (char *) NULL);
+    _exit(127);
+  }
+
+  close(inpipe[0]);
+  close(outpipe[1]);
+
+  if (0 > child)
+  {
+    close(inpipe[1]);
+    close(outpipe[0]);
+    return -1;
+  }
+
+  // The parent's ends shouldn't leak into later children.
+  fcntl(inpipe[1], F_SETFD, FD_CLOEXEC);
+  fcntl(outpipe[0], F_SETFD, FD_CLOEXEC);
+
+  to_child = inpipe[1];
+  from_child = outpipe[0];
+
+  return child;
+}
+
+
+
+// Writes a whole buffer.
+
+bool WriteAllBytes(int fd, const void *data, size_t length)
+{
+  const uint8_t *bytes;
+  struct pollfd waitfd;
+  ssize_t count;
+
+  bytes = (const uint8_t *) data;
+
+  while (0 < length)
+  {
+    count = write(fd, bytes, length);
+
+    if (0 <= count)
+    {
+      bytes += count;
+      length -= count;
+    }
+    else if ( (EAGAIN == errno) || (EWOULDBLOCK == errno) )
+    {
+      waitfd.fd = fd;
+      waitfd.events = POLLOUT;
+      poll(&waitfd, 1, 100);
+    }
+    else if (EINTR != errno)
+      return false;
+  }
+
+  return true;
+}
+
+
+//
+// This is the end of the file.
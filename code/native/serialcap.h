@@ -0,0 +1,161 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Raw serial capture file - record format, writer, and mapped reader.
+
+
+#ifndef SERIALCAP_H
+#define SERIALCAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+
+//
+// Macros
+
+// A capture is a 16-byte header followed by variable-length records, all
+// little-endian. Each record is a 16-byte record header and then the
+// bytes that were read in one go from one side of the link. Host times
+// are CLOCK_MONOTONIC nanoseconds; only differences between them mean
+// anything. See ncam-serialcap and ncam-serialreplay.
+
+#define SERIALCAP_MAGIC "NCSERCAP"
+#define SERIALCAP_VERSION 1
+
+#define SERIALCAP_HEADER_BYTES 16
+#define SERIALCAP_RECORD_HEADER_BYTES 16
+
+// Longest chunk a writer will put in one record.
+#define SERIALCAP_MAX_CHUNK 65536
+
+// Record directions.
+#define SERIALCAP_FROM_DEVICE 0
+#define SERIALCAP_TO_DEVICE 1
+
+
+//
+// Types
+
+struct serialcap_record_t
+{
+  uint64_t host_time_ns;
+  // Data bytes following this header.
+  uint32_t length;
+  // SERIALCAP_FROM_DEVICE or SERIALCAP_TO_DEVICE.
+  uint8_t direction;
+  uint8_t reserved[3];
+};
+
+// One record as handed out by the reader. The data points into the
+// mapped file.
+
+struct serialcap_chunk_t
+{
+  uint64_t host_time_ns;
+  uint8_t direction;
+  size_t length;
+  const uint8_t *data;
+};
+
+
+//
+// Classes
+
+// Appends records to a capture file. Records should be added in time
+// order.
+
+class SerialCaptureWriter
+{
+public:
+  SerialCaptureWriter();
+  ~SerialCaptureWriter();
+
+  // Creates (or replaces) a capture file. Returns false on failure.
+  bool Open(const std::string &path);
+
+  void Close();
+
+  // Appends one chunk, splitting it if it's longer than
+  // SERIALCAP_MAX_CHUNK.
+  bool Append(uint8_t direction, uint64_t host_time_ns, const void *data,
+    size_t length);
+
+  // Pushes buffered records out to the file.
+  bool Flush();
+
+  uint64_t Bytes(uint8_t direction) const
+  {
+    return (SERIALCAP_TO_DEVICE == direction) ? to_bytes : from_bytes;
+  }
+
+protected:
+  FILE *capture;
+  uint64_t from_bytes;
+  uint64_t to_bytes;
+};
+
+
+// Maps a capture file for reading. Opening walks the record headers once,
+// so that records can be fetched by number afterwards.
+
+class SerialCaptureReader
+{
+public:
+  SerialCaptureReader();
+  ~SerialCaptureReader();
+
+  // Maps a capture file. Returns false on failure.
+  bool Open(const std::string &path);
+
+  void Close();
+
+  size_t Count() const
+  {
+    return offsets.size();
+  }
+
+  // Fetches one record.
+  void Chunk(size_t ridx, serialcap_chunk_t &chunk) const;
+
+  // Returns the total data bytes in one direction.
+  uint64_t Bytes(uint8_t direction) const
+  {
+    return (SERIALCAP_TO_DEVICE == direction) ? to_bytes : from_bytes;
+  }
+
+protected:
+  const uint8_t *capture_map;
+  size_t capture_bytes;
+
+  std::vector<size_t> offsets;
+  uint64_t from_bytes;
+  uint64_t to_bytes;
+};
+
+
+//
+// Functions
+
+// Opens a pseudo-terminal for a host program to use in place of the
+// device's serial port, and puts it in raw mode. The slave side is kept
+// open too, so that the master doesn't see a hangup while the program
+// reopens the port. Returns the master descriptor, or -1 on failure.
+int OpenCapturePty(std::string &slave_path, int &slave_fd);
+
+// Runs a shell command with pipes to its standard input and output.
+// Returns the child's process ID, or -1 on failure.
+pid_t SpawnPipedCommand(const std::string &command, int &to_child,
+  int &from_child);
+
+// Writes all of a buffer to a descriptor, waiting if it's non-blocking
+// and full. Returns false on error.
+bool WriteAllBytes(int fd, const void *data, size_t length);
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,298 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// LED strobe time estimation for video streams.
+
+// NOTE - This has to be built with "-ffp-contract=off". Fused multiply-adds
+// would round differently from the Perl version.
+
+
+//
+// Includes
+
+#include <math.h>
+#include <vector>
+
+#include "streamtime.h"
+
+
+//
+// Private prototypes
+
+static long long PerlModulo(long long value, long long divisor);
+
+
+
+//
+// Parameter defaults
+
+
+StreamTimeParams::StreamTimeParams()
+{
+  bin_size = 10;
+  bin_group_radius = 2;
+  hint_weight = 25;
+  hpf_window = 5;
+  seek_frames = 3000;
+  tiles_wide = 16;
+  tiles_high = 12;
+}
+
+
+
+//
+// Tile series
+
+
+// Constructor.
+
+TileSeries::TileSeries(size_t tile_count)
+{
+  tiles = tile_count;
+}
+
+
+
+// Sets the number of frames (tile values start at zero).
+
+void TileSeries::Resize(size_t frame_count)
+{
+  times.assign(frame_count, 0.0);
+  values.assign(frame_count * tiles, 0.0f);
+}
+
+
+
+//
+// Functions
+
+
+// Integer modulo with a non-negative result, as Perl's "%" gives for a
+// positive divisor.
+
+static long long PerlModulo(long long value, long long divisor)
+{
+  value %= divisor;
+  if (0 > value)
+    value += divisor;
+
+  return value;
+}
+
+
+
+// Estimates the strobe offset for a range of frames and tiles.
+
+bool EstimateSeriesTimes(const TileSeries &series, size_t first_frame,
+  size_t last_frame, size_t first_tile, size_t last_tile, double period,
+  double hint_value, double hint_weight, const StreamTimeParams &params,
+  double *offsets, double *evidence)
+{
+  std::vector<double> lpf_store, hist_store, smooth_store, weight_store;
+  double *__restrict lpf;
+  double *__restrict hist;
+  double *__restrict smooth;
+  double *__restrict weightcoeff;
+  double *__restrict bestval;
+  const float *__restrict row;
+  double *__restrict binrow;
+  const double *__restrict scanrow;
+  double realbinsize, thistime, newcoeff, oldcoeff, maxdist, thisval, penalty;
+  long long bincount, binidx, scanidx, hintbin, thisdist;
+  size_t count, fidx, tidx;
+  std::vector<long long> bestbin;
+
+  count = last_tile - first_tile;
+  if (0 == count)
+    return true;
+
+  // The bin size should evenly divide the period.
+  bincount = (long long) (period / params.bin_size);
+  if (1 > bincount)
+    return false;
+  realbinsize = (0.001 + period) / bincount;
+
+  newcoeff = 1.0 / params.hpf_window;
+  oldcoeff = 1.0 - newcoeff;
+
+  lpf_store.assign(count, 0.0);
+  hist_store.assign(bincount * count, 0.0);
+  smooth_store.assign(bincount * count, 0.0);
+  weight_store.assign(2 * count, 0.0);
+
+  lpf = lpf_store.data();
+  hist = hist_store.data();
+  smooth = smooth_store.data();
+  weightcoeff = weight_store.data();
+  bestval = weight_store.data() + count;
+
+
+  // High-pass filter every tile and add each sample to its offset bin.
+  // The bin depends only on the frame time, so a frame's tiles all land in
+  // the same row.
+
+  for (fidx = first_frame; fidx < last_frame; fidx++)
+  {
+    thistime = series.times[fidx];
+    thistime -= ((long long) (thistime / period)) * period;
+    binidx = (long long) (thistime / realbinsize);
+
+    row = series.values.data() + (fidx * series.tiles) + first_tile;
+    binrow = hist + (binidx * count);
+
+    if (first_frame == fidx)
+    {
+      for (tidx = 0; tidx < count; tidx++)
+      {
+        lpf[tidx] = row[tidx];
+        binrow[tidx] += ((double) row[tidx]) - lpf[tidx];
+      }
+    }
+    else
+    {
+      for (tidx = 0; tidx < count; tidx++)
+      {
+        lpf[tidx] *= oldcoeff;
+        lpf[tidx] += newcoeff * ((double) row[tidx]);
+        binrow[tidx] += ((double) row[tidx]) - lpf[tidx];
+      }
+    }
+  }
+
+
+  // Moving-window average, tracking the largest uncorrected evidence.
+
+  for (binidx = 0; binidx < bincount; binidx++)
+  {
+    binrow = smooth + (binidx * count);
+
+    for (scanidx = -params.bin_group_radius;
+      scanidx <= params.bin_group_radius; scanidx++)
+    {
+      scanrow = hist + ( ((binidx + scanidx + bincount) % bincount) * count );
+      for (tidx = 0; tidx < count; tidx++)
+        binrow[tidx] += scanrow[tidx];
+    }
+
+    for (tidx = 0; tidx < count; tidx++)
+    {
+      binrow[tidx] /= (1 + params.bin_group_radius + params.bin_group_radius);
+
+      if ( (0 == binidx) || (binrow[tidx] > weightcoeff[tidx]) )
+        weightcoeff[tidx] = binrow[tidx];
+    }
+  }
+
+
+  // Penalize distance from the hint. The penalty scales with the square of
+  // the distance; at the maximum distance it's the hint weight times the
+  // maximum evidence.
+
+  maxdist = 0.5 * bincount;
+
+  for (tidx = 0; tidx < count; tidx++)
+  {
+    // "weightcoeff" held the maximum evidence until now.
+    thisval = weightcoeff[tidx];
+    weightcoeff[tidx] = hint_weight / (maxdist * maxdist);
+    if (1.0e-6 < thisval)
+      weightcoeff[tidx] /= thisval;
+  }
+
+  thistime = hint_value - ((long long) (hint_value / period)) * period;
+  hintbin = (long long) (thistime / realbinsize);
+
+  bestbin.assign(count, 0);
+
+  for (binidx = 0; binidx < bincount; binidx++)
+  {
+    thisdist = PerlModulo(binidx + bincount - hintbin, bincount);
+    if (thisdist > maxdist)
+      thisdist = bincount - thisdist;
+    penalty = (double) (thisdist * thisdist);
+
+    binrow = smooth + (binidx * count);
+
+    for (tidx = 0; tidx < count; tidx++)
+    {
+      binrow[tidx] -= penalty * weightcoeff[tidx];
+
+      // Find the bin with the most evidence (first one wins ties).
+      if ( (0 == binidx) || (binrow[tidx] > bestval[tidx]) )
+      {
+        bestval[tidx] = binrow[tidx];
+        bestbin[tidx] = binidx;
+      }
+    }
+  }
+
+  // Report the middle of the best bin.
+  for (tidx = 0; tidx < count; tidx++)
+  {
+    offsets[tidx] = (bestbin[tidx] + 0.5) * realbinsize;
+    evidence[tidx] = bestval[tidx];
+  }
+
+  return true;
+}
+
+
+
+// Picks the tile with the most evidence.
+
+size_t PickBestTile(const double *evidence, size_t tile_count)
+{
+  size_t tidx, best;
+
+  best = 0;
+  for (tidx = 1; tidx < tile_count; tidx++)
+    if (evidence[tidx] > evidence[best])
+      best = tidx;
+
+  return best;
+}
+
+
+
+// Runs the hinted per-segment pass.
+
+void AdjustStreamTimes(const TileSeries &series, size_t tile,
+  double blind_offset, double period, double gpio_offset,
+  const StreamTimeParams &params, std::vector<long long> &corrected,
+  std::vector<double> &segment_offsets)
+{
+  size_t halfsize, start, end, window, fidx;
+  double offset, evidence, newoffset;
+
+  corrected.assign(series.Frames(), 0);
+  segment_offsets.clear();
+
+  halfsize = params.seek_frames >> 1;
+  if (1 > halfsize)
+    halfsize = 1;
+
+  offset = blind_offset;
+
+  // Each segment is estimated over itself and the segment before it, using
+  // the previous estimate as the hint.
+  for (start = 0; start < series.Frames(); start += halfsize)
+  {
+    end = start + halfsize;
+    if (end > series.Frames())
+      end = series.Frames();
+
+    window = (start > halfsize) ? (start - halfsize) : 0;
+
+    if (EstimateSeriesTimes(series, window, end, tile, tile + 1, period,
+      offset, params.hint_weight, params, &newoffset, &evidence))
+      offset = newoffset;
+
+    segment_offsets.push_back(offset);
+
+    for (fidx = start; fidx < end; fidx++)
+      corrected[fidx] =
+        (long long) (0.5 + series.times[fidx] + gpio_offset - offset);
+  }
+}
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,94 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// LED strobe time estimation for video streams.
+
+
+#ifndef STREAMTIME_H
+#define STREAMTIME_H
+
+#include <stddef.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+//
+// Types
+
+// Tuning parameters. The defaults match neurocam-libpost.pl.
+
+struct StreamTimeParams
+{
+  // Offset bin size (ms), and the moving-window radius in bins.
+  double bin_size;
+  int bin_group_radius;
+  // Penalty weight for distance from the offset hint.
+  double hint_weight;
+  // High-pass filter decay window (frames).
+  double hpf_window;
+  // Frames used for the initial blind estimate; later segments are half
+  // this size.
+  size_t seek_frames;
+  // Thumbnail size in tiles.
+  int tiles_wide;
+  int tiles_high;
+
+  StreamTimeParams();
+};
+
+
+//
+// Classes
+
+// Thumbnail tile values for a sequence of frames, stored frame-major so that
+// each frame's tiles are contiguous. All per-tile arithmetic runs across a
+// frame's tiles at once, which the compiler turns into SIMD loops.
+
+class TileSeries
+{
+public:
+  TileSeries(size_t tile_count = 0);
+
+  void Resize(size_t frame_count);
+
+  size_t Frames() const
+  {
+    return times.size();
+  }
+
+  size_t tiles;
+  std::vector<double> times;
+  std::vector<float> values;
+};
+
+
+//
+// Functions
+
+// Estimates the strobe offset within frames [first_frame, last_frame) for
+// tiles [first_tile, last_tile), writing the offset and the evidence for it
+// for each tile. This is NCAM_MakeHPFSeries followed by
+// NCAM_EstimateSeriesTimeReal, done for many tiles at once; the arithmetic
+// is done in the same order, so results are the same.
+// Returns false if the period is shorter than one bin.
+bool EstimateSeriesTimes(const TileSeries &series, size_t first_frame,
+  size_t last_frame, size_t first_tile, size_t last_tile, double period,
+  double hint_value, double hint_weight, const StreamTimeParams &params,
+  double *offsets, double *evidence);
+
+// Picks the tile with the most evidence from per-tile results, the way
+// NCAM_EstimateStreamTimeBlind does (first tile wins ties).
+size_t PickBestTile(const double *evidence, size_t tile_count);
+
+// Runs the hinted per-segment pass of NCAM_AdjustTimestampsOneStream, given
+// the blind estimate. Each entry in "corrected" is the new timestamp for the
+// corresponding frame.
+void AdjustStreamTimes(const TileSeries &series, size_t tile,
+  double blind_offset, double period, double gpio_offset,
+  const StreamTimeParams &params, std::vector<long long> &corrected,
+  std::vector<double> &segment_offsets);
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,186 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Caption rendering with FreeType.
+
+
+//
+// Includes
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_OUTLINE_H
+
+#include "textrender.h"
+
+
+//
+// Private macros
+
+// Printable ASCII is all captions and labels ever use.
+#define TEXT_FIRST_CHAR 32
+#define TEXT_LAST_CHAR 126
+
+
+
+//
+// Functions
+
+
+// Constructor.
+
+TextRenderer::TextRenderer()
+{
+  int idx;
+
+  ascender = 0;
+  line_height = 0;
+
+  for (idx = 0; idx < 128; idx++)
+  {
+    glyphs[idx].left = 0;
+    glyphs[idx].top = 0;
+    glyphs[idx].advance = 0;
+    glyphs[idx].width = 0;
+    glyphs[idx].height = 0;
+  }
+}
+
+
+
+// Loads a font and renders its glyphs.
+
+bool TextRenderer::Load(const char *fontpath, int pixel_size, int outline)
+{
+  FT_Library library;
+  FT_Face face;
+  FT_GlyphSlot slot;
+  glyph_t *glyph;
+  int thischar, row, col;
+  bool is_ok;
+
+  if (FT_Init_FreeType(&library))
+    return false;
+
+  if (FT_New_Face(library, fontpath, 0, &face))
+  {
+    FT_Done_FreeType(library);
+    return false;
+  }
+
+  is_ok = (0 == FT_Set_Pixel_Sizes(face, 0, pixel_size));
+
+  ascender = (face->size->metrics.ascender + 63) >> 6;
+  line_height = ascender - (face->size->metrics.descender >> 6);
+
+  for (thischar = TEXT_FIRST_CHAR; is_ok && (thischar <= TEXT_LAST_CHAR);
+    thischar++)
+  {
+    if (FT_Load_Char(face, thischar, FT_LOAD_DEFAULT))
+      continue;
+
+    slot = face->glyph;
+
+    // Emboldening is in 1/64ths of a pixel.
+    if ( (0 < outline) && (FT_GLYPH_FORMAT_OUTLINE == slot->format) )
+      FT_Outline_Embolden(&slot->outline, outline * 64);
+
+    if (FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL))
+      continue;
+
+    glyph = &(glyphs[thischar]);
+    glyph->left = slot->bitmap_left;
+    glyph->top = slot->bitmap_top;
+    glyph->advance = (slot->advance.x + 63) >> 6;
+    glyph->width = slot->bitmap.width;
+    glyph->height = slot->bitmap.rows;
+
+    glyph->coverage.resize(glyph->width * glyph->height);
+    for (row = 0; row < glyph->height; row++)
+      for (col = 0; col < glyph->width; col++)
+        glyph->coverage[row * glyph->width + col] =
+          slot->bitmap.buffer[row * slot->bitmap.pitch + col];
+  }
+
+  FT_Done_Face(face);
+  FT_Done_FreeType(library);
+
+  return is_ok;
+}
+
+
+
+// Returns the width of a string, in pixels.
+
+int TextRenderer::MeasureText(const std::string &text) const
+{
+  int width;
+  unsigned char thischar;
+  size_t idx;
+
+  width = 0;
+  for (idx = 0; idx < text.size(); idx++)
+  {
+    thischar = text[idx];
+    if (128 > thischar)
+      width += glyphs[thischar].advance;
+  }
+
+  return width;
+}
+
+
+
+// Draws a string.
+
+void TextRenderer::DrawText(RGBImage &image, const std::string &text,
+  int gravity, const uint8_t colour[3]) const
+{
+  const glyph_t *glyph;
+  uint8_t *pixel;
+  unsigned char thischar;
+  int pen_x, baseline, x, y, row, col, alpha, channel;
+  size_t idx;
+
+  pen_x = (image.width - MeasureText(text)) / 2;
+  if (TEXT_SOUTH == gravity)
+    baseline = image.height - (line_height - ascender);
+  else
+    baseline = ascender;
+
+  for (idx = 0; idx < text.size(); idx++)
+  {
+    thischar = text[idx];
+    if (128 <= thischar)
+      continue;
+
+    glyph = &(glyphs[thischar]);
+
+    for (row = 0; row < glyph->height; row++)
+    {
+      y = baseline - glyph->top + row;
+      if ( (0 > y) || (image.height <= y) )
+        continue;
+
+      for (col = 0; col < glyph->width; col++)
+      {
+        x = pen_x + glyph->left + col;
+        if ( (0 > x) || (image.width <= x) )
+          continue;
+
+        alpha = glyph->coverage[row * glyph->width + col];
+        if (0 == alpha)
+          continue;
+
+        pixel = image.Pixel(x, y);
+        for (channel = 0; channel < 3; channel++)
+          pixel[channel] = (uint8_t) ((pixel[channel] * (255 - alpha)
+            + colour[channel] * alpha + 127) / 255);
+      }
+    }
+
+    pen_x += glyph->advance;
+  }
+}
+
+
+//
+// This is the end of the file.
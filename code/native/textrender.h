@@ -0,0 +1,62 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Caption rendering with FreeType.
+
+
+#ifndef TEXTRENDER_H
+#define TEXTRENDER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "rgbimage.h"
+
+
+//
+// Macros
+
+// Where text goes in the image (ImageMagick's "gravity").
+#define TEXT_NORTH 0
+#define TEXT_SOUTH 1
+
+
+//
+// Classes
+
+// One font size, with the printable ASCII glyphs rendered up front. Once
+// it's loaded, any number of threads may draw with it at once.
+
+class TextRenderer
+{
+public:
+  TextRenderer();
+
+  // Loads a font at the given pixel size. Returns false on failure.
+  // If "outline" is nonzero, glyphs are thickened by that many pixels,
+  // to stand in for a stroked outline.
+  bool Load(const char *fontpath, int pixel_size, int outline);
+
+  // Returns the width of a string, in pixels.
+  int MeasureText(const std::string &text) const;
+
+  // Draws a string centred horizontally, against the top or bottom edge.
+  void DrawText(RGBImage &image, const std::string &text, int gravity,
+    const uint8_t colour[3]) const;
+
+protected:
+  struct glyph_t
+  {
+    int left, top, advance;
+    int width, height;
+    std::vector<uint8_t> coverage;
+  };
+
+  int ascender, line_height;
+  glyph_t glyphs[128];
+};
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,205 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Low-resolution greyscale thumbnails of JPEG frames.
+
+
+//
+// Includes
+
+#include <math.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "thumbnail.h"
+
+
+//
+// Private types
+
+// libjpeg reports fatal errors through a callback; we jump back out.
+struct thumb_error_t
+{
+  struct jpeg_error_mgr manager;
+  jmp_buf escape;
+};
+
+// One source pixel's share of an output tile, along one axis.
+struct thumb_weight_t
+{
+  int tile;
+  double weight;
+};
+
+
+//
+// Private prototypes
+
+static void HandleJPEGError(j_common_ptr info);
+static void MakeAxisWeights(int source, int tiles,
+  std::vector< std::vector<thumb_weight_t> > &weights);
+
+
+
+//
+// Functions
+
+
+// Bails out of a failed decode.
+
+static void HandleJPEGError(j_common_ptr info)
+{
+  thumb_error_t *error;
+
+  error = (thumb_error_t *) info->err;
+  longjmp(error->escape, 1);
+}
+
+
+
+// Works out how each source pixel along an axis spreads over the tiles.
+// Tile boundaries fall at multiples of (source / tiles) pixels.
+
+static void MakeAxisWeights(int source, int tiles,
+  std::vector< std::vector<thumb_weight_t> > &weights)
+{
+  double span, left, right, overlap;
+  int pixel, tile;
+  thumb_weight_t entry;
+
+  span = ((double) source) / tiles;
+  weights.assign(source, std::vector<thumb_weight_t>());
+
+  for (pixel = 0; pixel < source; pixel++)
+  {
+    for (tile = (int) floor(pixel / span); tile < tiles; tile++)
+    {
+      left = tile * span;
+      right = left + span;
+      if (left >= (pixel + 1))
+        break;
+
+      overlap = ( (right < (pixel + 1)) ? right : (pixel + 1) )
+        - ( (left > pixel) ? left : pixel );
+
+      if (0 < overlap)
+      {
+        entry.tile = tile;
+        entry.weight = overlap / span;
+        weights[pixel].push_back(entry);
+      }
+    }
+  }
+}
+
+
+
+// Decodes a JPEG and box-filters it down to a tile grid.
+
+bool MakeThumbnail(const char *path, int width, int height, bool fast,
+  float *tiles)
+{
+  struct jpeg_decompress_struct info;
+  thumb_error_t error;
+  FILE *infile;
+  std::vector<double> sums;
+  std::vector<unsigned char> row;
+  std::vector< std::vector<thumb_weight_t> > xweights, yweights;
+  JSAMPROW rowptr;
+  unsigned char *pixel;
+  int channels, denom, xidx, yidx, tidx, widx, vidx;
+  double *cell, weight, red, green, blue;
+
+  memset(tiles, 0, width * height * sizeof(float));
+
+  infile = fopen(path, "rb");
+  if (NULL == infile)
+    return false;
+
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = HandleJPEGError;
+
+  if (setjmp(error.escape))
+  {
+    jpeg_destroy_decompress(&info);
+    fclose(infile);
+    memset(tiles, 0, width * height * sizeof(float));
+    return false;
+  }
+
+  jpeg_create_decompress(&info);
+  jpeg_stdio_src(&info, infile);
+  jpeg_read_header(&info, TRUE);
+
+  // Greyscale stays greyscale; everything else comes out as RGB.
+  if (JCS_GRAYSCALE != info.jpeg_color_space)
+    info.out_color_space = JCS_RGB;
+
+  // Shrink in the DCT domain as far as we can while keeping at least two
+  // pixels per tile in each direction.
+  info.scale_num = 1;
+  info.scale_denom = 1;
+  if (fast)
+    for (denom = 8; denom > 1; denom >>= 1)
+      if ( ((int) (info.image_width / denom) >= (2 * width))
+        && ((int) (info.image_height / denom) >= (2 * height)) )
+      {
+        info.scale_denom = denom;
+        break;
+      }
+
+  jpeg_start_decompress(&info);
+
+  channels = info.output_components;
+  MakeAxisWeights(info.output_width, width, xweights);
+  MakeAxisWeights(info.output_height, height, yweights);
+
+  sums.assign(width * height * 3, 0.0);
+  row.resize(info.output_width * channels);
+  rowptr = row.data();
+
+  for (yidx = 0; (unsigned) yidx < info.output_height; yidx++)
+  {
+    jpeg_read_scanlines(&info, &rowptr, 1);
+
+    for (xidx = 0; (unsigned) xidx < info.output_width; xidx++)
+    {
+      pixel = rowptr + xidx * channels;
+      red = pixel[0];
+      green = (3 <= channels) ? pixel[1] : red;
+      blue = (3 <= channels) ? pixel[2] : red;
+
+      for (vidx = 0; vidx < (int) yweights[yidx].size(); vidx++)
+        for (widx = 0; widx < (int) xweights[xidx].size(); widx++)
+        {
+          weight = yweights[yidx][vidx].weight * xweights[xidx][widx].weight;
+          cell = sums.data() + 3 * ( yweights[yidx][vidx].tile * width
+            + xweights[xidx][widx].tile );
+          cell[0] += weight * red;
+          cell[1] += weight * green;
+          cell[2] += weight * blue;
+        }
+    }
+  }
+
+  jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
+  fclose(infile);
+
+  // Weights were normalized per axis, so each sum is the tile's average.
+  for (tidx = 0; tidx < (width * height); tidx++)
+  {
+    red = sums[3 * tidx] / 255.0;
+    green = sums[3 * tidx + 1] / 255.0;
+    blue = sums[3 * tidx + 2] / 255.0;
+    tiles[tidx] = (float) sqrt(red * red + green * green + blue * blue);
+  }
+
+  return true;
+}
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,28 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Low-resolution greyscale thumbnails of JPEG frames.
+
+
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include <stddef.h>
+
+
+//
+// Functions
+
+// Decodes a JPEG and box-filters it down to width x height tiles (stretching
+// to fit, like ImageMagick's Scale). Each tile is the magnitude of its
+// average RGB colour, with channels normalized to 0..1, which is what the
+// Perl code's greyscale workaround computes.
+// If "fast" is set, libjpeg's DCT-domain scaling is used to shrink the
+// image before filtering, which is much faster and differs only by rounding.
+// Returns false (leaving the tiles at zero) if the file can't be decoded.
+bool MakeThumbnail(const char *path, int width, int height, bool fast,
+  float *tiles);
+
+
+#endif
+
+//
+// This is the end of the file.
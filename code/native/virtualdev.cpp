@@ -0,0 +1,221 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Simulated GPIO device, for benchmarking the host side of the link.
+
+
+//
+// Includes
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <deque>
+#include <string>
+
+#include "virtualdev.h"
+
+
+//
+// Private macros
+
+// Ten bits go over the wire per byte (start, eight data, stop).
+#define VIRTUALDEV_BITS_PER_BYTE 10
+
+
+
+//
+// Parameter methods
+
+
+// Constructor.
+
+VirtualDeviceParams::VirtualDeviceParams()
+{
+  edge_rate = 100;
+  edges = 1000;
+  baud = 500000;
+  poll_us = 50;
+  tx_queue = 64;
+}
+
+
+
+//
+// Device methods
+
+
+// Constructor.
+
+VirtualGPIODevice::VirtualGPIODevice()
+{
+  fd = -1;
+  start_ns = 0;
+  reports = 0;
+}
+
+
+
+// Destructor.
+
+VirtualGPIODevice::~VirtualGPIODevice()
+{
+  Join();
+}
+
+
+
+// Starts injecting edges.
+
+bool VirtualGPIODevice::Start(const VirtualDeviceParams &new_params,
+  int new_fd, uint64_t new_start_ns)
+{
+  Join();
+
+  if ( (0 > new_fd) || (!(0 < new_params.edge_rate)) )
+    return false;
+
+  params = new_params;
+  fd = new_fd;
+  start_ns = new_start_ns;
+  reports = 0;
+
+  worker = std::thread(&VirtualGPIODevice::Run, this);
+
+  return true;
+}
+
+
+
+// Waits for the device to finish.
+
+void VirtualGPIODevice::Join()
+{
+  if (worker.joinable())
+    worker.join();
+}
+
+
+
+// Returns the time an edge was injected.
+
+uint64_t VirtualGPIODevice::EdgeTime(size_t eidx) const
+{
+  return start_ns + (uint64_t) ((eidx * 1.0e9) / params.edge_rate);
+}
+
+
+
+// Runs the device's main loop.
+
+void VirtualGPIODevice::Run()
+{
+  std::deque< std::pair<uint64_t, std::string> > wire;
+  uint64_t now_ns, byte_ns, wire_free_ns, next_poll_ns, stall_ns, wake_ns;
+  size_t injected, reported;
+  char line[32];
+  ssize_t count;
+  size_t done;
+
+  byte_ns = 0;
+  if (0 < params.baud)
+    byte_ns = (VIRTUALDEV_BITS_PER_BYTE * 1000000000ull) / params.baud;
+
+  wire_free_ns = start_ns;
+  next_poll_ns = start_ns;
+  reported = 0;
+
+  while ( (reported < params.edges) || (!wire.empty()) )
+  {
+    // Wake for the next poll, or when the next line finishes sending.
+    wake_ns = next_poll_ns;
+    if ( (!wire.empty()) && (wire.front().first < wake_ns) )
+      wake_ns = wire.front().first;
+    if (reported >= params.edges)
+      wake_ns = wire.front().first;
+
+    SleepUntilNanos(wake_ns);
+    now_ns = GetMonotonicNanos();
+
+    // Hand over lines whose last byte has gone out. The host can't parse
+    // a line before that, so delivering it whole is the same thing.
+    while ( (!wire.empty()) && (wire.front().first <= now_ns) )
+    {
+      for (done = 0; done < wire.front().second.size(); done += count)
+      {
+        count = write(fd, wire.front().second.data() + done,
+          wire.front().second.size() - done);
+        if ( (0 > count) && (EINTR == errno) )
+          count = 0;
+        else if (0 > count)
+          break;
+      }
+
+      wire.pop_front();
+      reports++;
+    }
+
+    if ( (now_ns < next_poll_ns) || (reported >= params.edges) )
+      continue;
+
+    // Poll the inputs.
+    injected = 1 + (size_t) (((now_ns - start_ns) * params.edge_rate) / 1.0e9);
+    if (injected > params.edges)
+      injected = params.edges;
+
+    if (injected > reported)
+    {
+      reported = injected;
+
+      snprintf(line, sizeof(line), "I: %08lx\r\n", (unsigned long) reported);
+
+      if (wire_free_ns < now_ns)
+        wire_free_ns = now_ns;
+      wire_free_ns += byte_ns * strlen(line);
+      wire.push_back(std::make_pair(wire_free_ns, std::string(line)));
+    }
+
+    // A full transmit queue holds up the main loop until there's room.
+    next_poll_ns = now_ns + 1000ull * params.poll_us;
+    stall_ns = byte_ns * params.tx_queue;
+    if ( (0 < byte_ns) && (wire_free_ns > (next_poll_ns + stall_ns)) )
+      next_poll_ns = wire_free_ns - stall_ns;
+  }
+
+  close(fd);
+}
+
+
+
+//
+// Functions
+
+
+// Returns CLOCK_MONOTONIC in nanoseconds.
+
+uint64_t GetMonotonicNanos()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (((uint64_t) now.tv_sec) * 1000000000ull) + now.tv_nsec;
+}
+
+
+
+// Sleeps until a CLOCK_MONOTONIC time.
+
+void SleepUntilNanos(uint64_t when_ns)
+{
+  struct timespec when;
+
+  when.tv_sec = when_ns / 1000000000ull;
+  when.tv_nsec = when_ns % 1000000000ull;
+
+  while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, NULL))
+    ;
+}
+
+
+//
+// This is the end of the file.
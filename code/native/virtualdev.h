@@ -0,0 +1,93 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Simulated GPIO device, for benchmarking the host side of the link.
+
+
+#ifndef VIRTUALDEV_H
+#define VIRTUALDEV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+
+
+//
+// Types
+
+// How the simulated device behaves. The defaults follow the firmware:
+// the main loop polls the input lines and queues an "I:" report when they
+// have changed, and a full transmit queue stalls the main loop.
+
+struct VirtualDeviceParams
+{
+  VirtualDeviceParams();
+
+  // Edges injected per second, and how many.
+  double edge_rate;
+  size_t edges;
+
+  // Serial rate (0 for a USB link, which isn't paced).
+  uint32_t baud;
+
+  // Main loop period, in microseconds.
+  uint32_t poll_us;
+
+  // Transmit queue size, in bytes.
+  uint32_t tx_queue;
+};
+
+
+//
+// Classes
+
+// Writes timed reports into a descriptor from its own thread. The input
+// register holds the number of edges injected so far, so every report says
+// which edge it's for, and coalesced edges show up as gaps.
+
+class VirtualGPIODevice
+{
+public:
+  VirtualGPIODevice();
+  ~VirtualGPIODevice();
+
+  // Starts injecting edges at start_ns (CLOCK_MONOTONIC). The descriptor
+  // is closed when the last report has been written.
+  bool Start(const VirtualDeviceParams &new_params, int new_fd,
+    uint64_t new_start_ns);
+
+  // Waits for the device to finish.
+  void Join();
+
+  // Returns the time edge "eidx" was injected.
+  uint64_t EdgeTime(size_t eidx) const;
+
+  // Reports written.
+  size_t ReportCount() const
+  {
+    return reports;
+  }
+
+protected:
+  VirtualDeviceParams params;
+  int fd;
+  uint64_t start_ns;
+  size_t reports;
+  std::thread worker;
+
+  void Run();
+};
+
+
+//
+// Functions
+
+// Returns CLOCK_MONOTONIC in nanoseconds.
+uint64_t GetMonotonicNanos();
+
+// Sleeps until a CLOCK_MONOTONIC time.
+void SleepUntilNanos(uint64_t when_ns);
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,65 @@
+// Attention Circuits Control Laboratory - NeuroCam project
+// Simple fork-join helper for native tools.
+
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <stddef.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+
+//
+// Functions
+
+// Returns the number of worker threads to use by default.
+
+inline unsigned GetDefaultWorkerCount()
+{
+  unsigned count;
+
+  count = std::thread::hardware_concurrency();
+  return (0 < count) ? count : 1;
+}
+
+
+// Calls job(0) through job(count-1) on up to "workers" threads, and waits
+// for all of them. Jobs are handed out in order, one at a time, so uneven
+// jobs still balance.
+
+inline void RunParallel(size_t count, unsigned workers,
+  const std::function<void(size_t)> &job)
+{
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  unsigned tidx;
+
+  auto worker = [&next, count, &job]()
+  {
+    size_t jidx;
+
+    while ( (jidx = next.fetch_add(1)) < count )
+      job(jidx);
+  };
+
+  if (workers > count)
+    workers = count;
+
+  // The calling thread does its share too.
+  for (tidx = 1; tidx < workers; tidx++)
+    threads.push_back(std::thread(worker));
+
+  worker();
+
+  for (tidx = 0; tidx < threads.size(); tidx++)
+    threads[tidx].join();
+}
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -78,6 +78,29 @@ my ($video_frame_scout_lookahead);
 $video_frame_scout_lookahead = 50;
 
 
+# Binary GPIO event log. Register reports are written here as well as to
+# the text log, as fixed 32-byte records with a sparse time index, so that
+# post-processing can seek by time. See "native/gpioevlog.h" for the format.
+my ($gpioevents_basename, $gpioevents_stride);
+$gpioevents_basename = 'gpioevents';
+# Records per index entry.
+$gpioevents_stride = 256;
+
+
+# GPIO devices on this machine also publish register reports to
+# shared-memory event buses (see "native/gpiobus.h"). The logger reads
+# these directly, and skips the same reports when they arrive by UDP.
+# This is how often to look for new buses, in milliseconds.
+my ($gpiobus_scan_interval);
+$gpiobus_scan_interval = 1000;
+
+# The logger sleeps until something arrives on its pipe, or for this many
+# milliseconds at most. Bus records don't wake it, but their UDP copies
+# do, so this only delays reports that have no UDP copy.
+my ($gpiobus_poll_interval);
+$gpiobus_poll_interval = 10;
+
+
 
 #
 # Functions
@@ -197,6 +220,7 @@ sub CreateRepository
       # Make a note of where the logfile and session metadata file go.
       $$paths_p{logfile} = $repodir . '/logfile.txt';
       $$paths_p{metafile} = $repodir . '/metadata.txt';
+      $$paths_p{gpioevents} = $repodir . '/' . $gpioevents_basename;
 
       # Create directories.
       # NOTE - Creating config file's slots, not the canonical slots.
@@ -333,6 +357,149 @@ sub TrackVideoUpdate
 
 
 
+# Creates a binary GPIO event log and its index.
+# Arg 0 is the path to use, without an extension.
+# Returns a pointer to the log's state, or undef on error.
+
+sub OpenGPIOEventLog
+{
+  my ($basename, $log_p);
+  local (*EVENTFILE, *INDEXFILE);
+
+  $basename = $_[0];
+  $log_p = undef;
+
+  if ( (defined $basename)
+    && open(EVENTFILE, ">$basename.bin") )
+  {
+    if (!open(INDEXFILE, ">$basename.idx"))
+    {
+      close(EVENTFILE);
+    }
+    else
+    {
+      binmode EVENTFILE;
+      binmode INDEXFILE;
+
+      # Flush each record as it's written, like the text log.
+      {
+        my $oldhandle;
+        $oldhandle = select(EVENTFILE);
+        $| = 1;
+        select(INDEXFILE);
+        $| = 1;
+        select $oldhandle;
+      }
+
+      # Headers are magic, version, and record size or index stride.
+      print EVENTFILE pack('a8 V V', 'NCGPIOEV', 1, 32);
+      print INDEXFILE pack('a8 V V', 'NCGPIOIX', 1, $gpioevents_stride);
+
+      $log_p = { 'events' => *EVENTFILE{IO}, 'index' => *INDEXFILE{IO},
+        'count' => 0 };
+    }
+  }
+
+  return $log_p;
+}
+
+
+
+# Appends one register report to a binary GPIO event log.
+# Arg 0 points to the log's state.
+# Arg 1 is the host timestamp (the text log's milliseconds).
+# Arg 2 is the device label.
+# Arg 3 is the register letter.
+# Arg 4 is the register value.
+# Arg 5 is the device tick (may be undef).
+# No return value.
+
+sub WriteGPIOEvent
+{
+  my ($log_p, $thistime, $label, $regid, $value, $devtime);
+  my ($handle, $count);
+
+  $log_p = $_[0];
+  $thistime = $_[1];
+  $label = $_[2];
+  $regid = $_[3];
+  $value = $_[4];
+  $devtime = $_[5];
+
+  if (defined $log_p)
+  {
+    $count = $$log_p{count};
+
+    # Time, sequence, tick, value, label, register, flags, upper tick.
+    # Device ticks are 64-bit; the record has room for 48 bits of them.
+    $handle = $$log_p{events};
+    print $handle pack('q< V V V a8 C C v',
+      $thistime, $count & 0xffffffff,
+      (defined $devtime) ? ($devtime & 0xffffffff) : 0,
+      $value & 0xffffffff, $label, ord($regid),
+      (defined $devtime) ? 1 : 0,
+      (defined $devtime) ? (($devtime >> 32) & 0xffff) : 0);
+
+    # Every so often, note where we are in the index.
+    if (0 == ($count % $gpioevents_stride))
+    {
+      $handle = $$log_p{index};
+      print $handle pack('q< Q<', $thistime, $count);
+    }
+
+    $$log_p{count} = $count + 1;
+  }
+}
+
+
+
+# Closes a binary GPIO event log.
+# Arg 0 points to the log's state (may be undef).
+# No return value.
+
+sub CloseGPIOEventLog
+{
+  my ($log_p);
+
+  $log_p = $_[0];
+
+  if (defined $log_p)
+  {
+    close($$log_p{events});
+    close($$log_p{index});
+  }
+}
+
+
+
+# Writes one line to the session log, and register reports to the binary
+# GPIO event log.
+# Arg 0 is the text log's filehandle.
+# Arg 1 points to the binary event log's state (may be undef).
+# Arg 2 is the timestamp to use.
+# Arg 3 is the line, without a newline.
+# No return value.
+
+sub WriteLogLine
+{
+  my ($loghandle, $gpiolog_p, $thistime, $thisline);
+
+  $loghandle = $_[0];
+  $gpiolog_p = $_[1];
+  $thistime = $_[2];
+  $thisline = $_[3];
+
+  if ( (defined $gpiolog_p) && ($thisline =~
+    m/MSG gpio (\S+) ([A-Z]): ([0-9a-fA-F]+)(?:\s+(\d+))?\s*$/) )
+  {
+    WriteGPIOEvent($gpiolog_p, $thistime, $1, $2, hex($3), $4);
+  }
+
+  print $loghandle '(' . $thistime . ') ' . $thisline . "\n";
+}
+
+
+
 # This sets up the log file and writes data to it.
 # This idles when it sees a "stop" command, but never terminates.
 # Arg 0 points to the session hash.
@@ -347,6 +514,10 @@ sub DoLogger
   my ($thisline);
   my ($done);
   my ($thistime);
+  my ($gpiolog_p);
+  my (%gpiobuses, %buslost, $buslist_p, $bus_p, $label, $nextbusscan);
+  my ($records_p, $record_p, $timeoffset, $lasttime, $sequence);
+  my ($pipebuffer, $readcount, $filevec);
 
   $session_p = $_[0];
   $paths_p = $_[1];
@@ -370,27 +541,123 @@ sub DoLogger
       # The short and more cryptic way:
 #      select((select(LOGFILE), $| = 1)[0]);
 
+      # GPIO register reports also go to the binary event log.
+      # If that can't be created, only the text log is written.
+      $gpiolog_p = OpenGPIOEventLog($$paths_p{gpioevents});
+
 # FIXME - Diagnostics.
 if ($tattlecomm) { print STDERR "-- Logging started.\n"; }
 
-      # Write down events that are forwarded to us.
-      # Spinning with blocking is okay.
+      # Bus records are stamped with absolute time; this converts them to
+      # log time.
+      $timeoffset = NCAM_GetAbsTimeMillis() - NCAM_GetRelTimeMillis();
+      $lasttime = 0;
 
-      # NOTE - This blocks, so we don't need to yield.
+      %gpiobuses = ();
+      %buslost = ();
+      $nextbusscan = 0;
 
+      # Write down events that are forwarded to us, and events from GPIO
+      # buses. The pipe is read directly, rather than with "<>", so that
+      # lines left in Perl's buffer don't wait for the next write.
+
+      $pipebuffer = '';
       $done = 0;
-      while ( (!$done) && (defined ($thisline = <$eventhandle>)) )
+      while (!$done)
       {
-        # Check for the "stop" command.
-        # This may have sender information prepended.
-        if ($thisline =~ m/CMD\s+stop/i)
-        { $done = 1; }
-
-        # Whatever this is, it gets written.
-        # Prepend a timestamp.
-        # FIXME - Fetching a timestamp may slow things down!
+        # Sleep until something arrives, or it's time to look at the buses.
+        $filevec = '';
+        vec($filevec, fileno($eventhandle), 1) = 1;
+        if (0 < select($filevec, undef, undef,
+          $gpiobus_poll_interval / 1000))
+        {
+          $readcount = sysread($eventhandle, $pipebuffer, 65536,
+            length($pipebuffer));
+
+          # The other end went away.
+          if (!$readcount)
+          { $done = 1; }
+        }
+
+        # Pick up buses from devices that have appeared.
         $thistime = NCAM_GetRelTimeMillis();
-        chomp($thisline);
+        if ($thistime >= $nextbusscan)
+        {
+          $nextbusscan = $thistime + $gpiobus_scan_interval;
+
+          $buslist_p = NCAM_ListGPIOBuses();
+          foreach $label (keys %$buslist_p)
+          {
+            if (!(defined $gpiobuses{$label}))
+            {
+              $bus_p = NCAM_OpenGPIOBusReader($label);
+              if (defined $bus_p)
+              {
+                $gpiobuses{$label} = $bus_p;
+                $buslost{$label} = 0;
+
+# FIXME - Diagnostics.
+if ($tattlecomm) { print STDERR "-- Reading GPIO bus \"$label\".\n"; }
+              }
+            }
+          }
+        }
+
+        # The buses are read after the pipe, and all the way to the end.
+        # Monitors publish before they send by UDP, so any report whose UDP
+        # copy we have is on its bus by now.
+        foreach $label (sort keys %gpiobuses)
+        {
+          $bus_p = $gpiobuses{$label};
+
+          do
+          {
+            $records_p = NCAM_ReadGPIOBus($bus_p);
+
+            foreach $record_p (@$records_p)
+            {
+              # Bus records carry the time the monitor read the report,
+              # which is closer to the event than the time we see it. The
+              # log has to stay in order, though.
+              $thistime = int($$record_p[0] / 1000) - $timeoffset;
+              if ($thistime < $lasttime)
+              { $thistime = $lasttime; }
+              $lasttime = $thistime;
+
+              $thisline = '[gpiobus]  MSG gpio ' . $label . ' '
+                . $$record_p[1] . ': ' . $$record_p[2]
+                . ( (defined $$record_p[3]) ? (' ' . $$record_p[3]) : '' );
+
+              WriteLogLine(*LOGFILE{IO}, $gpiolog_p, $thistime, $thisline);
+            }
+          }
+          while (0 < scalar(@$records_p));
+
+          # Note reports that the bus overwrote before we read them. Their
+          # UDP copies are logged instead.
+          if ($$bus_p{lost} > $buslost{$label})
+          {
+            $thistime = NCAM_GetRelTimeMillis();
+            if ($thistime < $lasttime)
+            { $thistime = $lasttime; }
+            $lasttime = $thistime;
+
+            WriteLogLine(*LOGFILE{IO}, $gpiolog_p, $thistime,
+              '[gpiobus]  lost ' . ($$bus_p{lost} - $buslost{$label})
+              . ' reports from "' . $label . '"; using UDP copies');
+
+            $buslost{$label} = $$bus_p{lost};
+          }
+        }
+
+        while ($pipebuffer =~ s/^([^\n]*)\n//)
+        {
+          $thisline = $1;
+
+          # Check for the "stop" command.
+          # This may have sender information prepended.
+          if ($thisline =~ m/CMD\s+stop/i)
+          { $done = 1; }
 
 # FIXME - Diagnostics.
 if ($tattlecomm)
@@ -399,8 +666,29 @@ if ( $tattleframes || (!($thisline =~ m/^\s*\[\S+\]\s+\d+\s+\S+/)) )
 { print STDERR "-- Log message: $thisline\n"; }
 }
 
-        $thisline = '(' . $thistime . ') ' . $thisline . "\n";
-        print LOGFILE $thisline;
+          # Register reports from devices with buses carry the report's bus
+          # sequence number. That isn't logged. Reports we logged from the
+          # bus are skipped; ones from before we opened it, or that it
+          # lost, are logged from here.
+          if ($thisline =~
+            m/^(.*MSG gpio (\S+) [A-Z]: [0-9a-fA-F]+(?:\s+\d+)?)\s+#(\d+)\s*$/)
+          {
+            ($thisline, $label, $sequence) = ($1, $2, $3);
+
+            if (NCAM_WasGPIOBusRecordRead($gpiobuses{$label}, $sequence))
+            { next; }
+          }
+
+          # Whatever this is, it gets written.
+          # Prepend a timestamp.
+          # FIXME - Fetching a timestamp may slow things down!
+          $thistime = NCAM_GetRelTimeMillis();
+          if ($thistime < $lasttime)
+          { $thistime = $lasttime; }
+          $lasttime = $thistime;
+
+          WriteLogLine(*LOGFILE{IO}, $gpiolog_p, $thistime, $thisline);
+        }
       }
 
 # FIXME - Diagnostics.
@@ -408,6 +696,9 @@ if ($tattlecomm) { print STDERR "-- Logging stopped.\n"; }
 
       # Done.
       close(LOGFILE);
+      CloseGPIOEventLog($gpiolog_p);
+      foreach $label (keys %gpiobuses)
+      { NCAM_CloseGPIOBus($gpiobuses{$label}); }
       close($eventhandle);
     }
   }
@@ -1155,9 +1446,17 @@ if ($tattlecomm) { print $listenlogwrite "Writing test.\n"; }
 
     # Second child: spin off the imagecasting server.
     # FIXME - This doesn't give us a PID; instead we get a pipe handle.
-    # FIXME - Use the single-client version. Multi- can leave zombies.
+    # Use the native server if it's installed; it handles any number of
+    # clients and reads each frame once.
+    # FIXME - Otherwise use the single-client version. Multi- can leave
+    # zombies.
     $imagecast_handle =
-      NCAM_StartLiveImagecastSingle($$session_p{monitorport});
+      NCAM_StartLiveImagecastNative($$session_p{monitorport});
+    if (!(defined $imagecast_handle))
+    {
+      $imagecast_handle =
+        NCAM_StartLiveImagecastSingle($$session_p{monitorport});
+    }
 
 
     # Second child: spin off the stitcher.
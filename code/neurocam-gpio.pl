@@ -48,8 +48,26 @@ our ($NCAM_port_mgrdaemon_query);
 #
 
 # Baud rates to probe, in order.
+# The firmware's power-up rate goes first, so that the usual case is fast.
 my (@probebauds);
-@probebauds = ( 230400, 115200, 9600 );
+@probebauds = ( 115200, 230400, 9600 );
+
+# Baud rate to switch GPIO devices to after detection (undef to disable).
+# 250k, 500k, and 1M are exact with the GPIO device's 16 MHz clock.
+# If the terminal program won't open the port at this rate, the new rate
+# is never confirmed, and the device falls back to the old one by itself.
+my ($fastbaud);
+$fastbaud = 500000;
+
+# Time to wait for a device to hear us at a new baud rate before it falls
+# back to the old one, in milliseconds. This must match the firmware's
+# HOST_BAUD_CONFIRM_TICKS.
+my ($baudfallbacktime);
+$baudfallbacktime = 2000;
+
+# Interval between identity queries while probing, in milliseconds.
+my ($idqinterval);
+$idqinterval = 300;
 
 # Bitmasks for "start recording" and "stop recording" control lines.
 my ($cmdmask_start, $cmdmask_stop);
@@ -256,21 +274,60 @@ sub MakePrintableString
 
 
 
+# Computes the configuration hash a GPIOv1 device reports for a given
+# configuration. This must match GetSettingsHash() in the firmware.
+# Arg 0 is the pull-up flag (0 or 1).
+# Arg 1 is the echo flag (0 or 1).
+# Arg 2 is the reporting flag (0 or 1).
+# Arg 3 is the task activity flag (0 or 1).
+# Arg 4 is the task period in ticks.
+# Arg 5 is the task duration in ticks.
+# Arg 6 is the report timestamp flag (0 or 1; 1 for "REP 2").
+# Returns the hash as a lower-case hex string.
+
+sub ComputeGPIOConfigHash
+{
+  my ($pullups, $echo, $report, $taskactive, $period, $duration);
+  my ($timestamps);
+  my ($record, $hash, $thisbyte);
+
+  ($pullups, $echo, $report, $taskactive, $period, $duration, $timestamps)
+    = @_;
+
+  # Version 2 record layout.
+  $record = pack('CCCCCVVC', 2, $pullups, $echo, $report, $taskactive,
+    $period, $duration, $timestamps);
+
+  # FNV-1a, 32-bit.
+  $hash = 0x811c9dc5;
+  foreach $thisbyte (unpack('C*', $record))
+  {
+    $hash ^= $thisbyte;
+    $hash = ($hash * 0x01000193) & 0xffffffff;
+  }
+
+  return sprintf('%08x', $hash);
+}
+
+
+
 # Monitors a GPIO device, sending messages to the camera and management
 # daemons.
 # Arg 0 is the read handle.
 # Arg 1 is the write handle.
 # Arg 2 is the label to give this device when reporting.
 # Arg 3 is the full device identity string.
+# Arg 4 is the device's reported configuration hash (may be undef).
 # No return value.
 
 sub MonitorGPIODevice
 {
-  my ($readhandle, $writehandle, $labelstring, $idstring);
+  my ($readhandle, $writehandle, $labelstring, $idstring, $devhash);
   my ($devtype, $subtype, $devtask);
-  my ($initstring, $startmask, $stopmask);
-  my ($sockhandle);
-  my ($thisline, $regid, $dataval);
+  my ($initstring, $wanthash, $wantsave, $startmask, $stopmask);
+  my ($pullups, $taskactive, $taskperiod, $taskduration);
+  my ($sockhandle, $bus_p, $busseq);
+  my ($thisline, $regid, $dataval, $devtime);
   my ($want_start, $want_stop, $prev_start, $prev_stop);
   my ($thistime, $nextcmdtime);
 
@@ -278,6 +335,7 @@ sub MonitorGPIODevice
   $writehandle = $_[1];
   $labelstring = $_[2];
   $idstring = $_[3];
+  $devhash = $_[4];
 
   if (!( (defined $readhandle) && (defined $writehandle)
     && (defined $labelstring) && (defined $idstring) ))
@@ -315,6 +373,8 @@ sub MonitorGPIODevice
     # we know about it.
 
     $initstring = '';
+    $wanthash = undef;
+    $wantsave = 0;
     $startmask = 0x00;
     $stopmask = 0x00;
 
@@ -323,6 +383,14 @@ sub MonitorGPIODevice
       # This is a v1 GPIO device. Initialize it.
       $initstring .= "INI\nECH 0\n";
 
+      # Everything that goes into the configuration hash is set explicitly,
+      # so that we know what hash to expect. Pull-ups are on by default.
+      # The task is off unless we know what it's for.
+      $pullups = 1;
+      $taskactive = 0;
+      $taskperiod = 5000;
+      $taskduration = 20;
+
       # Check for known subtypes.
       if ( (defined $subtype) && ('neurocam' eq $subtype) )
       {
@@ -332,20 +400,32 @@ sub MonitorGPIODevice
         $startmask = $cmdmask_start;
         $stopmask = $cmdmask_stop;
 
-        # Enable pull-ups.
-        $initstring .= "PPU 1\n";
-
 
         # Check for known tasks.
         if ( (defined $devtask) && ('light strobe' eq $devtask) )
         {
-          # Add task initialization.
-          $initstring .= "TPP 10000\nTPD 20\nTSK 1\n";
+          $taskactive = 1;
+          $taskperiod = 10000;
+          $taskduration = 20;
+
+          # Save this configuration, so that the device boots into it and
+          # reconnects don't need to reinitialize.
+          $wantsave = 1;
         }
       }
 
+      $initstring .= "PPU $pullups\n";
+      $initstring .= "TPP $taskperiod\nTPD $taskduration\nTSK $taskactive\n";
+
       # Reporting comes last.
       $initstring .= "REP 1\n";
+
+      if ($wantsave)
+      { $initstring .= "CFS\n"; }
+
+      # This is the configuration the above produces.
+      $wanthash = ComputeGPIOConfigHash($pullups, 0, 1, $taskactive,
+        $taskperiod, $taskduration, 0);
     }
     else
     {
@@ -368,6 +448,11 @@ sub MonitorGPIODevice
     # Create a reporting socket.
     $sockhandle = NCAM_GetTransmitSocket();
 
+    # Register reports also go to this device's shared-memory event bus,
+    # which local consumers read without going through the relay. If the
+    # bus can't be created, reports only go out by UDP.
+    $bus_p = NCAM_OpenGPIOBusWriter($labelstring);
+
 
     # Initialize command processing.
     # Doing this early so that sample timestamps are after the dead time.
@@ -376,12 +461,28 @@ sub MonitorGPIODevice
     $nextcmdtime = NCAM_GetAbsTimeMillis();
 
 
-    # Wait a moment for the device to stabilize.
-    NCAM_SleepMillis(200);
+    # If the device is already configured the way we want, leave it alone.
+    # This preserves its clock and strobe phase.
+    # Turning reporting on again makes it send its current state, which we
+    # wouldn't otherwise hear about until something changed.
+    if ( (defined $wanthash) && (defined $devhash)
+      && (lc($devhash) eq $wanthash) )
+    {
+      if ($debug_tattle_banners)
+      {
+        print STDERR "-- Configuration hash matches; skipping init.\n";
+      }
 
+      print $writehandle "REP 1\n";
+    }
+    else
+    {
+      # Wait a moment for the device to stabilize.
+      NCAM_SleepMillis(200);
 
-    # Send the initialization string.
-    print $writehandle $initstring;
+      # Send the initialization string.
+      print $writehandle $initstring;
+    }
 
 
     # Spin, listening to the device.
@@ -404,17 +505,29 @@ sub MonitorGPIODevice
           }
 
           # FIXME - Assume that everything talks like a GPIOv1.
-          if ($thisline =~ m/^\s*([A-Z])\s*:\s*([0-9a-fA-F]+)\s*$/)
+          # Devices in timestamped reporting mode ("REP 2") append the
+          # event time, which may be on a shared multi-box timebase.
+          if ($thisline =~
+            m/^\s*([A-Z])\s*:\s*([0-9a-fA-F]+)(?:\s+(\d+))?\s*$/)
           {
             # This is a register update.
             $regid = $1;
             $dataval = $2;
+            $devtime = $3;
+
+            # Publish to the bus first; it's the faster path.
+            $busseq = NCAM_PublishGPIOBus($bus_p, $regid, $dataval,
+              $devtime);
 
             # No matter what, report this as a message packet.
             # This may contain changed non-command pins.
             # Bounce this through the parent thread.
+            # The bus sequence number, if any, tells the logger whether it
+            # already has this report from the bus. It strips it.
             NCAM_SendSocket($sockhandle, $hostip, $parentport,
-              "MSG gpio $labelstring $regid: $dataval");
+              "MSG gpio $labelstring $regid: $dataval"
+              . ((defined $devtime) ? " $devtime" : "")
+              . ((defined $busseq) ? " #$busseq" : ""));
 
 
             # Check to see if this is a start or stop command.
@@ -471,6 +584,25 @@ sub MonitorGPIODevice
 
             # Finished processing this register update.
           }
+          elsif ($thisline =~ m/^\s*W\s*:\s*((start|end)\s.*\S)\s*$/)
+          {
+            # This is a waveform playback event, with device timestamp.
+            NCAM_SendSocket($sockhandle, $hostip, $parentport,
+              "MSG gpio $labelstring W: $1");
+          }
+          elsif ($thisline =~ m/^\s*AT\s*:\s*(\d+\s+(up|down)\s+\d+)\s*$/)
+          {
+            # This is an analog threshold crossing, with device timestamp.
+            NCAM_SendSocket($sockhandle, $hostip, $parentport,
+              "MSG gpio $labelstring AT: $1");
+          }
+          elsif ($thisline =~ m/^\s*(FC|QE|FQ)\s*:\s*([^=]*[^=\s])\s*$/)
+          {
+            # This is a frame clock, quadrature or frequency report, with
+            # device timestamps. State query replies ("key=value") aren't.
+            NCAM_SendSocket($sockhandle, $hostip, $parentport,
+              "MSG gpio $labelstring $1: $2");
+          }
         }
       }
 
@@ -485,6 +617,201 @@ sub MonitorGPIODevice
 
 
 
+# Reads from a device until a pattern is seen or a timeout expires.
+# Arg 0 is the read handle.
+# Arg 1 is the regex to look for.
+# Arg 2 is the timeout in milliseconds.
+# Returns 1 if the pattern was seen and 0 otherwise.
+
+sub WaitForSerialPattern
+{
+  my ($readhandle, $pattern, $timeout);
+  my ($endtime, $response, $thesebytes, $bytesread, $found);
+
+  $readhandle = $_[0];
+  $pattern = $_[1];
+  $timeout = $_[2];
+
+  $found = 0;
+  $response = '';
+  $endtime = NCAM_GetAbsTimeMillis() + $timeout;
+
+  while ( (!$found) && (NCAM_GetAbsTimeMillis() < $endtime) )
+  {
+    if (NCAM_HandleCanRead($readhandle))
+    {
+      $thesebytes = '';
+      $bytesread = sysread($readhandle, $thesebytes, 1);
+
+      if ((defined $bytesread) && (0 < $bytesread))
+      {
+        $response .= $thesebytes;
+        if ($response =~ $pattern)
+        { $found = 1; }
+      }
+    }
+  }
+
+  return $found;
+}
+
+
+
+# Sends a query to a device until a pattern is seen or a timeout expires.
+# The query is resent every $idqinterval milliseconds, in case the device
+# wasn't listening yet.
+# Arg 0 is the read handle.
+# Arg 1 is the write handle.
+# Arg 2 is the query to send (including the newline).
+# Arg 3 is the regex to look for.
+# Arg 4 is the timeout in milliseconds.
+# Returns 1 if the pattern was seen and 0 otherwise.
+
+sub QuerySerialPattern
+{
+  my ($readhandle, $writehandle, $query, $pattern, $timeout);
+  my ($endtime, $thistime, $found);
+
+  $readhandle = $_[0];
+  $writehandle = $_[1];
+  $query = $_[2];
+  $pattern = $_[3];
+  $timeout = $_[4];
+
+  $found = 0;
+  $endtime = NCAM_GetAbsTimeMillis() + $timeout;
+  $thistime = NCAM_GetAbsTimeMillis();
+
+  while ( (!$found) && ($thistime < $endtime) )
+  {
+    print $writehandle $query;
+
+    $found = WaitForSerialPattern($readhandle, $pattern,
+      ($endtime - $thistime < $idqinterval)
+      ? ($endtime - $thistime) : $idqinterval);
+
+    $thistime = NCAM_GetAbsTimeMillis();
+  }
+
+  return $found;
+}
+
+
+
+# Asks a GPIO device to switch to a faster baud rate, and confirms that
+# we can talk to it at the new rate. If we can't, we wait for the device
+# to fall back to the old rate.
+# Each step waits for the device to answer rather than for a fixed time,
+# so this takes about as long as the device does.
+# Arg 0 is the device filename.
+# Arg 1 is the baud rate the device is currently using.
+# Returns the baud rate the device is using afterwards.
+
+sub NegotiateGPIOBaud
+{
+  my ($devname, $oldbaud, $newbaud);
+  my ($ttypid, $readhandle, $writehandle);
+  my ($ready, $acked, $confirmed, $fallbacktime);
+
+  $devname = $_[0];
+  $oldbaud = $_[1];
+  $newbaud = $oldbaud;
+
+  if ( (defined $devname) && (defined $oldbaud) && (defined $fastbaud)
+    && ($fastbaud != $oldbaud) )
+  {
+    # Keep DTR asserted when the port is closed. Otherwise, reopening it
+    # at the new rate resets Arduino-style boards.
+    `stty -F $devname -hupcl 2>/dev/null`;
+
+    $ready = 0;
+    $acked = 0;
+    $confirmed = 0;
+    $fallbacktime = undef;
+
+    ($ttypid, $readhandle, $writehandle) = OpenSerialPort($devname, $oldbaud);
+
+    if (defined $ttypid)
+    {
+      ScheduleKillAbs($ttypid, NCAM_GetAbsTimeMillis() + 3000);
+
+      # The device may still be restarting after the probe closed the port.
+      # Anything it answers means it's listening.
+      $ready = QuerySerialPattern($readhandle, $writehandle, "IDQ\n",
+        qr/devicetype\s*:.*\n/, 2000);
+
+      # Older firmware answers this with a help message, not an ack.
+      if ($ready)
+      {
+        print $writehandle "BAU $fastbaud\n";
+        $acked = WaitForSerialPattern($readhandle,
+          qr/BAU\s*:\s*$fastbaud\s*\n/, 500);
+        $fallbacktime = NCAM_GetAbsTimeMillis() + $baudfallbacktime;
+      }
+
+      kill 'TERM', $ttypid;
+      close($readhandle);
+      close($writehandle);
+    }
+
+    if ($acked)
+    {
+      ($ttypid, $readhandle, $writehandle) =
+        OpenSerialPort($devname, $fastbaud);
+
+      if (defined $ttypid)
+      {
+        ScheduleKillAbs($ttypid, $fallbacktime);
+
+        # Any valid command confirms the new rate. Stop trying a little
+        # before the device gives up on us, so we don't confirm a rate it's
+        # about to abandon.
+        $confirmed = QuerySerialPattern($readhandle, $writehandle, "IDQ\n",
+          qr/devicetype\s*:.*\n/,
+          $fallbacktime - 200 - NCAM_GetAbsTimeMillis());
+
+        kill 'TERM', $ttypid;
+        close($readhandle);
+        close($writehandle);
+      }
+
+      if ($confirmed)
+      {
+        $newbaud = $fastbaud;
+      }
+      else
+      {
+        # The device will go back to the old rate on its own. Wait until it
+        # answers there.
+        ($ttypid, $readhandle, $writehandle) =
+          OpenSerialPort($devname, $oldbaud);
+
+        if (defined $ttypid)
+        {
+          ScheduleKillAbs($ttypid, $fallbacktime + 1500);
+
+          QuerySerialPattern($readhandle, $writehandle, "IDQ\n",
+            qr/devicetype\s*:.*\n/,
+            $fallbacktime + 1000 - NCAM_GetAbsTimeMillis());
+
+          kill 'TERM', $ttypid;
+          close($readhandle);
+          close($writehandle);
+        }
+      }
+    }
+
+    if ($debug_device_detect)
+    {
+      print "-- Baud negotiation on $devname: using $newbaud baud.\n";
+    }
+  }
+
+  return $newbaud;
+}
+
+
+
 # Probes a USB serial port, checking to see if it has a device we want to
 # talk to. If so, a handler thread is spun off.
 # Arg 0 is the device filename.
@@ -492,10 +819,11 @@ sub MonitorGPIODevice
 
 sub ProbePort
 {
-  my ($devname, $childpid, $ttypid, $foundbaud, $idstring);
+  my ($devname, $childpid, $ttypid, $foundbaud, $idstring, $confighash);
   my ($readhandle, $writehandle);
   my ($bidx, $thisbaud, $found);
-  my ($endtime, $response, $bytesread, $thesebytes);
+  my ($endtime, $response, $idline, $bytesread, $thesebytes);
+  my ($thistime, $nextidqtime, $answertime);
   my ($devtype);
   my ($label);
 
@@ -505,6 +833,7 @@ sub ProbePort
   $ttypid = undef;
   $foundbaud = undef;
   $idstring = undef;
+  $confighash = undef;
 
   $devtype = undef;
 
@@ -542,20 +871,32 @@ sub ProbePort
 
         # Try to query the device type.
         # Give it a second to respond before giving up.
-
-        print $writehandle "IDQ\n";
+        # Repeat the query until we get an answer, in case the device was
+        # still starting up when the first one went out.
 
         # If we connect at the wrong speed, we'll get gibberish, not
         # cleanly terminated lines of text.
-        # Just glom all bytes read for one second and analyze it afterwards.
+        # Glom all bytes read for one second and analyze it afterwards, but
+        # stop early once we've seen a full identity response.
 
         # NOTE - Our loop exit should be _later_ than the kill, so that
         # we don't initiate a second trial while the first is still running.
+        # Exiting early is only done on success, which ends probing.
         $response = '';
         $endtime = NCAM_GetAbsTimeMillis() + 1500;
+        $nextidqtime = 0;
+        $answertime = undef;
 
         while (NCAM_GetAbsTimeMillis() < $endtime)
         {
+          $thistime = NCAM_GetAbsTimeMillis();
+
+          if ( (!(defined $answertime)) && ($thistime >= $nextidqtime) )
+          {
+            print $writehandle "IDQ\n";
+            $nextidqtime = $thistime + $idqinterval;
+          }
+
           if (NCAM_HandleCanRead($readhandle))
           {
             $thesebytes = '';
@@ -564,6 +905,17 @@ sub ProbePort
             if ((defined $bytesread) && (0 < $bytesread))
             { $response .= $thesebytes; }
           }
+
+          # Newer firmware follows the identity line with a hash line.
+          # Give it a moment to arrive, but don't wait for it forever.
+          if ( (!(defined $answertime))
+            && ($response =~ m/devicetype\s*:.*\n/) )
+          {
+            $answertime = $thistime;
+            $endtime = $thistime + 100;
+          }
+          if ($response =~ m/confighash\s*:\s*[0-9a-fA-F]+\s*\n/)
+          { $endtime = $thistime; }
         }
 
         if ($response =~ m/.*^\s*(.*?devicetype\s*:.*?\S)\s*$/ms)
@@ -571,7 +923,13 @@ sub ProbePort
           # We found something that responds to inquiries.
           # Extract that response string for downstream processing.
           $found = 1;
-          $response = $1;
+          $idline = $1;
+
+          # Newer firmware reports a configuration hash on its own line.
+          if ($response =~ m/confighash\s*:\s*([0-9a-fA-F]+)/)
+          { $confighash = $1; }
+
+          $response = $idline;
 
           # Extract the device type. This _should_ always match.
           if ($response =~ m/devicetype\s*:\s*(\S+)/)
@@ -587,6 +945,9 @@ sub ProbePort
         }
 
         # No matter what, the probe thread should be dead by now.
+        # If we finished early, make sure of that.
+        if ($found)
+        { kill 'TERM', $ttypid; }
 
         # Close both filehandles, ignoring errors.
         close($readhandle);
@@ -635,9 +996,11 @@ sub ProbePort
       # Only spin off a child if this is a device type we understand.
       if ('GPIOv1' eq $devtype)
       {
-        $foundbaud = $thisbaud;
         $idstring = $response;
 
+        # Try to speed up the link. This falls back to the probed rate.
+        $foundbaud = NegotiateGPIOBaud($devname, $thisbaud);
+
         # Give it a moment, then spin off a child with its own connection.
         NCAM_SleepMillis(500);
 
@@ -650,7 +1013,8 @@ sub ProbePort
         {
           # We're the child.
           NCAM_SetProcessName('ncam-gpio-monitor');
-          MonitorGPIODevice($readhandle, $writehandle, $label, $idstring);
+          MonitorGPIODevice($readhandle, $writehandle, $label, $idstring,
+            $confighash);
 
           # Exit gracefully. We shouldn't actually reach here.
           exit(0);
@@ -58,6 +58,23 @@ our ($NCAM_port_mjpeglib_base);
 
 
 
+#
+# Private Constants
+#
+
+# Native imagecast server (built from "native/"). If this isn't installed,
+# NCAM_StartLiveImagecastNative() returns undef and callers use one of the
+# Perl servers.
+my ($mjpegcast_cmd);
+$mjpegcast_cmd = 'ncam-mjpegcast';
+
+# Pre-scaled streams the native server offers, as "name:WxH". Clients ask
+# for these as "/name". Monitor frames are 800x600.
+my (@mjpegcast_variants);
+@mjpegcast_variants = ( 'small:400x300', 'thumb:200x150' );
+
+
+
 #
 # Public Functions
 #
@@ -791,6 +808,54 @@ sub NCAM_StartLiveImagecastSingle
 
 
 
+# Starts a live imagecasting server - native version.
+# This takes the same filenames and "shutdown" command as the Perl servers,
+# but reads each frame once and shares it between any number of clients.
+# Clients that can't keep up skip frames instead of holding up the rest.
+# Arg 0 is the port to serve streams from. Filename requested is ignored,
+# except that "/small" and so forth get pre-scaled streams.
+# Returns a filehandle to send filenames and commands to, or undef if the
+# native server isn't available.
+
+sub NCAM_StartLiveImagecastNative
+{
+  my ($stream_port);
+  my ($command_xmit, $serverpid);
+  my (@cmdargs, $thisvariant);
+
+  $stream_port = $_[0];
+  $command_xmit = undef;
+
+  if (defined $stream_port)
+  {
+    @cmdargs = ( $mjpegcast_cmd, '--port=' . $stream_port );
+    foreach $thisvariant (@mjpegcast_variants)
+    { push @cmdargs, '--variant=' . $thisvariant; }
+
+    # The list form doesn't go through the shell, so this fails (rather
+    # than starting a shell that fails) if the tool isn't on the path.
+    $serverpid = open($command_xmit, '|-', @cmdargs);
+
+    if (!(defined $serverpid))
+    {
+      $command_xmit = undef;
+    }
+    else
+    {
+      # The stitcher sends one line per frame; don't sit on them.
+      my ($oldhandle);
+
+      $oldhandle = select($command_xmit);
+      $| = 1;
+      select($oldhandle);
+    }
+  }
+
+  return $command_xmit;
+}
+
+
+
 #
 # Main Program
 #
@@ -12,6 +12,7 @@
 
 use strict;
 use warnings;
+use Fcntl qw(:DEFAULT :seek);
 
 
 
@@ -83,6 +84,22 @@ my (%reserved_ports);
 # Various local network information. Initialized on the first query.
 my ($local_network_info_p);
 
+# Shared-memory GPIO event buses. Each GPIO device's monitor publishes its
+# register reports to a ring of fixed 32-byte records in
+# "/dev/shm/ncam-gpio-<label>". See "native/gpiobus.h" for the format.
+my ($gpiobus_dir, $gpiobus_prefix);
+my ($gpiobus_capacity, $gpiobus_header_bytes, $gpiobus_record_bytes);
+my ($gpiobus_check_seed, $gpiobus_read_batch);
+$gpiobus_dir = '/dev/shm';
+$gpiobus_prefix = 'ncam-gpio-';
+# Records per bus. This must be a power of two.
+$gpiobus_capacity = 4096;
+$gpiobus_header_bytes = 64;
+$gpiobus_record_bytes = 32;
+$gpiobus_check_seed = 0x4e434742;
+# Most records to fetch from a bus per read.
+$gpiobus_read_batch = 256;
+
 
 
 #
@@ -753,6 +770,416 @@ sub NCAM_ProbeNetworkDevices
 
 
 
+# Adds up a bus record's check word.
+# Arg 0 is the first 28 bytes of the record.
+# Returns the check word.
+
+sub NCAM_GetGPIOBusCheck
+{
+  my ($data);
+
+  $data = $_[0];
+
+  return (unpack('%32V7', $data) + $gpiobus_check_seed) & 0xffffffff;
+}
+
+
+
+# Finds the newest valid record in a bus's slots.
+# Arg 0 is the contents of all of the slots.
+# Returns the record's sequence number (0 if there are no records).
+
+sub NCAM_FindGPIOBusNewest
+{
+  my ($slots, $newest);
+  my ($sidx, $record, $sequence);
+
+  $slots = $_[0];
+  $newest = 0;
+
+  for ($sidx = 0; ($sidx + 1) * $gpiobus_record_bytes <= length($slots);
+    $sidx++)
+  {
+    $record = substr($slots, $sidx * $gpiobus_record_bytes,
+      $gpiobus_record_bytes);
+    $sequence = unpack('Q<', $record);
+
+    # A record only counts if it's in the slot it belongs in.
+    if ( ($sequence > $newest)
+      && ($sidx == (($sequence - 1) % $gpiobus_capacity))
+      && (NCAM_GetGPIOBusCheck(substr($record, 0, 28))
+        == unpack('V', substr($record, 28, 4))) )
+    {
+      $newest = $sequence;
+    }
+  }
+
+  return $newest;
+}
+
+
+
+# Reads a bus's header and slots.
+# Arg 0 is the filehandle.
+# Returns (label, writer PID, slot contents), or an empty list if this
+# isn't a bus with the layout we use.
+
+sub NCAM_ReadGPIOBusFile
+{
+  my ($handle);
+  my ($header, $slots, $slotbytes);
+  my ($magic, $version, $recordbytes, $capacity, $pid, $label);
+
+  $handle = $_[0];
+
+  $slotbytes = $gpiobus_capacity * $gpiobus_record_bytes;
+
+  if ( (defined $handle)
+    && (sysseek($handle, 0, SEEK_SET))
+    && ($gpiobus_header_bytes
+      == sysread($handle, $header, $gpiobus_header_bytes))
+    && ($slotbytes == sysread($handle, $slots, $slotbytes)) )
+  {
+    ($magic, $version, $recordbytes, $capacity, $pid, $label) =
+      unpack('a8 V V V V Z16', $header);
+
+    if ( ('NCGPIOBS' eq $magic) && (1 == $version)
+      && ($gpiobus_record_bytes == $recordbytes)
+      && ($gpiobus_capacity == $capacity) )
+    {
+      return ($label, $pid, $slots);
+    }
+  }
+
+  return ();
+}
+
+
+
+# Creates the shared-memory event bus for a GPIO device, or takes over an
+# existing one, carrying on from its last record.
+# There must only be one writer per bus.
+# Arg 0 is the device label.
+# Returns a pointer to the bus's state, or undef on error.
+
+sub NCAM_OpenGPIOBusWriter
+{
+  my ($label, $bus_p);
+  my ($handle, $path, $oldlabel, $oldpid, $slots, $newest);
+
+  $label = $_[0];
+  $bus_p = undef;
+
+  $path = $gpiobus_dir . '/' . $gpiobus_prefix . $label;
+
+  if ( (defined $label) && ($label =~ m/^[\w.-]{1,16}$/)
+    && sysopen($handle, $path, O_RDWR | O_CREAT, 0644) )
+  {
+    binmode $handle;
+
+    ($oldlabel, $oldpid, $slots) = NCAM_ReadGPIOBusFile($handle);
+
+    if (defined $slots)
+    {
+      $newest = NCAM_FindGPIOBusNewest($slots);
+    }
+    else
+    {
+      # Start the bus over. The header goes in last, so that readers don't
+      # use the bus before the slots are cleared.
+      $newest = 0;
+      $slots = "\0" x ($gpiobus_capacity * $gpiobus_record_bytes);
+
+      if (! ( truncate($handle, 0)
+        && sysseek($handle, $gpiobus_header_bytes, SEEK_SET)
+        && (length($slots) == syswrite($handle, $slots))
+        && sysseek($handle, 0, SEEK_SET)
+        && ($gpiobus_header_bytes == syswrite($handle,
+          pack('a8 V V V V a16 x24', 'NCGPIOBS', 1, $gpiobus_record_bytes,
+            $gpiobus_capacity, 0, $label))) ) )
+      {
+        close($handle);
+        $handle = undef;
+      }
+    }
+
+    # Note who's writing.
+    if ( (defined $handle) && sysseek($handle, 20, SEEK_SET)
+      && (4 == syswrite($handle, pack('V', $$))) )
+    {
+      $bus_p = { 'handle' => $handle, 'label' => $label,
+        'next' => $newest + 1 };
+    }
+    elsif (defined $handle)
+    {
+      close($handle);
+    }
+  }
+
+  return $bus_p;
+}
+
+
+
+# Publishes one register report to a GPIO event bus.
+# Each report costs one seek and one write; readers need no system calls.
+# Arg 0 points to the bus's state.
+# Arg 1 is the register letter.
+# Arg 2 is the register value, as the device's hex string.
+# Arg 3 is the device tick (may be undef).
+# Returns the record's sequence number, or undef if there's no bus.
+
+sub NCAM_PublishGPIOBus
+{
+  my ($bus_p, $regid, $hexval, $devtime);
+  my ($sequence, $seconds, $micros, $flags, $record);
+
+  $bus_p = $_[0];
+  $regid = $_[1];
+  $hexval = $_[2];
+  $devtime = $_[3];
+  $sequence = undef;
+
+  if ( (defined $bus_p) && (defined $regid) && (defined $hexval) )
+  {
+    $sequence = $$bus_p{next};
+    ($seconds, $micros) = Time::HiRes::gettimeofday();
+
+    # Keep the hex width, so that the value can be logged as it was sent.
+    $flags = ((length($hexval) & 0x0f) << 4)
+      | ((defined $devtime) ? 1 : 0);
+
+    $record = pack('Q< q< V v C C V',
+      $sequence, int($seconds) * 1000000 + int($micros),
+      (defined $devtime) ? ($devtime & 0xffffffff) : 0,
+      (defined $devtime) ? (($devtime >> 32) & 0xffff) : 0,
+      ord($regid), $flags, hex($hexval) & 0xffffffff);
+    $record .= pack('V', NCAM_GetGPIOBusCheck($record));
+
+    sysseek($$bus_p{handle}, $gpiobus_header_bytes
+      + (($sequence - 1) % $gpiobus_capacity) * $gpiobus_record_bytes,
+      SEEK_SET);
+    syswrite($$bus_p{handle}, $record);
+
+    $$bus_p{next} = $sequence + 1;
+  }
+
+  return $sequence;
+}
+
+
+
+# Lists GPIO event buses that have a running writer.
+# No arguments.
+# Returns a pointer to a hash of bus paths, indexed by device label.
+
+sub NCAM_ListGPIOBuses
+{
+  my ($buses_p);
+  my ($direntry, $handle, $label, $pid, $slots);
+  local (*BUSDIR);
+
+  $buses_p = {};
+
+  if (opendir(BUSDIR, $gpiobus_dir))
+  {
+    while (defined ($direntry = readdir(BUSDIR)))
+    {
+      if ( ($direntry =~ m/^\Q$gpiobus_prefix\E(\S+)$/)
+        && sysopen($handle, $gpiobus_dir . '/' . $direntry, O_RDONLY) )
+      {
+        ($label, $pid, $slots) = NCAM_ReadGPIOBusFile($handle);
+        close($handle);
+
+        # Buses left over from writers that have gone away are skipped.
+        if ( (defined $slots) && (0 < $pid)
+          && ( kill(0, $pid) || $!{EPERM} ) )
+        {
+          $$buses_p{$label} = $gpiobus_dir . '/' . $direntry;
+        }
+      }
+    }
+
+    closedir(BUSDIR);
+  }
+
+  return $buses_p;
+}
+
+
+
+# Opens a GPIO event bus for reading. Reading starts after the newest
+# record.
+# Arg 0 is the device label.
+# Returns a pointer to the reader's state, or undef on error.
+
+sub NCAM_OpenGPIOBusReader
+{
+  my ($label, $bus_p);
+  my ($handle, $buslabel, $pid, $slots);
+
+  $label = $_[0];
+  $bus_p = undef;
+
+  if ( (defined $label)
+    && sysopen($handle, $gpiobus_dir . '/' . $gpiobus_prefix . $label,
+      O_RDONLY) )
+  {
+    binmode $handle;
+
+    ($buslabel, $pid, $slots) = NCAM_ReadGPIOBusFile($handle);
+
+    # "first" and "lostranges" record which sequence numbers this reader
+    # has returned (see NCAM_WasGPIOBusRecordRead()).
+    if (defined $slots)
+    {
+      $bus_p = { 'handle' => $handle, 'label' => $label,
+        'next' => NCAM_FindGPIOBusNewest($slots) + 1, 'lost' => 0,
+        'lostranges' => [] };
+      $$bus_p{first} = $$bus_p{next};
+    }
+    else
+    {
+      close($handle);
+    }
+  }
+
+  return $bus_p;
+}
+
+
+
+# Fetches new records from a GPIO event bus.
+# This reads a batch of records at a time, however many have arrived.
+# Records that were overwritten before they could be read are counted in
+# the reader's "lost" entry, and their sequence numbers are noted.
+# Arg 0 points to the reader's state.
+# Returns a pointer to an array of records. Each is a pointer to an array
+# of (host time in microseconds, register letter, hex value string,
+# device tick or undef).
+
+sub NCAM_ReadGPIOBus
+{
+  my ($bus_p, $records_p);
+  my ($slotidx, $count, $data, $offset, $record);
+  my ($sequence, $hosttime, $ticklow, $tickhigh, $reg, $flags, $value);
+  my ($check, $digits, $keepgoing);
+
+  $bus_p = $_[0];
+  $records_p = [];
+
+  if (defined $bus_p)
+  {
+    # Read up to the end of the ring; the next call picks up from the start.
+    $slotidx = ($$bus_p{next} - 1) % $gpiobus_capacity;
+    $count = $gpiobus_capacity - $slotidx;
+    if ($count > $gpiobus_read_batch)
+    { $count = $gpiobus_read_batch; }
+
+    $data = '';
+    if (sysseek($$bus_p{handle},
+      $gpiobus_header_bytes + $slotidx * $gpiobus_record_bytes, SEEK_SET))
+    {
+      sysread($$bus_p{handle}, $data, $count * $gpiobus_record_bytes);
+    }
+
+    $keepgoing = 1;
+    for ($offset = 0;
+      $keepgoing && ($offset + $gpiobus_record_bytes <= length($data));
+      $offset += $gpiobus_record_bytes)
+    {
+      $record = substr($data, $offset, $gpiobus_record_bytes);
+      ($sequence, $hosttime, $ticklow, $tickhigh, $reg, $flags, $value,
+        $check) = unpack('Q< q< V v C C V V', $record);
+
+      # The writer has lapped us. Skip to what's in this slot now.
+      # Slots after it line up with sequence numbers after it.
+      if ($sequence > $$bus_p{next})
+      {
+        $$bus_p{lost} += $sequence - $$bus_p{next};
+        push @{$$bus_p{lostranges}}, [ $$bus_p{next}, $sequence ];
+        $$bus_p{next} = $sequence;
+      }
+
+      # Stop at the first slot that isn't written yet (an older sequence
+      # number, or a record that's only partly there).
+      if ( ($sequence < $$bus_p{next})
+        || ($check != NCAM_GetGPIOBusCheck(substr($record, 0, 28))) )
+      {
+        $keepgoing = 0;
+      }
+      else
+      {
+        $digits = $flags >> 4;
+        if (1 > $digits)
+        { $digits = 2; }
+
+        push @$records_p, [ $hosttime, chr($reg),
+          sprintf('%0*x', $digits, $value),
+          ($flags & 1) ? ($tickhigh * 4294967296 + $ticklow) : undef ];
+
+        $$bus_p{next} = $sequence + 1;
+      }
+    }
+  }
+
+  return $records_p;
+}
+
+
+
+# Checks whether a reader returned the record with a given sequence
+# number. Records from before the reader was opened, records it lost, and
+# records it hasn't got to yet weren't returned.
+# Sequence numbers must be asked about in increasing order; lost ranges
+# that are behind the one asked about are forgotten.
+# Arg 0 points to the reader's state.
+# Arg 1 is the sequence number.
+# Returns 1 if the record was returned, 0 if not.
+
+sub NCAM_WasGPIOBusRecordRead
+{
+  my ($bus_p, $sequence);
+  my ($ranges_p);
+
+  $bus_p = $_[0];
+  $sequence = $_[1];
+
+  if ( (!(defined $bus_p)) || (!(defined $sequence))
+    || ($sequence < $$bus_p{first}) || ($sequence >= $$bus_p{next}) )
+  { return 0; }
+
+  $ranges_p = $$bus_p{lostranges};
+
+  while ( (0 < scalar(@$ranges_p)) && ($$ranges_p[0][1] <= $sequence) )
+  { shift @$ranges_p; }
+
+  if ( (0 < scalar(@$ranges_p)) && ($$ranges_p[0][0] <= $sequence) )
+  { return 0; }
+
+  return 1;
+}
+
+
+
+# Closes a GPIO event bus writer or reader. The bus itself stays.
+# Arg 0 points to the bus's state (may be undef).
+# No return value.
+
+sub NCAM_CloseGPIOBus
+{
+  my ($bus_p);
+
+  $bus_p = $_[0];
+
+  if (defined $bus_p)
+  {
+    close($$bus_p{handle});
+  }
+}
+
+
+
 #
 # Main Program
 #
@@ -96,6 +96,21 @@ $fake_greyscale = 1;
 my ($ffmpeg_cmd);
 $ffmpeg_cmd = 'avconv';
 
+# Native GPIO timing analyzer (built from "native/"). If this isn't
+# installed, the Perl fallback in NCAM_AnalyzeGPIOTime() is used.
+my ($gpiotime_cmd);
+$gpiotime_cmd = 'ncam-gpiotime';
+
+# Native video stream timing estimator (also from "native/"). If this isn't
+# installed, NCAM_AdjustTimestampsOneStream() is used for each feed.
+my ($streamtime_cmd);
+$streamtime_cmd = 'ncam-streamtime';
+
+# Native composite frame builder (also from "native/"). If this isn't
+# installed, frames are stitched one at a time with PerlMagick.
+my ($composite_cmd);
+$composite_cmd = 'ncam-composite';
+
 # Video encoding flags.
 
 # FIXME - Mint 18's ffmpeg doesn't like "libx264" or "libopenh264".
@@ -482,6 +497,62 @@ sub NCAM_AnalyzeGPIOTime
 
 
 
+# Analyzes GPIO timing signals within a log file, using the native analyzer.
+# This fits the whole pulse train rather than averaging gaps, so it isn't
+# thrown off by dropped packets, and it picks the strobe channel by how well
+# each candidate fits rather than by name.
+# This reads the binary GPIO event log if the daemon wrote one, and the text
+# log otherwise. Both give the same results.
+# Arg 0 is the repository directory name.
+# Returns (period, offset) of the timing signal, or undef if not found or if
+# the analyzer isn't available.
+
+sub NCAM_AnalyzeGPIOTimeNative
+{
+  my ($repodir, $logfilename, $period, $offset);
+  my ($cmd, $result);
+
+  $repodir = $_[0];
+
+  $period = undef;
+  $offset = undef;
+
+  $logfilename = undef;
+  if (defined $repodir)
+  {
+    # The binary log only holds GPIO reports, so it's much faster to scan.
+    $logfilename = $repodir . '/gpioevents.bin';
+    if (!( -s $logfilename ))
+    { $logfilename = $repodir . '/logfile.txt'; }
+  }
+
+  if ( (defined $logfilename) && (-e $logfilename) )
+  {
+    $cmd = "$gpiotime_cmd $logfilename 2>/dev/null";
+    $result = `$cmd`;
+
+    if ( (defined $result)
+      && ($result =~ m/^period:\s+(\S+)/m) )
+    {
+      $period = $1;
+
+      if ($result =~ m/^offset:\s+(\S+)/m)
+      { $offset = $1; }
+      else
+      { $period = undef; }
+
+      if ( (defined $period) && $debug_tattle_gpio )
+      {
+        print STDERR "-- Native GPIO timing analysis:\n" . $result;
+      }
+    }
+  }
+
+  return ($period, $offset);
+}
+
+
+
 # Extracts a high-pass-filtered data series corresponding to one tile
 # (one pixel of the thumbnailed image).
 # Raw samples are normalized to (0..1). HPFd will be (-1..+1) at worst.
@@ -1011,7 +1082,13 @@ sub NCAM_AdjustTimestampsOneStream
   {
     # Extract the timing signal's period and offset.
     # FIXME - Doing this for every feed is redundant.
-    ($gpio_period, $gpio_offset) = NCAM_AnalyzeGPIOTime($logfile_p);
+    ($gpio_period, $gpio_offset) =
+      NCAM_AnalyzeGPIOTimeNative($repodir);
+
+    if (!( (defined $gpio_period) && (defined $gpio_offset) ))
+    {
+      ($gpio_period, $gpio_offset) = NCAM_AnalyzeGPIOTime($logfile_p);
+    }
 
     if (!( (defined $gpio_period) && (defined $gpio_offset) ))
     {
@@ -1265,6 +1342,97 @@ print STDERR "-- Can't find \"$thisfile\"!\n";
 }
 
 
+# Adjusts timestamps for several video feeds at once, using the native
+# estimator. This gives the same results as NCAM_AdjustTimestampsOneStream()
+# but decodes frames and evaluates tiles and feeds in parallel.
+# Arg 0 is the repository directory name.
+# Arg 1 points to a list of feed names.
+# Arg 2 points to an array containing the uncorrected log file text.
+# Returns a pointer to a hash of per-feed correction hashes (each mapping
+# uncorrected lines to corrected lines), or undef if the native estimator
+# isn't available.
+
+sub NCAM_AdjustTimestampsNative
+{
+  my ($repodir, $feeds_p, $logfile_p, $allcorrections_p);
+  my ($gpio_period, $gpio_offset, $cmd, @result, $resultline);
+  my ($thisfeed, $corrections_p, $thisline, $thistime);
+
+  $repodir = $_[0];
+  $feeds_p = $_[1];
+  $logfile_p = $_[2];
+
+  $allcorrections_p = undef;
+
+  if ( (defined $repodir) && (defined $feeds_p) && (defined $logfile_p)
+    && (defined $$feeds_p[0]) )
+  {
+    ($gpio_period, $gpio_offset) =
+      NCAM_AnalyzeGPIOTimeNative($repodir);
+
+    if (!( (defined $gpio_period) && (defined $gpio_offset) ))
+    {
+      ($gpio_period, $gpio_offset) = NCAM_AnalyzeGPIOTime($logfile_p);
+    }
+
+    if ( (defined $gpio_period) && (defined $gpio_offset) )
+    {
+      # Pass full precision, so that binning matches the Perl version.
+      $cmd = $streamtime_cmd
+        . sprintf(' --period=%.17g --gpio-offset=%.17g',
+          $gpio_period, $gpio_offset);
+      foreach $thisfeed (@$feeds_p)
+      { $cmd .= ' --feed=' . $thisfeed; }
+      $cmd .= ' ' . $repodir . ' 2>/dev/null';
+
+      @result = `$cmd`;
+
+      $corrections_p = undef;
+
+      foreach $resultline (@result)
+      {
+        if ($resultline =~ m/^feed\s+(\w+)/)
+        {
+          $thisfeed = $1;
+          $corrections_p = {};
+
+          if (!(defined $allcorrections_p))
+          { $allcorrections_p = {}; }
+          $$allcorrections_p{$thisfeed} = $corrections_p;
+
+          if ($debug_tattle_timing)
+          {
+            if ($resultline =~ m/offset\s+(\S+)\s+evidence/)
+            {
+              print STDERR
+                sprintf('-- [%s]  Native offset: %.1f ms' . "\n",
+                  $thisfeed, $1);
+            }
+            else
+            {
+              print STDERR "-- [$thisfeed]  Native estimate failed.\n";
+            }
+          }
+        }
+        elsif ( (defined $corrections_p)
+          && ($resultline =~ m/^line\s+(\d+)\s+(-?\d+)/) )
+        {
+          $thistime = $2;
+          $thisline = $$logfile_p[$1];
+
+          if ( (defined $thisline) && ($thisline =~ m/^\(\d+\)(.*)/s) )
+          {
+            $$corrections_p{$thisline} = '(' . $thistime . ')' . $1;
+          }
+        }
+      }
+    }
+  }
+
+  return $allcorrections_p;
+}
+
+
 # Adjusts timestamps for all face and scene video feeds.
 # This reads from "logfile.txt" and creates "logfile-timed.txt".
 # Lines are moved so that timestamps are still monotonic.
@@ -1281,6 +1449,7 @@ sub NCAM_AdjustTimestampsAllStreams
   my ($lidx);
   my ($thistime, $lasttime, %linehash, $thislist_p);
   my ($sockhandle, $netinfo_p, $hostip);
+  my (@todolist, $nativecorrections_p);
 
   $repodir = $_[0];
   $port = $_[1];
@@ -1316,24 +1485,41 @@ sub NCAM_AdjustTimestampsAllStreams
 
     @$newlog_p = @$logdata_p;
 
+    # FIXME - Don't process the game feed.
+    # FIXME - We still need a way to align game frames!
+    @todolist = ();
     foreach $thisfeed (@NCAM_session_slots)
     {
-      # FIXME - Don't process the game feed.
-      # FIXME - We still need a way to align game frames!
       if ( (defined $feedlist{$thisfeed}) && ('Game' ne $thisfeed) )
-      {
-        # FIXME - Just send the stream name as the progress report for now.
-        NCAM_SendSocket($sockhandle, $hostip, $port, "progress $thisfeed");
+      { push @todolist, $thisfeed; }
+    }
+
+    # Try the native estimator first. It does all feeds in one go.
+    NCAM_SendSocket($sockhandle, $hostip, $port, "progress timing");
+    $nativecorrections_p =
+      NCAM_AdjustTimestampsNative($repodir, \@todolist, $logdata_p);
 
+    foreach $thisfeed (@todolist)
+    {
+      # FIXME - Just send the stream name as the progress report for now.
+      NCAM_SendSocket($sockhandle, $hostip, $port, "progress $thisfeed");
+
+      if ( (defined $nativecorrections_p)
+        && (defined $$nativecorrections_p{$thisfeed}) )
+      {
+        $corrections_p = $$nativecorrections_p{$thisfeed};
+      }
+      else
+      {
         $corrections_p =
           NCAM_AdjustTimestampsOneStream($repodir, $thisfeed, $logdata_p);
+      }
 
-        # Apply the corrections from this stream.
-        for ($lidx = 0; defined ($thisline = $$newlog_p[$lidx]); $lidx++)
-        {
-          if (defined $$corrections_p{$thisline})
-          { $$newlog_p[$lidx] = $$corrections_p{$thisline}; }
-        }
+      # Apply the corrections from this stream.
+      for ($lidx = 0; defined ($thisline = $$newlog_p[$lidx]); $lidx++)
+      {
+        if (defined $$corrections_p{$thisline})
+        { $$newlog_p[$lidx] = $$corrections_p{$thisline}; }
       }
     }
 
@@ -1356,6 +1542,79 @@ sub NCAM_AdjustTimestampsAllStreams
 
 
 
+# Builds composite frames using the native compositor, which decodes each
+# source frame once and builds output frames in parallel. This writes the
+# same frames as the PerlMagick loop in NCAM_BuildCompositeFrames().
+# The "Composite" folder must already exist.
+# Arg 0 is the repository directory path.
+# Arg 1 is the log file to read.
+# Arg 2 is the IP address to send progress reports to.
+# Arg 3 is the port to send progress reports to.
+# Returns a pointer to an array of new log lines, or undef if the native
+# compositor isn't available.
+
+sub NCAM_BuildCompositeFramesNative
+{
+  my ($repodir, $logname, $hostip, $port, $newlog_p);
+  my ($cmd, @result, $resultline);
+  my ($thisslot, $placement_p, $label);
+
+  $repodir = $_[0];
+  $logname = $_[1];
+  $hostip = $_[2];
+  $port = $_[3];
+
+  $newlog_p = undef;
+
+  if ( (defined $repodir) && (defined $logname)
+    && (defined $hostip) && (defined $port) )
+  {
+    $cmd = $composite_cmd
+      . ' --log=' . $logname
+      . ' --size=' . $$stitchinfo_composite_p{fullsize}
+      . ' --tile=' . $$stitchinfo_composite_p{tilesize}
+      . ' --step=' . $$stitchinfo_composite_p{dx}
+        . ',' . $$stitchinfo_composite_p{dy}
+      . ' --offset=' . $$stitchinfo_composite_p{offx}
+        . ',' . $$stitchinfo_composite_p{offy}
+      . ' --fontsize=' . $$stitchinfo_composite_p{fontsize}
+      . ' --progress=' . $hostip . ':' . $port;
+
+    foreach $thisslot (@NCAM_session_slots)
+    {
+      $placement_p = $$stitchslots_composite_p{$thisslot};
+      if (defined $placement_p)
+      {
+        # Labels have spaces, so they're quoted.
+        $label = $$placement_p{label};
+        $label =~ s/'//g;
+        $cmd .= sprintf(" '--slot=%s:%d:%d:%s'", $thisslot,
+          $$placement_p{x}, $$placement_p{y}, $label);
+      }
+    }
+
+    $cmd .= ' ' . $repodir . ' 2>/dev/null';
+
+    @result = `$cmd`;
+
+    # A missing tool or a bad argument gives a nonzero exit status.
+    if (0 == $?)
+    {
+      $newlog_p = [];
+
+      foreach $resultline (@result)
+      {
+        if ($resultline =~ m/^\(\d+\)\s+\[Composite\]/)
+        { push @$newlog_p, $resultline; }
+      }
+    }
+  }
+
+  return $newlog_p;
+}
+
+
+
 # Builds a "Composite" stream that stitches together all standard streams.
 # This is pretty much the monitor stream with timestamps and no dropped
 # frames.
@@ -1373,6 +1632,7 @@ sub NCAM_BuildCompositeFrames
   my ($thisline, $thistime, $thisslot, $thisfile, $nexttime);
   my ($command, $result);
   my ($sockhandle, $netinfo_p, $hostip);
+  my ($logname, $nativelog_p);
 
   $repodir = $_[0];
   $port = $_[1];
@@ -1410,65 +1670,81 @@ sub NCAM_BuildCompositeFrames
     $netinfo_p = NCAM_GetNetworkInfo();
     $hostip = $$netinfo_p{hostip};
 
-    # Estimate how many frames we'll be emitting, for progress reports.
-    # FIXME - This estimate may be off!
-    $thistime = 0;
-    foreach $thisline (@$logdata_p)
+    # Use the native compositor if it's installed. Otherwise stitch each
+    # frame here.
+    $logname = $repodir . '/logfile-timed.txt';
+    if (!( -e $logname ))
+    { $logname = $repodir . '/logfile.txt'; }
+
+    $nativelog_p =
+      NCAM_BuildCompositeFramesNative($repodir, $logname, $hostip, $port);
+
+    if (defined $nativelog_p)
     {
-      if ($thisline =~ m/^\((\d+)\)\s+\[\w+\]\s+frame\s+\d+\s+\S+/)
+      $newlog_p = $nativelog_p;
+    }
+    else
+    {
+      # Estimate how many frames we'll be emitting, for progress reports.
+      # FIXME - This estimate may be off!
+      $thistime = 0;
+      foreach $thisline (@$logdata_p)
       {
-        $thistime = $1;
+        if ($thisline =~ m/^\((\d+)\)\s+\[\w+\]\s+frame\s+\d+\s+\S+/)
+        {
+          $thistime = $1;
+        }
       }
-    }
-    $framemax = int((0.999 + $thistime) / $period);
+      $framemax = int((0.999 + $thistime) / $period);
 
 
-    # Process the logfile.
+      # Process the logfile.
 
-    foreach $thisline (@$logdata_p)
-    {
-      if ($thisline =~ m/^\((\d+)\)\s+\[(\w+)\]\s+frame\s+\d+\s+(\S+)/)
+      foreach $thisline (@$logdata_p)
       {
-        $thistime = $1;
-        $thisslot = $2;
-        $thisfile = $3;
-
-        if (defined $slotnames{$thisslot})
+        if ($thisline =~ m/^\((\d+)\)\s+\[(\w+)\]\s+frame\s+\d+\s+(\S+)/)
         {
-          # This is a frame we want to keep track of.
-
-          $recentframes{$thisslot} = "$repodir/$thisfile";
+          $thistime = $1;
+          $thisslot = $2;
+          $thisfile = $3;
 
-          # If we're at the point at which we should emit a frame, do so.
-          if ($thistime >= $nexttime)
+          if (defined $slotnames{$thisslot})
           {
-            # Bump the next-frame time until it's in the future.
-            # Increment the frame count each time. This gives a sparse
-            # list, but that's better than wasting disk space.
-            do
+            # This is a frame we want to keep track of.
+
+            $recentframes{$thisslot} = "$repodir/$thisfile";
+
+            # If we're at the point at which we should emit a frame, do so.
+            if ($thistime >= $nexttime)
             {
-              $nexttime += $period;
-              $framecount++;
-            }
-            while ($nexttime <= $thistime);
+              # Bump the next-frame time until it's in the future.
+              # Increment the frame count each time. This gives a sparse
+              # list, but that's better than wasting disk space.
+              do
+              {
+                $nexttime += $period;
+                $framecount++;
+              }
+              while ($nexttime <= $thistime);
 
 
-            # Emit this frame.
+              # Emit this frame.
 
-            $thisfile = 
-              sprintf('Composite/%08d.jpg', $framecount);
+              $thisfile = 
+                sprintf('Composite/%08d.jpg', $framecount);
 
-            NCAM_CreateStitchedImage("$repodir/$thisfile", \%recentframes,
-              $stitchinfo_composite_p, $stitchslots_composite_p,
-              "$thistime ms");
+              NCAM_CreateStitchedImage("$repodir/$thisfile", \%recentframes,
+                $stitchinfo_composite_p, $stitchslots_composite_p,
+                "$thistime ms");
 
-            push @$newlog_p,
-              "($thistime) [Composite]  frame $framecount  $thisfile\n";
+              push @$newlog_p,
+                "($thistime) [Composite]  frame $framecount  $thisfile\n";
 
 
-            # Send a progress report to the manager.
-            NCAM_SendSocket($sockhandle, $hostip, $port,
-              "progress $framecount/$framemax");
+              # Send a progress report to the manager.
+              NCAM_SendSocket($sockhandle, $hostip, $port,
+                "progress $framecount/$framemax");
+            }
           }
         }
       }
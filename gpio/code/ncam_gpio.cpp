@@ -19,20 +19,36 @@ void DoSetup()
 {
   MCU_Init();
 
+  ResetLineStats();
   ConfigPins(FOB_DEFAULT_PULLUPS);
 
   // Set up the timer before initializing the task, as task init reads
   // the clock.
   Timer_Init(CPU_SPEED, RTC_TICKS_PER_SECOND);
+#if CAPTURE_ENABLE
+  InitCaptureTimer();
+#endif
 
   ConfigureTask(FOB_DEFAULT_STROBE_PERIOD, FOB_DEFAULT_STROBE_HOLD);
   SetTaskActivity(TASK_AUTOSTART);
 
+#if WAVE_ENABLE
+  // Make any saved playback sequence available (but don't start it).
+  LoadWave();
+#endif
+
+#if TASKLET_ENABLE
+  InitTasklets();
+#endif
+
   // Add the timer callback _after_ initializing the task, as it calls the
   // task's update routine.
   Timer_RegisterCallback(&TimerCallback_ISR);
 
   InitHostLink();
+
+  // If a configuration was saved, boot straight into it.
+  LoadSettings();
 }
 
 
@@ -43,6 +59,16 @@ int main(void)
   while (1)
   {
     PollHostInput();
+#if TASKLET_ENABLE
+    PollTasklets();
+#else
+#if SYNC_ENABLE
+    PollSync();
+#endif
+#if PLL_ENABLE
+    PollPLL();
+#endif
+#endif
     PollHostReporting();
   }
 
@@ -0,0 +1,561 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Analog acquisition on the port C pins.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if ADC_ENABLE
+
+//
+// Private macros
+
+// ADC0..ADC5 are PC0..PC5.
+#define ADC_CHANNEL_COUNT 6
+#define ADC_CHANNEL_MASK 0x3f
+
+// Reference is AVcc; the low bits select the channel.
+#define ADC_ADMUX_REF (1 << REFS0)
+
+// ADC enabled, interrupt enabled, 128x prescaler (125 kHz ADC clock).
+#define ADC_ADCSRA_RUN \
+  ( (1 << ADEN) | (1 << ADIE) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0) )
+
+// Conversions are 10 bits.
+#define ADC_LEVEL_MAX 0x3ff
+
+// Sums of 10-bit conversions must fit in 32 bits with room to spare.
+#define ADC_MAX_DECIMATION 0xffff
+
+
+
+//
+// Private types
+
+// One decimated sample for each enabled channel.
+// Sums are stored rather than averages, to keep division out of the ISR.
+struct adc_set_t
+{
+  uint32_t timestamp;
+  uint32_t sums[ADC_CHANNEL_COUNT];
+};
+
+struct adc_event_t
+{
+  uint32_t timestamp;
+  uint8_t channel;
+  bool is_rising;
+};
+
+
+
+//
+// Private variables
+
+// Acquisition configuration.
+uint8_t adc_channel_mask = 0;
+uint8_t adc_channel_list[ADC_CHANNEL_COUNT];
+uint8_t adc_channel_count = 0;
+uint16_t adc_decimation = 1;
+bool adc_streaming = true;
+
+// Threshold levels (0 = disabled), and which channels are above theirs.
+uint16_t adc_thresholds[ADC_CHANNEL_COUNT];
+uint8_t adc_above_mask = 0;
+uint8_t adc_primed_mask = 0;
+
+// Position in the channel list of the conversion in progress.
+volatile uint8_t adc_slot = 0;
+
+// Boxcar accumulators.
+uint32_t adc_sums[ADC_CHANNEL_COUNT];
+uint16_t adc_decim_count = 0;
+
+// Decimated samples waiting to be sent.
+adc_set_t adc_sets[ADC_BUFFER_SETS];
+volatile uint8_t adc_set_head = 0;
+volatile uint8_t adc_set_count = 0;
+volatile uint32_t adc_set_seq = 0;
+volatile uint32_t adc_sets_lost = 0;
+uint32_t adc_lost_reported = 0;
+
+// Threshold events waiting to be sent.
+adc_event_t adc_events[ADC_EVENT_BUFFER_SIZE];
+volatile uint8_t adc_event_head = 0;
+volatile uint8_t adc_event_count = 0;
+
+
+
+//
+// Private prototypes
+
+// Clears accumulators and buffered data.
+// This must be called with interrupts off.
+void ResetADCState_ISR(void);
+
+// Checks one conversion against its channel's threshold.
+// This must be called with interrupts off.
+void NoteADCThreshold_ISR(uint8_t slot, uint16_t value, uint32_t this_time);
+
+// Moves the accumulators into the sample buffer.
+// This must be called with interrupts off.
+void StoreADCSet_ISR(uint32_t this_time);
+
+// Prints a 10-bit value as three hex digits.
+void PrintADCValue(uint16_t value);
+
+
+
+//
+// Functions
+
+
+// Clears accumulators and buffered data.
+// This must be called with interrupts off.
+
+void ResetADCState_ISR(void)
+{
+  uint8_t sidx;
+
+  for (sidx = 0; sidx < ADC_CHANNEL_COUNT; sidx++)
+    adc_sums[sidx] = 0;
+
+  adc_slot = 0;
+  adc_decim_count = 0;
+  adc_above_mask = 0;
+  adc_primed_mask = 0;
+
+  adc_set_head = 0;
+  adc_set_count = 0;
+  adc_event_head = 0;
+  adc_event_count = 0;
+}
+
+
+
+// Stops acquisition and reconfigures the ADC for the selected channels.
+// Bit n of the mask selects ADC channel n (pin PCn). A mask of 0 leaves
+// the ADC off. Returns false if the mask selects nonexistent channels.
+
+bool SetADCChannels(uint32_t channel_mask)
+{
+  uint8_t cidx;
+
+  if (channel_mask & ~((uint32_t) ADC_CHANNEL_MASK))
+    return false;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    // Stop any conversion in progress and discard its result.
+    ADCSRA = 0;
+    ADCSRA = (1 << ADIF);
+
+    adc_channel_mask = channel_mask;
+    adc_channel_count = 0;
+    for (cidx = 0; cidx < ADC_CHANNEL_COUNT; cidx++)
+      if (adc_channel_mask & (1 << cidx))
+      {
+        adc_channel_list[adc_channel_count] = cidx;
+        adc_channel_count++;
+      }
+
+    ResetADCState_ISR();
+
+    // Analog pins are inputs with no pull-ups and no digital buffers.
+    // The digital buffers waste power and add noise with analog inputs.
+    DDRC &= ~adc_channel_mask;
+    PORTC &= ~adc_channel_mask;
+    DIDR0 = adc_channel_mask;
+
+    if (0 < adc_channel_count)
+    {
+      PRR &= ~(1 << PRADC);
+      ADCSRB = 0;
+      ADMUX = ADC_ADMUX_REF | adc_channel_list[0];
+      ADCSRA = ADC_ADCSRA_RUN | (1 << ADSC);
+    }
+  }
+
+  return true;
+}
+
+
+
+// Sets the number of conversions averaged per channel for each reported
+// sample. Returns false if the factor is out of range.
+
+bool SetADCDecimation(uint32_t factor)
+{
+  if ( (1 > factor) || (ADC_MAX_DECIMATION < factor) )
+    return false;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    adc_decimation = factor;
+
+    // Buffered samples were summed with the old factor.
+    ResetADCState_ISR();
+  }
+
+  return true;
+}
+
+
+
+// Picks a decimation factor that gives approximately the requested
+// output rate (samples per second per channel).
+// Returns false if the rate can't be reached.
+
+bool SetADCOutputRate(uint32_t rate)
+{
+  uint32_t channel_rate;
+
+  if ( (0 == rate) || (0 == adc_channel_count) )
+    return false;
+
+  channel_rate = ADC_CONVERSIONS_PER_SECOND / adc_channel_count;
+
+  return SetADCDecimation((channel_rate + (rate / 2)) / rate);
+}
+
+
+
+// Sets a channel's threshold crossing level.
+// The argument is (channel) * 1024 + (level); a level of 0 disables
+// threshold events for that channel.
+// Returns false if the channel doesn't exist.
+
+bool SetADCThreshold(uint32_t packed_threshold)
+{
+  uint32_t channel;
+  uint8_t sidx;
+
+  channel = packed_threshold >> 10;
+  if (ADC_CHANNEL_COUNT <= channel)
+    return false;
+
+  // Thresholds are stored by channel number, and looked up by slot in the
+  // ISR, so the list has to be searched either here or there.
+  adc_thresholds[channel] = packed_threshold & ADC_LEVEL_MAX;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (sidx = 0; sidx < adc_channel_count; sidx++)
+      if (channel == adc_channel_list[sidx])
+        adc_primed_mask &= ~(1 << sidx);
+  }
+
+  return true;
+}
+
+
+
+// Enables or disables streaming of decimated sample blocks.
+
+void SetADCStreaming(bool is_streaming)
+{
+  adc_streaming = is_streaming;
+}
+
+
+
+// Checks one conversion against its channel's threshold.
+// This must be called with interrupts off.
+
+void NoteADCThreshold_ISR(uint8_t slot, uint16_t value, uint32_t this_time)
+{
+  uint16_t level;
+  uint8_t slotbit;
+  bool was_above, is_above;
+  uint8_t idx;
+
+  level = adc_thresholds[adc_channel_list[slot]];
+  if (0 == level)
+    return;
+
+  slotbit = (1 << slot);
+  was_above = (0 != (adc_above_mask & slotbit));
+
+  // Rise at the threshold, fall below it minus the hysteresis.
+  if (was_above)
+    is_above = ( (value + ADC_THRESHOLD_HYSTERESIS) > level );
+  else
+    is_above = (value >= level);
+
+  if (is_above)
+    adc_above_mask |= slotbit;
+  else
+    adc_above_mask &= ~slotbit;
+
+  // The first conversion after a change only establishes the state.
+  if (!(adc_primed_mask & slotbit))
+  {
+    adc_primed_mask |= slotbit;
+    return;
+  }
+
+  if ( (is_above != was_above) && (adc_event_count < ADC_EVENT_BUFFER_SIZE) )
+  {
+    idx = adc_event_head + adc_event_count;
+    if (ADC_EVENT_BUFFER_SIZE <= idx)
+      idx -= ADC_EVENT_BUFFER_SIZE;
+
+    adc_events[idx].timestamp = this_time;
+    adc_events[idx].channel = adc_channel_list[slot];
+    adc_events[idx].is_rising = is_above;
+    adc_event_count++;
+  }
+}
+
+
+
+// Moves the accumulators into the sample buffer.
+// This must be called with interrupts off.
+
+void StoreADCSet_ISR(uint32_t this_time)
+{
+  uint8_t idx, sidx;
+
+  if (adc_set_count < ADC_BUFFER_SETS)
+  {
+    idx = adc_set_head + adc_set_count;
+    if (ADC_BUFFER_SETS <= idx)
+      idx -= ADC_BUFFER_SETS;
+
+    adc_sets[idx].timestamp = this_time;
+    for (sidx = 0; sidx < adc_channel_count; sidx++)
+      adc_sets[idx].sums[sidx] = adc_sums[sidx];
+
+    adc_set_count++;
+  }
+  else
+    adc_sets_lost++;
+
+  adc_set_seq++;
+
+  for (sidx = 0; sidx < adc_channel_count; sidx++)
+    adc_sums[sidx] = 0;
+  adc_decim_count = 0;
+}
+
+
+
+// Conversion-complete interrupt.
+// Conversions are chained from here rather than auto-triggered, so that the
+// channel a result belongs to is always known; in free-running mode the
+// multiplexer setting lags by one conversion and depends on ISR latency.
+
+ISR(ADC_vect)
+{
+  uint16_t value;
+  uint8_t slot, next;
+  uint32_t thistime;
+
+  value = ADC;
+  slot = adc_slot;
+
+  // Start the next conversion first, to keep the sample rate steady.
+  next = slot + 1;
+  if (adc_channel_count <= next)
+    next = 0;
+  ADMUX = ADC_ADMUX_REF | adc_channel_list[next];
+  ADCSRA = ADC_ADCSRA_RUN | (1 << ADSC);
+  adc_slot = next;
+
+  thistime = Timer_Query_ISR();
+
+  NoteADCThreshold_ISR(slot, value, thistime);
+
+  adc_sums[slot] += value;
+
+  // A set is complete when the last channel in the list has been sampled.
+  if (0 == next)
+  {
+    adc_decim_count++;
+    if (adc_decim_count >= adc_decimation)
+      StoreADCSet_ISR(thistime);
+  }
+}
+
+
+
+// Prints a 10-bit value as three hex digits.
+
+void PrintADCValue(uint16_t value)
+{
+  int shift;
+  uint8_t nybble;
+
+  for (shift = 8; shift >= 0; shift -= 4)
+  {
+    nybble = (value >> shift) & 0x0f;
+    Link_PrintChar( (nybble < 10) ? ('0' + nybble) : ('a' + nybble - 10) );
+  }
+}
+
+
+
+// Prints acquisition state.
+
+void PrintADCState(void)
+{
+  uint8_t count;
+  uint32_t lost;
+  uint8_t cidx;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    count = adc_set_count;
+    lost = adc_sets_lost;
+  }
+
+  Link_QueueSend_P(PSTR("AD: channels="));
+  Link_PrintHex8(adc_channel_mask);
+  Link_QueueSend_P(PSTR(" decim="));
+  Link_PrintUInt(adc_decimation);
+  Link_QueueSend_P(PSTR(" rate="));
+  if (0 < adc_channel_count)
+    Link_PrintUInt(ADC_CONVERSIONS_PER_SECOND
+      / ((uint32_t) adc_channel_count * adc_decimation));
+  else
+    Link_PrintUInt(0);
+  Link_QueueSend_P(PSTR(" stream="));
+  Link_PrintUInt(adc_streaming ? 1 : 0);
+  Link_QueueSend_P(PSTR(" sets="));
+  Link_PrintUInt(count);
+  Link_QueueSend_P(PSTR(" lost="));
+  Link_PrintUInt(lost);
+  Link_QueueSend_P(PSTR(" thresh="));
+  for (cidx = 0; cidx < ADC_CHANNEL_COUNT; cidx++)
+  {
+    if (0 < cidx)
+      Link_PrintChar(',');
+    Link_PrintUInt(adc_thresholds[cidx]);
+  }
+  Link_QueueSend_P(PSTR("\r\n"));
+}
+
+
+
+// Polling entry point for sending samples and events to the host.
+// Sample blocks are "AD: (seq) (first tick) (last tick)" followed by one
+// token per set, holding three hex digits per enabled channel in channel
+// order. Sets within a block are evenly spaced.
+
+void PollADCReporting(void)
+{
+  adc_event_t event;
+  adc_set_t set;
+  bool have_event;
+  uint32_t seq, lost, first_time, last_time;
+  uint8_t count, chancount, sidx, bidx;
+  uint16_t decim;
+
+  // Threshold events.
+  do
+  {
+    have_event = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      if (0 < adc_event_count)
+      {
+        have_event = true;
+        event = adc_events[adc_event_head];
+        adc_event_head++;
+        if (ADC_EVENT_BUFFER_SIZE <= adc_event_head)
+          adc_event_head = 0;
+        adc_event_count--;
+      }
+    }
+
+    if (have_event)
+    {
+      Link_QueueSend_P(PSTR("AT: "));
+      Link_PrintUInt(event.channel);
+      if (event.is_rising)
+        Link_QueueSend_P(PSTR(" up "));
+      else
+        Link_QueueSend_P(PSTR(" down "));
+      Link_PrintUInt64(ExtendLocalTime(event.timestamp));
+      Link_QueueSend_P(PSTR("\r\n"));
+    }
+  }
+  while (have_event);
+
+  if (!adc_streaming)
+  {
+    // Keep discarding, so that re-enabling starts with fresh data.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      adc_set_head = 0;
+      adc_set_count = 0;
+      adc_lost_reported = adc_sets_lost;
+    }
+    return;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    count = adc_set_count;
+    seq = adc_set_seq - count;
+    lost = adc_sets_lost;
+    chancount = adc_channel_count;
+    decim = adc_decimation;
+  }
+
+  if (lost != adc_lost_reported)
+  {
+    Link_QueueSend_P(PSTR("AD: lost "));
+    Link_PrintUInt(lost - adc_lost_reported);
+    Link_QueueSend_P(PSTR("\r\n"));
+    adc_lost_reported = lost;
+  }
+
+  // Send one block per call, so other reporting isn't starved.
+  if (ADC_BLOCK_SETS > count)
+    return;
+
+  // Sets are only ever removed here, so the block can be peeked first.
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    first_time = adc_sets[adc_set_head].timestamp;
+    bidx = adc_set_head + ADC_BLOCK_SETS - 1;
+    if (ADC_BUFFER_SETS <= bidx)
+      bidx -= ADC_BUFFER_SETS;
+    last_time = adc_sets[bidx].timestamp;
+  }
+
+  Link_QueueSend_P(PSTR("AD: "));
+  Link_PrintUInt(seq);
+  Link_PrintChar(' ');
+  Link_PrintUInt64(ExtendLocalTime(first_time));
+  Link_PrintChar(' ');
+  Link_PrintUInt64(ExtendLocalTime(last_time));
+
+  for (bidx = 0; bidx < ADC_BLOCK_SETS; bidx++)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      set = adc_sets[adc_set_head];
+      adc_set_head++;
+      if (ADC_BUFFER_SETS <= adc_set_head)
+        adc_set_head = 0;
+      adc_set_count--;
+    }
+
+    Link_PrintChar(' ');
+    for (sidx = 0; sidx < chancount; sidx++)
+      PrintADCValue(set.sums[sidx] / decim);
+  }
+
+  Link_QueueSend_P(PSTR("\r\n"));
+}
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,39 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Analog acquisition on the port C pins.
+
+
+//
+// Functions
+
+// Stops acquisition and reconfigures the ADC for the selected channels.
+// Bit n of the mask selects ADC channel n (pin PCn). A mask of 0 leaves
+// the ADC off. Returns false if the mask selects nonexistent channels.
+bool SetADCChannels(uint32_t channel_mask);
+
+// Sets the number of conversions averaged per channel for each reported
+// sample. Returns false if the factor is out of range.
+bool SetADCDecimation(uint32_t factor);
+
+// Picks a decimation factor that gives approximately the requested
+// output rate (samples per second per channel).
+// Returns false if the rate can't be reached.
+bool SetADCOutputRate(uint32_t rate);
+
+// Sets a channel's threshold crossing level.
+// The argument is (channel) * 1024 + (level); a level of 0 disables
+// threshold events for that channel.
+// Returns false if the channel doesn't exist.
+bool SetADCThreshold(uint32_t packed_threshold);
+
+// Enables or disables streaming of decimated sample blocks.
+void SetADCStreaming(bool is_streaming);
+
+// Prints acquisition state.
+void PrintADCState(void);
+
+// Polling entry point for sending samples and events to the host.
+void PollADCReporting(void);
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,177 @@
+// Attention Circuits Control Laboratory - GPIO device
+// High-resolution capture timer (Timer1).
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if CAPTURE_ENABLE
+
+//
+// Private variables
+
+// Upper 16 bits of the capture timer.
+volatile uint16_t capture_overflows = 0;
+
+
+
+//
+// Private prototypes
+
+// Extends a 16-bit timer value to 32 bits.
+// This must be called with interrupts off.
+uint32_t ExtendCaptureTime_ISR(uint16_t count);
+
+
+
+//
+// Functions
+
+
+// Starts Timer1 counting CPU cycles, with input capture turned off.
+
+void InitCaptureTimer(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    // Normal mode, no prescaling, no output compare pins.
+    TCCR1A = 0;
+    TCCR1B = (1 << CS10);
+    TCNT1 = 0;
+    capture_overflows = 0;
+
+    // Clear stale flags, then enable only the overflow interrupt.
+    TIFR1 = (1 << ICF1) | (1 << TOV1);
+    TIMSK1 = (1 << TOIE1);
+  }
+
+#if CAPTURE_INPUT_ENABLE
+  SetCaptureSource(CAPTURE_OFF);
+#else
+  // Nothing captures, so the comparator can stay powered down.
+  ACSR = (1 << ACD);
+#endif
+}
+
+
+
+// Extends a 16-bit timer value to 32 bits.
+// This must be called with interrupts off.
+
+uint32_t ExtendCaptureTime_ISR(uint16_t count)
+{
+  uint16_t high;
+
+  high = capture_overflows;
+
+  // If the timer has overflowed but the overflow interrupt hasn't run yet,
+  // a small count belongs to the next period.
+  if ( (TIFR1 & (1 << TOV1)) && (count < 0x8000) )
+    high++;
+
+  return (((uint32_t) high) << 16) | count;
+}
+
+
+
+// Reads the capture timer. This counts CPU cycles, and wraps every
+// 2^32 cycles (about 268 seconds at 16 MHz).
+// This must be called with interrupts off.
+
+uint32_t GetCaptureTime_ISR(void)
+{
+  return ExtendCaptureTime_ISR(TCNT1);
+}
+
+
+
+#if CAPTURE_INPUT_ENABLE
+// Selects the input capture source: the ICP1 pin (D8), the analog
+// comparator (AIN0 = D6 against AIN1 = D7), or nothing.
+
+void SetCaptureSource(capture_source_t source)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    TIMSK1 &= ~(1 << ICIE1);
+
+    // The comparator's negative input is AIN1, not the ADC multiplexer.
+    // NOTE - The comparator has to be powered before ACIC is set.
+    if (CAPTURE_COMPARATOR == source)
+    {
+      ADCSRB &= ~(1 << ACME);
+      ACSR = 0;
+      ACSR = (1 << ACIC);
+    }
+    else
+      ACSR = (1 << ACD);
+
+    if (CAPTURE_OFF != source)
+    {
+      TIFR1 = (1 << ICF1);
+      TIMSK1 |= (1 << ICIE1);
+    }
+  }
+}
+
+
+
+// Selects the edge that triggers the next capture.
+// After each capture, the edge is flipped, to catch the opposite edge.
+// This must be called with interrupts off.
+
+void SetCaptureEdge_ISR(bool is_rising)
+{
+  if (is_rising)
+    TCCR1B |= (1 << ICES1);
+  else
+    TCCR1B &= ~(1 << ICES1);
+
+  // Changing the edge can set the capture flag.
+  TIFR1 = (1 << ICF1);
+}
+#endif
+
+
+
+// Timer overflow interrupt.
+
+ISR(TIMER1_OVF_vect)
+{
+  capture_overflows++;
+}
+
+
+
+#if CAPTURE_INPUT_ENABLE
+// Input capture interrupt.
+
+ISR(TIMER1_CAPT_vect)
+{
+  uint32_t thistime;
+  bool is_rising;
+
+  // The capture interrupt has priority over the overflow interrupt, so
+  // the overflow check in ExtendCaptureTime_ISR() matters here.
+  thistime = ExtendCaptureTime_ISR(ICR1);
+  is_rising = (0 != (TCCR1B & (1 << ICES1)));
+
+  SetCaptureEdge_ISR(!is_rising);
+
+#if SELFTEST_ENABLE
+  NoteSelfTestCapture_ISR(thistime, is_rising);
+#endif
+#if SYNC_ENABLE
+  NoteSyncCapture_ISR(thistime, is_rising);
+#endif
+}
+#endif
+
+
+#endif
+
+//
+// This is the end of the file.
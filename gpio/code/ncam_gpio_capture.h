@@ -0,0 +1,40 @@
+// Attention Circuits Control Laboratory - GPIO device
+// High-resolution capture timer (Timer1).
+
+
+//
+// Enums
+
+enum capture_source_t
+{
+  CAPTURE_OFF,
+  CAPTURE_PIN,
+  CAPTURE_COMPARATOR
+};
+
+
+//
+// Functions
+
+// Starts Timer1 counting CPU cycles, with input capture turned off.
+void InitCaptureTimer(void);
+
+// Reads the capture timer. This counts CPU cycles, and wraps every
+// 2^32 cycles (about 268 seconds at 16 MHz).
+// This must be called with interrupts off.
+uint32_t GetCaptureTime_ISR(void);
+
+#if CAPTURE_INPUT_ENABLE
+// Selects the input capture source: the ICP1 pin (D8), the analog
+// comparator (AIN0 = D6 against AIN1 = D7), or nothing.
+void SetCaptureSource(capture_source_t source);
+
+// Selects the edge that triggers the next capture.
+// After each capture, the edge is flipped, to catch the opposite edge.
+// This must be called with interrupts off.
+void SetCaptureEdge_ISR(bool is_rising);
+#endif
+
+
+//
+// This is the end of the file.
@@ -3,14 +3,85 @@
 // Written by Christopher Thomas.
 
 //
-// Diagnostics constants
+// Device variants
 
-#define VERSION_STR "20161030"
+// One source tree builds several devices. The Makefile's "variants" target
+// builds all of them, defining one of these; building without one gives
+// the production strobe box.
+//   VARIANT_STROBE  - Production strobe box. Strobe, line reporting, and
+//                     the debug commands only, so the timer interrupt does
+//                     as little as possible.
+//   VARIANT_LAB     - Strobe box with the diagnostic and timing features
+//                     that fit in the ATmega328P's RAM alongside each
+//                     other. Frame clocks and encoders are on the fob,
+//                     playback is on the trigger box, and the debug
+//                     commands are left out for space.
+//   VARIANT_FOB     - TTL fob. Line reporting, statistics, camera frame
+//                     clocks, encoders, and the frequency counter; the
+//                     strobe is off until asked for.
+//   VARIANT_TRIGGER - Trigger box. Waveform playback, with multi-box sync
+//                     and reference locking.
+// Variants with more than one timing duty run them as tasklets, so that
+// each can be switched on and off, and its cost measured.
+
+// Feature bits.
+#define FEATURE_STATS     0x0001
+#define FEATURE_WAVE      0x0002
+#define FEATURE_ADC       0x0004
+#define FEATURE_SELFTEST  0x0008
+#define FEATURE_SYNC      0x0010
+#define FEATURE_PLL       0x0020
+#define FEATURE_DEBUG     0x0040
+#define FEATURE_TASKLET   0x0080
+#define FEATURE_FRAME     0x0100
+#define FEATURE_QUAD      0x0200
+#define FEATURE_FREQ      0x0400
+
+#if !defined(VARIANT_LAB) && !defined(VARIANT_FOB) \
+  && !defined(VARIANT_TRIGGER) && !defined(VARIANT_STROBE)
+#define VARIANT_STROBE
+#endif
+
+#if defined(VARIANT_STROBE)
 
-#define DEVICETYPE "GPIOv1"
 #define DEVICESUBTYPE "neurocam"
+#define TASKNAME "light strobe"
+#define TASK_AUTOSTART true
+#define VARIANT_FEATURES FEATURE_DEBUG
+
+#elif defined(VARIANT_LAB)
 
+#define DEVICESUBTYPE "neurocam"
 #define TASKNAME "light strobe"
+#define TASK_AUTOSTART true
+#define VARIANT_FEATURES (FEATURE_STATS | FEATURE_ADC | FEATURE_SELFTEST \
+  | FEATURE_SYNC | FEATURE_PLL | FEATURE_TASKLET)
+
+#elif defined(VARIANT_FOB)
+
+#define DEVICESUBTYPE "fob"
+#define TASKNAME "TTL fob"
+#define TASK_AUTOSTART false
+#define VARIANT_FEATURES (FEATURE_STATS | FEATURE_FRAME | FEATURE_QUAD \
+  | FEATURE_FREQ | FEATURE_DEBUG)
+
+#elif defined(VARIANT_TRIGGER)
+
+#define DEVICESUBTYPE "trigger"
+#define TASKNAME "trigger box"
+#define TASK_AUTOSTART false
+#define VARIANT_FEATURES (FEATURE_WAVE | FEATURE_SYNC | FEATURE_PLL \
+  | FEATURE_TASKLET)
+
+#endif
+
+
+//
+// Diagnostics constants
+
+#define VERSION_STR "20161030"
+
+#define DEVICETYPE "GPIOv1"
 
 
 //
@@ -21,8 +92,8 @@
 #define FOB_DEFAULT_STROBE_PERIOD 5000
 #define FOB_DEFAULT_STROBE_HOLD 20
 
-// Indicates whether the strobe should be active on startup (bool).
-#define TASK_AUTOSTART true
+// Whether the strobe is active on startup (TASK_AUTOSTART) depends on the
+// variant.
 
 
 //
@@ -36,23 +107,274 @@
 //define FOB_DIN_DEBOUNCE_TICKS 10
 
 
+//
+// Line statistics constants
+
+// Enable per-line edge statistics (set by the variant).
+#define STATS_ENABLE (0 != (VARIANT_FEATURES & FEATURE_STATS))
+
+// Number of bins in each line's edge interval histogram.
+// Bin N counts intervals of 2^N to 2^(N+1)-1 ticks. The last bin also
+// counts anything longer than that.
+#define STATS_HIST_BINS 16
+
+
+//
+// Camera frame clock constants
+
+// Enable counting camera exposure outputs as frame clocks (set by the
+// variant). Frame clock inputs are reported as batches of (line, frame
+// number, tick) records instead of as line changes.
+#define FRAME_ENABLE (0 != (VARIANT_FEATURES & FEATURE_FRAME))
+
+// Number of frame records buffered for the host. Each takes 9 bytes of RAM.
+#define FRAME_BUFFER_RECORDS 16
+
+// Most records sent per report line, and the number sent by default.
+#define FRAME_BATCH_MAX 8
+#define FRAME_DEFAULT_BATCH 4
+
+// A partial batch is sent once its oldest record is this many ticks old.
+#define FRAME_FLUSH_TICKS 100
+
+
+//
+// Quadrature encoder constants
+
+// Enable decoding rotary encoders on pairs of inputs (set by the variant).
+// Encoder inputs are reported as positions and velocities instead of as
+// line changes.
+#define QUAD_ENABLE (0 != (VARIANT_FEATURES & FEATURE_QUAD))
+
+// Number of decoders. Decoder n uses input bits 2n (A) and 2n+1 (B).
+#define QUAD_DECODER_COUNT 4
+
+// Shortest period for automatic position reports, in ticks.
+#define QUAD_MIN_REPORT_TICKS 5
+
+
+//
+// Frequency counter constants
+
+// Enable the hardware frequency and period counter (set by the variant).
+// This takes Timer1 over, so it can't be combined with features that need
+// the capture timer. Frequency mode counts edges on T1 (D5, input bit 0)
+// in hardware, up to a few MHz. Period mode times edges on ICP1 (D8,
+// input bit 3) to the CPU cycle, up to FREQ_MAX_PERIOD_HZ.
+// The ATmega32U4 has these on other pins, so it goes without.
+#if defined(__AVR_ATmega32U4__)
+#define FREQ_ENABLE 0
+#else
+#define FREQ_ENABLE (0 != (VARIANT_FEATURES & FEATURE_FREQ))
+#endif
+
+// Gate time limits and default, in ticks. Period mode counts CPU cycles
+// in 32 bits, which wraps after about 268 seconds.
+#define FREQ_MIN_GATE_TICKS 10
+#define FREQ_MAX_GATE_TICKS 60000
+#define FREQ_DEFAULT_GATE_TICKS 1000
+
+// Fastest input period mode will time, in edges per second. Each edge
+// costs a capture interrupt, so a faster input would starve the timer and
+// pin-change interrupts. A gate that sees more edges than this allows
+// stops capturing and is reported as over range.
+#define FREQ_MAX_PERIOD_HZ 20000ul
+
+
+//
+// Waveform playback constants
+
+// Enable playback of uploaded output sequences (set by the variant).
+#define WAVE_ENABLE (0 != (VARIANT_FEATURES & FEATURE_WAVE))
+
+// Number of (delay, output value) entries the playback buffer holds.
+// Each entry takes 3 bytes of RAM (and of EEPROM, when saved).
+#define WAVE_BUFFER_SIZE 64
+
+
+//
+// Analog acquisition constants
+
+// Enable analog acquisition on the port C (ADC0..ADC5) pins (set by the
+// variant).
+// The ATmega32U4's analog inputs are on port F, so it goes without.
+#if defined(__AVR_ATmega32U4__)
+#define ADC_ENABLE 0
+#else
+#define ADC_ENABLE (0 != (VARIANT_FEATURES & FEATURE_ADC))
+#endif
+
+// Nominal total conversion rate (all channels), with a 128x ADC clock
+// prescaler and conversions chained from the ADC interrupt.
+// This is only used to turn a requested output rate into a decimation
+// factor; reported timestamps are what the host should trust.
+#define ADC_CONVERSIONS_PER_SECOND 8900ul
+
+// Number of decimated sample sets buffered for the host.
+#define ADC_BUFFER_SETS 8
+
+// Number of sample sets sent per data block.
+#define ADC_BLOCK_SETS 4
+
+// Number of threshold crossing events buffered for the host.
+#define ADC_EVENT_BUFFER_SIZE 8
+
+// Hysteresis for threshold crossings, in ADC counts.
+#define ADC_THRESHOLD_HYSTERESIS 8
+
+
+//
+// Capture timer constants
+
+// Enable the strobe self-test (set by the variant).
+// This loops the strobe output back to ICP1 (D8), or senses the light with
+// a photodiode on the analog comparator (AIN0 = D6, reference on D7).
+// The ATmega32U4 has ICP1 on D4 and AIN0 on D7, which aren't wired for
+// this, so it goes without.
+#if defined(__AVR_ATmega32U4__)
+#define SELFTEST_ENABLE 0
+#else
+#define SELFTEST_ENABLE (0 != (VARIANT_FEATURES & FEATURE_SELFTEST))
+#endif
+
+// Most pulses a single self-test run may measure.
+#define SELFTEST_MAX_PULSES 10000
+
+// Timer1 runs at the CPU clock as a high-resolution capture timer.
+// It's needed by the self-test, multi-box sync, the reference PLL, and
+// tasklet cost measurement.
+#define CAPTURE_ENABLE (SELFTEST_ENABLE || SYNC_ENABLE || PLL_ENABLE \
+  || TASKLET_ENABLE)
+
+// Only the self-test and sync slaves use input capture itself. Without
+// them, the capture interrupt is left out.
+#define CAPTURE_INPUT_ENABLE (SELFTEST_ENABLE || SYNC_ENABLE)
+
+
+//
+// Multi-box sync constants
+
+// Enable master/slave timebase sharing between boxes (set by the
+// variant).
+// The ATmega32U4 has ICP1 on D4 and uses D2 for I2C, so it goes without.
+#if defined(__AVR_ATmega32U4__)
+#define SYNC_ENABLE 0
+#else
+#define SYNC_ENABLE (0 != (VARIANT_FEATURES & FEATURE_SYNC))
+#endif
+
+// Masters send a sync pulse every this many ticks. Pulse widths are up to
+// 3 ticks, so this has to be at least 10.
+#define SYNC_PERIOD_TICKS 100
+
+// Masters drive the sync line on this port D pin (D2).
+// Slaves listen on ICP1 (D8).
+#define SYNC_OUTPUT_MASK 0b00000100
+
+// Slaves count as locked while within this many CPU cycles of the master.
+#define SYNC_LOCK_CYCLES 80
+
+// Slaves step rather than slew if this many CPU cycles off (on acquisition
+// or after the master is reset).
+#define SYNC_STEP_CYCLES 16000
+
+
+//
+// External reference PLL constants
+
+// Enable locking the strobe to an external reference clock (set by the
+// variant).
+// Reference edges arrive via pin-change interrupts, so this is meant for
+// slow references (a 1 Hz TTL, or a frame or block clock), not for
+// kilohertz sample clocks.
+// On the ATmega32U4, only input bits 3..6 have pin-change interrupts;
+// edges on the others are only seen to the tick.
+#define PLL_ENABLE (0 != (VARIANT_FEATURES & FEATURE_PLL))
+
+// Default nominal reference period, in ticks.
+#define PLL_DEFAULT_REF_PERIOD 1000
+
+// Reference intervals more than this many parts per thousand away from
+// nominal are treated as glitches or missed edges.
+#define PLL_REF_TOLERANCE_PPT 50
+
+
+//
+// Tasklet constants
+
+// Run timing duties through the tasklet scheduler (set by the variant).
+// Without it, the timer interrupt and main loop call them directly.
+#define TASKLET_ENABLE (0 != (VARIANT_FEATURES & FEATURE_TASKLET))
+
+// Most tasklets that can be registered.
+#define TASKLET_MAX 6
+
+// Total worst-case cycles that enabled tasklets may take in one timer
+// interrupt. A tick is 16000 cycles; the rest is left for pin-change,
+// UART, and capture interrupts, and for the main loop.
+#define TASKLET_ISR_BUDGET 6000
+
+
 //
 // Host link constants
 
-// Host link baud rate.
+// Host link transport. The ATmega328P boards talk through the NeurAVR UART
+// and a USB serial bridge. ATmega32U4 boards (Micro, Leonardo) have native
+// USB, and show up as a CDC-ACM serial device, with no baud rate ceiling
+// and no bridge latency timer. Host-native builds use stdin/stdout.
+#define HOST_LINK_UART 0
+#define HOST_LINK_USB 1
+#define HOST_LINK_NATIVE 2
+
+#if defined(NCAM_NATIVE)
+#define HOST_LINK HOST_LINK_NATIVE
+#elif defined(__AVR_ATmega32U4__)
+#define HOST_LINK HOST_LINK_USB
+#else
+#define HOST_LINK HOST_LINK_UART
+#endif
+
+// USB vendor and product IDs. These are the shared V-USB CDC-ACM IDs,
+// which require a unique product string.
+#define HOST_USB_VID 0x16c0
+#define HOST_USB_PID 0x05e1
+
+// Reset into the boot loader when the host opens and closes the port at
+// 1200 baud, the same way the stock Micro and Leonardo firmware does.
+// (bool value)
+#define HOST_USB_BOOTLOADER_TOUCH 1
+
+// Longest line of input from the host, for USB and native links.
+#define HOST_LINE_CHARS 80
+
+// Host link baud rate (UART link only).
 // 115.2 can be done with high precision. 230.4 with coarser precision.
 // 250.0 can be done with high precision but isn't supported by some terminals.
 #define HOST_BAUD 115200
 //define HOST_BAUD 230400
 
+// After a "BAU" rate change, the host has this many ticks to send a valid
+// command at the new rate. If it doesn't, we go back to the old rate.
+#define HOST_BAUD_CONFIRM_TICKS 2000
+
 // Echo. (bool value)
 #define ECHO_DEFAULT true
 
 // Do we start reporting on power-up, or wait for it? (bool value)
 #define REPORT_DEFAULT true
 
-// Enable debugging commands.
-#define DEBUG_ENABLE 1
+// Enable debugging commands (set by the variant).
+#define DEBUG_ENABLE (0 != (VARIANT_FEATURES & FEATURE_DEBUG))
+
+
+//
+// EEPROM layout
+
+// Byte offset of the saved device configuration.
+#define EEPROM_SETTINGS_ADDR 0x000
+
+// Byte offset of the saved playback sequence.
+#define EEPROM_WAVE_ADDR 0x100
 
 
 //
@@ -17,6 +17,27 @@
 
 // FIXME - We have 18 uncontested pins available, and only use 9.
 
+#if defined(__AVR_ATmega32U4__)
+
+// The Micro and Leonardo use the same digital line numbers as the Uno and
+// Nano, but the lines are on different pins.
+// NOTE - Don't touch B0 or D5 (RX and TX LEDs).
+
+// We have one output line on C7 (digital line 13).
+// Inputs are C6, D7, E6 (digital 5..7), B4..B7 (digital 8..11), and D6
+// (digital 12). Only port B has pin-change interrupts; the rest are polled.
+
+#define PORTB_INPUT_MASK  0b11110000
+#define PORTB_OUTPUT_MASK 0x00
+#define PORTC_INPUT_MASK  0b01000000
+#define PORTC_OUTPUT_MASK 0b10000000
+#define PORTD_INPUT_MASK  0b11000000
+#define PORTD_OUTPUT_MASK 0x00
+#define PORTE_INPUT_MASK  0b01000000
+#define PORTE_OUTPUT_MASK 0x00
+
+#else
+
 // NOTE - Don't touch B6/7 (crystal) or D0/1 (UART).
 // These should be protected by pin function logic, but be careful anyways.
 
@@ -30,6 +51,8 @@
 #define PORTD_INPUT_MASK  0b11100000
 #define PORTD_OUTPUT_MASK 0b00000000
 
+#endif
+
 
 
 //
@@ -38,6 +61,30 @@
 
 bool using_pullups = false;
 
+// Last-seen input state, for edge detection in the pin-change handler.
+volatile uint32_t prev_input_bits = 0;
+
+// Inputs left out of change detection.
+uint8_t unwatched_inputs = 0;
+
+// Event timestamps of the most recent input and output changes.
+// These are 64-bit, so that a line that's been quiet for weeks still
+// reports the right time.
+volatile uint64_t input_change_time = 0;
+volatile uint64_t output_change_time = 0;
+
+
+
+//
+// Private prototypes
+
+// Enables pin-change interrupts for the watched inputs.
+// This must be called with interrupts off.
+void UpdateWatchedPins_ISR(void);
+
+// Pin-change interrupt handler body (shared by all ports).
+void HandleInputChange_ISR(void);
+
 
 
 //
@@ -48,12 +95,25 @@ bool using_pullups = false;
 
 void ConfigPins(bool want_pullups)
 {
+#if SYNC_ENABLE
+  sync_status_t sync_status;
+#endif
+
   // Pins are initialized to high-Z inputs at mcu start.
 
   // Configure outputs.
   DDRB = PORTB_OUTPUT_MASK;
   DDRC = PORTC_OUTPUT_MASK;
   DDRD = PORTD_OUTPUT_MASK;
+#if defined(__AVR_ATmega32U4__)
+  DDRE = PORTE_OUTPUT_MASK;
+#endif
+#if SYNC_ENABLE
+  // The sync line isn't one of our I/O lines, but it's still an output.
+  QuerySyncStatus(sync_status);
+  if (SYNC_ROLE_MASTER == sync_status.role)
+    DDRD |= SYNC_OUTPUT_MASK;
+#endif
 
   // Configure pull-ups if we have those.
   if (want_pullups)
@@ -61,9 +121,61 @@ void ConfigPins(bool want_pullups)
     PORTB = PORTB_INPUT_MASK;
     PORTC = PORTC_INPUT_MASK;
     PORTD = PORTD_INPUT_MASK;
+#if defined(__AVR_ATmega32U4__)
+    PORTE = PORTE_INPUT_MASK;
+#endif
   }
 
   using_pullups = want_pullups;
+
+  // Watch the input pins for changes.
+  // NOTE - Port C (PCINT1) has no inputs yet.
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    prev_input_bits = GetDIOBits(DIO_REG_INPUT);
+
+    UpdateWatchedPins_ISR();
+#if defined(__AVR_ATmega32U4__)
+    // The 32U4 only has pin-change interrupts on port B. Other inputs are
+    // polled from the timer interrupt instead.
+    PCIFR = _BV(PCIE0);
+    PCICR = _BV(PCIE0);
+#else
+    PCIFR = _BV(PCIE0) | _BV(PCIE2);
+    PCICR = _BV(PCIE0) | _BV(PCIE2);
+#endif
+  }
+}
+
+
+
+// Enables pin-change interrupts for the watched inputs.
+// This must be called with interrupts off.
+
+void UpdateWatchedPins_ISR(void)
+{
+  // This is the inverse of the mapping in GetDIOBits().
+#if defined(__AVR_ATmega32U4__)
+  PCMSK0 = PORTB_INPUT_MASK & ~((unwatched_inputs & 0x78) << 1);
+#else
+  PCMSK0 = PORTB_INPUT_MASK & ~(unwatched_inputs >> 3);
+  PCMSK2 = PORTD_INPUT_MASK & ~(unwatched_inputs << 5);
+#endif
+}
+
+
+
+// Stops watching some inputs for changes, for lines that toggle too fast
+// to handle edge by edge. They can still be read. Bit n of the mask is
+// input bit n; a mask of 0 watches every input.
+
+void SetUnwatchedInputs(uint32_t input_mask)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    unwatched_inputs = input_mask;
+    UpdateWatchedPins_ISR();
+  }
 }
 
 
@@ -83,18 +195,46 @@ bool QueryPinPullups(void)
 uint32_t GetDIOBits(reg_id_t target)
 {
   uint32_t result;
+#if defined(__AVR_ATmega32U4__)
+  uint8_t portbval, portcval, portdval, porteval, scratch;
+#else
   uint8_t portbval, portdval, scratch;
+#endif
 
   result = 0x00;
 
   // Read the pin values.
   portbval = PINB;
   portdval = PIND;
+#if defined(__AVR_ATmega32U4__)
+  portcval = PINC;
+  porteval = PINE;
+#endif
 
   // Shift and mask to get the desired virtual register's contents.
 
   switch (target)
   {
+#if defined(__AVR_ATmega32U4__)
+    case DIO_REG_INPUT:
+      scratch = (portbval & PORTB_INPUT_MASK) >> 1;
+      if (portcval & _BV(6))
+        scratch |= 0x01;
+      if (portdval & _BV(7))
+        scratch |= 0x02;
+      if (porteval & _BV(6))
+        scratch |= 0x04;
+      if (portdval & _BV(6))
+        scratch |= 0x80;
+      result = scratch;
+      break;
+
+    case DIO_REG_OUTPUT:
+      portcval &= PORTC_OUTPUT_MASK;
+      scratch = (portcval >> 7);
+      result = scratch;
+      break;
+#else
     case DIO_REG_INPUT:
       portbval &= PORTB_INPUT_MASK;
       portdval &= PORTD_INPUT_MASK;
@@ -107,6 +247,7 @@ uint32_t GetDIOBits(reg_id_t target)
       scratch = (portbval >> 5);
       result = scratch;
       break;
+#endif
 
     case DIO_REG_USER:
       // No user-configurable bits.
@@ -127,23 +268,54 @@ uint32_t GetDIOBits(reg_id_t target)
 
 uint32_t SetDIOBits(reg_id_t target, uint32_t value)
 {
-  uint8_t portbval, scratch;
+  uint8_t portval;
+  uint32_t old_bits, new_bits;
 
   switch (target)
   {
     case DIO_REG_OUTPUT:
+      old_bits = GetDIOBits(DIO_REG_OUTPUT);
+
       // FIXME - Cheat. There's only one output pin.
-      portbval = 0x00;
+#if defined(__AVR_ATmega32U4__)
+      portval = 0x00;
       if (0 != value)
-        portbval = PORTB_OUTPUT_MASK;
+        portval = PORTC_OUTPUT_MASK;
 
       // Set the port values.
       // Remember that input pull-ups need to be set too.
 
       if (using_pullups)
-        portbval |= PORTB_INPUT_MASK;
+        portval |= PORTC_INPUT_MASK;
 
-      PORTB = portbval;
+      PORTC = portval;
+#else
+      portval = 0x00;
+      if (0 != value)
+        portval = PORTB_OUTPUT_MASK;
+
+      // Set the port values.
+      // Remember that input pull-ups need to be set too.
+
+      if (using_pullups)
+        portval |= PORTB_INPUT_MASK;
+
+      PORTB = portval;
+#endif
+
+      // Record any edge this produced.
+      new_bits = GetDIOBits(DIO_REG_OUTPUT);
+      if (new_bits != old_bits)
+      {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+          output_change_time = GetEventTime64_ISR();
+#if STATS_ENABLE
+          NoteLineEdges_ISR(DIO_REG_OUTPUT, old_bits ^ new_bits, new_bits,
+            Timer_Query_ISR());
+#endif
+        }
+      }
 
       break;
 
@@ -162,6 +334,109 @@ uint32_t SetDIOBits(reg_id_t target, uint32_t value)
 
 
 
+// Pin-change interrupt handler body (shared by all ports).
+
+void HandleInputChange_ISR(void)
+{
+  uint32_t new_bits, changed, hidden;
+  uint64_t event_time;
+#if STATS_ENABLE || WAVE_ENABLE
+  uint32_t this_time;
+#endif
+
+  new_bits = GetDIOBits(DIO_REG_INPUT);
+  // Unwatched lines may have toggled any number of times; ignore them.
+  changed = (new_bits ^ prev_input_bits) & ~((uint32_t) unwatched_inputs);
+
+  // Pins on the other port may have triggered this; nothing to do if so.
+  if (0 != changed)
+  {
+    prev_input_bits = new_bits;
+#if STATS_ENABLE || WAVE_ENABLE
+    this_time = Timer_Query_ISR();
+#endif
+
+    // Reported timestamps may be on a shared timebase; internal timing
+    // stays on the local clock.
+    event_time = GetEventTime64_ISR();
+
+    // Only changes that I/O reports show move their timestamp. Otherwise,
+    // a busy hidden line would restamp a report of some other line.
+    hidden = GetFrameLineMask() | GetQuadLineMask() | GetFreqLineMask();
+    if (0 != (changed & ~hidden))
+      input_change_time = event_time;
+
+#if STATS_ENABLE
+    NoteLineEdges_ISR(DIO_REG_INPUT, changed, new_bits, this_time);
+#endif
+#if WAVE_ENABLE
+    NoteWaveInputEdges_ISR(changed, new_bits, this_time);
+#endif
+#if PLL_ENABLE
+    NotePLLInputEdges_ISR(changed, new_bits);
+#endif
+#if FRAME_ENABLE
+    // Frames are mapped to time by the host, so use reported timestamps.
+    NoteFrameEdges_ISR(changed, new_bits, (uint32_t) event_time);
+#endif
+#if QUAD_ENABLE
+    NoteQuadEdges_ISR(changed, new_bits);
+#endif
+  }
+}
+
+
+
+// Pin-change interrupts for port B (PCINT0) and port D (PCINT2).
+
+ISR(PCINT0_vect)
+{
+  HandleInputChange_ISR();
+}
+
+#if defined(__AVR_ATmega32U4__)
+
+// Checks for input changes that don't raise a pin-change interrupt.
+// This must be called with interrupts off.
+
+void PollInputs_ISR(void)
+{
+  HandleInputChange_ISR();
+}
+
+#else
+
+ISR(PCINT2_vect)
+{
+  HandleInputChange_ISR();
+}
+
+#endif
+
+
+
+// Returns the event timestamp of the most recent change to a bank.
+// Banks that never change report the current time.
+
+uint64_t GetDIOChangeTime(reg_id_t target)
+{
+  uint64_t result;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (DIO_REG_INPUT == target)
+      result = input_change_time;
+    else if (DIO_REG_OUTPUT == target)
+      result = output_change_time;
+    else
+      result = GetEventTime64_ISR();
+  }
+
+  return result;
+}
+
+
+
 // Returns the number of digital I/O pins of a given class.
 
 int GetDIOCount(reg_id_t target)
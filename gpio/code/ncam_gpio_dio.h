@@ -31,9 +31,23 @@ uint32_t GetDIOBits(reg_id_t target);
 // Returns the resulting state.
 uint32_t SetDIOBits(reg_id_t target, uint32_t value);
 
+// Stops watching some inputs for changes, for lines that toggle too fast
+// to handle edge by edge. They can still be read. Bit n of the mask is
+// input bit n; a mask of 0 watches every input.
+void SetUnwatchedInputs(uint32_t input_mask);
+
+// Returns the event timestamp of the most recent change to a bank.
+uint64_t GetDIOChangeTime(reg_id_t target);
+
 // Returns the number of digital I/O pins of a given class.
 int GetDIOCount(reg_id_t target);
 
+#if defined(__AVR_ATmega32U4__)
+// Checks for input changes on pins without pin-change interrupts.
+// This must be called with interrupts off.
+void PollInputs_ISR(void);
+#endif
+
 // FIXME - User-configurable registers need a config function here.
 
 
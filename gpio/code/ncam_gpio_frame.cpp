@@ -0,0 +1,342 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Camera frame clock capture.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if FRAME_ENABLE
+
+//
+// Private macros
+
+// FIXME - Hardwired to match GetDIOCount().
+#define FRAME_LINE_COUNT 8
+
+
+
+//
+// Private types
+
+// One exposure. Frame numbers count from 0 on each line.
+struct frame_record_t
+{
+  uint32_t timestamp;
+  uint32_t frame;
+  uint8_t line;
+};
+
+
+
+//
+// Private variables
+
+// Configuration. These are only changed with interrupts off.
+uint8_t frame_line_mask = 0;
+uint8_t frame_falling_mask = 0;
+uint8_t frame_batch = FRAME_DEFAULT_BATCH;
+
+// Exposures seen on each line.
+uint32_t frame_counts[FRAME_LINE_COUNT];
+
+// Records waiting to be sent.
+frame_record_t frame_records[FRAME_BUFFER_RECORDS];
+volatile uint8_t frame_record_head = 0;
+volatile uint8_t frame_record_count = 0;
+volatile uint32_t frame_records_lost = 0;
+uint32_t frame_lost_reported = 0;
+
+
+
+//
+// Private prototypes
+
+// Clears frame counts and buffered records.
+// This must be called with interrupts off.
+void ResetFrameState_ISR(void);
+
+// Sends the oldest buffered record.
+void SendOneFrameRecord(void);
+
+
+
+//
+// Functions
+
+
+// Clears frame counts and buffered records.
+// This must be called with interrupts off.
+
+void ResetFrameState_ISR(void)
+{
+  uint8_t lidx;
+
+  for (lidx = 0; lidx < FRAME_LINE_COUNT; lidx++)
+    frame_counts[lidx] = 0;
+
+  frame_record_head = 0;
+  frame_record_count = 0;
+}
+
+#endif
+
+
+
+// Selects the inputs that carry camera exposure (frame clock) signals.
+// Bit n of the mask selects input bit n; a mask of 0 turns this off.
+// Frame counts and buffered records are cleared.
+// Returns false if the mask selects nonexistent inputs.
+
+bool SetFrameLines(uint32_t line_mask)
+{
+  bool result;
+
+  result = false;
+
+#if FRAME_ENABLE
+  if (0 == (line_mask >> GetDIOCount(DIO_REG_INPUT)))
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      ResetFrameState_ISR();
+      frame_line_mask = line_mask;
+    }
+
+    result = true;
+  }
+#endif
+
+  return result;
+}
+
+
+
+// Selects which frame clock inputs count falling edges (active-low
+// exposure outputs). The rest count rising edges.
+// Returns false if the mask selects nonexistent inputs.
+
+bool SetFramePolarity(uint32_t falling_mask)
+{
+  bool result;
+
+  result = false;
+
+#if FRAME_ENABLE
+  if (0 == (falling_mask >> GetDIOCount(DIO_REG_INPUT)))
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      frame_falling_mask = falling_mask;
+    }
+
+    result = true;
+  }
+#endif
+
+  return result;
+}
+
+
+
+// Sets the number of frame records sent per report line.
+// Returns false if the count is out of range.
+
+bool SetFrameBatch(uint32_t count)
+{
+  bool result;
+
+  result = false;
+
+#if FRAME_ENABLE
+  if ( (0 < count) && (FRAME_BATCH_MAX >= count) )
+  {
+    frame_batch = count;
+    result = true;
+  }
+#endif
+
+  return result;
+}
+
+
+
+// Returns the mask of inputs being used as frame clocks.
+
+uint32_t GetFrameLineMask(void)
+{
+#if FRAME_ENABLE
+  return frame_line_mask;
+#else
+  return 0;
+#endif
+}
+
+
+
+// Records edges on frame clock inputs.
+// "changed" has a bit set for each input that toggled; "new_bits" is the
+// input bank's state after the change. This must be called with
+// interrupts off.
+
+void NoteFrameEdges_ISR(uint32_t changed, uint32_t new_bits,
+  uint32_t event_time)
+{
+#if FRAME_ENABLE
+  uint8_t starts, lidx, ridx;
+
+  // Only the edge that starts an exposure counts.
+  starts = changed & (new_bits ^ frame_falling_mask) & frame_line_mask;
+
+  for (lidx = 0; 0 != starts; lidx++)
+  {
+    if (starts & 0x01)
+    {
+      // Frames are counted even if their records are lost, so that the
+      // host can tell which ones are missing.
+      if (FRAME_BUFFER_RECORDS > frame_record_count)
+      {
+        ridx = frame_record_head + frame_record_count;
+        if (FRAME_BUFFER_RECORDS <= ridx)
+          ridx -= FRAME_BUFFER_RECORDS;
+
+        frame_records[ridx].timestamp = event_time;
+        frame_records[ridx].frame = frame_counts[lidx];
+        frame_records[ridx].line = lidx;
+        frame_record_count++;
+      }
+      else
+        frame_records_lost++;
+
+      frame_counts[lidx]++;
+    }
+
+    starts >>= 1;
+  }
+#endif
+}
+
+
+
+// Prints frame clock state.
+
+void PrintFrameState(void)
+{
+#if FRAME_ENABLE
+  uint32_t counts[FRAME_LINE_COUNT];
+  uint32_t lost;
+  uint8_t pending, lidx;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (lidx = 0; lidx < FRAME_LINE_COUNT; lidx++)
+      counts[lidx] = frame_counts[lidx];
+    pending = frame_record_count;
+    lost = frame_records_lost;
+  }
+
+  Link_QueueSend_P(PSTR("FC: lines="));
+  Link_PrintHex8(frame_line_mask);
+  Link_QueueSend_P(PSTR(" falling="));
+  Link_PrintHex8(frame_falling_mask);
+  Link_QueueSend_P(PSTR(" batch="));
+  Link_PrintUInt(frame_batch);
+  Link_QueueSend_P(PSTR(" pending="));
+  Link_PrintUInt(pending);
+  Link_QueueSend_P(PSTR(" lost="));
+  Link_PrintUInt(lost);
+  Link_QueueSend_P(PSTR(" frames="));
+  for (lidx = 0; lidx < FRAME_LINE_COUNT; lidx++)
+  {
+    if (0 < lidx)
+      Link_PrintChar(',');
+    Link_PrintUInt(counts[lidx]);
+  }
+  Link_QueueSend_P(PSTR("\r\n"));
+#else
+  Link_QueueSend_P(PSTR("Frame clock capture is disabled.\r\n"));
+#endif
+}
+
+
+
+#if FRAME_ENABLE
+
+// Sends the oldest buffered record.
+
+void SendOneFrameRecord(void)
+{
+  frame_record_t record;
+
+  // Records are only ever removed here.
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    record = frame_records[frame_record_head];
+    frame_record_head++;
+    if (FRAME_BUFFER_RECORDS <= frame_record_head)
+      frame_record_head = 0;
+    frame_record_count--;
+  }
+
+  Link_PrintChar(' ');
+  Link_PrintUInt(record.line);
+  Link_PrintChar(':');
+  Link_PrintUInt(record.frame);
+  Link_PrintChar(':');
+  Link_PrintUInt64(ExtendEventTime(record.timestamp));
+}
+
+#endif
+
+
+
+// Polling entry point for sending frame records to the host.
+// Records are sent as "FC: (line):(frame):(tick) ...", up to the batch
+// size per line. A partial batch is sent once its oldest record is
+// FRAME_FLUSH_TICKS old, so the last frames of a run aren't held back.
+// Timestamps are event timestamps, so they follow a sync master.
+
+void PollFrameReporting(void)
+{
+#if FRAME_ENABLE
+  uint32_t lost;
+  uint8_t count, sidx;
+  bool flush_due;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    count = frame_record_count;
+    lost = frame_records_lost;
+    flush_due = (0 < count) && IsTimeReached(GetEventTime_ISR(),
+      frame_records[frame_record_head].timestamp + FRAME_FLUSH_TICKS);
+  }
+
+  if (lost != frame_lost_reported)
+  {
+    Link_QueueSend_P(PSTR("FC: lost "));
+    Link_PrintUInt(lost - frame_lost_reported);
+    Link_QueueSend_P(PSTR("\r\n"));
+    frame_lost_reported = lost;
+  }
+
+  // A slave stepping its clock back just delays the flush.
+  if ( (0 == count) || ( (frame_batch > count) && (!flush_due) ) )
+    return;
+
+  // Send one line per call, so other reporting isn't starved.
+  if (frame_batch < count)
+    count = frame_batch;
+
+  Link_QueueSend_P(PSTR("FC:"));
+  for (sidx = 0; sidx < count; sidx++)
+    SendOneFrameRecord();
+  Link_QueueSend_P(PSTR("\r\n"));
+#endif
+}
+
+
+
+//
+// This is the end of the file.
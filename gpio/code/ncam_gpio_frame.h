@@ -0,0 +1,41 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Camera frame clock capture.
+
+
+//
+// Functions
+
+// Selects the inputs that carry camera exposure (frame clock) signals.
+// Bit n of the mask selects input bit n; a mask of 0 turns this off.
+// Frame counts and buffered records are cleared.
+// Returns false if the mask selects nonexistent inputs.
+bool SetFrameLines(uint32_t line_mask);
+
+// Selects which frame clock inputs count falling edges (active-low
+// exposure outputs). The rest count rising edges.
+// Returns false if the mask selects nonexistent inputs.
+bool SetFramePolarity(uint32_t falling_mask);
+
+// Sets the number of frame records sent per report line.
+// Returns false if the count is out of range.
+bool SetFrameBatch(uint32_t count);
+
+// Returns the mask of inputs being used as frame clocks.
+uint32_t GetFrameLineMask(void);
+
+// Records edges on frame clock inputs.
+// "changed" has a bit set for each input that toggled; "new_bits" is the
+// input bank's state after the change. This must be called with
+// interrupts off.
+void NoteFrameEdges_ISR(uint32_t changed, uint32_t new_bits,
+  uint32_t event_time);
+
+// Prints frame clock state.
+void PrintFrameState(void);
+
+// Polling entry point for sending frame records to the host.
+void PollFrameReporting(void);
+
+
+//
+// This is the end of the file.
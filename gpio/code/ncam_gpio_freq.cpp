@@ -0,0 +1,480 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Hardware frequency and period counter (Timer1).
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if FREQ_ENABLE
+
+#if CAPTURE_ENABLE
+#error "The frequency counter needs Timer1, which the capture timer uses."
+#endif
+
+//
+// Private macros
+
+// Measured inputs (see ncam_gpio_config.h).
+#define FREQ_COUNT_LINE_MASK 0x01
+#define FREQ_PERIOD_LINE_MASK 0x08
+
+
+
+//
+// Private types
+
+// One gate's measurement. In frequency mode, "count" is edges and "span"
+// is ticks; in period mode, "count" is whole periods and "span" is the
+// CPU cycles they took. An over-range gate has no measurement.
+struct freq_result_t
+{
+  uint32_t count;
+  uint32_t span;
+  uint32_t end_time;
+  bool is_over;
+};
+
+
+
+//
+// Private variables
+
+// Configuration. These are only changed with interrupts off.
+uint8_t freq_mode = FREQ_MODE_OFF;
+uint32_t freq_gate_ticks = FREQ_DEFAULT_GATE_TICKS;
+uint32_t freq_report_interval = 1;
+
+// Upper 16 bits of Timer1.
+volatile uint16_t freq_overflows = 0;
+
+// The gate in progress.
+uint32_t freq_gate_start = 0;
+uint32_t freq_gate_end = 0;
+uint32_t freq_gate_start_count = 0;
+
+// Captured edges in the gate in progress (period mode).
+volatile uint32_t freq_edges = 0;
+volatile uint32_t freq_first_edge = 0;
+volatile uint32_t freq_last_edge = 0;
+
+// Most edges a gate may capture before capturing stops (period mode), and
+// whether the gate in progress hit that.
+uint32_t freq_edge_limit =
+  (FREQ_MAX_PERIOD_HZ * FREQ_DEFAULT_GATE_TICKS) / RTC_TICKS_PER_SECOND;
+volatile bool freq_is_over = false;
+
+// The last gate's measurement, and the number of gates closed so far.
+freq_result_t freq_result;
+volatile uint32_t freq_result_count = 0;
+uint32_t freq_result_reported = 0;
+
+
+
+//
+// Private prototypes
+
+// Extends a 16-bit Timer1 value to 32 bits.
+// This must be called with interrupts off.
+uint32_t ExtendFreqCount_ISR(uint16_t count);
+
+// Starts a new gate, discarding the one in progress.
+// This must be called with interrupts off.
+void RestartFreqGate_ISR(void);
+
+// Turns edge capture back on after an over-range gate (period mode).
+// This must be called with interrupts off.
+void ResumeFreqCapture_ISR(void);
+
+
+
+//
+// Functions
+
+
+// Extends a 16-bit Timer1 value to 32 bits.
+// This must be called with interrupts off.
+
+uint32_t ExtendFreqCount_ISR(uint16_t count)
+{
+  uint16_t high;
+
+  high = freq_overflows;
+
+  // If the timer has overflowed but the overflow interrupt hasn't run yet,
+  // a small count belongs to the next period.
+  if ( (TIFR1 & (1 << TOV1)) && (count < 0x8000) )
+    high++;
+
+  return (((uint32_t) high) << 16) | count;
+}
+
+
+
+// Starts a new gate, discarding the one in progress.
+// This must be called with interrupts off.
+
+void RestartFreqGate_ISR(void)
+{
+  freq_gate_start = Timer_Query_ISR();
+  freq_gate_end = freq_gate_start + freq_gate_ticks;
+  freq_gate_start_count = ExtendFreqCount_ISR(TCNT1);
+  freq_edges = 0;
+
+  if (freq_is_over)
+    ResumeFreqCapture_ISR();
+}
+
+
+
+// Turns edge capture back on after an over-range gate (period mode).
+// This must be called with interrupts off.
+
+void ResumeFreqCapture_ISR(void)
+{
+  freq_is_over = false;
+
+  if (FREQ_MODE_PERIOD == freq_mode)
+  {
+    // A capture left over from before would give a bogus first edge.
+    TIFR1 = (1 << ICF1);
+    TIMSK1 |= (1 << ICIE1);
+  }
+}
+
+#endif
+
+
+
+// Selects the measurement mode (a freq_mode_t value): counting edges on
+// T1 (D5, input bit 0) over each gate, timing edges on ICP1 (D8, input
+// bit 3), or off. The measured input is left out of change reports.
+// Returns false if the mode isn't valid.
+
+bool SetFreqMode(uint32_t mode)
+{
+  bool result;
+
+  result = false;
+
+#if FREQ_ENABLE
+  if (FREQ_MODE_PERIOD >= mode)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      // Stop the timer before changing its clock source.
+      TIMSK1 = 0;
+      TCCR1B = 0;
+      TCCR1A = 0;
+      TCNT1 = 0;
+      TIFR1 = (1 << ICF1) | (1 << TOV1);
+      freq_overflows = 0;
+      freq_is_over = false;
+
+      if (FREQ_MODE_FREQUENCY == mode)
+      {
+        // Clocked by rising edges on T1. The pin is sampled at the CPU
+        // clock, so this counts up to about 2/5 of it.
+        TCCR1B = (1 << CS12) | (1 << CS11) | (1 << CS10);
+        TIMSK1 = (1 << TOIE1);
+      }
+      else if (FREQ_MODE_PERIOD == mode)
+      {
+        // Counting CPU cycles, capturing on rising edges.
+        TCCR1B = (1 << ICES1) | (1 << CS10);
+        TIMSK1 = (1 << TOIE1) | (1 << ICIE1);
+      }
+
+      freq_mode = mode;
+      freq_result.count = 0;
+      freq_result.span = 0;
+      freq_result.end_time = GetEventTime_ISR();
+      freq_result.is_over = false;
+      freq_result_count = 0;
+      freq_result_reported = 0;
+
+      RestartFreqGate_ISR();
+    }
+
+    // Per-edge pin-change interrupts would swamp the device at these
+    // rates.
+    SetUnwatchedInputs(GetFreqLineMask());
+
+    result = true;
+  }
+#endif
+
+  return result;
+}
+
+
+
+// Sets the gate time in ticks. The current gate is restarted.
+// Returns false if the gate time is out of range.
+// Period mode captures at most FREQ_MAX_PERIOD_HZ edges per second of gate.
+
+bool SetFreqGate(uint32_t gate_ticks)
+{
+  bool result;
+
+  result = false;
+
+#if FREQ_ENABLE
+  if ( (FREQ_MIN_GATE_TICKS <= gate_ticks)
+    && (FREQ_MAX_GATE_TICKS >= gate_ticks) )
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      freq_gate_ticks = gate_ticks;
+      freq_edge_limit =
+        (FREQ_MAX_PERIOD_HZ * gate_ticks) / RTC_TICKS_PER_SECOND;
+      RestartFreqGate_ISR();
+    }
+
+    result = true;
+  }
+#endif
+
+  return result;
+}
+
+
+
+// Sets how often measurements are sent: every n gates, or only when
+// asked for if n is 0.
+
+void SetFreqReportInterval(uint32_t gate_count)
+{
+#if FREQ_ENABLE
+  freq_report_interval = gate_count;
+#endif
+}
+
+
+
+// Returns the mask of inputs being measured.
+
+uint32_t GetFreqLineMask(void)
+{
+#if FREQ_ENABLE
+  if (FREQ_MODE_FREQUENCY == freq_mode)
+    return FREQ_COUNT_LINE_MASK;
+  if (FREQ_MODE_PERIOD == freq_mode)
+    return FREQ_PERIOD_LINE_MASK;
+#endif
+
+  return 0;
+}
+
+
+
+// Closes the gate if it's time, and starts the next one.
+// This is called from the timer interrupt, before anything else that
+// takes time.
+
+void UpdateFreqGate_ISR(void)
+{
+#if FREQ_ENABLE
+  uint32_t now, count;
+
+  if (FREQ_MODE_OFF == freq_mode)
+    return;
+
+  now = Timer_Query_ISR();
+  if (!IsTimeReached(now, freq_gate_end))
+    return;
+
+  if (FREQ_MODE_FREQUENCY == freq_mode)
+  {
+    // Gates open and close at the same point in the timer interrupt, so
+    // interrupt latency mostly cancels out.
+    count = ExtendFreqCount_ISR(TCNT1);
+    freq_result.count = count - freq_gate_start_count;
+    freq_result.span = now - freq_gate_start;
+    freq_gate_start_count = count;
+    freq_result.is_over = false;
+  }
+  else if (freq_is_over)
+  {
+    // Capturing stopped partway through, so there's nothing to report.
+    // The next gate starts from its own first edge.
+    freq_result.count = 0;
+    freq_result.span = 0;
+    freq_result.is_over = true;
+    freq_edges = 0;
+    ResumeFreqCapture_ISR();
+  }
+  else
+  {
+    freq_result.is_over = false;
+    freq_result.count = (1 < freq_edges) ? (freq_edges - 1) : 0;
+    freq_result.span = freq_last_edge - freq_first_edge;
+
+    // The last edge starts the next gate's first period, so no time is
+    // lost between gates. An edge with no period after it is dropped, so
+    // that a stopped input doesn't give a wrapped span later.
+    if (0 < freq_result.count)
+    {
+      freq_first_edge = freq_last_edge;
+      freq_edges = 1;
+    }
+    else
+      freq_edges = 0;
+  }
+
+  freq_result.end_time = GetEventTime_ISR();
+  freq_result_count++;
+
+  freq_gate_start = now;
+  freq_gate_end = now + freq_gate_ticks;
+#endif
+}
+
+
+
+// Sends the most recent measurement now.
+// Measurements are sent as "FQ: (tick) (mHz) (period ns) (count)", where
+// the tick is when the gate closed and the count is the number of edges
+// or periods measured. A gate with nothing in it reports 0 for both.
+// A gate that was over range in period mode reports 0 for both and ends
+// with " over".
+
+void SendFreqReport(void)
+{
+#if FREQ_ENABLE
+  freq_result_t result;
+  uint64_t millihertz, period_ns;
+  uint32_t unit_rate;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    result = freq_result;
+    freq_result_reported = freq_result_count;
+  }
+
+  // Spans are in ticks when counting and in CPU cycles when timing.
+  unit_rate = (FREQ_MODE_PERIOD == freq_mode)
+    ? CPU_SPEED : RTC_TICKS_PER_SECOND;
+
+  millihertz = 0;
+  period_ns = 0;
+  if ( (0 < result.count) && (0 < result.span) )
+  {
+    millihertz = (((uint64_t) result.count) * 1000ull * unit_rate)
+      / result.span;
+    period_ns = (((uint64_t) result.span) * 1000000000ull)
+      / (((uint64_t) unit_rate) * result.count);
+  }
+
+  Link_QueueSend_P(PSTR("FQ: "));
+  Link_PrintUInt64(ExtendEventTime(result.end_time));
+  Link_PrintChar(' ');
+  Link_PrintUInt64(millihertz);
+  Link_PrintChar(' ');
+  Link_PrintUInt64(period_ns);
+  Link_PrintChar(' ');
+  Link_PrintUInt(result.count);
+  if (result.is_over)
+    Link_QueueSend_P(PSTR(" over"));
+  Link_QueueSend_P(PSTR("\r\n"));
+#endif
+}
+
+
+
+// Prints counter state.
+
+void PrintFreqState(void)
+{
+#if FREQ_ENABLE
+  uint32_t gates;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    gates = freq_result_count;
+  }
+
+  Link_QueueSend_P(PSTR("FQ: mode="));
+  Link_PrintUInt(freq_mode);
+  Link_QueueSend_P(PSTR(" gate="));
+  Link_PrintUInt(freq_gate_ticks);
+  Link_QueueSend_P(PSTR(" interval="));
+  Link_PrintUInt(freq_report_interval);
+  Link_QueueSend_P(PSTR(" gates="));
+  Link_PrintUInt(gates);
+  Link_QueueSend_P(PSTR("\r\n"));
+#else
+  Link_QueueSend_P(PSTR("The frequency counter is disabled.\r\n"));
+#endif
+}
+
+
+
+// Polling entry point for sending measurements to the host.
+
+void PollFreqReporting(void)
+{
+#if FREQ_ENABLE
+  uint32_t gates;
+
+  if ( (FREQ_MODE_OFF == freq_mode) || (0 == freq_report_interval) )
+    return;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    gates = freq_result_count;
+  }
+
+  // Gates that close while we're busy are skipped, rather than sent late.
+  if ( (gates != freq_result_reported)
+    && (0 == (gates % freq_report_interval)) )
+    SendFreqReport();
+#endif
+}
+
+
+
+#if FREQ_ENABLE
+
+// Timer overflow interrupt.
+
+ISR(TIMER1_OVF_vect)
+{
+  freq_overflows++;
+}
+
+
+
+// Input capture interrupt (period mode).
+// Once a gate has as many edges as FREQ_MAX_PERIOD_HZ allows, this turns
+// itself off until the gate closes, so a fast input can't starve the
+// other interrupts.
+
+ISR(TIMER1_CAPT_vect)
+{
+  uint32_t thistime;
+
+  if (freq_edges >= freq_edge_limit)
+  {
+    TIMSK1 &= ~(1 << ICIE1);
+    freq_is_over = true;
+    return;
+  }
+
+  // The capture interrupt has priority over the overflow interrupt, so
+  // the overflow check in ExtendFreqCount_ISR() matters here.
+  thistime = ExtendFreqCount_ISR(ICR1);
+
+  if (0 == freq_edges)
+    freq_first_edge = thistime;
+  freq_last_edge = thistime;
+  freq_edges++;
+}
+
+#endif
+
+
+//
+// This is the end of the file.
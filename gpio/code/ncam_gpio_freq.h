@@ -0,0 +1,53 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Hardware frequency and period counter (Timer1).
+
+
+//
+// Enums
+
+enum freq_mode_t
+{
+  FREQ_MODE_OFF,
+  FREQ_MODE_FREQUENCY,
+  FREQ_MODE_PERIOD
+};
+
+
+//
+// Functions
+
+// Selects the measurement mode (a freq_mode_t value): counting edges on
+// T1 (D5, input bit 0) over each gate, timing edges on ICP1 (D8, input
+// bit 3), or off. The measured input is left out of change reports.
+// Returns false if the mode isn't valid.
+bool SetFreqMode(uint32_t mode);
+
+// Sets the gate time in ticks. The current gate is restarted.
+// Returns false if the gate time is out of range.
+// Period mode captures at most FREQ_MAX_PERIOD_HZ edges per second of gate.
+bool SetFreqGate(uint32_t gate_ticks);
+
+// Sets how often measurements are sent: every n gates, or only when
+// asked for if n is 0.
+void SetFreqReportInterval(uint32_t gate_count);
+
+// Returns the mask of inputs being measured.
+uint32_t GetFreqLineMask(void);
+
+// Closes the gate if it's time, and starts the next one.
+// This is called from the timer interrupt, before anything else that
+// takes time.
+void UpdateFreqGate_ISR(void);
+
+// Sends the most recent measurement now.
+void SendFreqReport(void);
+
+// Prints counter state.
+void PrintFreqState(void);
+
+// Polling entry point for sending measurements to the host.
+void PollFreqReporting(void);
+
+
+//
+// This is the end of the file.
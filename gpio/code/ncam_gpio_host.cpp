@@ -16,8 +16,15 @@
 // Maximum length of an actual command word (opcode).
 #define MAX_OPCODE_CHARS 3
 
-// Length of the output scratch string used with snprintf().
-#define SCRATCH_STRING_SIZE 20
+// Start-of-frame marker for binary records. This never appears in text.
+#define BINARY_FRAME_START 0x02
+
+// Record type and payload length for the binary state query.
+#define BINARY_TYPE_QUERY 'Q'
+#define BINARY_QUERY_LENGTH 48
+
+// Number of entries in the supported baud rate table.
+#define BAUD_TABLE_SIZE 9
 
 
 
@@ -53,6 +60,8 @@ bool echo_active;
 bool force_output;
 // Flag indicating that we do want to automatically report changes.
 bool report_changes;
+// Flag indicating that reports should carry event timestamps.
+bool report_timestamps;
 
 
 // Command buffer.
@@ -67,6 +76,25 @@ bool argvalid;
 uint32_t argument;
 
 
+// Baud rate state.
+
+// Rates that "BAU" accepts.
+// 250k, 500k, and 1M are exact at 16 MHz; 115.2k and 230.4k are not, but
+// are what most hosts expect.
+const uint32_t baud_table[BAUD_TABLE_SIZE] PROGMEM =
+{
+  9600, 19200, 38400, 57600, 115200, 230400, 250000, 500000, 1000000
+};
+
+uint32_t current_baud;
+
+// If a rate change hasn't been confirmed yet, this is the rate to go back
+// to, and the time at which to do it.
+bool baud_unconfirmed;
+uint32_t fallback_baud;
+uint32_t fallback_time;
+
+
 
 //
 // Private prototypes
@@ -93,15 +121,36 @@ void PrintLongHelp();
 // Prints a description of system state.
 void PrintFullQuery();
 
+// Prints system state as a single line of key=value pairs.
+void PrintCompactQuery();
+
+// Sends system state as a single binary record.
+void SendBinaryQuery();
+
+// Sends one byte of a binary record, adding it to the running checksum.
+void SendBinaryByte(uint8_t value, uint8_t &checksum);
+
+// Sends a little-endian 32-bit value as part of a binary record.
+void SendBinaryUInt32(uint32_t value, uint8_t &checksum);
+
 // Handles the most recently parsed command.
 void HandleCommand();
 
+// Switches the host link to a new baud rate, pending confirmation.
+// Returns false if the rate isn't supported.
+bool ChangeBaudRate(uint32_t new_baud);
+
+// Reverts an unconfirmed baud rate change if the host has gone quiet.
+void CheckBaudFallback();
+
 // Prints a formatted hex value with zero-padding and appropriate width.
-// We could do this via UART_PrintHex..(), except for the 24-bit case.
+// We could do this via Link_PrintHex..(), except for the 24-bit case.
 void PrintHexValue(uint32_t value, int bits);
 
+#if DEBUG_ENABLE
 // Dumps full config register state to the serial port (debug command).
 void DebugDumpRegState();
+#endif
 
 
 
@@ -116,6 +165,7 @@ void InitReporting(bool want_reports)
 {
   force_output = false;
   report_changes = false;
+  report_timestamps = false;
 
   if (want_reports)
   {
@@ -138,7 +188,123 @@ void InitHostLink()
 
   InitReporting(REPORT_DEFAULT);
 
-  UART_Init(CPU_SPEED, HOST_BAUD);
+  current_baud = HOST_BAUD;
+  baud_unconfirmed = false;
+
+  Link_Init(HOST_BAUD);
+}
+
+
+
+// Switches the host link to a new baud rate, pending confirmation.
+// Returns false if the rate isn't supported.
+
+bool ChangeBaudRate(uint32_t new_baud)
+{
+  bool result;
+#if HOST_LINK == HOST_LINK_UART
+  int idx;
+#endif
+
+  result = false;
+
+  // USB and native links have no baud rate to change.
+#if HOST_LINK == HOST_LINK_UART
+  for (idx = 0; idx < BAUD_TABLE_SIZE; idx++)
+    if (new_baud == pgm_read_dword(&(baud_table[idx])))
+      result = true;
+#endif
+
+  if (result)
+  {
+    // Acknowledge at the old rate, and make sure it's actually been sent
+    // before switching.
+    Link_QueueSend_P(PSTR("BAU: "));
+    Link_PrintUInt(new_baud);
+    Link_QueueSend_P(PSTR("\r\n"));
+    Link_WaitForSendDone();
+
+    // If this is a change on top of an unconfirmed change, fall back to
+    // the last rate that was known to work.
+    if (!baud_unconfirmed)
+      fallback_baud = current_baud;
+    baud_unconfirmed = true;
+    fallback_time = Timer_Query() + HOST_BAUD_CONFIRM_TICKS;
+
+    current_baud = new_baud;
+    Link_SetBaud(new_baud);
+  }
+
+  return result;
+}
+
+
+
+// Reverts an unconfirmed baud rate change if the host has gone quiet.
+
+void CheckBaudFallback()
+{
+  if ( baud_unconfirmed && IsTimeReached(Timer_Query(), fallback_time) )
+  {
+    baud_unconfirmed = false;
+
+    current_baud = fallback_baud;
+    Link_SetBaud(fallback_baud);
+  }
+}
+
+
+
+// Queries command echo.
+
+bool IsEchoActive()
+{
+  return echo_active;
+}
+
+
+
+// Sets command echo.
+
+void SetEchoActive(bool want_echo)
+{
+  echo_active = want_echo;
+}
+
+
+
+// Queries automatic reporting of I/O line changes.
+
+bool IsReportingActive()
+{
+  return report_changes;
+}
+
+
+
+// Sets automatic reporting of I/O line changes.
+
+void SetReportingActive(bool want_reports)
+{
+  InitReporting(want_reports);
+}
+
+
+
+// Queries event timestamps on change reports.
+
+bool IsReportTimestampActive()
+{
+  return report_timestamps;
+}
+
+
+
+// Sets event timestamps on change reports.
+
+void SetReportTimestampActive(bool want_timestamps)
+{
+  report_timestamps = want_timestamps;
 }
 
 
@@ -330,7 +496,7 @@ void PrintShortHelp()
   int idx;
   char thischar;
 
-  UART_QueueSend_P(PSTR("Unrecognized command:  \""));
+  Link_QueueSend_P(PSTR("Unrecognized command:  \""));
 
   // Take this apart character by character, in case there are unprintable
   // characters in the string.
@@ -340,17 +506,17 @@ void PrintShortHelp()
   {
     if ((32 <= thischar) && (126 >= thischar))
     {
-      UART_PrintChar(thischar);
+      Link_PrintChar(thischar);
     }
     else
     {
-      UART_PrintChar('<');
+      Link_PrintChar('<');
       PrintHexValue(thischar, 8);
-      UART_PrintChar('>');
+      Link_PrintChar('>');
     }
   }
 
-  UART_QueueSend_P(PSTR("\". Type \"?\" or \"HLP\" for help.\r\n"));
+  Link_QueueSend_P(PSTR("\". Type \"?\" or \"HLP\" for help.\r\n"));
 }
 
 
@@ -359,12 +525,17 @@ void PrintShortHelp()
 
 void PrintLongHelp()
 {
-  UART_QueueSend_P(PSTR(
+  Link_QueueSend_P(PSTR(
 "Commands:\r\n"
 " ?, HLP  :  Help screen.\r\n"
 "    IDQ  :  Device identity query.\r\n"
 "    QRY  :  Query system state.\r\n"
+"    QRM  :  Query system state (one line of key=value pairs).\r\n"
+"    QRB  :  Query system state (one binary record).\r\n"
 "    INI  :  Reinitialize (clock and event reset, pins to default config).\r\n"
+"    BAU n:  Switch to n baud. Send a command at the new rate within\r\n"
+"            2 seconds, or the old rate is restored. (Serial links only;\r\n"
+"            USB links have no baud rate.)\r\n"
 "  ECH 1/0:  Start/stop echoing typed characters back to the host.\r\n"
 "    WRO n:  Set the output bank to data value n.\r\n"
 "    WRU n:  Set the user-configurable bank outputs to data value n.\r\n"
@@ -372,13 +543,113 @@ void PrintLongHelp()
 "    RDO  :  Read the state of the output bank.\r\n"
 "    RDU  :  Read the state of the user-configurable bank.\r\n"
 "  REP 1/0:  Start/stop automatically reporting changes in I/O lines.\r\n"
+"    REP 2:  Report changes with event timestamps (ticks) appended.\r\n"
 "  PPU 1/0:  Enable/disable input pin pull-up resistors.\r\n"
 "  TSK 1/0:  Start/stop the device's preconfigured task.\r\n"
 "    TPP n:  (task) Set pulse period to n ticks.\r\n"
 "    TPD n:  (task) Set pulse duration to n ticks.\r\n"
+"    CFS  :  Save the current configuration to EEPROM (used at power-up).\r\n"
+"    CFL  :  Reload the configuration saved in EEPROM.\r\n"
+"    CFE  :  Erase the saved configuration (power up with defaults).\r\n"
+"    LSQ  :  Query per-line edge statistics.\r\n"
+"    LSR  :  Reset per-line edge statistics.\r\n"
+  ));
+#if FRAME_ENABLE
+  Link_QueueSend_P(PSTR(
+"    FCL n:  (frame) Count camera exposures on input bits in mask n\r\n"
+"            (0 = off). These lines are then left out of \"I:\" reports.\r\n"
+"    FCP n:  (frame) Count falling edges on input bits in mask n, and\r\n"
+"            rising edges on the rest.\r\n"
+"    FCB n:  (frame) Send n \"line:frame:tick\" records per \"FC:\" line.\r\n"
+"    FCQ  :  (frame) Query frame counts and buffer state.\r\n"
+  ));
+#endif
+#if QUAD_ENABLE
+  Link_QueueSend_P(PSTR(
+"    QEL n:  (quad) Decode encoders in mask n (0 = off). Encoder k uses\r\n"
+"            input bits 2k (A) and 2k+1 (B), which are then left out of\r\n"
+"            \"I:\" reports.\r\n"
+"    QER n:  (quad) Send \"QE: tick k:position:velocity ...\" every n\r\n"
+"            ticks (0 = only when asked).\r\n"
+"    QEP  :  (quad) Send a position report now.\r\n"
+"    QEZ  :  (quad) Zero all positions.\r\n"
+"    QEQ  :  (quad) Query decoder state and error counts.\r\n"
+  ));
+#endif
+#if FREQ_ENABLE
+  Link_QueueSend_P(PSTR(
+"    FQM n:  (freq) 0 = off, 1 = count edges on input bit 0 (D5, up to\r\n"
+"            MHz), 2 = time periods on input bit 3 (D8, up to 20 kHz;\r\n"
+"            faster gates are reported as \"over\"). The measured line\r\n"
+"            is left out of \"I:\" reports.\r\n"
+"    FQG n:  (freq) Set the gate time to n ticks.\r\n"
+"    FQR n:  (freq) Send \"FQ: tick mHz period_ns count\" every n gates\r\n"
+"            (0 = only when asked).\r\n"
+"    FQP  :  (freq) Send the last gate's measurement now.\r\n"
+"    FQQ  :  (freq) Query counter state.\r\n"
+  ));
+#endif
+#if WAVE_ENABLE
+  Link_QueueSend_P(PSTR(
+"    WVC  :  (wave) Stop playback and clear the sequence buffer.\r\n"
+"    WVA n:  (wave) Append entry; n = (delay ticks) * 256 + output value.\r\n"
+"    WVF  :  (wave) No more entries follow (ends streamed playback).\r\n"
+"  WVM 1/0:  (wave) Streaming (consume entries as played) / table mode.\r\n"
+"    WVL n:  (wave) Play the table n times (0 = forever).\r\n"
+"    WVT n:  (wave) Use input bit n's rising edge as the start trigger.\r\n"
+"    WVG n:  (wave) 0 = stop, 1 = start now, 2 = start on trigger.\r\n"
+"    WVS  :  (wave) Save the sequence to EEPROM.\r\n"
+"    WVR  :  (wave) Restore the sequence from EEPROM.\r\n"
+"    WVQ  :  (wave) Query playback state.\r\n"
+  ));
+#endif
+#if ADC_ENABLE
+  Link_QueueSend_P(PSTR(
+"    ADC n:  (analog) Acquire channels in bitmask n (PC0 = bit 0; 0 = off).\r\n"
+"    ADD n:  (analog) Average n conversions per channel per sample.\r\n"
+"    ADR n:  (analog) Average to about n samples/sec (set channels first).\r\n"
+"    ADT n:  (analog) Threshold events; n = channel * 1024 + level\r\n"
+"            (level 0 = off).\r\n"
+"  ADS 1/0:  (analog) Start/stop streaming sample blocks.\r\n"
+"    ADQ  :  (analog) Query acquisition state.\r\n"
+  ));
+#endif
+#if SYNC_ENABLE
+  Link_QueueSend_P(PSTR(
+"    SYN n:  (sync) 0 = off, 1 = master (pulses on D2), 2 = slave (pulses\r\n"
+"            on D8; timestamps follow the master).\r\n"
+  ));
+#endif
+#if PLL_ENABLE
+  Link_QueueSend_P(PSTR(
+"    PLE n:  (PLL) Lock the strobe to rising edges on input bit n.\r\n"
+"    PLR n:  (PLL) Set the nominal reference period to n ticks. The strobe\r\n"
+"            period should be a multiple of this.\r\n"
+"    PLX  :  (PLL) Stop locking; the strobe follows the local crystal.\r\n"
+"    PLQ  :  (PLL) Query lock state, frequency error (ppb), and phase\r\n"
+"            error (CPU cycles).\r\n"
+  ));
+#endif
+#if SELFTEST_ENABLE
+  Link_QueueSend_P(PSTR(
+"    STE n:  (self-test) Measure n strobe pulses looped back from D13 to D8.\r\n"
+"    STO n:  (self-test) Measure n strobe pulses seen by a photodiode on D6\r\n"
+"            (reference on D7).\r\n"
+"    STX  :  (self-test) Stop the test in progress.\r\n"
+"    STQ  :  (self-test) Report results (times are in CPU cycles).\r\n"
   ));
+#endif
+#if TASKLET_ENABLE
+  Link_QueueSend_P(PSTR(
+"    TKL  :  (tasklets) List tasklets, with ISR cycle budgets and measured\r\n"
+"            worst-case costs (CPU cycles).\r\n"
+"    TKE n:  (tasklets) Enable tasklet n.\r\n"
+"    TKD n:  (tasklets) Disable tasklet n. Strobe and sync drive their\r\n"
+"            outputs low; re-enabling them restarts their timing.\r\n"
+  ));
+#endif
 #if DEBUG_ENABLE
-  UART_QueueSend_P(PSTR(
+  Link_QueueSend_P(PSTR(
 "    DDC  :  (debug) Dump MCU configuration register contents.\r\n"
   ));
 #endif
@@ -391,8 +662,14 @@ void PrintLongHelp()
 void PrintFullQuery()
 {
   uint32_t dval_input, dval_output, dval_user;
-  uint32_t thistime;
+  uint64_t thistime;
   uint32_t strobe_period, strobe_duration;
+#if SYNC_ENABLE
+  sync_status_t sync_status;
+#endif
+#if PLL_ENABLE
+  pll_status_t pll_status;
+#endif
 
   // Read the current I/O line values.
   // This doesn't need locking.
@@ -402,50 +679,50 @@ void PrintFullQuery()
 
   // Get the timestamp.
   // This makes its own locking call.
-  thistime = Timer_Query();
+  thistime = QueryTimebase64();
 
 
   // Banner.
-  UART_QueueSend_P(
+  Link_QueueSend_P(
     PSTR("System state (all values in base 10 unless noted):\r\n"));
 
   // Device and version information.
-  UART_QueueSend_P(PSTR("  Device type:  "));
-  UART_QueueSend_P(PSTR(DEVICETYPE));
-  UART_QueueSend_P(PSTR("    Subtype/Configuration:  "));
-  UART_QueueSend_P(PSTR(DEVICESUBTYPE));
-  UART_QueueSend_P(PSTR("\r\n  Preconfigured task:  "));
-  UART_QueueSend_P(PSTR(TASKNAME));
-  UART_QueueSend_P(PSTR("\r\n  Firmware version:  "));
-  UART_QueueSend_P(PSTR(VERSION_STR));
-  UART_QueueSend_P(PSTR("\r\n  Debugging commands:  "));
-  UART_QueueSend_P(DEBUG_ENABLE ? PSTR("enabled") : PSTR("disabled"));
-  UART_QueueSend_P(PSTR("\r\n"));
+  Link_QueueSend_P(PSTR("  Device type:  "));
+  Link_QueueSend_P(PSTR(DEVICETYPE));
+  Link_QueueSend_P(PSTR("    Subtype/Configuration:  "));
+  Link_QueueSend_P(PSTR(DEVICESUBTYPE));
+  Link_QueueSend_P(PSTR("\r\n  Preconfigured task:  "));
+  Link_QueueSend_P(PSTR(TASKNAME));
+  Link_QueueSend_P(PSTR("\r\n  Firmware version:  "));
+  Link_QueueSend_P(PSTR(VERSION_STR));
+  Link_QueueSend_P(PSTR("\r\n  Debugging commands:  "));
+  Link_QueueSend_P(DEBUG_ENABLE ? PSTR("enabled") : PSTR("disabled"));
+  Link_QueueSend_P(PSTR("\r\n"));
 
   // RTC information.
-  UART_QueueSend_P(PSTR("  Timestamp:  "));
-  UART_PrintUInt(thistime);
-  UART_QueueSend_P(PSTR(" ticks\r\n"));
-  UART_QueueSend_P(PSTR("  Clock ticks per second:  "));
-  UART_PrintUInt(RTC_TICKS_PER_SECOND);
-  UART_QueueSend_P(PSTR("\r\n"));
+  Link_QueueSend_P(PSTR("  Timestamp:  "));
+  Link_PrintUInt64(thistime);
+  Link_QueueSend_P(PSTR(" ticks\r\n"));
+  Link_QueueSend_P(PSTR("  Clock ticks per second:  "));
+  Link_PrintUInt(RTC_TICKS_PER_SECOND);
+  Link_QueueSend_P(PSTR("\r\n"));
 
   // Digital I/O state.
-  UART_QueueSend_P(PSTR("  Digital I/Os (Input/Output/User-config):  "));
-  UART_PrintUInt(GetDIOCount(DIO_REG_INPUT));
-  UART_QueueSend_P(PSTR(" / "));
-  UART_PrintUInt(GetDIOCount(DIO_REG_OUTPUT));
-  UART_QueueSend_P(PSTR(" / "));
-  UART_PrintUInt(GetDIOCount(DIO_REG_USER));
-  UART_QueueSend_P(PSTR("\r\n  Input pull-up resistors?  "));
-  UART_QueueSend_P(QueryPinPullups() ? PSTR("yes") : PSTR("no"));
-  UART_QueueSend_P(PSTR("\r\n     Input state (hex):  "));
+  Link_QueueSend_P(PSTR("  Digital I/Os (Input/Output/User-config):  "));
+  Link_PrintUInt(GetDIOCount(DIO_REG_INPUT));
+  Link_QueueSend_P(PSTR(" / "));
+  Link_PrintUInt(GetDIOCount(DIO_REG_OUTPUT));
+  Link_QueueSend_P(PSTR(" / "));
+  Link_PrintUInt(GetDIOCount(DIO_REG_USER));
+  Link_QueueSend_P(PSTR("\r\n  Input pull-up resistors?  "));
+  Link_QueueSend_P(QueryPinPullups() ? PSTR("yes") : PSTR("no"));
+  Link_QueueSend_P(PSTR("\r\n     Input state (hex):  "));
   PrintHexValue(dval_input, GetDIOCount(DIO_REG_INPUT));
-  UART_QueueSend_P(PSTR("\r\n    Output state (hex):  "));
+  Link_QueueSend_P(PSTR("\r\n    Output state (hex):  "));
   PrintHexValue(dval_output, GetDIOCount(DIO_REG_OUTPUT));
-  UART_QueueSend_P(PSTR("\r\n      User state (hex):  "));
+  Link_QueueSend_P(PSTR("\r\n      User state (hex):  "));
   PrintHexValue(dval_user, GetDIOCount(DIO_REG_USER));
-  UART_QueueSend_P(PSTR("\r\n"));
+  Link_QueueSend_P(PSTR("\r\n"));
   // FIXME - Configuration of user-configurable registers goes here!
 
   // Task-specific state.
@@ -454,17 +731,260 @@ void PrintFullQuery()
   strobe_duration = 0;
   QueryTaskParams(strobe_period, strobe_duration);
 
-  UART_QueueSend_P(PSTR("  Task-specific state:\r\n"));
-  UART_QueueSend_P(PSTR("    Enabled?  "));
-  UART_QueueSend_P(IsTaskActive() ? PSTR("yes") : PSTR("no"));
-  UART_QueueSend_P(PSTR("\r\n    Synch light period (ticks):  "));
-  UART_PrintUInt(strobe_period);
-  UART_QueueSend_P(PSTR("\r\n    Synch light duration (ticks):  "));
-  UART_PrintUInt(strobe_duration);
-  UART_QueueSend_P(PSTR("\r\n"));
+  Link_QueueSend_P(PSTR("  Task-specific state:\r\n"));
+  Link_QueueSend_P(PSTR("    Enabled?  "));
+  Link_QueueSend_P(IsTaskRunning() ? PSTR("yes") : PSTR("no"));
+  Link_QueueSend_P(PSTR("\r\n    Synch light period (ticks):  "));
+  Link_PrintUInt(strobe_period);
+  Link_QueueSend_P(PSTR("\r\n    Synch light duration (ticks):  "));
+  Link_PrintUInt(strobe_duration);
+  Link_QueueSend_P(PSTR("\r\n"));
+
+#if PLL_ENABLE
+  QueryPLLStatus(pll_status);
+
+  Link_QueueSend_P(PSTR("    Reference lock:  "));
+  if (PLL_STATE_LOCKED == pll_status.state)
+    Link_QueueSend_P(PSTR("locked"));
+  else if (PLL_STATE_TRACKING == pll_status.state)
+    Link_QueueSend_P(PSTR("tracking"));
+  else if (PLL_STATE_HOLDOVER == pll_status.state)
+    Link_QueueSend_P(PSTR("holdover"));
+  else if (PLL_STATE_WAITING == pll_status.state)
+    Link_QueueSend_P(PSTR("waiting"));
+  else
+    Link_QueueSend_P(PSTR("off"));
+  Link_QueueSend_P(PSTR("\r\n"));
+
+  if (PLL_STATE_OFF != pll_status.state)
+  {
+    Link_QueueSend_P(PSTR("      Reference input bit:  "));
+    Link_PrintUInt(pll_status.ref_bit);
+    Link_QueueSend_P(PSTR("\r\n      Reference period (ticks):  "));
+    Link_PrintUInt(pll_status.ref_period);
+    Link_QueueSend_P(PSTR("\r\n      Frequency error (ppb):  "));
+    Link_PrintInt(pll_status.freq_ppb);
+    Link_QueueSend_P(PSTR("\r\n      Phase error (CPU cycles):  "));
+    Link_PrintInt(pll_status.phase_error);
+    Link_QueueSend_P(PSTR("\r\n"));
+  }
+#endif
+
+#if SYNC_ENABLE
+  // Multi-box sync state.
+  QuerySyncStatus(sync_status);
+
+  Link_QueueSend_P(PSTR("  Multi-box sync:  "));
+  if (SYNC_ROLE_MASTER == sync_status.role)
+    Link_QueueSend_P(PSTR("master"));
+  else if (SYNC_ROLE_SLAVE == sync_status.role)
+    Link_QueueSend_P(PSTR("slave"));
+  else
+    Link_QueueSend_P(PSTR("off"));
+  Link_QueueSend_P(PSTR("\r\n"));
+
+  if (SYNC_ROLE_SLAVE == sync_status.role)
+  {
+    Link_QueueSend_P(PSTR("    Lock state:  "));
+    if (SYNC_STATE_LOCKED == sync_status.state)
+      Link_QueueSend_P(PSTR("locked"));
+    else if (SYNC_STATE_TRACKING == sync_status.state)
+      Link_QueueSend_P(PSTR("tracking"));
+    else if (SYNC_STATE_HOLDOVER == sync_status.state)
+      Link_QueueSend_P(PSTR("holdover"));
+    else
+      Link_QueueSend_P(PSTR("searching"));
+    Link_QueueSend_P(PSTR("\r\n    Offset from local clock (ticks):  "));
+    Link_PrintInt(sync_status.tick_offset);
+    Link_QueueSend_P(PSTR("\r\n    Phase error (CPU cycles):  "));
+    Link_PrintInt(sync_status.phase_error);
+    Link_QueueSend_P(PSTR("\r\n    Frequency correction (ppb):  "));
+    Link_PrintInt(sync_status.freq_ppb);
+    Link_QueueSend_P(PSTR("\r\n"));
+  }
+#endif
 
   // Banner.
-  UART_QueueSend_P(PSTR("End of system state.\r\n"));
+  Link_QueueSend_P(PSTR("End of system state.\r\n"));
+}
+
+
+
+// Prints system state as a single line of key=value pairs.
+
+void PrintCompactQuery()
+{
+  uint64_t thistime;
+  uint32_t strobe_period, strobe_duration;
+#if SYNC_ENABLE
+  sync_status_t sync_status;
+#endif
+#if PLL_ENABLE
+  pll_status_t pll_status;
+#endif
+
+  // This makes its own locking call.
+  thistime = QueryTimebase64();
+
+  strobe_period = 0;
+  strobe_duration = 0;
+  QueryTaskParams(strobe_period, strobe_duration);
+
+  // Keys are short; values are decimal except for register contents and
+  // the configuration hash, which are hex.
+  Link_QueueSend_P(PSTR("QRM: ver=" VERSION_STR " tick="));
+  Link_PrintUInt64(thistime);
+  Link_QueueSend_P(PSTR(" tps="));
+  Link_PrintUInt(RTC_TICKS_PER_SECOND);
+  Link_QueueSend_P(PSTR(" nin="));
+  Link_PrintUInt(GetDIOCount(DIO_REG_INPUT));
+  Link_QueueSend_P(PSTR(" nout="));
+  Link_PrintUInt(GetDIOCount(DIO_REG_OUTPUT));
+  Link_QueueSend_P(PSTR(" nuser="));
+  Link_PrintUInt(GetDIOCount(DIO_REG_USER));
+  Link_QueueSend_P(PSTR(" pu="));
+  Link_PrintChar(QueryPinPullups() ? '1' : '0');
+  Link_QueueSend_P(PSTR(" in="));
+  PrintHexValue(GetDIOBits(DIO_REG_INPUT), GetDIOCount(DIO_REG_INPUT));
+  Link_QueueSend_P(PSTR(" out="));
+  PrintHexValue(GetDIOBits(DIO_REG_OUTPUT), GetDIOCount(DIO_REG_OUTPUT));
+  Link_QueueSend_P(PSTR(" user="));
+  PrintHexValue(GetDIOBits(DIO_REG_USER), GetDIOCount(DIO_REG_USER));
+  Link_QueueSend_P(PSTR(" task="));
+  Link_PrintChar(IsTaskRunning() ? '1' : '0');
+  Link_QueueSend_P(PSTR(" tpp="));
+  Link_PrintUInt(strobe_period);
+  Link_QueueSend_P(PSTR(" tpd="));
+  Link_PrintUInt(strobe_duration);
+  Link_QueueSend_P(PSTR(" rep="));
+  Link_PrintChar(report_changes ? (report_timestamps ? '2' : '1') : '0');
+  Link_QueueSend_P(PSTR(" baud="));
+  Link_PrintUInt(current_baud);
+  Link_QueueSend_P(PSTR(" hash="));
+  PrintHexValue(GetSettingsHash(), 32);
+#if SYNC_ENABLE
+  // Sync role and state are the enum values (see SYN).
+  QuerySyncStatus(sync_status);
+  Link_QueueSend_P(PSTR(" sync="));
+  Link_PrintUInt(sync_status.role);
+  Link_QueueSend_P(PSTR(" lock="));
+  Link_PrintUInt(sync_status.state);
+  Link_QueueSend_P(PSTR(" soff="));
+  Link_PrintInt(sync_status.tick_offset);
+  Link_QueueSend_P(PSTR(" serr="));
+  Link_PrintInt(sync_status.phase_error);
+#endif
+#if PLL_ENABLE
+  QueryPLLStatus(pll_status);
+  Link_QueueSend_P(PSTR(" pll="));
+  Link_PrintUInt(pll_status.state);
+  Link_QueueSend_P(PSTR(" pllf="));
+  Link_PrintInt(pll_status.freq_ppb);
+#endif
+  Link_QueueSend_P(PSTR("\r\n"));
+}
+
+
+
+// Sends one byte of a binary record, adding it to the running checksum.
+
+void SendBinaryByte(uint8_t value, uint8_t &checksum)
+{
+  Link_QueueSendBytes(&value, 1);
+  checksum += value;
+}
+
+
+
+// Sends a little-endian 32-bit value as part of a binary record.
+
+void SendBinaryUInt32(uint32_t value, uint8_t &checksum)
+{
+  SendBinaryByte(value & 0xff, checksum);
+  SendBinaryByte((value >> 8) & 0xff, checksum);
+  SendBinaryByte((value >> 16) & 0xff, checksum);
+  SendBinaryByte((value >> 24) & 0xff, checksum);
+}
+
+
+
+// Sends system state as a single binary record.
+// Framing is: start byte, type, payload length, payload, checksum. The
+// checksum makes the byte sum of type through checksum zero (mod 256).
+// The payload is (little-endian):
+//   firmware version (8 ASCII bytes), tick (32), ticks per second (32),
+//   input/output/user counts (8 each), flags (8; bit 0 = pull-ups,
+//   bit 1 = task active, bit 2 = reporting, bit 3 = echo,
+//   bit 4 = timestamped reporting),
+//   input/output/user values (32 each), task period and duration (32 each),
+//   configuration hash (32), upper half of the 64-bit tick (32).
+// The tick's upper half was added at the end, so that hosts that only
+// know the 44-byte payload can read the rest as before.
+
+void SendBinaryQuery()
+{
+  uint8_t checksum, flags, framebyte;
+  uint64_t thistime;
+  uint32_t strobe_period, strobe_duration;
+  const char *verstr;
+  int idx;
+  char thischar;
+
+  thistime = QueryTimebase64();
+
+  strobe_period = 0;
+  strobe_duration = 0;
+  QueryTaskParams(strobe_period, strobe_duration);
+
+  flags = 0;
+  if (QueryPinPullups())
+    flags |= 0x01;
+  if (IsTaskRunning())
+    flags |= 0x02;
+  if (report_changes)
+    flags |= 0x04;
+  if (echo_active)
+    flags |= 0x08;
+  if (report_timestamps)
+    flags |= 0x10;
+
+  // The start byte isn't part of the checksum.
+  framebyte = BINARY_FRAME_START;
+  Link_QueueSendBytes(&framebyte, 1);
+  checksum = 0;
+  SendBinaryByte(BINARY_TYPE_QUERY, checksum);
+  SendBinaryByte(BINARY_QUERY_LENGTH, checksum);
+
+  // Version string, NUL-padded to 8 bytes.
+  verstr = PSTR(VERSION_STR);
+  thischar = pgm_read_byte(verstr);
+  for (idx = 0; idx < 8; idx++)
+  {
+    SendBinaryByte(thischar, checksum);
+    if (0 != thischar)
+      thischar = pgm_read_byte(verstr + idx + 1);
+  }
+
+  SendBinaryUInt32((uint32_t) thistime, checksum);
+  SendBinaryUInt32(RTC_TICKS_PER_SECOND, checksum);
+  SendBinaryByte(GetDIOCount(DIO_REG_INPUT), checksum);
+  SendBinaryByte(GetDIOCount(DIO_REG_OUTPUT), checksum);
+  SendBinaryByte(GetDIOCount(DIO_REG_USER), checksum);
+  SendBinaryByte(flags, checksum);
+  SendBinaryUInt32(GetDIOBits(DIO_REG_INPUT), checksum);
+  SendBinaryUInt32(GetDIOBits(DIO_REG_OUTPUT), checksum);
+  SendBinaryUInt32(GetDIOBits(DIO_REG_USER), checksum);
+  SendBinaryUInt32(strobe_period, checksum);
+  SendBinaryUInt32(strobe_duration, checksum);
+  SendBinaryUInt32(GetSettingsHash(), checksum);
+  SendBinaryUInt32((uint32_t) (thistime >> 32), checksum);
+
+  framebyte = 0 - checksum;
+  Link_QueueSendBytes(&framebyte, 1);
+
+  // There's no line end to push the frame out, so do it now. Otherwise
+  // USB would hold the last partial packet until more output came along.
+  Link_WaitForSendDone();
 }
 
 
@@ -494,18 +1014,30 @@ void HandleCommand()
     && (!argvalid))
   {
     // Device type identifier, plus auxiliary data.
-    UART_QueueSend_P(PSTR("devicetype: "));
-    UART_QueueSend_P(PSTR(DEVICETYPE));
-    UART_QueueSend_P(PSTR("  subtype: "));
-    UART_QueueSend_P(PSTR(DEVICESUBTYPE));
-    UART_QueueSend_P(PSTR("  task: "));
-    UART_QueueSend_P(PSTR(TASKNAME));
-    UART_QueueSend_P(PSTR("\r\n"));
-  }
-  else if (('Q' == opcode[0]) && ('R' == opcode[1]) && ('Y' == opcode[2])
-    && (!argvalid))
+    Link_QueueSend_P(PSTR("devicetype: "));
+    Link_QueueSend_P(PSTR(DEVICETYPE));
+    Link_QueueSend_P(PSTR("  subtype: "));
+    Link_QueueSend_P(PSTR(DEVICESUBTYPE));
+    Link_QueueSend_P(PSTR("  task: "));
+    Link_QueueSend_P(PSTR(TASKNAME));
+    Link_QueueSend_P(PSTR("\r\n"));
+
+    // The configuration hash goes on its own line, so that hosts that
+    // parse the line above to the end still work.
+    Link_QueueSend_P(PSTR("confighash: "));
+    PrintHexValue(GetSettingsHash(), 32);
+    Link_QueueSend_P(PSTR("\r\n"));
+  }
+  else if (('Q' == opcode[0]) && ('R' == opcode[1]) && (!argvalid))
   {
-    PrintFullQuery();
+    if ('Y' == opcode[2])
+      PrintFullQuery();
+    else if ('M' == opcode[2])
+      PrintCompactQuery();
+    else if ('B' == opcode[2])
+      SendBinaryQuery();
+    else
+      command_valid = false;
   }
   else if (('I' == opcode[0]) && ('N' == opcode[1]) && ('I' == opcode[2])
     && (!argvalid))
@@ -515,12 +1047,45 @@ void HandleCommand()
 
     ConfigPins(FOB_DEFAULT_PULLUPS);
 
-    Timer_Reset();
+#if WAVE_ENABLE
+    SetWaveActivity(WAVE_START_STOP);
+#endif
+#if ADC_ENABLE
+    SetADCChannels(0);
+#endif
+#if FRAME_ENABLE
+    SetFrameLines(0);
+#endif
+#if QUAD_ENABLE
+    SetQuadDecoders(0);
+    SetQuadReportPeriod(0);
+#endif
+#if FREQ_ENABLE
+    SetFreqMode(FREQ_MODE_OFF);
+    SetFreqGate(FREQ_DEFAULT_GATE_TICKS);
+    SetFreqReportInterval(1);
+#endif
+    ResetTimebase();
+#if SYNC_ENABLE
+    ResetSync();
+#endif
+#if PLL_ENABLE
+    DisablePLL();
+#endif
+#if TASKLET_ENABLE
+    ResetTasklets();
+#endif
+    ResetLineStats();
     ConfigureTask(FOB_DEFAULT_STROBE_PERIOD, FOB_DEFAULT_STROBE_HOLD);
     SetTaskActivity(TASK_AUTOSTART);
 
     InitReporting(REPORT_DEFAULT);
   }
+  else if (('B' == opcode[0]) && ('A' == opcode[1]) && ('U' == opcode[2])
+    && argvalid)
+  {
+    command_valid = ChangeBaudRate(argument);
+  }
   else if (('E' == opcode[0]) && ('C' == opcode[1]) && ('H' == opcode[2])
     && argvalid)
   {
@@ -538,6 +1103,11 @@ void HandleCommand()
       InitReporting(false);
     else if (1 == argument)
       InitReporting(true);
+    else if (2 == argument)
+    {
+      InitReporting(true);
+      report_timestamps = true;
+    }
     else
       command_valid = false;
   }
@@ -581,10 +1151,10 @@ void HandleCommand()
 
     if (command_valid)
     {
-      UART_PrintChar(scratchchar);
-      UART_QueueSend_P(PSTR(": "));
+      Link_PrintChar(scratchchar);
+      Link_QueueSend_P(PSTR(": "));
       PrintHexValue(scratchval, scratchcount);
-      UART_QueueSend_P(PSTR("\r\n"));
+      Link_QueueSend_P(PSTR("\r\n"));
     }
   }
   else if (('P' == opcode[0]) && ('P' == opcode[1]) && ('U' == opcode[2])
@@ -607,6 +1177,19 @@ void HandleCommand()
     else
       command_valid = false;
   }
+#if TASKLET_ENABLE
+  else if (('T' == opcode[0]) && ('K' == opcode[1]))
+  {
+    if ( ('L' == opcode[2]) && (!argvalid) )
+      PrintTaskletState();
+    else if ( ('E' == opcode[2]) && argvalid )
+      command_valid = SetTaskletActivity(argument, true);
+    else if ( ('D' == opcode[2]) && argvalid )
+      command_valid = SetTaskletActivity(argument, false);
+    else
+      command_valid = false;
+  }
+#endif
   else if (('T' == opcode[0]) && ('P' == opcode[1]) && ('P' == opcode[2])
     && argvalid)
   {
@@ -637,6 +1220,207 @@ void HandleCommand()
     // FIXME - Keeping the task active if it was active before!
     SetTaskActivity(old_activity);
   }
+  else if (('C' == opcode[0]) && ('F' == opcode[1]) && (!argvalid))
+  {
+    if ('S' == opcode[2])
+      SaveSettings();
+    else if ('L' == opcode[2])
+      command_valid = LoadSettings();
+    else if ('E' == opcode[2])
+      EraseSettings();
+    else
+      command_valid = false;
+  }
+  else if (('L' == opcode[0]) && ('S' == opcode[1]) && (!argvalid))
+  {
+    if ('Q' == opcode[2])
+      PrintLineStats();
+    else if ('R' == opcode[2])
+      ResetLineStats();
+    else
+      command_valid = false;
+  }
+#if FRAME_ENABLE
+  else if (('F' == opcode[0]) && ('C' == opcode[1]))
+  {
+    if (argvalid)
+    {
+      if ('L' == opcode[2])
+        command_valid = SetFrameLines(argument);
+      else if ('P' == opcode[2])
+        command_valid = SetFramePolarity(argument);
+      else if ('B' == opcode[2])
+        command_valid = SetFrameBatch(argument);
+      else
+        command_valid = false;
+    }
+    else if ('Q' == opcode[2])
+      PrintFrameState();
+    else
+      command_valid = false;
+  }
+#endif
+#if QUAD_ENABLE
+  else if (('Q' == opcode[0]) && ('E' == opcode[1]))
+  {
+    if (argvalid)
+    {
+      if ('L' == opcode[2])
+        command_valid = SetQuadDecoders(argument);
+      else if ('R' == opcode[2])
+        command_valid = SetQuadReportPeriod(argument);
+      else
+        command_valid = false;
+    }
+    else if ('P' == opcode[2])
+      SendQuadReport();
+    else if ('Z' == opcode[2])
+      ZeroQuadPositions();
+    else if ('Q' == opcode[2])
+      PrintQuadState();
+    else
+      command_valid = false;
+  }
+#endif
+#if FREQ_ENABLE
+  else if (('F' == opcode[0]) && ('Q' == opcode[1]))
+  {
+    if (argvalid)
+    {
+      if ('M' == opcode[2])
+        command_valid = SetFreqMode(argument);
+      else if ('G' == opcode[2])
+        command_valid = SetFreqGate(argument);
+      else if ('R' == opcode[2])
+        SetFreqReportInterval(argument);
+      else
+        command_valid = false;
+    }
+    else if ('P' == opcode[2])
+      SendFreqReport();
+    else if ('Q' == opcode[2])
+      PrintFreqState();
+    else
+      command_valid = false;
+  }
+#endif
+#if WAVE_ENABLE
+  else if (('W' == opcode[0]) && ('V' == opcode[1]))
+  {
+    if (argvalid)
+    {
+      if ('A' == opcode[2])
+        command_valid = AppendWaveEntry(argument);
+      else if ( ('M' == opcode[2]) && (1 >= argument) )
+        SetWaveStreaming(1 == argument);
+      else if ('L' == opcode[2])
+        SetWaveLoops(argument);
+      else if ('T' == opcode[2])
+        command_valid = SetWaveTrigger(argument);
+      else if ( ('G' == opcode[2]) && (0 == argument) )
+        SetWaveActivity(WAVE_START_STOP);
+      else if ( ('G' == opcode[2]) && (1 == argument) )
+        command_valid = SetWaveActivity(WAVE_START_NOW);
+      else if ( ('G' == opcode[2]) && (2 == argument) )
+        command_valid = SetWaveActivity(WAVE_START_TRIGGER);
+      else
+        command_valid = false;
+    }
+    else
+    {
+      if ('C' == opcode[2])
+        ClearWave();
+      else if ('F' == opcode[2])
+        FinishWave();
+      else if ('S' == opcode[2])
+        SaveWave();
+      else if ('R' == opcode[2])
+        command_valid = LoadWave();
+      else if ('Q' == opcode[2])
+        PrintWaveState();
+      else
+        command_valid = false;
+    }
+  }
+#endif
+#if ADC_ENABLE
+  else if (('A' == opcode[0]) && ('D' == opcode[1]))
+  {
+    if (argvalid)
+    {
+      if ('C' == opcode[2])
+        command_valid = SetADCChannels(argument);
+      else if ('D' == opcode[2])
+        command_valid = SetADCDecimation(argument);
+      else if ('R' == opcode[2])
+        command_valid = SetADCOutputRate(argument);
+      else if ('T' == opcode[2])
+        command_valid = SetADCThreshold(argument);
+      else if ( ('S' == opcode[2]) && (1 >= argument) )
+        SetADCStreaming(1 == argument);
+      else
+        command_valid = false;
+    }
+    else if ('Q' == opcode[2])
+      PrintADCState();
+    else
+      command_valid = false;
+  }
+#endif
+#if SELFTEST_ENABLE
+  else if (('S' == opcode[0]) && ('T' == opcode[1]))
+  {
+    if (argvalid)
+    {
+      if ('E' == opcode[2])
+        command_valid = StartSelfTest(SELFTEST_ELECTRICAL, argument);
+      else if ('O' == opcode[2])
+        command_valid = StartSelfTest(SELFTEST_OPTICAL, argument);
+      else
+        command_valid = false;
+    }
+    else if ('X' == opcode[2])
+      StopSelfTest();
+    else if ('Q' == opcode[2])
+      PrintSelfTestResults();
+    else
+      command_valid = false;
+  }
+#endif
+#if SYNC_ENABLE
+  else if (('S' == opcode[0]) && ('Y' == opcode[1]) && ('N' == opcode[2])
+    && argvalid)
+  {
+    if (0 == argument)
+      SetSyncRole(SYNC_ROLE_OFF);
+    else if (1 == argument)
+      SetSyncRole(SYNC_ROLE_MASTER);
+    else if (2 == argument)
+      command_valid = SetSyncRole(SYNC_ROLE_SLAVE);
+    else
+      command_valid = false;
+  }
+#endif
+#if PLL_ENABLE
+  else if (('P' == opcode[0]) && ('L' == opcode[1]))
+  {
+    if (argvalid)
+    {
+      if ('E' == opcode[2])
+        command_valid = EnablePLL(argument);
+      else if ('R' == opcode[2])
+        command_valid = SetPLLReferencePeriod(argument);
+      else
+        command_valid = false;
+    }
+    else if ('X' == opcode[2])
+      DisablePLL();
+    else if ('Q' == opcode[2])
+      PrintPLLState();
+    else
+      command_valid = false;
+  }
+#endif
 #if DEBUG_ENABLE
   else if (('D' == opcode[0]) && ('D' == opcode[1]) && ('C' == opcode[2])
     && (!argvalid))
@@ -658,14 +1442,13 @@ void HandleCommand()
 
 void PollHostInput()
 {
-  int rawserial;
-  char thischar;
   parse_result_t validity;
-  int charcount;
+
+  CheckBaudFallback();
 
   // As long as the serial port has been initialized, this returns a valid
   // result (which may be a NULL pointer).
-  rawcommand = UART_GetNextLine();
+  rawcommand = Link_GetNextLine();
 
   if (NULL != rawcommand)
   {
@@ -675,8 +1458,8 @@ void PollHostInput()
     // Remember that it's been stripped of any newlines.
     if (echo_active)
     {
-      UART_QueueSend(rawcommand);
-      UART_QueueSend_P(PSTR("\r\n"));
+      Link_QueueSend(rawcommand);
+      Link_QueueSend_P(PSTR("\r\n"));
     }
 
     // See if we can parse this.
@@ -686,12 +1469,18 @@ void PollHostInput()
     // NOTE - The raw command is still in the buffer, so that we can
     // still report errors from HandleCommand().
     if (PARSER_VALID == validity)
+    {
+      // Anything that parses means the host can hear us at this rate.
+      // This has to happen before handling, as the command may be "BAU".
+      baud_unconfirmed = false;
+
       HandleCommand();
+    }
     else if (PARSER_BAD == validity)
       PrintShortHelp();
 
     // Release this line from the buffer.
-    UART_DoneWithLine();
+    Link_DoneWithLine();
 
     // Reset the command state.
     InitRawCommand();
@@ -701,28 +1490,34 @@ void PollHostInput()
 
 
 // Prints a formatted hex value with zero-padding and appropriate width.
-// We could do this via UART_PrintHex..(), except for the 24-bit case.
+// We could do this via Link_PrintHex..(), except for the 24-bit case.
 
 void PrintHexValue(uint32_t value, int bits)
 {
-  static char scratchstr[SCRATCH_STRING_SIZE + 1];
+  int digits;
+  uint8_t nybble;
 
-  // Make sure we aren't still using the scratch string.
-  UART_WaitForSendDone();
-
-  // Format this data.
+  // Round up to a whole number of bytes.
   if (8 >= bits)
-    snprintf(scratchstr, SCRATCH_STRING_SIZE, "%02lx", value);
+    digits = 2;
   else if (16 >= bits)
-    snprintf(scratchstr, SCRATCH_STRING_SIZE, "%04lx", value);
+    digits = 4;
   else if (24 >= bits)
-    snprintf(scratchstr, SCRATCH_STRING_SIZE, "%06lx", value);
+    digits = 6;
   else
-    snprintf(scratchstr, SCRATCH_STRING_SIZE, "%08lx", value);
+    digits = 8;
 
-  scratchstr[SCRATCH_STRING_SIZE] = 0;
+  // Emit digits directly. This avoids snprintf() and doesn't have to wait
+  // for a shared scratch string to finish sending.
+  for (; 0 < digits; digits--)
+  {
+    nybble = (value >> ((digits - 1) * 4)) & 0x0f;
 
-  UART_QueueSend(scratchstr);
+    if (10 > nybble)
+      Link_PrintChar('0' + nybble);
+    else
+      Link_PrintChar('a' + (nybble - 10));
+  }
 }
 
 
@@ -734,6 +1529,29 @@ void PollHostReporting()
   static uint32_t prev_dval_input, prev_dval_output, prev_dval_user;
   uint32_t dval_input, dval_output, dval_user;
 
+#if WAVE_ENABLE
+  // Playback events are always reported; they're replies to commands.
+  PollWaveReporting();
+#endif
+#if ADC_ENABLE
+  // Analog data is requested explicitly, so it's sent regardless too.
+  PollADCReporting();
+#endif
+#if SELFTEST_ENABLE
+  PollSelfTestReporting();
+#endif
+#if FRAME_ENABLE
+  // Frame records are sent whether or not line changes are.
+  PollFrameReporting();
+#endif
+#if QUAD_ENABLE
+  // Encoder positions are sent on their own schedule.
+  PollQuadReporting();
+#endif
+#if FREQ_ENABLE
+  PollFreqReporting();
+#endif
+
   if (report_changes)
   {
     // Read the current I/O line values.
@@ -742,6 +1560,19 @@ void PollHostReporting()
     dval_output = GetDIOBits(DIO_REG_OUTPUT);
     dval_user = GetDIOBits(DIO_REG_USER);
 
+#if FRAME_ENABLE
+    // Frame clock lines are reported by frame, not by edge.
+    dval_input &= ~GetFrameLineMask();
+#endif
+#if QUAD_ENABLE
+    // Likewise encoder lines, by position.
+    dval_input &= ~GetQuadLineMask();
+#endif
+#if FREQ_ENABLE
+    // The measured line changes too fast to report.
+    dval_input &= ~GetFreqLineMask();
+#endif
+
     // See if any of our register values have changed.
     // If so, report them to the user.
 
@@ -749,27 +1580,42 @@ void PollHostReporting()
     {
       prev_dval_input = dval_input;
 
-      UART_QueueSend_P(PSTR("I: "));
+      Link_QueueSend_P(PSTR("I: "));
       PrintHexValue(dval_input, GetDIOCount(DIO_REG_INPUT));
-      UART_QueueSend_P(PSTR("\r\n"));
+      if (report_timestamps)
+      {
+        Link_PrintChar(' ');
+        Link_PrintUInt64(GetDIOChangeTime(DIO_REG_INPUT));
+      }
+      Link_QueueSend_P(PSTR("\r\n"));
     }
 
     if ( force_output || (dval_output != prev_dval_output) )
     {
       prev_dval_output = dval_output;
 
-      UART_QueueSend_P(PSTR("O: "));
+      Link_QueueSend_P(PSTR("O: "));
       PrintHexValue(dval_output, GetDIOCount(DIO_REG_OUTPUT));
-      UART_QueueSend_P(PSTR("\r\n"));
+      if (report_timestamps)
+      {
+        Link_PrintChar(' ');
+        Link_PrintUInt64(GetDIOChangeTime(DIO_REG_OUTPUT));
+      }
+      Link_QueueSend_P(PSTR("\r\n"));
     }
 
     if ( force_output || (dval_user != prev_dval_user) )
     {
       prev_dval_user = dval_user;
 
-      UART_QueueSend_P(PSTR("U: "));
+      Link_QueueSend_P(PSTR("U: "));
       PrintHexValue(dval_user, GetDIOCount(DIO_REG_USER));
-      UART_QueueSend_P(PSTR("\r\n"));
+      if (report_timestamps)
+      {
+        Link_PrintChar(' ');
+        Link_PrintUInt64(GetDIOChangeTime(DIO_REG_USER));
+      }
+      Link_QueueSend_P(PSTR("\r\n"));
     }
 
 
@@ -780,6 +1626,7 @@ void PollHostReporting()
 
 
 
+#if DEBUG_ENABLE
 // Dumps full config register state to the serial port (debug command).
 
 // FIXME - Don't stack-allocate something this big.
@@ -798,26 +1645,27 @@ void DebugDumpRegState()
       regvals[idx] = _SFR_MEM8(idx);
   }
 
-  UART_QueueSend_P(PSTR("AVR configuration register contents:\r\n\r\n"));
+  Link_QueueSend_P(PSTR("AVR configuration register contents:\r\n\r\n"));
 
   for (idx = 0; idx < 256; idx++)
   {
     if (0 == (idx & 0x03))
-      UART_PrintChar(' ');
+      Link_PrintChar(' ');
 
-    UART_PrintChar(' ');
+    Link_PrintChar(' ');
 
-    UART_PrintHex8(regvals[idx]);
+    Link_PrintHex8(regvals[idx]);
 
     if (0 == ((idx + 1) & 0x0f))
-      UART_QueueSend_P(PSTR("\r\n"));
+      Link_QueueSend_P(PSTR("\r\n"));
 
     if (0 == ((idx + 1) & 0x3f))
-      UART_QueueSend_P(PSTR("\r\n"));
+      Link_QueueSend_P(PSTR("\r\n"));
   }
 
-  UART_QueueSend_P(PSTR("Register contents ends.\r\n"));
+  Link_QueueSend_P(PSTR("Register contents ends.\r\n"));
 }
+#endif
 
 
 
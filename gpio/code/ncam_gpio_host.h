@@ -15,6 +15,19 @@ void PollHostInput();
 // Polling entry point for handling messages sent to the host.
 void PollHostReporting();
 
+// Queries and sets command echo.
+bool IsEchoActive();
+void SetEchoActive(bool want_echo);
+
+// Queries and sets automatic reporting of I/O line changes.
+bool IsReportingActive();
+void SetReportingActive(bool want_reports);
+
+// Queries and sets event timestamps on change reports ("REP 2").
+// Setting reporting active or inactive turns these off.
+bool IsReportTimestampActive();
+void SetReportTimestampActive(bool want_timestamps);
+
 
 //
 // This is the end of the file.
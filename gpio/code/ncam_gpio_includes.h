@@ -6,18 +6,41 @@
 //
 // Includes
 
+#ifdef NCAM_NATIVE
+
+// Host-native build (see ncam_gpio_native.h).
+#include "ncam_gpio_native.h"
+
+#else
+
 // Firmware includes.
 #include "neuravr.h"
 
 // Standard library includes.
-#include <stdio.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+
+#endif
 
 // Project-specific includes.
 #include "ncam_gpio_config.h"
+#include "ncam_gpio_link.h"
 #include "ncam_gpio_timer.h"
 #include "ncam_gpio_dio.h"
 #include "ncam_gpio_task.h"
+#include "ncam_gpio_stats.h"
+#include "ncam_gpio_frame.h"
+#include "ncam_gpio_quad.h"
+#include "ncam_gpio_freq.h"
+#include "ncam_gpio_wave.h"
+#include "ncam_gpio_adc.h"
+#include "ncam_gpio_capture.h"
+#include "ncam_gpio_selftest.h"
+#include "ncam_gpio_sync.h"
+#include "ncam_gpio_pll.h"
+#include "ncam_gpio_tasklet.h"
 #include "ncam_gpio_host.h"
+#include "ncam_gpio_settings.h"
 
 
 //
@@ -0,0 +1,249 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Host link transport - formatting and line assembly for byte streams.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if HOST_LINK != HOST_LINK_UART
+
+//
+// Private variables
+
+// Input line being assembled. Once a line is complete, further input is
+// left with the transport until the line is released.
+char link_line[HOST_LINE_CHARS + 1];
+uint8_t link_line_length = 0;
+bool link_line_ready = false;
+
+// Set after a CR, so that a following LF doesn't count as a blank line.
+bool link_saw_cr = false;
+
+
+
+//
+// Functions
+
+
+// Initializes the link.
+
+void Link_Init(uint32_t baud)
+{
+  // There's no baud rate to set on USB or on a native stream.
+  (void) baud;
+
+  link_line_length = 0;
+  link_line_ready = false;
+  link_saw_cr = false;
+
+  Link_InitStream();
+}
+
+
+
+// Changes the baud rate of a running link. Byte streams have none.
+
+void Link_SetBaud(uint32_t baud)
+{
+  (void) baud;
+}
+
+
+
+// Queues a string for sending.
+
+void Link_QueueSend(const char *text)
+{
+  while (0 != *text)
+  {
+    Link_PutByte(*text);
+    text++;
+  }
+}
+
+
+
+// Queues a string stored in flash for sending.
+
+void Link_QueueSend_P(const char *text)
+{
+  uint8_t thischar;
+
+  thischar = pgm_read_byte(text);
+  while (0 != thischar)
+  {
+    Link_PutByte(thischar);
+    text++;
+    thischar = pgm_read_byte(text);
+  }
+}
+
+
+
+// Queues one character for sending.
+
+void Link_PrintChar(char thischar)
+{
+  Link_PutByte(thischar);
+}
+
+
+
+// Queues an unsigned decimal value for sending.
+
+void Link_PrintUInt(uint32_t value)
+{
+  char digits[10];
+  int count;
+
+  count = 0;
+  do
+  {
+    digits[count] = '0' + (value % 10);
+    value /= 10;
+    count++;
+  }
+  while (0 < value);
+
+  while (0 < count)
+  {
+    count--;
+    Link_PutByte(digits[count]);
+  }
+}
+
+
+
+// Queues a two-digit hex value for sending.
+
+void Link_PrintHex8(uint8_t value)
+{
+  uint8_t nybble;
+
+  nybble = value >> 4;
+  Link_PutByte( (10 > nybble) ? ('0' + nybble) : ('a' + nybble - 10) );
+  nybble = value & 0x0f;
+  Link_PutByte( (10 > nybble) ? ('0' + nybble) : ('a' + nybble - 10) );
+}
+
+
+
+// Queues raw bytes for sending.
+
+void Link_QueueSendBytes(const uint8_t *data, uint8_t count)
+{
+  uint8_t idx;
+
+  for (idx = 0; idx < count; idx++)
+    Link_PutByte(data[idx]);
+}
+
+
+
+// Waits until everything queued has gone out.
+
+void Link_WaitForSendDone(void)
+{
+  Link_FlushStream();
+}
+
+
+
+// Returns the next complete line from the host, or NULL.
+
+char *Link_GetNextLine(void)
+{
+  uint8_t thischar;
+
+  while ( (!link_line_ready) && Link_GetByte(thischar) )
+  {
+    if ( ('\r' == thischar) || ('\n' == thischar) )
+    {
+      // Treat CR LF as one line end, but still pass blank lines along.
+      if ( ('\n' != thischar) || (!link_saw_cr) || (0 < link_line_length) )
+        link_line_ready = true;
+      link_saw_cr = ('\r' == thischar);
+    }
+    else
+    {
+      link_saw_cr = false;
+
+      // Overlong lines are truncated; the parser will complain about them.
+      if (HOST_LINE_CHARS > link_line_length)
+      {
+        link_line[link_line_length] = thischar;
+        link_line_length++;
+      }
+    }
+  }
+
+  if (!link_line_ready)
+    return NULL;
+
+  link_line[link_line_length] = 0;
+  return link_line;
+}
+
+
+
+// Releases the current line, so that the next one can be assembled.
+
+void Link_DoneWithLine(void)
+{
+  link_line_length = 0;
+  link_line_ready = false;
+}
+
+
+#endif
+
+
+
+// Queues a 64-bit unsigned decimal value for sending.
+// This is shared by all transports.
+
+void Link_PrintUInt64(uint64_t value)
+{
+  uint32_t lower, divisor;
+
+  // Values that fit in 32 bits (the first 49 days of ticks) are printed
+  // without any 64-bit arithmetic.
+  if (0 == (value >> 32))
+  {
+    Link_PrintUInt((uint32_t) value);
+    return;
+  }
+
+  // Otherwise print the upper and lower nine digits separately. The upper
+  // part fits in 32 bits for any tick count we'll see.
+  lower = (uint32_t) (value % 1000000000ull);
+  Link_PrintUInt((uint32_t) (value / 1000000000ull));
+
+  for (divisor = 100000000ul; 0 < divisor; divisor /= 10)
+    Link_PrintChar('0' + ((lower / divisor) % 10));
+}
+
+
+
+// Queues a signed decimal value for sending.
+// This is shared by all transports.
+
+void Link_PrintInt(int32_t value)
+{
+  if (0 > value)
+  {
+    Link_PrintChar('-');
+    // Negate as unsigned, so that INT32_MIN comes out right.
+    Link_PrintUInt(0 - (uint32_t) value);
+  }
+  else
+    Link_PrintUInt(value);
+}
+
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,62 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Host link transport.
+
+
+//
+// Functions
+
+// These mirror the NeurAVR UART calls, so that the protocol code doesn't
+// care which transport it's talking over. HOST_LINK (in the config file)
+// picks the backend.
+
+// Initializes the link. The baud rate is ignored by USB and native links.
+void Link_Init(uint32_t baud);
+
+// Changes the baud rate of a running link, once queued output has gone
+// out. Input arriving during the change may be garbled. This does nothing
+// on USB and native links.
+void Link_SetBaud(uint32_t baud);
+
+// Queues a string for sending. The _P version takes a string in flash.
+void Link_QueueSend(const char *text);
+void Link_QueueSend_P(const char *text);
+
+// Queues formatted values for sending.
+void Link_PrintChar(char thischar);
+void Link_PrintUInt(uint32_t value);
+void Link_PrintUInt64(uint64_t value);
+void Link_PrintInt(int32_t value);
+void Link_PrintHex8(uint8_t value);
+
+// Queues raw bytes for sending. Unlike the calls above, this passes NUL
+// bytes through, so it's what binary records use.
+void Link_QueueSendBytes(const uint8_t *data, uint8_t count);
+
+// Waits until everything queued has gone out (or been given up on).
+void Link_WaitForSendDone(void);
+
+// Returns the next complete line from the host (without newlines), or
+// NULL if there isn't one yet. The line stays valid until
+// Link_DoneWithLine() is called.
+char *Link_GetNextLine(void);
+void Link_DoneWithLine(void);
+
+
+// Byte-stream backends (USB and native) supply these. Formatting and line
+// assembly are shared, in ncam_gpio_link.cpp.
+
+// Brings up the transport.
+void Link_InitStream(void);
+
+// Sends one byte. Returns false if it had to be dropped.
+bool Link_PutByte(uint8_t value);
+
+// Fetches one byte. Returns false if nothing is waiting.
+bool Link_GetByte(uint8_t &value);
+
+// Pushes out any partly-filled packet and waits for it to be sent.
+void Link_FlushStream(void);
+
+
+//
+// This is the end of the file.
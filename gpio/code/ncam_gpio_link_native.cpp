@@ -0,0 +1,102 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Host link transport - host-native backend (stdin/stdout).
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+
+
+#if HOST_LINK == HOST_LINK_NATIVE
+
+//
+// Private variables
+
+// Set once standard input reaches end-of-file.
+bool native_stream_closed = false;
+
+
+
+//
+// Functions
+
+// This lets the protocol code and the shared link code run on the
+// development machine, driven through a pipe or a pseudo-terminal.
+
+
+// Brings up the transport.
+
+void Link_InitStream(void)
+{
+  // Nothing to do; stdio is already open.
+}
+
+
+
+// Sends one byte. Returns false if it had to be dropped.
+
+bool Link_PutByte(uint8_t value)
+{
+  if (EOF == putchar(value))
+    return false;
+
+  // Line ends go out right away, the same as on USB.
+  if ('\n' == value)
+    fflush(stdout);
+
+  return true;
+}
+
+
+
+// Fetches one byte without blocking. Returns false if nothing is waiting.
+
+bool Link_GetByte(uint8_t &value)
+{
+  struct pollfd waiting;
+  ssize_t count;
+
+  waiting.fd = STDIN_FILENO;
+  waiting.events = POLLIN;
+  waiting.revents = 0;
+
+  if ( native_stream_closed || (0 >= poll(&waiting, 1, 0)) )
+    return false;
+
+  count = read(STDIN_FILENO, &value, 1);
+
+  // Readable with nothing to read means the other end has gone away.
+  if (0 == count)
+    native_stream_closed = true;
+
+  return (1 == count);
+}
+
+
+
+// Returns true once the host has closed the link's input.
+
+bool Link_IsStreamClosed(void)
+{
+  return native_stream_closed;
+}
+
+
+
+// Pushes out anything buffered.
+
+void Link_FlushStream(void)
+{
+  fflush(stdout);
+}
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,143 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Host link transport - NeurAVR UART backend.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if HOST_LINK == HOST_LINK_UART
+
+//
+// Private macros
+
+// Time to let the last byte leave the shift register, in ticks. This is
+// more than one character time at the slowest rate "BAU" accepts.
+#define LINK_SHIFT_OUT_TICKS 3
+
+
+
+//
+// Functions
+
+
+// Initializes the link.
+
+void Link_Init(uint32_t baud)
+{
+  UART_Init(CPU_SPEED, baud);
+}
+
+
+
+// Changes the baud rate of a running link.
+// UART_Init() isn't meant for a running port, so this waits for output to
+// finish and reprograms the divisor directly. Double-speed mode gives the
+// least error at 16 MHz for every rate that "BAU" accepts.
+
+void Link_SetBaud(uint32_t baud)
+{
+  uint32_t start_time;
+
+  UART_WaitForSendDone();
+
+  while (0 == (UCSR0A & _BV(UDRE0)))
+    ;
+
+  // There's no reliable "shift register empty" flag without clearing TXC0
+  // before the last byte went out, so just give it time.
+  start_time = Timer_Query();
+  while (!IsTimeReached(Timer_Query(), start_time + LINK_SHIFT_OUT_TICKS))
+    ;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    UCSR0A = _BV(U2X0);
+    UBRR0 = ( (CPU_SPEED + (4 * baud)) / (8 * baud) ) - 1;
+  }
+}
+
+
+
+// Queues strings for sending.
+
+void Link_QueueSend(const char *text)
+{
+  UART_QueueSend(text);
+}
+
+void Link_QueueSend_P(const char *text)
+{
+  UART_QueueSend_P(text);
+}
+
+
+
+// Queues formatted values for sending.
+
+void Link_PrintChar(char thischar)
+{
+  UART_PrintChar(thischar);
+}
+
+void Link_PrintUInt(uint32_t value)
+{
+  UART_PrintUInt(value);
+}
+
+void Link_PrintHex8(uint8_t value)
+{
+  UART_PrintHex8(value);
+}
+
+
+
+// Queues raw bytes for sending.
+// NeurAVR's send queue holds NUL-terminated strings, so it can't carry
+// these. Once it has drained, the bytes are written straight to the UART.
+// This blocks for as long as the bytes take to send.
+
+void Link_QueueSendBytes(const uint8_t *data, uint8_t count)
+{
+  uint8_t idx;
+
+  UART_WaitForSendDone();
+
+  for (idx = 0; idx < count; idx++)
+  {
+    while (0 == (UCSR0A & _BV(UDRE0)))
+      ;
+    UDR0 = data[idx];
+  }
+}
+
+
+
+// Waits until everything queued has gone out.
+
+void Link_WaitForSendDone(void)
+{
+  UART_WaitForSendDone();
+}
+
+
+
+// Line input.
+
+char *Link_GetNextLine(void)
+{
+  return UART_GetNextLine();
+}
+
+void Link_DoneWithLine(void)
+{
+  UART_DoneWithLine();
+}
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,577 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Host link transport - ATmega32U4 native USB (CDC-ACM) backend.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if HOST_LINK == HOST_LINK_USB
+
+//
+// Private macros
+
+// Endpoint layout. The endpoint buffers are allocated in this order.
+// EP0 is control. EP1 is the CDC notification endpoint, which we never
+// send anything on. EP2 and EP3 are the data endpoints, double-buffered.
+#define USB_EP0_SIZE 32
+#define USB_NOTIFY_ENDPOINT 1
+#define USB_NOTIFY_SIZE 16
+#define USB_RX_ENDPOINT 2
+#define USB_TX_ENDPOINT 3
+#define USB_DATA_SIZE 64
+
+// UECFG0X values: endpoint type and direction.
+#define USB_EPTYPE_CONTROL 0x00
+#define USB_EPTYPE_BULK_OUT 0x80
+#define USB_EPTYPE_BULK_IN 0x81
+#define USB_EPTYPE_INT_IN 0xc1
+
+// UECFG1X values: size, banks, and "allocate".
+#define USB_EPCFG_32_SINGLE 0x22
+#define USB_EPCFG_16_SINGLE 0x12
+#define USB_EPCFG_64_DOUBLE 0x36
+
+// UEINTX values that hand a bank to the hardware. These clear FIFOCON and
+// the bank's interrupt flag, and leave everything else alone (in
+// particular, KILLBK on IN endpoints shares a bit with RXOUTI).
+#define USB_RELEASE_IN 0x3a
+#define USB_RELEASE_OUT 0x6b
+
+// Standard requests.
+#define USB_REQ_GET_STATUS 0x00
+#define USB_REQ_SET_ADDRESS 0x05
+#define USB_REQ_GET_DESCRIPTOR 0x06
+#define USB_REQ_GET_CONFIGURATION 0x08
+#define USB_REQ_SET_CONFIGURATION 0x09
+
+// CDC class requests.
+#define USB_CDC_SET_LINE_CODING 0x20
+#define USB_CDC_GET_LINE_CODING 0x21
+#define USB_CDC_SET_CONTROL_LINE_STATE 0x22
+#define USB_CDC_DTR 0x01
+
+// If the host stops reading, give up on a packet after this many frames
+// (milliseconds), and drop output until it starts reading again.
+#define USB_TX_TIMEOUT_FRAMES 50
+
+// The Caterina boot loader looks for this key after a watchdog reset.
+#define BOOTLOADER_KEY_ADDR 0x0800
+#define BOOTLOADER_KEY 0x7777
+
+
+
+//
+// Private types
+
+struct usb_descriptor_t
+{
+  uint16_t value;
+  uint16_t index;
+  const uint8_t *address;
+  uint8_t length;
+};
+
+
+
+//
+// Private constants
+
+const uint8_t usb_device_descriptor[] PROGMEM =
+{
+  18, 1,              // Length, type (device).
+  0x00, 0x02,         // USB 2.0.
+  0x02, 0x00, 0x00,   // Class (communications), subclass, protocol.
+  USB_EP0_SIZE,
+  HOST_USB_VID & 0xff, HOST_USB_VID >> 8,
+  HOST_USB_PID & 0xff, HOST_USB_PID >> 8,
+  0x00, 0x01,         // Device release 1.00.
+  1, 2, 0,            // Manufacturer, product, serial number strings.
+  1                   // Configurations.
+};
+
+#define USB_CONFIG_LENGTH 67
+
+const uint8_t usb_config_descriptor[USB_CONFIG_LENGTH] PROGMEM =
+{
+  // Configuration.
+  9, 2, USB_CONFIG_LENGTH, 0,
+  2, 1, 0,            // Interfaces, this configuration's number, string.
+  0x80, 50,           // Bus powered, 100 mA.
+
+  // Communications interface (ACM).
+  9, 4, 0, 0, 1,      // Interface 0, alternate 0, one endpoint.
+  0x02, 0x02, 0x01, 0,
+
+  // CDC header, call management, ACM, and union functional descriptors.
+  5, 0x24, 0x00, 0x10, 0x01,
+  5, 0x24, 0x01, 0x00, 1,
+  4, 0x24, 0x02, 0x02,  // Line coding and control line state.
+  5, 0x24, 0x06, 0, 1,
+
+  // Notification endpoint (interrupt IN).
+  7, 5, 0x80 | USB_NOTIFY_ENDPOINT, 0x03, USB_NOTIFY_SIZE, 0, 64,
+
+  // Data interface.
+  9, 4, 1, 0, 2,      // Interface 1, alternate 0, two endpoints.
+  0x0a, 0x00, 0x00, 0,
+
+  // Data endpoints (bulk OUT and bulk IN).
+  7, 5, USB_RX_ENDPOINT, 0x02, USB_DATA_SIZE, 0, 0,
+  7, 5, 0x80 | USB_TX_ENDPOINT, 0x02, USB_DATA_SIZE, 0, 0
+};
+
+// String 0 is the list of languages (US English).
+const uint8_t usb_string_languages[] PROGMEM = { 4, 3, 0x09, 0x04 };
+
+const uint8_t usb_string_manufacturer[] PROGMEM =
+{
+  16, 3,
+  'A', 0, 'C', 0, 'C', 0, ' ', 0, 'L', 0, 'a', 0, 'b', 0
+};
+
+const uint8_t usb_string_product[] PROGMEM =
+{
+  28, 3,
+  'N', 0, 'e', 0, 'u', 0, 'r', 0, 'o', 0, 'C', 0, 'a', 0, 'm', 0,
+  ' ', 0, 'G', 0, 'P', 0, 'I', 0, 'O', 0
+};
+
+#define USB_DESCRIPTOR_COUNT 5
+
+const usb_descriptor_t usb_descriptors[USB_DESCRIPTOR_COUNT] PROGMEM =
+{
+  { 0x0100, 0x0000, usb_device_descriptor, sizeof(usb_device_descriptor) },
+  { 0x0200, 0x0000, usb_config_descriptor, sizeof(usb_config_descriptor) },
+  { 0x0300, 0x0000, usb_string_languages, sizeof(usb_string_languages) },
+  { 0x0301, 0x0409, usb_string_manufacturer,
+    sizeof(usb_string_manufacturer) },
+  { 0x0302, 0x0409, usb_string_product, sizeof(usb_string_product) }
+};
+
+
+
+//
+// Private variables
+
+// Nonzero once the host has picked our configuration.
+volatile uint8_t usb_configuration = 0;
+
+// Set when a packet timed out, so that we don't stall on every byte.
+volatile bool usb_tx_timed_out = false;
+
+// Line coding as last set by the host: rate (32 bits), stop bits, parity,
+// and data bits. None of this means anything to us, except as a signal to
+// reset into the boot loader.
+uint8_t usb_line_coding[7] = { 0x00, 0xc2, 0x01, 0x00, 0, 0, 8 };
+
+
+
+//
+// Private prototypes
+
+// Answers a control request on endpoint 0. Returns false to stall.
+bool HandleSetupRequest_ISR(uint8_t request_type, uint8_t request,
+  uint16_t value, uint16_t index, uint16_t length);
+
+// Sends a descriptor from flash on endpoint 0. Returns false to stall.
+bool SendDescriptor_ISR(uint16_t value, uint16_t index, uint16_t length);
+
+// Sets up endpoint 0 (after a bus reset).
+void ConfigControlEndpoint_ISR(void);
+
+// Sets up the CDC endpoints (after the host picks a configuration).
+void ConfigDataEndpoints_ISR(void);
+
+
+
+//
+// Functions
+
+
+// Brings up the USB controller and attaches to the bus.
+
+void Link_InitStream(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    usb_configuration = 0;
+    usb_tx_timed_out = false;
+
+    // Pad regulator on, controller on with its clock frozen.
+    UHWCON = _BV(UVREGE);
+    USBCON = _BV(USBE) | _BV(FRZCLK);
+
+    // The PLL wants 8 MHz in; the crystal is 16 MHz.
+    PLLCSR = _BV(PINDIV) | _BV(PLLE);
+    while (0 == (PLLCSR & _BV(PLOCK)))
+      ;
+
+    // Unfreeze the clock, enable the VBUS pad, and attach.
+    USBCON = _BV(USBE) | _BV(OTGPADE);
+    UDCON = 0;
+
+    UDIEN = _BV(EORSTE);
+  }
+}
+
+
+
+// Sends one byte. Returns false if it had to be dropped.
+
+bool Link_PutByte(uint8_t value)
+{
+  uint8_t start_frame;
+  bool result, done;
+
+  result = false;
+  done = false;
+  start_frame = UDFNUML;
+
+  // Wait for a free bank with interrupts on, so that the timer and the
+  // USB interrupts keep running. The endpoint has to be re-selected each
+  // time, as the USB interrupts change UENUM.
+  while (!done)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      UENUM = USB_TX_ENDPOINT;
+
+      if (0 == usb_configuration)
+        done = true;
+      else if (0 != (UEINTX & _BV(RWAL)))
+      {
+        UEDATX = value;
+
+        // Send full packets right away, and send line ends right away too.
+        // Report lines are what the host is waiting on, and holding them
+        // for more data would just add latency.
+        if ( (0 == (UEINTX & _BV(RWAL))) || ('\n' == value) )
+          UEINTX = USB_RELEASE_IN;
+
+        usb_tx_timed_out = false;
+        result = true;
+        done = true;
+      }
+      else if (usb_tx_timed_out)
+      {
+        // The host stopped reading. Drop output until there's room.
+        done = true;
+      }
+      else if (USB_TX_TIMEOUT_FRAMES <= (uint8_t) (UDFNUML - start_frame))
+      {
+        usb_tx_timed_out = true;
+        done = true;
+      }
+    }
+  }
+
+  return result;
+}
+
+
+
+// Fetches one byte. Returns false if nothing is waiting.
+
+bool Link_GetByte(uint8_t &value)
+{
+  bool result;
+
+  result = false;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (0 != usb_configuration)
+    {
+      UENUM = USB_RX_ENDPOINT;
+
+      // Release empty banks (zero-length packets) until there's data.
+      while ( (0 == (UEINTX & _BV(RWAL))) && (0 != (UEINTX & _BV(RXOUTI))) )
+        UEINTX = USB_RELEASE_OUT;
+
+      if (0 != (UEINTX & _BV(RWAL)))
+      {
+        value = UEDATX;
+        result = true;
+
+        // Hand the bank back once it's empty.
+        if (0 == (UEINTX & _BV(RWAL)))
+          UEINTX = USB_RELEASE_OUT;
+      }
+    }
+  }
+
+  return result;
+}
+
+
+
+// Pushes out any partly-filled packet and waits for it to be sent.
+
+void Link_FlushStream(void)
+{
+  uint8_t start_frame;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (0 != usb_configuration)
+    {
+      UENUM = USB_TX_ENDPOINT;
+      if (0 != UEBCLX)
+        UEINTX = USB_RELEASE_IN;
+
+      // Wait until no banks are busy.
+      start_frame = UDFNUML;
+      while ( (0 != (UESTA0X & (_BV(NBUSYBK1) | _BV(NBUSYBK0))))
+        && (USB_TX_TIMEOUT_FRAMES > (uint8_t) (UDFNUML - start_frame)) )
+        ;
+    }
+  }
+}
+
+
+
+// Sets up endpoint 0 (after a bus reset).
+
+void ConfigControlEndpoint_ISR(void)
+{
+  UENUM = 0;
+  UECONX = _BV(EPEN);
+  UECFG0X = USB_EPTYPE_CONTROL;
+  UECFG1X = USB_EPCFG_32_SINGLE;
+  UEIENX = _BV(RXSTPE);
+}
+
+
+
+// Sets up the CDC endpoints (after the host picks a configuration).
+
+void ConfigDataEndpoints_ISR(void)
+{
+  UENUM = USB_NOTIFY_ENDPOINT;
+  UECONX = _BV(EPEN);
+  UECFG0X = USB_EPTYPE_INT_IN;
+  UECFG1X = USB_EPCFG_16_SINGLE;
+
+  UENUM = USB_RX_ENDPOINT;
+  UECONX = _BV(EPEN);
+  UECFG0X = USB_EPTYPE_BULK_OUT;
+  UECFG1X = USB_EPCFG_64_DOUBLE;
+
+  UENUM = USB_TX_ENDPOINT;
+  UECONX = _BV(EPEN);
+  UECFG0X = USB_EPTYPE_BULK_IN;
+  UECFG1X = USB_EPCFG_64_DOUBLE;
+
+  // Reset the data endpoints' FIFOs.
+  UERST = _BV(USB_NOTIFY_ENDPOINT) | _BV(USB_RX_ENDPOINT)
+    | _BV(USB_TX_ENDPOINT);
+  UERST = 0;
+}
+
+
+
+// Sends a descriptor from flash on endpoint 0. Returns false to stall.
+
+bool SendDescriptor_ISR(uint16_t value, uint16_t index, uint16_t length)
+{
+  const uint8_t *address;
+  uint8_t idx, packet, intbits;
+  bool found;
+
+  found = false;
+  address = NULL;
+
+  for (idx = 0; idx < USB_DESCRIPTOR_COUNT; idx++)
+    if ( (value == pgm_read_word(&(usb_descriptors[idx].value)))
+      && (index == pgm_read_word(&(usb_descriptors[idx].index))) )
+    {
+      found = true;
+      address = (const uint8_t *)
+        pgm_read_word(&(usb_descriptors[idx].address));
+      if (length > pgm_read_byte(&(usb_descriptors[idx].length)))
+        length = pgm_read_byte(&(usb_descriptors[idx].length));
+    }
+
+  if (!found)
+    return false;
+
+  // Send in EP0-sized pieces. A full last packet needs a zero-length
+  // packet after it, to show that it was the last one.
+  do
+  {
+    // Wait for the bank, or for the host to cut us off.
+    do
+    {
+      intbits = UEINTX;
+    }
+    while (0 == (intbits & (_BV(TXINI) | _BV(RXOUTI))));
+
+    if (0 != (intbits & _BV(RXOUTI)))
+      return true;
+
+    packet = (USB_EP0_SIZE < length) ? USB_EP0_SIZE : length;
+    length -= packet;
+
+    for (idx = 0; idx < packet; idx++)
+    {
+      UEDATX = pgm_read_byte(address);
+      address++;
+    }
+
+    UEINTX = ~_BV(TXINI);
+  }
+  while ( (0 < length) || (USB_EP0_SIZE == packet) );
+
+  return true;
+}
+
+
+
+// Answers a control request on endpoint 0. Returns false to stall.
+
+bool HandleSetupRequest_ISR(uint8_t request_type, uint8_t request,
+  uint16_t value, uint16_t index, uint16_t length)
+{
+  uint8_t idx;
+
+  if (USB_REQ_GET_DESCRIPTOR == request)
+    return SendDescriptor_ISR(value, index, length);
+
+  if (USB_REQ_SET_ADDRESS == request)
+  {
+    // The new address only takes effect after the status stage.
+    UEINTX = ~_BV(TXINI);
+    while (0 == (UEINTX & _BV(TXINI)))
+      ;
+    UDADDR = (value & 0x7f) | _BV(ADDEN);
+    return true;
+  }
+
+  if ( (USB_REQ_SET_CONFIGURATION == request) && (0x00 == request_type) )
+  {
+    usb_configuration = value;
+    usb_tx_timed_out = false;
+    UEINTX = ~_BV(TXINI);
+    ConfigDataEndpoints_ISR();
+    return true;
+  }
+
+  if ( (USB_REQ_GET_CONFIGURATION == request) && (0x80 == request_type) )
+  {
+    while (0 == (UEINTX & _BV(TXINI)))
+      ;
+    UEDATX = usb_configuration;
+    UEINTX = ~_BV(TXINI);
+    return true;
+  }
+
+  if (USB_REQ_GET_STATUS == request)
+  {
+    // Not self-powered, no remote wakeup, and no halted endpoints.
+    while (0 == (UEINTX & _BV(TXINI)))
+      ;
+    UEDATX = 0;
+    UEDATX = 0;
+    UEINTX = ~_BV(TXINI);
+    return true;
+  }
+
+  if ( (USB_CDC_GET_LINE_CODING == request) && (0xa1 == request_type) )
+  {
+    while (0 == (UEINTX & _BV(TXINI)))
+      ;
+    for (idx = 0; idx < sizeof(usb_line_coding); idx++)
+      UEDATX = usb_line_coding[idx];
+    UEINTX = ~_BV(TXINI);
+    return true;
+  }
+
+  if ( (USB_CDC_SET_LINE_CODING == request) && (0x21 == request_type) )
+  {
+    while (0 == (UEINTX & _BV(RXOUTI)))
+      ;
+    for (idx = 0; idx < sizeof(usb_line_coding); idx++)
+      usb_line_coding[idx] = UEDATX;
+    UEINTX = ~_BV(RXOUTI);
+    UEINTX = ~_BV(TXINI);
+    return true;
+  }
+
+  if ( (USB_CDC_SET_CONTROL_LINE_STATE == request) && (0x21 == request_type) )
+  {
+    UEINTX = ~_BV(TXINI);
+
+#if HOST_USB_BOOTLOADER_TOUCH
+    // Dropping DTR at 1200 baud means "reset into the boot loader".
+    if ( (0 == (value & USB_CDC_DTR))
+      && (0xb0 == usb_line_coding[0]) && (0x04 == usb_line_coding[1])
+      && (0x00 == usb_line_coding[2]) && (0x00 == usb_line_coding[3]) )
+    {
+      *((volatile uint16_t *) BOOTLOADER_KEY_ADDR) = BOOTLOADER_KEY;
+      wdt_enable(WDTO_120MS);
+    }
+#endif
+
+    return true;
+  }
+
+  return false;
+}
+
+
+
+// USB device-level interrupts (bus reset).
+
+ISR(USB_GEN_vect)
+{
+  uint8_t intbits;
+
+  intbits = UDINT;
+  UDINT = 0;
+
+  if (0 != (intbits & _BV(EORSTI)))
+  {
+    ConfigControlEndpoint_ISR();
+    usb_configuration = 0;
+  }
+}
+
+
+
+// USB endpoint interrupts (control requests on endpoint 0).
+
+ISR(USB_COM_vect)
+{
+  uint8_t request_type, request;
+  uint16_t value, index, length;
+
+  UENUM = 0;
+
+  if (0 != (UEINTX & _BV(RXSTPI)))
+  {
+    request_type = UEDATX;
+    request = UEDATX;
+    value = UEDATX;
+    value |= ((uint16_t) UEDATX) << 8;
+    index = UEDATX;
+    index |= ((uint16_t) UEDATX) << 8;
+    length = UEDATX;
+    length |= ((uint16_t) UEDATX) << 8;
+
+    UEINTX = ~(_BV(RXSTPI) | _BV(RXOUTI) | _BV(TXINI));
+
+    if (HandleSetupRequest_ISR(request_type, request, value, index, length))
+      return;
+  }
+
+  UECONX = _BV(STALLRQ) | _BV(EPEN);
+}
+
+
+#endif
+
+//
+// This is the end of the file.
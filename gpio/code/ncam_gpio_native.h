@@ -0,0 +1,83 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Host-native build shim.
+
+
+//
+// Includes
+
+// This stands in for the NeurAVR and avr-libc headers when building the
+// firmware for the development machine (with NCAM_NATIVE defined). The
+// protocol code, task, timebase, and saved settings are built as-is;
+// digital I/O, the tick timer, and EEPROM are simulated (see
+// ncam_gpio_native_avr.cpp and ncam_gpio_native_dio.cpp).
+
+// Standard library includes.
+#include <stdint.h>
+#include <stddef.h>
+
+
+//
+// Macros
+
+// Strings and tables stay in RAM on the host.
+#define PROGMEM
+#define PSTR(text) (text)
+#define pgm_read_byte(address) (*((const uint8_t *) (address)))
+#define pgm_read_dword(address) (*((const uint32_t *) (address)))
+
+// The simulated device is single-threaded, and the "timer interrupt" only
+// runs between main loop passes, so atomic blocks just run once.
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_BLOCK(type) \
+  for (int native_atomic_once = 1; native_atomic_once; \
+    native_atomic_once = 0)
+
+// There are no AVR registers on the host. These read as zero.
+#define _SFR_MEM8(address) (native_registers[(address) & 0xff])
+
+
+//
+// Variables
+
+extern volatile uint8_t native_registers[256];
+
+
+//
+// Functions
+
+// NeurAVR stand-ins.
+
+void MCU_Init(void);
+
+// Ticks are counted by NativeAdvanceTime(), not by a hardware timer.
+void Timer_Init(uint32_t cpu_speed, uint32_t ticks_per_second);
+void Timer_RegisterCallback(void (*callback)(void));
+uint32_t Timer_Query(void);
+uint32_t Timer_Query_ISR(void);
+void Timer_Reset(void);
+
+// avr-libc stand-ins. EEPROM is kept in memory, and starts out erased.
+void eeprom_read_block(void *dest, const void *src, size_t count);
+void eeprom_update_block(const void *src, void *dest, size_t count);
+
+
+// Simulation hooks, for the native driver.
+
+// Runs the timer callback once for each tick that has elapsed on the host
+// clock since the last call.
+void NativeAdvanceTime(void);
+
+// Sets the simulated input lines. Changes are handled as the pin-change
+// interrupt would handle them.
+void NativeSetInputs(uint32_t bits);
+
+// Copies output bit 0 to an input bit (0..7) whenever outputs change, as
+// if the two were wired together. -1 disconnects it.
+void NativeSetLoopback(int input_bit);
+
+// Returns true once the host has closed the link's input.
+bool Link_IsStreamClosed(void);
+
+
+//
+// This is the end of the file.
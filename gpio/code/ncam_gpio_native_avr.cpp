@@ -0,0 +1,191 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Host-native build - NeurAVR and avr-libc stand-ins.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+#include <string.h>
+#include <time.h>
+
+
+#ifdef NCAM_NATIVE
+
+//
+// Private macros
+
+// Same size as the ATmega328P's EEPROM.
+#define NATIVE_EEPROM_BYTES 1024
+
+
+
+//
+// Private variables
+
+volatile uint8_t native_registers[256];
+
+// Tick timer. Ticks follow the host's monotonic clock.
+volatile uint32_t native_ticks = 0;
+uint64_t native_tick_ns = 1000000000ull / RTC_TICKS_PER_SECOND;
+uint64_t native_next_tick_ns = 0;
+void (*native_timer_callback)(void) = NULL;
+
+// Simulated EEPROM, erased (all ones) until first written.
+uint8_t native_eeprom[NATIVE_EEPROM_BYTES];
+bool native_eeprom_ready = false;
+
+
+
+//
+// Private prototypes
+
+// Returns the host's monotonic clock in nanoseconds.
+uint64_t GetNativeTimeNs(void);
+
+// Erases the simulated EEPROM on first use.
+void PrepareNativeEEPROM(void);
+
+
+
+//
+// Functions
+
+
+// Returns the host's monotonic clock in nanoseconds.
+
+uint64_t GetNativeTimeNs(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (((uint64_t) now.tv_sec) * 1000000000ull) + now.tv_nsec;
+}
+
+
+
+// Erases the simulated EEPROM on first use.
+
+void PrepareNativeEEPROM(void)
+{
+  if (!native_eeprom_ready)
+  {
+    memset(native_eeprom, 0xff, sizeof(native_eeprom));
+    native_eeprom_ready = true;
+  }
+}
+
+
+
+// Initializes the (nonexistent) microcontroller peripherals.
+
+void MCU_Init(void)
+{
+  memset((void *) native_registers, 0, sizeof(native_registers));
+}
+
+
+
+// Starts the tick timer.
+
+void Timer_Init(uint32_t cpu_speed, uint32_t ticks_per_second)
+{
+  (void) cpu_speed;
+
+  native_tick_ns = 1000000000ull / ticks_per_second;
+  native_ticks = 0;
+  native_next_tick_ns = GetNativeTimeNs() + native_tick_ns;
+}
+
+
+
+// Sets the function called on every tick.
+
+void Timer_RegisterCallback(void (*callback)(void))
+{
+  native_timer_callback = callback;
+}
+
+
+
+// Returns the tick count.
+
+uint32_t Timer_Query(void)
+{
+  return native_ticks;
+}
+
+uint32_t Timer_Query_ISR(void)
+{
+  return native_ticks;
+}
+
+
+
+// Resets the tick count.
+
+void Timer_Reset(void)
+{
+  native_ticks = 0;
+}
+
+
+
+// Runs the timer callback once for each tick that has elapsed on the host
+// clock since the last call.
+
+void NativeAdvanceTime(void)
+{
+  uint64_t now;
+
+  now = GetNativeTimeNs();
+
+  while (now >= native_next_tick_ns)
+  {
+    native_ticks++;
+    native_next_tick_ns += native_tick_ns;
+
+    if (NULL != native_timer_callback)
+      (*native_timer_callback)();
+  }
+}
+
+
+
+// Reads from the simulated EEPROM.
+
+void eeprom_read_block(void *dest, const void *src, size_t count)
+{
+  size_t addr;
+
+  PrepareNativeEEPROM();
+
+  addr = (size_t) src;
+  if ( (NATIVE_EEPROM_BYTES < addr) || (NATIVE_EEPROM_BYTES - addr < count) )
+    memset(dest, 0xff, count);
+  else
+    memcpy(dest, native_eeprom + addr, count);
+}
+
+
+
+// Writes to the simulated EEPROM. Out-of-range writes are dropped.
+
+void eeprom_update_block(const void *src, void *dest, size_t count)
+{
+  size_t addr;
+
+  PrepareNativeEEPROM();
+
+  addr = (size_t) dest;
+  if ( (NATIVE_EEPROM_BYTES >= addr) && (NATIVE_EEPROM_BYTES - addr >= count) )
+    memcpy(native_eeprom + addr, src, count);
+}
+
+
+#endif
+
+//
+// This is the end of the file.
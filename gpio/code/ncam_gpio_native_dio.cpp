@@ -0,0 +1,264 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Host-native build - simulated digital I/O.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#ifdef NCAM_NATIVE
+
+//
+// Private macros
+
+// The same line counts as the hardware (see ncam_gpio_dio.cpp).
+#define NATIVE_INPUT_MASK 0xff
+#define NATIVE_OUTPUT_MASK 0x01
+
+
+
+//
+// Private variables
+
+bool using_pullups = false;
+
+// Simulated line states.
+uint32_t native_input_bits = 0;
+uint32_t native_output_bits = 0;
+
+// Input bit that output bit 0 is wired to, or -1.
+int native_loopback_bit = -1;
+
+// Last-seen input state, for edge detection.
+uint32_t prev_input_bits = 0;
+
+// Inputs left out of change detection.
+uint32_t unwatched_inputs = 0;
+
+// Event timestamps of the most recent input and output changes.
+uint64_t input_change_time = 0;
+uint64_t output_change_time = 0;
+
+
+
+//
+// Private prototypes
+
+// Handles input changes, as the pin-change interrupt does on hardware.
+// This must be called with interrupts off.
+void HandleInputChange_ISR(void);
+
+
+
+//
+// Functions
+
+
+// Configures digital I/O pins.
+// Floating inputs with pull-ups read high, as they would on hardware.
+
+void ConfigPins(bool want_pullups)
+{
+  using_pullups = want_pullups;
+  native_output_bits = 0;
+
+  if (want_pullups)
+    native_input_bits = NATIVE_INPUT_MASK;
+
+  // Outputs start low, so a looped-back input does too.
+  if (0 <= native_loopback_bit)
+    native_input_bits &= ~(1ul << native_loopback_bit);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    prev_input_bits = GetDIOBits(DIO_REG_INPUT);
+  }
+}
+
+
+
+// Stops watching some inputs for changes.
+
+void SetUnwatchedInputs(uint32_t input_mask)
+{
+  unwatched_inputs = input_mask;
+}
+
+
+
+// Queries whether or not pull-ups are enabled.
+
+bool QueryPinPullups(void)
+{
+  return using_pullups;
+}
+
+
+
+// Queries the current state of digital I/Os.
+
+uint32_t GetDIOBits(reg_id_t target)
+{
+  if (DIO_REG_INPUT == target)
+    return native_input_bits & NATIVE_INPUT_MASK;
+  if (DIO_REG_OUTPUT == target)
+    return native_output_bits & NATIVE_OUTPUT_MASK;
+
+  return 0;
+}
+
+
+
+// Sets the state of output bits.
+// Returns the resulting state.
+
+uint32_t SetDIOBits(reg_id_t target, uint32_t value)
+{
+  uint32_t old_bits, new_bits;
+
+  if (DIO_REG_OUTPUT == target)
+  {
+    old_bits = GetDIOBits(DIO_REG_OUTPUT);
+
+    // FIXME - Cheat. There's only one output pin, as on hardware.
+    native_output_bits = (0 != value) ? NATIVE_OUTPUT_MASK : 0;
+
+    new_bits = GetDIOBits(DIO_REG_OUTPUT);
+    if (new_bits != old_bits)
+    {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        output_change_time = GetEventTime64_ISR();
+#if STATS_ENABLE
+        NoteLineEdges_ISR(DIO_REG_OUTPUT, old_bits ^ new_bits, new_bits,
+          Timer_Query_ISR());
+#endif
+      }
+
+      if (0 <= native_loopback_bit)
+      {
+        if (0 != new_bits)
+          NativeSetInputs(native_input_bits | (1ul << native_loopback_bit));
+        else
+          NativeSetInputs(native_input_bits & ~(1ul << native_loopback_bit));
+      }
+    }
+  }
+
+  return GetDIOBits(target);
+}
+
+
+
+// Handles input changes, as the pin-change interrupt does on hardware.
+// This must be called with interrupts off.
+
+void HandleInputChange_ISR(void)
+{
+  uint32_t new_bits, changed, hidden;
+  uint64_t event_time;
+#if STATS_ENABLE || WAVE_ENABLE
+  uint32_t this_time;
+#endif
+
+  new_bits = GetDIOBits(DIO_REG_INPUT);
+  changed = (new_bits ^ prev_input_bits) & ~unwatched_inputs;
+
+  if (0 != changed)
+  {
+    prev_input_bits = new_bits;
+#if STATS_ENABLE || WAVE_ENABLE
+    this_time = Timer_Query_ISR();
+#endif
+
+    event_time = GetEventTime64_ISR();
+
+    // Only changes that I/O reports show move their timestamp.
+    hidden = GetFrameLineMask() | GetQuadLineMask() | GetFreqLineMask();
+    if (0 != (changed & ~hidden))
+      input_change_time = event_time;
+
+#if STATS_ENABLE
+    NoteLineEdges_ISR(DIO_REG_INPUT, changed, new_bits, this_time);
+#endif
+#if WAVE_ENABLE
+    NoteWaveInputEdges_ISR(changed, new_bits, this_time);
+#endif
+#if PLL_ENABLE
+    NotePLLInputEdges_ISR(changed, new_bits);
+#endif
+#if FRAME_ENABLE
+    NoteFrameEdges_ISR(changed, new_bits, (uint32_t) event_time);
+#endif
+#if QUAD_ENABLE
+    NoteQuadEdges_ISR(changed, new_bits);
+#endif
+  }
+}
+
+
+
+// Sets the simulated input lines.
+
+void NativeSetInputs(uint32_t bits)
+{
+  native_input_bits = bits & NATIVE_INPUT_MASK;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    HandleInputChange_ISR();
+  }
+}
+
+
+
+// Copies output bit 0 to an input bit whenever outputs change.
+
+void NativeSetLoopback(int input_bit)
+{
+  native_loopback_bit = ( (0 <= input_bit) && (8 > input_bit) )
+    ? input_bit : -1;
+}
+
+
+
+// Returns the event timestamp of the most recent change to a bank.
+
+uint64_t GetDIOChangeTime(reg_id_t target)
+{
+  uint64_t result;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (DIO_REG_INPUT == target)
+      result = input_change_time;
+    else if (DIO_REG_OUTPUT == target)
+      result = output_change_time;
+    else
+      result = GetEventTime64_ISR();
+  }
+
+  return result;
+}
+
+
+
+// Returns the number of digital I/O pins of a given class.
+
+int GetDIOCount(reg_id_t target)
+{
+  if (DIO_REG_INPUT == target)
+    return 8;
+  if (DIO_REG_OUTPUT == target)
+    return 1;
+
+  return 0;
+}
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,220 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Host-native build - driver program.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+
+#ifdef NCAM_NATIVE
+
+//
+// Private macros
+
+// Longest line taken from the input line descriptor.
+#define NATIVE_INPUT_LINE_CHARS 64
+
+
+
+//
+// Private prototypes
+
+// Prints a help screen.
+void PrintNativeHelp(void);
+
+// Sets up the simulated device, as DoSetup() does on hardware.
+void DoNativeSetup(void);
+
+// Applies the next input line state waiting on a descriptor. Each line is
+// a hex value for the input register. Returns false at end-of-file.
+bool ReadNativeInputs(int fd, char *buffer, size_t &length);
+
+// Returns true if a whole input line is already buffered.
+bool HaveNativeInputLine(const char *buffer, size_t length);
+
+
+
+//
+// Functions
+
+
+// Prints a help screen.
+
+void PrintNativeHelp(void)
+{
+  fprintf(stderr,
+"Runs the GPIO firmware on this machine, talking over stdin and stdout.\n"
+"Digital I/O, the tick timer, and EEPROM are simulated; everything else is\n"
+"the firmware's own code. It exits when stdin is closed.\n"
+"\n"
+"Usage:  ncam_gpio_native [options]\n"
+"\n"
+"Options:\n"
+"  --loopback=<bit>   Wire output bit 0 to this input bit (0..7).\n"
+"  --input-fd=<fd>    Read input register values (hex, one per line) from\n"
+"                     this descriptor, as if the lines had changed.\n"
+"\n");
+}
+
+
+
+// Sets up the simulated device, as DoSetup() does on hardware.
+
+void DoNativeSetup(void)
+{
+  MCU_Init();
+
+  ResetLineStats();
+  ConfigPins(FOB_DEFAULT_PULLUPS);
+
+  Timer_Init(CPU_SPEED, RTC_TICKS_PER_SECOND);
+
+  ConfigureTask(FOB_DEFAULT_STROBE_PERIOD, FOB_DEFAULT_STROBE_HOLD);
+  SetTaskActivity(TASK_AUTOSTART);
+
+#if TASKLET_ENABLE
+  InitTasklets();
+#endif
+
+  Timer_RegisterCallback(&TimerCallback_ISR);
+
+  InitHostLink();
+
+  LoadSettings();
+}
+
+
+
+// Applies the next input line state waiting on a descriptor.
+// Only one state is applied per main loop pass, so that the report loop
+// sees each one, as it would see pin changes spaced out in time.
+
+bool ReadNativeInputs(int fd, char *buffer, size_t &length)
+{
+  ssize_t count;
+  char *newline;
+
+  if (!HaveNativeInputLine(buffer, length))
+  {
+    count = read(fd, buffer + length, NATIVE_INPUT_LINE_CHARS - length);
+    if (0 == count)
+      return false;
+    if (0 > count)
+      return true;
+
+    length += count;
+  }
+
+  newline = (char *) memchr(buffer, '\n', length);
+  if (NULL != newline)
+  {
+    *newline = 0;
+    NativeSetInputs(strtoul(buffer, NULL, 16));
+
+    length -= (newline + 1 - buffer);
+    memmove(buffer, newline + 1, length);
+  }
+
+  // A line this long isn't a register value.
+  if (NATIVE_INPUT_LINE_CHARS <= length)
+    length = 0;
+
+  return true;
+}
+
+
+
+// Returns true if a whole input line is already buffered.
+
+bool HaveNativeInputLine(const char *buffer, size_t length)
+{
+  return (NULL != memchr(buffer, '\n', length));
+}
+
+
+
+// Main program.
+
+int main(int argc, char **argv)
+{
+  char input_line[NATIVE_INPUT_LINE_CHARS];
+  size_t input_length;
+  struct pollfd waiting[2];
+  int input_fd, aidx;
+  bool is_pending;
+
+  input_fd = -1;
+  input_length = 0;
+
+  for (aidx = 1; aidx < argc; aidx++)
+  {
+    if (0 == strncmp(argv[aidx], "--loopback=", 11))
+      NativeSetLoopback(atoi(argv[aidx] + 11));
+    else if (0 == strncmp(argv[aidx], "--input-fd=", 11))
+      input_fd = atoi(argv[aidx] + 11);
+    else
+    {
+      PrintNativeHelp();
+      return 1;
+    }
+  }
+
+  if (0 <= input_fd)
+    fcntl(input_fd, F_SETFL, fcntl(input_fd, F_GETFL) | O_NONBLOCK);
+
+  DoNativeSetup();
+
+  while (!Link_IsStreamClosed())
+  {
+    NativeAdvanceTime();
+
+    PollHostInput();
+#if TASKLET_ENABLE
+    PollTasklets();
+#else
+#if SYNC_ENABLE
+    PollSync();
+#endif
+#if PLL_ENABLE
+    PollPLL();
+#endif
+#endif
+    PollHostReporting();
+
+    // Sleep until there's input or the next tick is due, rather than
+    // spinning. Buffered input states don't wait.
+    is_pending = (0 <= input_fd)
+      && HaveNativeInputLine(input_line, input_length);
+
+    waiting[0].fd = STDIN_FILENO;
+    waiting[0].events = POLLIN;
+    waiting[1].fd = input_fd;
+    waiting[1].events = POLLIN;
+    waiting[1].revents = 0;
+    poll(waiting, (0 <= input_fd) ? 2 : 1, is_pending ? 0 : 1);
+
+    if ( (0 <= input_fd)
+      && ( is_pending || (0 != (waiting[1].revents & (POLLIN | POLLHUP))) )
+      && (!ReadNativeInputs(input_fd, input_line, input_length)) )
+      input_fd = -1;
+  }
+
+  Link_WaitForSendDone();
+
+  return 0;
+}
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,390 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Strobe phase-locked to an external reference clock.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if PLL_ENABLE
+
+//
+// Private macros
+
+// FIXME - Hardwired to match GetDIOCount().
+#define PLL_INPUT_LINES 8
+
+// Capture timer cycles per tick.
+#define PLL_CYCLES_PER_TICK (CPU_SPEED / RTC_TICKS_PER_SECOND)
+
+// The fine strobe period is 16.16 fixed-point ticks.
+#define PLL_MAX_STROBE_PERIOD 0xffff
+
+// Holdover detection has to fit in a signed 32-bit cycle count.
+#define PLL_MAX_REF_PERIOD 30000
+
+// The reference period estimate moves 1/8 of the way to each new interval.
+#define PLL_REF_FILTER_SHIFT 3
+
+// Each strobe cycle removes 1/8 of the phase error. Strobe edges are
+// quantized to ticks, so a faster loop would just chase quantization noise.
+#define PLL_PHASE_GAIN_SHIFT 3
+
+// References that stop for this many periods put us in holdover.
+#define PLL_HOLDOVER_PERIODS 4
+
+// Consecutive in-tolerance strobe edges needed to declare lock.
+#define PLL_LOCK_COUNT 4
+
+// Number of reference edges waiting for the main loop.
+#define PLL_REF_QUEUE_SIZE 4
+
+
+
+//
+// Private variables
+
+bool pll_enabled = false;
+pll_state_t pll_state = PLL_STATE_OFF;
+uint8_t pll_ref_bit = 0;
+uint32_t pll_ref_mask = 0;
+uint32_t pll_ref_period = PLL_DEFAULT_REF_PERIOD;
+
+// Reference edges from the pin-change handler, in capture timer cycles.
+uint32_t pll_ref_queue[PLL_REF_QUEUE_SIZE];
+volatile uint8_t pll_ref_head = 0;
+volatile uint8_t pll_ref_count = 0;
+
+// Most recent strobe turn-on time, in capture timer cycles.
+volatile bool pll_strobe_pending = false;
+uint32_t pll_strobe_time = 0;
+
+// Reference period estimate, in cycles.
+bool pll_have_ref = false;
+uint32_t pll_last_ref = 0;
+bool pll_have_estimate = false;
+uint32_t pll_ref_estimate = 0;
+
+int32_t pll_freq_ppb = 0;
+int32_t pll_phase_error = 0;
+uint8_t pll_lock_count = 0;
+
+
+
+//
+// Private prototypes
+
+// Updates the reference period estimate with one edge.
+void HandlePLLReference(uint32_t ref_time);
+
+// Updates the strobe period after a strobe edge.
+void HandlePLLStrobe(uint32_t strobe_time);
+
+
+
+//
+// Functions
+
+
+// Locks the strobe to rising edges on the given input bit.
+// The strobe period should be a multiple of the reference period, or only
+// frequency will lock.
+// Returns false if the bit doesn't exist.
+
+bool EnablePLL(uint32_t bitnum)
+{
+  if (PLL_INPUT_LINES <= bitnum)
+    return false;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    pll_ref_bit = bitnum;
+    pll_ref_mask = 1ul << bitnum;
+    pll_ref_head = 0;
+    pll_ref_count = 0;
+    pll_strobe_pending = false;
+    pll_enabled = true;
+  }
+
+  pll_state = PLL_STATE_WAITING;
+  pll_have_ref = false;
+  pll_have_estimate = false;
+  pll_freq_ppb = 0;
+  pll_phase_error = 0;
+  pll_lock_count = 0;
+
+  return true;
+}
+
+
+
+// Returns the strobe to free-running on the local crystal.
+
+void DisablePLL(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    pll_enabled = false;
+  }
+
+  pll_state = PLL_STATE_OFF;
+  SetTaskFinePeriod(0);
+}
+
+
+
+// Sets the nominal reference period, in ticks.
+// Returns false if the period is out of range.
+
+bool SetPLLReferencePeriod(uint32_t period)
+{
+  if ( (1 > period) || (PLL_MAX_REF_PERIOD < period) )
+    return false;
+
+  pll_ref_period = period;
+
+  // The old estimate may be for a different reference.
+  if (pll_enabled)
+    EnablePLL(pll_ref_bit);
+
+  return true;
+}
+
+
+
+// Queries PLL state.
+
+void QueryPLLStatus(pll_status_t &status)
+{
+  status.state = pll_state;
+  status.ref_bit = pll_ref_bit;
+  status.ref_period = pll_ref_period;
+  status.freq_ppb = pll_freq_ppb;
+  status.phase_error = pll_phase_error;
+}
+
+
+
+// Prints PLL state.
+
+void PrintPLLState(void)
+{
+  Link_QueueSend_P(PSTR("PL: state="));
+  if (PLL_STATE_LOCKED == pll_state)
+    Link_QueueSend_P(PSTR("locked"));
+  else if (PLL_STATE_TRACKING == pll_state)
+    Link_QueueSend_P(PSTR("tracking"));
+  else if (PLL_STATE_HOLDOVER == pll_state)
+    Link_QueueSend_P(PSTR("holdover"));
+  else if (PLL_STATE_WAITING == pll_state)
+    Link_QueueSend_P(PSTR("waiting"));
+  else
+    Link_QueueSend_P(PSTR("off"));
+  Link_QueueSend_P(PSTR(" bit="));
+  Link_PrintUInt(pll_ref_bit);
+  Link_QueueSend_P(PSTR(" ref="));
+  Link_PrintUInt(pll_ref_period);
+  Link_QueueSend_P(PSTR(" ferr="));
+  Link_PrintInt(pll_freq_ppb);
+  Link_QueueSend_P(PSTR(" perr="));
+  Link_PrintInt(pll_phase_error);
+  Link_QueueSend_P(PSTR("\r\n"));
+}
+
+
+
+// Checks input edges for reference clock edges.
+// This must be called with interrupts off.
+
+void NotePLLInputEdges_ISR(uint32_t changed, uint32_t new_bits)
+{
+  uint8_t idx;
+
+  if ( (!pll_enabled) || (0 == (changed & new_bits & pll_ref_mask)) )
+    return;
+
+  if (pll_ref_count < PLL_REF_QUEUE_SIZE)
+  {
+    idx = pll_ref_head + pll_ref_count;
+    if (PLL_REF_QUEUE_SIZE <= idx)
+      idx -= PLL_REF_QUEUE_SIZE;
+
+    pll_ref_queue[idx] = GetCaptureTime_ISR();
+    pll_ref_count++;
+  }
+}
+
+
+
+// Notes that the strobe task has just turned the light on.
+// This must be called with interrupts off.
+
+void NotePLLStrobe_ISR(void)
+{
+  if (!pll_enabled)
+    return;
+
+  pll_strobe_time = GetCaptureTime_ISR();
+  pll_strobe_pending = true;
+}
+
+
+
+// Updates the reference period estimate with one edge.
+
+void HandlePLLReference(uint32_t ref_time)
+{
+  uint32_t nominal, tolerance, interval;
+
+  nominal = pll_ref_period * PLL_CYCLES_PER_TICK;
+  tolerance = (nominal / 1000) * PLL_REF_TOLERANCE_PPT;
+
+  if (pll_have_ref)
+  {
+    interval = ref_time - pll_last_ref;
+
+    // Short intervals are glitches; don't let them move the reference.
+    if (interval < (nominal - tolerance))
+      return;
+
+    // Long intervals mean that edges were missed, so they can't be used
+    // for the estimate, but the edge itself is still good.
+    if (interval <= (nominal + tolerance))
+    {
+      if (pll_have_estimate)
+        pll_ref_estimate += ((int32_t) (interval - pll_ref_estimate))
+          >> PLL_REF_FILTER_SHIFT;
+      else
+        pll_ref_estimate = interval;
+
+      pll_have_estimate = true;
+
+      pll_freq_ppb = (int32_t) ( ( ((int64_t) pll_ref_estimate)
+        - ((int64_t) nominal) ) * 1000000000LL / ((int64_t) nominal) );
+    }
+  }
+
+  pll_last_ref = ref_time;
+  pll_have_ref = true;
+}
+
+
+
+// Updates the strobe period after a strobe edge.
+
+void HandlePLLStrobe(uint32_t strobe_time)
+{
+  uint32_t strobe_period, strobe_duration, ratio;
+  int32_t since, estimate, phase_error;
+  int64_t period_cycles;
+
+  if (!pll_have_estimate)
+    return;
+
+  // This can be slightly negative, if a reference edge arrived after the
+  // strobe edge but was processed first.
+  since = (int32_t) (strobe_time - pll_last_ref);
+  estimate = pll_ref_estimate;
+
+  // If the reference stopped, keep the last period (holdover).
+  if (since > (PLL_HOLDOVER_PERIODS * estimate))
+  {
+    pll_state = PLL_STATE_HOLDOVER;
+    pll_lock_count = 0;
+    return;
+  }
+
+  // Phase error is against the nearest reference edge, whether that's the
+  // last one or the next one.
+  phase_error = since % estimate;
+  if (phase_error > (estimate / 2))
+    phase_error -= estimate;
+  else if (phase_error <= -(estimate / 2))
+    phase_error += estimate;
+  pll_phase_error = phase_error;
+
+  // Strobe periods are a whole number of reference periods.
+  strobe_period = 0;
+  strobe_duration = 0;
+  QueryTaskParams(strobe_period, strobe_duration);
+  ratio = (strobe_period + (pll_ref_period / 2)) / pll_ref_period;
+  if (1 > ratio)
+    ratio = 1;
+
+  period_cycles = ((int64_t) ratio) * pll_ref_estimate
+    - (phase_error >> PLL_PHASE_GAIN_SHIFT);
+
+  // Leave the period alone if it won't fit in 16.16 fixed-point.
+  if ( (period_cycles >= (int64_t) PLL_CYCLES_PER_TICK)
+    && (period_cycles
+      < (int64_t) (PLL_MAX_STROBE_PERIOD * PLL_CYCLES_PER_TICK)) )
+  {
+    SetTaskFinePeriod( (uint32_t)
+      ((period_cycles << 16) / PLL_CYCLES_PER_TICK) );
+  }
+
+  // Strobe edges land on ticks, so within a tick is as good as it gets.
+  if ( (((int32_t) PLL_CYCLES_PER_TICK) > phase_error)
+    && (-((int32_t) PLL_CYCLES_PER_TICK) < phase_error) )
+  {
+    if (PLL_LOCK_COUNT > pll_lock_count)
+      pll_lock_count++;
+  }
+  else
+    pll_lock_count = 0;
+
+  pll_state = (PLL_LOCK_COUNT <= pll_lock_count)
+    ? PLL_STATE_LOCKED : PLL_STATE_TRACKING;
+}
+
+
+
+// Polling entry point for updating the strobe period.
+
+void PollPLL(void)
+{
+  uint32_t ref_time, strobe_time;
+  bool have_ref, have_strobe;
+
+  if (!pll_enabled)
+    return;
+
+  do
+  {
+    have_ref = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      if (0 < pll_ref_count)
+      {
+        have_ref = true;
+        ref_time = pll_ref_queue[pll_ref_head];
+        pll_ref_head++;
+        if (PLL_REF_QUEUE_SIZE <= pll_ref_head)
+          pll_ref_head = 0;
+        pll_ref_count--;
+      }
+    }
+
+    if (have_ref)
+      HandlePLLReference(ref_time);
+  }
+  while (have_ref);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    have_strobe = pll_strobe_pending;
+    strobe_time = pll_strobe_time;
+    pll_strobe_pending = false;
+  }
+
+  if (have_strobe)
+    HandlePLLStrobe(strobe_time);
+}
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,74 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Strobe phase-locked to an external reference clock.
+
+
+//
+// Enums
+
+enum pll_state_t
+{
+  PLL_STATE_OFF,
+  PLL_STATE_WAITING,
+  PLL_STATE_TRACKING,
+  PLL_STATE_LOCKED,
+  PLL_STATE_HOLDOVER
+};
+
+
+//
+// Structures
+
+struct pll_status_t
+{
+  pll_state_t state;
+
+  // Reference input bit, and its nominal period in ticks.
+  uint8_t ref_bit;
+  uint32_t ref_period;
+
+  // Reference frequency error relative to our crystal, in parts per
+  // billion (positive means the reference is slow).
+  int32_t freq_ppb;
+
+  // Most recent strobe phase error against the nearest reference edge,
+  // in CPU cycles (positive means the strobe is late).
+  int32_t phase_error;
+};
+
+
+//
+// Functions
+
+// Locks the strobe to rising edges on the given input bit.
+// The strobe period should be a multiple of the reference period, or only
+// frequency will lock.
+// Returns false if the bit doesn't exist.
+bool EnablePLL(uint32_t bitnum);
+
+// Returns the strobe to free-running on the local crystal.
+void DisablePLL(void);
+
+// Sets the nominal reference period, in ticks.
+// Returns false if the period is out of range.
+bool SetPLLReferencePeriod(uint32_t period);
+
+// Queries PLL state.
+void QueryPLLStatus(pll_status_t &status);
+
+// Prints PLL state.
+void PrintPLLState(void);
+
+// Checks input edges for reference clock edges.
+// This must be called with interrupts off.
+void NotePLLInputEdges_ISR(uint32_t changed, uint32_t new_bits);
+
+// Notes that the strobe task has just turned the light on.
+// This must be called with interrupts off.
+void NotePLLStrobe_ISR(void);
+
+// Polling entry point for updating the strobe period.
+void PollPLL(void);
+
+
+//
+// This is the end of the file.
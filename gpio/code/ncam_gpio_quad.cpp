@@ -0,0 +1,353 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Quadrature encoder decoding.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if QUAD_ENABLE
+
+//
+// Private macros
+
+// Lookup table entry for a transition that skipped a state (both phases
+// changed at once), so its direction is unknown.
+#define QUAD_STEP_INVALID 2
+
+// Position changes smaller than this can be scaled to counts per second
+// without overflowing 32 bits.
+#define QUAD_VELOCITY_SMALL ((int32_t) (0x7fffffffl / RTC_TICKS_PER_SECOND))
+
+
+
+//
+// Private variables
+
+// Position change for each (old phases, new phases) pair, indexed by
+// (old << 2) | new, with A in bit 0 and B in bit 1. A leading B counts up.
+const int8_t quad_steps[16] =
+{
+   0,  1, -1, QUAD_STEP_INVALID,
+  -1,  0, QUAD_STEP_INVALID,  1,
+   1, QUAD_STEP_INVALID,  0, -1,
+  QUAD_STEP_INVALID, -1,  1,  0
+};
+
+// Configuration. These are only changed with interrupts off.
+uint8_t quad_decoder_mask = 0;
+uint8_t quad_line_mask = 0;
+
+// Decoder state, updated by the pin-change interrupt.
+uint8_t quad_prev_bits = 0;
+volatile int32_t quad_positions[QUAD_DECODER_COUNT];
+volatile uint32_t quad_errors[QUAD_DECODER_COUNT];
+
+// Reporting state. Velocity is measured between consecutive reports, on
+// the local clock.
+uint32_t quad_report_period = 0;
+uint32_t quad_next_report = 0;
+uint32_t quad_last_report_time = 0;
+int32_t quad_last_positions[QUAD_DECODER_COUNT];
+
+
+
+//
+// Private prototypes
+
+// Clears positions and the velocity baseline.
+// This must be called with interrupts off.
+void ResetQuadPositions_ISR(void);
+
+
+
+//
+// Functions
+
+
+// Clears positions and the velocity baseline.
+// This must be called with interrupts off.
+
+void ResetQuadPositions_ISR(void)
+{
+  uint8_t didx;
+
+  for (didx = 0; didx < QUAD_DECODER_COUNT; didx++)
+  {
+    quad_positions[didx] = 0;
+    quad_last_positions[didx] = 0;
+  }
+
+  quad_last_report_time = Timer_Query_ISR();
+}
+
+#endif
+
+
+
+// Selects which decoders are active. Bit n of the mask enables decoder n,
+// which reads input bit 2n as its A phase and 2n+1 as its B phase; a mask
+// of 0 turns decoding off. Positions and error counts are cleared.
+// Returns false if the mask selects nonexistent inputs.
+
+bool SetQuadDecoders(uint32_t decoder_mask)
+{
+  bool result;
+#if QUAD_ENABLE
+  uint32_t line_mask;
+  uint8_t didx;
+#endif
+
+  result = false;
+
+#if QUAD_ENABLE
+  line_mask = 0;
+  for (didx = 0; didx < QUAD_DECODER_COUNT; didx++)
+    if (decoder_mask & (1ul << didx))
+      line_mask |= (3ul << (2 * didx));
+
+  if ( (0 == (decoder_mask >> QUAD_DECODER_COUNT))
+    && (0 == (line_mask >> GetDIOCount(DIO_REG_INPUT))) )
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      ResetQuadPositions_ISR();
+      for (didx = 0; didx < QUAD_DECODER_COUNT; didx++)
+        quad_errors[didx] = 0;
+
+      // Decoding starts from the phases as they are now.
+      quad_prev_bits = GetDIOBits(DIO_REG_INPUT);
+      quad_decoder_mask = decoder_mask;
+      quad_line_mask = line_mask;
+    }
+
+    result = true;
+  }
+#endif
+
+  return result;
+}
+
+
+
+// Sets the period of automatic position reports, in ticks. A period of 0
+// sends reports only when asked for.
+// Returns false if the period is too short.
+
+bool SetQuadReportPeriod(uint32_t period)
+{
+  bool result;
+
+  result = false;
+
+#if QUAD_ENABLE
+  if ( (0 == period) || (QUAD_MIN_REPORT_TICKS <= period) )
+  {
+    quad_report_period = period;
+    quad_next_report = Timer_Query() + period;
+    result = true;
+  }
+#endif
+
+  return result;
+}
+
+
+
+// Sets all positions back to zero.
+
+void ZeroQuadPositions(void)
+{
+#if QUAD_ENABLE
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    ResetQuadPositions_ISR();
+  }
+#endif
+}
+
+
+
+// Returns the mask of inputs being used by active decoders.
+
+uint32_t GetQuadLineMask(void)
+{
+#if QUAD_ENABLE
+  return quad_line_mask;
+#else
+  return 0;
+#endif
+}
+
+
+
+// Updates decoder positions.
+// "changed" has a bit set for each input that toggled; "new_bits" is the
+// input bank's state after the change. This must be called with
+// interrupts off.
+
+void NoteQuadEdges_ISR(uint32_t changed, uint32_t new_bits)
+{
+#if QUAD_ENABLE
+  uint8_t pairs_changed, old_phases, new_phases, didx;
+  int8_t step;
+
+  pairs_changed = changed & quad_line_mask;
+  if (0 == pairs_changed)
+    return;
+
+  // Lines that aren't decoder phases don't matter here, so keeping all of
+  // them is fine.
+  old_phases = quad_prev_bits;
+  new_phases = new_bits;
+  quad_prev_bits = new_phases;
+
+  for (didx = 0; 0 != pairs_changed; didx++)
+  {
+    if (pairs_changed & 0x03)
+    {
+      step = quad_steps[((old_phases & 0x03) << 2) | (new_phases & 0x03)];
+
+      if (QUAD_STEP_INVALID == step)
+        quad_errors[didx]++;
+      else
+        quad_positions[didx] += step;
+    }
+
+    pairs_changed >>= 2;
+    old_phases >>= 2;
+    new_phases >>= 2;
+  }
+#endif
+}
+
+
+
+// Sends a position report now.
+// Reports are "QE: (tick) (decoder):(position):(velocity) ...", with one
+// entry per active decoder. Velocity is in counts per second, averaged
+// since the previous report. The tick is an event timestamp, so it
+// follows a sync master.
+
+void SendQuadReport(void)
+{
+#if QUAD_ENABLE
+  int32_t positions[QUAD_DECODER_COUNT];
+  uint32_t local_time, event_time, elapsed;
+  int32_t velocity;
+  uint8_t didx;
+
+  // Positions and both clocks are sampled together.
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (didx = 0; didx < QUAD_DECODER_COUNT; didx++)
+      positions[didx] = quad_positions[didx];
+    local_time = Timer_Query_ISR();
+    event_time = GetEventTime_ISR();
+  }
+
+  elapsed = local_time - quad_last_report_time;
+  quad_last_report_time = local_time;
+
+  Link_QueueSend_P(PSTR("QE: "));
+  Link_PrintUInt64(ExtendEventTime(event_time));
+
+  for (didx = 0; didx < QUAD_DECODER_COUNT; didx++)
+  {
+    // Differences stay right across position wraparound.
+    velocity = (int32_t) ((uint32_t) positions[didx]
+      - (uint32_t) quad_last_positions[didx]);
+    quad_last_positions[didx] = positions[didx];
+
+    // Large changes (from long gaps between on-demand reports) need 64-bit
+    // arithmetic; the usual case doesn't.
+    if (0 == elapsed)
+      velocity = 0;
+    else if ( (-QUAD_VELOCITY_SMALL < velocity)
+      && (QUAD_VELOCITY_SMALL > velocity) )
+      velocity = (velocity * (int32_t) RTC_TICKS_PER_SECOND)
+        / (int32_t) elapsed;
+    else
+      velocity = ((int64_t) velocity * RTC_TICKS_PER_SECOND) / elapsed;
+
+    if (quad_decoder_mask & (1 << didx))
+    {
+      Link_PrintChar(' ');
+      Link_PrintUInt(didx);
+      Link_PrintChar(':');
+      Link_PrintInt(positions[didx]);
+      Link_PrintChar(':');
+      Link_PrintInt(velocity);
+    }
+  }
+
+  Link_QueueSend_P(PSTR("\r\n"));
+#endif
+}
+
+
+
+// Prints decoder state.
+
+void PrintQuadState(void)
+{
+#if QUAD_ENABLE
+  uint32_t errors[QUAD_DECODER_COUNT];
+  uint8_t didx;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (didx = 0; didx < QUAD_DECODER_COUNT; didx++)
+      errors[didx] = quad_errors[didx];
+  }
+
+  Link_QueueSend_P(PSTR("QE: decoders="));
+  Link_PrintHex8(quad_decoder_mask);
+  Link_QueueSend_P(PSTR(" lines="));
+  Link_PrintHex8(quad_line_mask);
+  Link_QueueSend_P(PSTR(" period="));
+  Link_PrintUInt(quad_report_period);
+  Link_QueueSend_P(PSTR(" errors="));
+  for (didx = 0; didx < QUAD_DECODER_COUNT; didx++)
+  {
+    if (0 < didx)
+      Link_PrintChar(',');
+    Link_PrintUInt(errors[didx]);
+  }
+  Link_QueueSend_P(PSTR("\r\n"));
+#else
+  Link_QueueSend_P(PSTR("Quadrature decoding is disabled.\r\n"));
+#endif
+}
+
+
+
+// Polling entry point for sending periodic position reports.
+
+void PollQuadReporting(void)
+{
+#if QUAD_ENABLE
+  uint32_t now;
+
+  if ( (0 == quad_report_period) || (0 == quad_decoder_mask) )
+    return;
+
+  now = Timer_Query();
+  if (!IsTimeReached(now, quad_next_report))
+    return;
+
+  SendQuadReport();
+
+  // Keep to the schedule, unless we've fallen a whole period behind.
+  quad_next_report += quad_report_period;
+  if (IsTimeReached(now, quad_next_report))
+    quad_next_report = now + quad_report_period;
+#endif
+}
+
+
+
+//
+// This is the end of the file.
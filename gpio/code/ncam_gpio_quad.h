@@ -0,0 +1,42 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Quadrature encoder decoding.
+
+
+//
+// Functions
+
+// Selects which decoders are active. Bit n of the mask enables decoder n,
+// which reads input bit 2n as its A phase and 2n+1 as its B phase; a mask
+// of 0 turns decoding off. Positions and error counts are cleared.
+// Returns false if the mask selects nonexistent inputs.
+bool SetQuadDecoders(uint32_t decoder_mask);
+
+// Sets the period of automatic position reports, in ticks. A period of 0
+// sends reports only when asked for.
+// Returns false if the period is too short.
+bool SetQuadReportPeriod(uint32_t period);
+
+// Sets all positions back to zero.
+void ZeroQuadPositions(void);
+
+// Returns the mask of inputs being used by active decoders.
+uint32_t GetQuadLineMask(void);
+
+// Updates decoder positions.
+// "changed" has a bit set for each input that toggled; "new_bits" is the
+// input bank's state after the change. This must be called with
+// interrupts off.
+void NoteQuadEdges_ISR(uint32_t changed, uint32_t new_bits);
+
+// Sends a position report now.
+void SendQuadReport(void);
+
+// Prints decoder state.
+void PrintQuadState(void);
+
+// Polling entry point for sending periodic position reports.
+void PollQuadReporting(void);
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,449 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Strobe self-test (edge latency and jitter measurement).
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if SELFTEST_ENABLE
+
+//
+// Private macros
+
+// Analog comparator inputs (AIN0 = D6, AIN1 = D7).
+#define SELFTEST_COMPARATOR_BITS 0xc0
+
+// Capture timer cycles per RTC tick.
+#define SELFTEST_CYCLES_PER_TICK (CPU_SPEED / RTC_TICKS_PER_SECOND)
+
+
+
+//
+// Private enums
+
+enum selftest_state_t
+{
+  SELFTEST_IDLE,
+  SELFTEST_RUNNING,
+  SELFTEST_DONE
+};
+
+
+
+//
+// Private types
+
+// Latency is measured from the task's decision to switch the output to the
+// captured edge, in CPU cycles.
+struct selftest_edge_stats_t
+{
+  uint16_t count;
+  uint32_t lat_min, lat_max;
+  uint32_t lat_total;
+};
+
+// Period deviation is the captured rising-edge interval minus the nominal
+// strobe period, in CPU cycles.
+struct selftest_stats_t
+{
+  selftest_edge_stats_t rise;
+  selftest_edge_stats_t fall;
+
+  uint16_t period_count;
+  int32_t dev_min, dev_max;
+  // Missed edges make for deviations of whole periods, which could add up
+  // past 32 bits.
+  int64_t dev_total;
+
+  uint16_t missed;
+  uint16_t extra;
+};
+
+
+
+//
+// Private variables
+
+volatile selftest_state_t selftest_state = SELFTEST_IDLE;
+selftest_mode_t selftest_mode = SELFTEST_ELECTRICAL;
+bool selftest_aborted = false;
+
+uint16_t selftest_pulses_wanted = 0;
+uint16_t selftest_rises_commanded = 0;
+uint32_t selftest_nominal_period = 0;
+
+// The commanded edge that we're waiting to capture.
+bool selftest_pending = false;
+bool selftest_pending_rising = false;
+uint32_t selftest_pending_time = 0;
+
+// Timestamp of the last captured rising edge.
+bool selftest_have_rise = false;
+uint32_t selftest_last_rise = 0;
+
+selftest_stats_t selftest_stats;
+
+// Things to put back the way they were when the test finishes.
+bool selftest_started_task = false;
+uint8_t selftest_saved_pullups = 0;
+
+
+
+//
+// Private prototypes
+
+// Adds a latency measurement to one edge's statistics.
+// This must be called with interrupts off.
+void AddSelfTestLatency_ISR(selftest_edge_stats_t &stats, uint32_t latency);
+
+// Prints one edge's latency statistics.
+void PrintSelfTestEdge(const char *label_P, selftest_edge_stats_t &stats);
+
+// Restores the hardware and task state after a test.
+void CleanUpSelfTest(void);
+
+
+
+//
+// Functions
+
+
+// Starts measuring the given number of strobe pulses.
+// Electrical tests expect the strobe output (D13) wired to ICP1 (D8).
+// Optical tests expect a photodiode signal on AIN0 (D6) that goes above
+// a reference on AIN1 (D7) when the light is on.
+// The strobe task is started if it isn't already running.
+// Returns false if the pulse count or strobe period is out of range.
+
+bool StartSelfTest(selftest_mode_t mode, uint32_t pulses)
+{
+  uint32_t period, duration;
+#if SYNC_ENABLE
+  sync_status_t sync_status;
+#endif
+
+  if ( (1 > pulses) || (SELFTEST_MAX_PULSES < pulses) )
+    return false;
+
+#if SYNC_ENABLE
+  // Sync slaves need the capture pin to themselves.
+  QuerySyncStatus(sync_status);
+  if (SYNC_ROLE_SLAVE == sync_status.role)
+    return false;
+#endif
+
+  // Periods have to be measurable with the 32-bit capture timer, and
+  // single deviations have to fit in 32 signed bits.
+  period = 0;
+  duration = 0;
+  QueryTaskParams(period, duration);
+  if ( (1 > period)
+    || ((0x7fffffffUL / SELFTEST_CYCLES_PER_TICK) < period) )
+    return false;
+
+  // Finish off any previous test without reporting it.
+  if (SELFTEST_IDLE != selftest_state)
+  {
+    selftest_state = SELFTEST_IDLE;
+    CleanUpSelfTest();
+  }
+
+  selftest_mode = mode;
+  selftest_aborted = false;
+  selftest_pulses_wanted = pulses;
+  selftest_rises_commanded = 0;
+  selftest_nominal_period = period * SELFTEST_CYCLES_PER_TICK;
+
+  selftest_pending = false;
+  selftest_have_rise = false;
+
+  selftest_stats.rise.count = 0;
+  selftest_stats.rise.lat_min = 0xffffffffUL;
+  selftest_stats.rise.lat_max = 0;
+  selftest_stats.rise.lat_total = 0;
+  selftest_stats.fall = selftest_stats.rise;
+  selftest_stats.period_count = 0;
+  selftest_stats.dev_min = 0x7fffffffL;
+  selftest_stats.dev_max = -0x7fffffffL;
+  selftest_stats.dev_total = 0;
+  selftest_stats.missed = 0;
+  selftest_stats.extra = 0;
+
+  if (SELFTEST_OPTICAL == mode)
+  {
+    // Pull-ups would bias the photodiode and the reference.
+    selftest_saved_pullups = PORTD & SELFTEST_COMPARATOR_BITS;
+    PORTD &= ~SELFTEST_COMPARATOR_BITS;
+    SetCaptureSource(CAPTURE_COMPARATOR);
+  }
+  else
+    SetCaptureSource(CAPTURE_PIN);
+
+  selftest_started_task = !IsTaskActive();
+  if (selftest_started_task)
+    SetTaskActivity(true);
+
+  // Measurement starts with the next rising edge the task commands.
+  selftest_state = SELFTEST_RUNNING;
+
+  return true;
+}
+
+
+
+// Abandons a self-test in progress. Results so far are reported.
+
+void StopSelfTest(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (SELFTEST_RUNNING == selftest_state)
+    {
+      selftest_aborted = true;
+      selftest_state = SELFTEST_DONE;
+    }
+  }
+}
+
+
+
+// Queries whether a self-test is using the capture timer.
+
+bool IsSelfTestActive(void)
+{
+  // Finished tests hold the capture timer until they're reported.
+  return (SELFTEST_IDLE != selftest_state);
+}
+
+
+
+// Restores the hardware and task state after a test.
+
+void CleanUpSelfTest(void)
+{
+  SetCaptureSource(CAPTURE_OFF);
+
+  if (SELFTEST_OPTICAL == selftest_mode)
+    PORTD |= selftest_saved_pullups;
+
+  if (selftest_started_task)
+    SetTaskActivity(false);
+  selftest_started_task = false;
+}
+
+
+
+// Adds a latency measurement to one edge's statistics.
+// This must be called with interrupts off.
+
+void AddSelfTestLatency_ISR(selftest_edge_stats_t &stats, uint32_t latency)
+{
+  stats.count++;
+  stats.lat_total += latency;
+  if (latency < stats.lat_min)
+    stats.lat_min = latency;
+  if (latency > stats.lat_max)
+    stats.lat_max = latency;
+}
+
+
+
+// Notes that the strobe task is about to switch the output.
+// This must be called with interrupts off.
+
+void NoteStrobeEdge_ISR(bool is_rising)
+{
+  if (SELFTEST_RUNNING != selftest_state)
+    return;
+
+  // The previous edge never showed up.
+  if (selftest_pending)
+  {
+    selftest_stats.missed++;
+    selftest_pending = false;
+  }
+
+  // Wait for a rising edge to start, so that pulses are measured whole.
+  if ( (!is_rising) && (0 == selftest_rises_commanded) )
+    return;
+
+  // A rising edge after the last pulse means the last falling edge was
+  // missed (and counted above), so we're done. The last pulse's own
+  // falling edge is measured like any other.
+  if ( is_rising && (selftest_rises_commanded >= selftest_pulses_wanted) )
+  {
+    selftest_state = SELFTEST_DONE;
+    return;
+  }
+
+  if (is_rising)
+    selftest_rises_commanded++;
+
+  // Select the edge before taking the timestamp, as changing it clears
+  // any pending capture.
+  SetCaptureEdge_ISR(is_rising);
+
+  selftest_pending_rising = is_rising;
+  selftest_pending_time = GetCaptureTime_ISR();
+  selftest_pending = true;
+}
+
+
+
+// Notes an input capture event, timestamped with the capture timer.
+// This must be called with interrupts off.
+
+void NoteSelfTestCapture_ISR(uint32_t capture_time, bool is_rising)
+{
+  int32_t deviation;
+
+  if (SELFTEST_RUNNING != selftest_state)
+    return;
+
+  // Anything we weren't expecting is noise or bounce.
+  if ( (!selftest_pending) || (is_rising != selftest_pending_rising) )
+  {
+    selftest_stats.extra++;
+    return;
+  }
+
+  selftest_pending = false;
+
+  if (is_rising)
+  {
+    AddSelfTestLatency_ISR(selftest_stats.rise,
+      capture_time - selftest_pending_time);
+
+    if (selftest_have_rise)
+    {
+      deviation = (int32_t) (capture_time - selftest_last_rise
+        - selftest_nominal_period);
+
+      selftest_stats.period_count++;
+      selftest_stats.dev_total += deviation;
+      if (deviation < selftest_stats.dev_min)
+        selftest_stats.dev_min = deviation;
+      if (deviation > selftest_stats.dev_max)
+        selftest_stats.dev_max = deviation;
+    }
+
+    selftest_last_rise = capture_time;
+    selftest_have_rise = true;
+  }
+  else
+  {
+    AddSelfTestLatency_ISR(selftest_stats.fall,
+      capture_time - selftest_pending_time);
+
+    if (selftest_rises_commanded >= selftest_pulses_wanted)
+      selftest_state = SELFTEST_DONE;
+  }
+}
+
+
+
+// Prints one edge's latency statistics.
+
+void PrintSelfTestEdge(const char *label_P, selftest_edge_stats_t &stats)
+{
+  Link_QueueSend_P(label_P);
+  Link_QueueSend_P(PSTR(" n="));
+  Link_PrintUInt(stats.count);
+  Link_QueueSend_P(PSTR(" lat="));
+  if (0 < stats.count)
+  {
+    Link_PrintUInt(stats.lat_min);
+    Link_PrintChar('/');
+    Link_PrintUInt(stats.lat_total / stats.count);
+    Link_PrintChar('/');
+    Link_PrintUInt(stats.lat_max);
+    Link_QueueSend_P(PSTR(" jit="));
+    Link_PrintUInt(stats.lat_max - stats.lat_min);
+  }
+  else
+    Link_QueueSend_P(PSTR("0/0/0 jit=0"));
+  Link_QueueSend_P(PSTR("\r\n"));
+}
+
+
+
+// Prints self-test results (so far, if a test is in progress).
+// All times are in CPU cycles.
+
+void PrintSelfTestResults(void)
+{
+  selftest_stats_t snapshot;
+  selftest_state_t state;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    snapshot = selftest_stats;
+    state = selftest_state;
+  }
+
+  Link_QueueSend_P(PSTR("ST: "));
+  if (SELFTEST_RUNNING == state)
+    Link_QueueSend_P(PSTR("running"));
+  else if (selftest_aborted)
+    Link_QueueSend_P(PSTR("stopped"));
+  else
+    Link_QueueSend_P(PSTR("done"));
+  if (SELFTEST_OPTICAL == selftest_mode)
+    Link_QueueSend_P(PSTR(" optical"));
+  else
+    Link_QueueSend_P(PSTR(" electrical"));
+  Link_QueueSend_P(PSTR(" pulses="));
+  Link_PrintUInt(selftest_pulses_wanted);
+  Link_QueueSend_P(PSTR(" miss="));
+  Link_PrintUInt(snapshot.missed);
+  Link_QueueSend_P(PSTR(" extra="));
+  Link_PrintUInt(snapshot.extra);
+  Link_QueueSend_P(PSTR(" cps="));
+  Link_PrintUInt(CPU_SPEED);
+  Link_QueueSend_P(PSTR("\r\n"));
+
+  PrintSelfTestEdge(PSTR("ST: rise"), snapshot.rise);
+  PrintSelfTestEdge(PSTR("ST: fall"), snapshot.fall);
+
+  Link_QueueSend_P(PSTR("ST: period n="));
+  Link_PrintUInt(snapshot.period_count);
+  Link_QueueSend_P(PSTR(" nom="));
+  Link_PrintUInt(selftest_nominal_period);
+  Link_QueueSend_P(PSTR(" dev="));
+  if (0 < snapshot.period_count)
+  {
+    Link_PrintInt(snapshot.dev_min);
+    Link_PrintChar('/');
+    Link_PrintInt((int32_t) (snapshot.dev_total / snapshot.period_count));
+    Link_PrintChar('/');
+    Link_PrintInt(snapshot.dev_max);
+  }
+  else
+    Link_QueueSend_P(PSTR("0/0/0"));
+  Link_QueueSend_P(PSTR("\r\n"));
+
+  Link_QueueSend_P(PSTR("ST: end\r\n"));
+}
+
+
+
+// Polling entry point for finishing tests and reporting results.
+
+void PollSelfTestReporting(void)
+{
+  if (SELFTEST_DONE == selftest_state)
+  {
+    CleanUpSelfTest();
+    PrintSelfTestResults();
+    selftest_state = SELFTEST_IDLE;
+  }
+}
+
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,48 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Strobe self-test (edge latency and jitter measurement).
+
+
+//
+// Enums
+
+enum selftest_mode_t
+{
+  SELFTEST_ELECTRICAL,
+  SELFTEST_OPTICAL
+};
+
+
+//
+// Functions
+
+// Starts measuring the given number of strobe pulses.
+// Electrical tests expect the strobe output (D13) wired to ICP1 (D8).
+// Optical tests expect a photodiode signal on AIN0 (D6) that goes above
+// a reference on AIN1 (D7) when the light is on.
+// The strobe task is started if it isn't already running.
+// Returns false if the pulse count or strobe period is out of range.
+bool StartSelfTest(selftest_mode_t mode, uint32_t pulses);
+
+// Abandons a self-test in progress. Results so far are reported.
+void StopSelfTest(void);
+
+// Queries whether a self-test is using the capture timer.
+bool IsSelfTestActive(void);
+
+// Prints self-test results (so far, if a test is in progress).
+void PrintSelfTestResults(void);
+
+// Notes that the strobe task is about to switch the output.
+// This must be called with interrupts off.
+void NoteStrobeEdge_ISR(bool is_rising);
+
+// Notes an input capture event, timestamped with the capture timer.
+// This must be called with interrupts off.
+void NoteSelfTestCapture_ISR(uint32_t capture_time, bool is_rising);
+
+// Polling entry point for finishing tests and reporting results.
+void PollSelfTestReporting(void);
+
+
+//
+// This is the end of the file.
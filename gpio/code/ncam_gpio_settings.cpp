@@ -0,0 +1,215 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Saved configuration.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+
+//
+// Private macros
+
+// Marker for a valid saved configuration in EEPROM.
+#define SETTINGS_EEPROM_MAGIC 0x4346
+
+// Version of the serialized configuration record.
+// Bump this whenever the record's layout changes.
+#define SETTINGS_VERSION 2
+
+// Size of the serialized configuration record.
+#define SETTINGS_RECORD_SIZE 14
+
+// FNV-1a (32-bit) parameters.
+#define FNV_OFFSET_BASIS 0x811c9dc5ul
+#define FNV_PRIME 0x01000193ul
+
+
+
+//
+// Private types
+
+struct settings_eeprom_t
+{
+  uint16_t magic;
+  uint8_t record[SETTINGS_RECORD_SIZE];
+  uint32_t hash;
+};
+
+
+
+//
+// Private prototypes
+
+// Serializes the active configuration.
+void BuildSettingsRecord(uint8_t *record);
+
+// Writes a little-endian 32-bit value into a byte buffer.
+void PackUInt32(uint8_t *dest, uint32_t value);
+
+// Reads a little-endian 32-bit value from a byte buffer.
+uint32_t UnpackUInt32(const uint8_t *src);
+
+// Computes the FNV-1a hash of a byte buffer.
+uint32_t HashBytes(const uint8_t *data, uint8_t count);
+
+
+
+//
+// Functions
+
+
+// Writes a little-endian 32-bit value into a byte buffer.
+
+void PackUInt32(uint8_t *dest, uint32_t value)
+{
+  dest[0] = value & 0xff;
+  dest[1] = (value >> 8) & 0xff;
+  dest[2] = (value >> 16) & 0xff;
+  dest[3] = (value >> 24) & 0xff;
+}
+
+
+
+// Reads a little-endian 32-bit value from a byte buffer.
+
+uint32_t UnpackUInt32(const uint8_t *src)
+{
+  uint32_t result;
+
+  result = src[3];
+  result = (result << 8) | src[2];
+  result = (result << 8) | src[1];
+  result = (result << 8) | src[0];
+
+  return result;
+}
+
+
+
+// Computes the FNV-1a hash of a byte buffer.
+
+uint32_t HashBytes(const uint8_t *data, uint8_t count)
+{
+  uint32_t result;
+  uint8_t idx;
+
+  result = FNV_OFFSET_BASIS;
+
+  for (idx = 0; idx < count; idx++)
+  {
+    result ^= data[idx];
+    result *= FNV_PRIME;
+  }
+
+  return result;
+}
+
+
+
+// Serializes the active configuration.
+
+void BuildSettingsRecord(uint8_t *record)
+{
+  uint32_t period, duration;
+
+  period = 0;
+  duration = 0;
+  QueryTaskParams(period, duration);
+
+  record[0] = SETTINGS_VERSION;
+  record[1] = QueryPinPullups() ? 1 : 0;
+  record[2] = IsEchoActive() ? 1 : 0;
+  record[3] = IsReportingActive() ? 1 : 0;
+  record[4] = IsTaskActive() ? 1 : 0;
+  PackUInt32(&(record[5]), period);
+  PackUInt32(&(record[9]), duration);
+  record[13] = IsReportTimestampActive() ? 1 : 0;
+}
+
+
+
+// Saves the active configuration to EEPROM.
+
+void SaveSettings(void)
+{
+  settings_eeprom_t saved;
+
+  saved.magic = SETTINGS_EEPROM_MAGIC;
+  BuildSettingsRecord(saved.record);
+  saved.hash = HashBytes(saved.record, SETTINGS_RECORD_SIZE);
+
+  // This only rewrites bytes that changed.
+  eeprom_update_block(&saved, (void *) EEPROM_SETTINGS_ADDR, sizeof(saved));
+}
+
+
+
+// Applies the configuration saved in EEPROM.
+// Returns false (changing nothing) if no valid configuration was saved.
+
+bool LoadSettings(void)
+{
+  settings_eeprom_t saved;
+  bool result;
+
+  result = false;
+
+  eeprom_read_block(&saved, (const void *) EEPROM_SETTINGS_ADDR,
+    sizeof(saved));
+
+  // The hash doubles as a checksum.
+  if ( (SETTINGS_EEPROM_MAGIC == saved.magic)
+    && (SETTINGS_VERSION == saved.record[0])
+    && (saved.hash == HashBytes(saved.record, SETTINGS_RECORD_SIZE)) )
+  {
+    ConfigPins(0 != saved.record[1]);
+    SetEchoActive(0 != saved.record[2]);
+
+    ConfigureTask(UnpackUInt32(&(saved.record[5])),
+      UnpackUInt32(&(saved.record[9])));
+    SetTaskActivity(0 != saved.record[4]);
+
+    // Reporting comes last, so that the first report reflects the new
+    // pin configuration.
+    SetReportingActive(0 != saved.record[3]);
+    SetReportTimestampActive(0 != saved.record[13]);
+
+    result = true;
+  }
+
+  return result;
+}
+
+
+
+// Invalidates the saved configuration, so that defaults are used at
+// power-up. The active configuration isn't changed.
+
+void EraseSettings(void)
+{
+  uint16_t magic;
+
+  magic = 0xffff;
+  eeprom_update_block(&magic, (void *) EEPROM_SETTINGS_ADDR, sizeof(magic));
+}
+
+
+
+// Returns a hash of the active configuration.
+
+uint32_t GetSettingsHash(void)
+{
+  uint8_t record[SETTINGS_RECORD_SIZE];
+
+  BuildSettingsRecord(record);
+
+  return HashBytes(record, SETTINGS_RECORD_SIZE);
+}
+
+
+
+//
+// This is the end of the file.
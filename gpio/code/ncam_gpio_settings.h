@@ -0,0 +1,30 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Saved configuration.
+
+
+//
+// Functions
+
+// Saves the active configuration to EEPROM.
+void SaveSettings(void);
+
+// Applies the configuration saved in EEPROM.
+// Returns false (changing nothing) if no valid configuration was saved.
+bool LoadSettings(void);
+
+// Invalidates the saved configuration, so that defaults are used at
+// power-up. The active configuration isn't changed.
+void EraseSettings(void);
+
+// Returns a hash of the active configuration.
+// Hosts compare this against the hash of the configuration they want, and
+// skip reinitialization if it matches. The hash is FNV-1a (32-bit) over
+// this byte sequence:
+//   version (2), pull-ups, echo, reporting, task active (one byte each,
+//   0 or 1), task period, task duration (little-endian 32-bit each),
+//   report timestamps (one byte, 0 or 1; "REP 2").
+uint32_t GetSettingsHash(void);
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,341 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Per-line edge statistics.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+
+//
+// Private macros
+
+// FIXME - Hardwired to match GetDIOCount().
+#define STATS_INPUT_LINES 8
+#define STATS_OUTPUT_LINES 1
+#define STATS_LINE_COUNT (STATS_INPUT_LINES + STATS_OUTPUT_LINES)
+
+// Widths are stored as 16-bit values and saturate at this.
+#define STATS_WIDTH_MAX 0xffff
+
+// Histogram bins saturate at this. When one does, all bins are halved.
+#define STATS_BIN_MAX 0xffff
+
+// Flag bits.
+#define STATS_FLAG_SEEN_RISE 0x01
+#define STATS_FLAG_SEEN_FALL 0x02
+#define STATS_FLAG_FIRST_RISE 0x04
+
+
+
+//
+// Private types
+
+struct line_stats_t
+{
+  uint32_t rise_count;
+  uint32_t fall_count;
+
+  uint32_t last_rise_time;
+  uint32_t last_fall_time;
+
+  // Widths are measured in ticks. High widths are recorded on falling
+  // edges, low widths on rising edges.
+  uint32_t high_total;
+  uint16_t high_min, high_max;
+  uint32_t low_total;
+  uint16_t low_min, low_max;
+
+  // Rising-edge to rising-edge intervals, log2-binned.
+  uint16_t interval_hist[STATS_HIST_BINS];
+
+  uint8_t flags;
+};
+
+
+
+//
+// Private variables
+
+#if STATS_ENABLE
+// Inputs come first, followed by outputs.
+line_stats_t line_stats[STATS_LINE_COUNT];
+#endif
+
+
+
+//
+// Private prototypes
+
+#if STATS_ENABLE
+// Updates one line's statistics with a single edge.
+void NoteOneEdge_ISR(line_stats_t &stats, bool is_rising, uint32_t this_time);
+
+// Adds an interval to a line's histogram.
+void AddHistogramInterval_ISR(line_stats_t &stats, uint32_t interval);
+
+// Prints one line's statistics.
+void PrintOneLineStats(char bankchar, int bitidx, line_stats_t &stats);
+#endif
+
+
+
+//
+// Functions
+
+
+// Clears all accumulated statistics.
+
+void ResetLineStats(void)
+{
+#if STATS_ENABLE
+  int lidx, bidx;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (lidx = 0; lidx < STATS_LINE_COUNT; lidx++)
+    {
+      line_stats[lidx].rise_count = 0;
+      line_stats[lidx].fall_count = 0;
+      line_stats[lidx].last_rise_time = 0;
+      line_stats[lidx].last_fall_time = 0;
+
+      line_stats[lidx].high_total = 0;
+      line_stats[lidx].high_min = STATS_WIDTH_MAX;
+      line_stats[lidx].high_max = 0;
+      line_stats[lidx].low_total = 0;
+      line_stats[lidx].low_min = STATS_WIDTH_MAX;
+      line_stats[lidx].low_max = 0;
+
+      for (bidx = 0; bidx < STATS_HIST_BINS; bidx++)
+        line_stats[lidx].interval_hist[bidx] = 0;
+
+      line_stats[lidx].flags = 0;
+    }
+  }
+#endif
+}
+
+
+
+#if STATS_ENABLE
+
+// Adds an interval to a line's histogram.
+
+void AddHistogramInterval_ISR(line_stats_t &stats, uint32_t interval)
+{
+  uint8_t bin, bidx;
+
+  // This is bounded by the bin count, so it's still constant-time.
+  bin = 0;
+  while ( (interval > 1) && (bin < (STATS_HIST_BINS - 1)) )
+  {
+    interval >>= 1;
+    bin++;
+  }
+
+  // Halve everything rather than saturating, so that the histogram's
+  // shape is preserved.
+  if (STATS_BIN_MAX == stats.interval_hist[bin])
+  {
+    for (bidx = 0; bidx < STATS_HIST_BINS; bidx++)
+      stats.interval_hist[bidx] >>= 1;
+  }
+
+  stats.interval_hist[bin]++;
+}
+
+
+
+// Updates one line's statistics with a single edge.
+
+void NoteOneEdge_ISR(line_stats_t &stats, bool is_rising, uint32_t this_time)
+{
+  uint32_t width;
+
+  if (is_rising)
+  {
+    stats.rise_count++;
+
+    // The previous low phase ended here.
+    if (stats.flags & STATS_FLAG_SEEN_FALL)
+    {
+      width = this_time - stats.last_fall_time;
+      stats.low_total += width;
+      if (width > STATS_WIDTH_MAX)
+        width = STATS_WIDTH_MAX;
+      if (width < stats.low_min)
+        stats.low_min = width;
+      if (width > stats.low_max)
+        stats.low_max = width;
+    }
+
+    if (stats.flags & STATS_FLAG_SEEN_RISE)
+      AddHistogramInterval_ISR(stats, this_time - stats.last_rise_time);
+    else if (!(stats.flags & STATS_FLAG_SEEN_FALL))
+      stats.flags |= STATS_FLAG_FIRST_RISE;
+
+    stats.last_rise_time = this_time;
+    stats.flags |= STATS_FLAG_SEEN_RISE;
+  }
+  else
+  {
+    stats.fall_count++;
+
+    // The previous high phase ended here.
+    if (stats.flags & STATS_FLAG_SEEN_RISE)
+    {
+      width = this_time - stats.last_rise_time;
+      stats.high_total += width;
+      if (width > STATS_WIDTH_MAX)
+        width = STATS_WIDTH_MAX;
+      if (width < stats.high_min)
+        stats.high_min = width;
+      if (width > stats.high_max)
+        stats.high_max = width;
+    }
+
+    stats.last_fall_time = this_time;
+    stats.flags |= STATS_FLAG_SEEN_FALL;
+  }
+}
+
+#endif
+
+
+
+// Records edges on one bank of lines.
+// "changed" has a bit set for each line that toggled; "new_bits" is the
+// bank's state after the change. This must be called with interrupts off.
+
+void NoteLineEdges_ISR(reg_id_t target, uint32_t changed, uint32_t new_bits,
+  uint32_t this_time)
+{
+#if STATS_ENABLE
+  int lidx, count;
+
+  lidx = 0;
+  count = 0;
+
+  if (DIO_REG_INPUT == target)
+  {
+    lidx = 0;
+    count = STATS_INPUT_LINES;
+  }
+  else if (DIO_REG_OUTPUT == target)
+  {
+    lidx = STATS_INPUT_LINES;
+    count = STATS_OUTPUT_LINES;
+  }
+
+  for (; (0 < count) && (0 != changed); count--)
+  {
+    if (changed & 0x01)
+      NoteOneEdge_ISR(line_stats[lidx], (new_bits & 0x01), this_time);
+
+    changed >>= 1;
+    new_bits >>= 1;
+    lidx++;
+  }
+#endif
+}
+
+
+
+#if STATS_ENABLE
+
+// Prints one line's statistics.
+
+void PrintOneLineStats(char bankchar, int bitidx, line_stats_t &stats)
+{
+  uint32_t samples;
+  int bidx;
+
+  Link_QueueSend_P(PSTR("LS "));
+  Link_PrintChar(bankchar);
+  Link_PrintUInt(bitidx);
+  Link_QueueSend_P(PSTR(":  r="));
+  Link_PrintUInt(stats.rise_count);
+  Link_QueueSend_P(PSTR(" f="));
+  Link_PrintUInt(stats.fall_count);
+
+  // Widths are min/mean/max.
+  // High widths are measured at every fall that follows a rise.
+  samples = stats.fall_count;
+  if ( (0 < samples) && !(stats.flags & STATS_FLAG_FIRST_RISE) )
+    samples--;
+  Link_QueueSend_P(PSTR(" h="));
+  Link_PrintUInt(samples ? stats.high_min : 0);
+  Link_PrintChar('/');
+  Link_PrintUInt(samples ? (stats.high_total / samples) : 0);
+  Link_PrintChar('/');
+  Link_PrintUInt(stats.high_max);
+
+  // Low widths are measured at every rise that follows a fall.
+  samples = stats.rise_count;
+  if ( (0 < samples) && (stats.flags & STATS_FLAG_FIRST_RISE) )
+    samples--;
+  Link_QueueSend_P(PSTR(" l="));
+  Link_PrintUInt(samples ? stats.low_min : 0);
+  Link_PrintChar('/');
+  Link_PrintUInt(samples ? (stats.low_total / samples) : 0);
+  Link_PrintChar('/');
+  Link_PrintUInt(stats.low_max);
+
+  Link_QueueSend_P(PSTR(" p="));
+  for (bidx = 0; bidx < STATS_HIST_BINS; bidx++)
+  {
+    if (0 < bidx)
+      Link_PrintChar(',');
+    Link_PrintUInt(stats.interval_hist[bidx]);
+  }
+
+  Link_QueueSend_P(PSTR("\r\n"));
+}
+
+#endif
+
+
+
+// Prints a summary of all lines' statistics.
+
+void PrintLineStats(void)
+{
+#if STATS_ENABLE
+  line_stats_t snapshot;
+  uint64_t thistime;
+  int lidx;
+
+  // This makes its own locking call.
+  thistime = QueryTimebase64();
+
+  Link_QueueSend_P(PSTR("LS: "));
+  Link_PrintUInt64(thistime);
+  Link_QueueSend_P(PSTR("\r\n"));
+
+  for (lidx = 0; lidx < STATS_LINE_COUNT; lidx++)
+  {
+    // Copy this line's record so that the ISR can keep updating it.
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      snapshot = line_stats[lidx];
+    }
+
+    if (lidx < STATS_INPUT_LINES)
+      PrintOneLineStats('I', lidx, snapshot);
+    else
+      PrintOneLineStats('O', lidx - STATS_INPUT_LINES, snapshot);
+  }
+
+  Link_QueueSend_P(PSTR("LS: end\r\n"));
+#else
+  Link_QueueSend_P(PSTR("Line statistics are disabled.\r\n"));
+#endif
+}
+
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,22 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Per-line edge statistics.
+
+
+//
+// Functions
+
+// Clears all accumulated statistics.
+void ResetLineStats(void);
+
+// Records edges on one bank of lines.
+// "changed" has a bit set for each line that toggled; "new_bits" is the
+// bank's state after the change. This must be called with interrupts off.
+void NoteLineEdges_ISR(reg_id_t target, uint32_t changed, uint32_t new_bits,
+  uint32_t this_time);
+
+// Prints a summary of all lines' statistics.
+void PrintLineStats(void);
+
+
+//
+// This is the end of the file.
@@ -0,0 +1,655 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Multi-box shared timebase (master/slave sync).
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if SYNC_ENABLE
+
+//
+// Private macros
+
+// Capture timer cycles per tick and per sync period.
+// These are signed, as they're mostly used with signed phase errors.
+#define SYNC_CYCLES_PER_TICK ((int32_t) (CPU_SPEED / RTC_TICKS_PER_SECOND))
+#define SYNC_PERIOD_CYCLES (SYNC_PERIOD_TICKS * SYNC_CYCLES_PER_TICK)
+
+// Each frame is a 3-tick marker pulse followed by 32 pulses that are
+// 1 tick wide for a 0 bit and 2 ticks wide for a 1 bit. The bits are the
+// master's timestamp of the marker's leading edge, LSB first.
+#define SYNC_FRAME_BITS 32
+#define SYNC_MARKER_TICKS 3
+
+// Frequency corrections are in units of 2^-24 (about 0.06 ppm), and are
+// limited to about 244 ppm. This bounds the slew rate.
+#define SYNC_FREQ_SHIFT 24
+#define SYNC_MAX_FREQ 4096
+
+// Slaves go into holdover after this many missing pulses.
+#define SYNC_HOLDOVER_PERIODS 3
+
+// Slaves forget the master's pulse count after this long without pulses.
+#define SYNC_FORGET_CYCLES (60ul * CPU_SPEED)
+
+// Number of captured pulses waiting for the main loop.
+#define SYNC_PULSE_QUEUE_SIZE 4
+
+
+
+//
+// Private types
+
+struct sync_pulse_t
+{
+  uint32_t rise_time;
+  uint32_t width;
+};
+
+
+
+//
+// Private variables
+
+volatile sync_role_t sync_role = SYNC_ROLE_OFF;
+sync_state_t sync_state = SYNC_STATE_IDLE;
+
+// Master pulse generation.
+uint32_t sync_next_pulse = 0;
+uint32_t sync_pulse_end = 0;
+bool sync_pulse_high = false;
+uint8_t sync_frame_pos = 0;
+uint32_t sync_frame_bits = 0;
+
+// Slave pulse capture.
+bool sync_have_rise = false;
+uint32_t sync_rise_time = 0;
+sync_pulse_t sync_pulses[SYNC_PULSE_QUEUE_SIZE];
+volatile uint8_t sync_pulse_head = 0;
+volatile uint8_t sync_pulse_count = 0;
+
+// Slave timebase model.
+// Capture timer value sync_base_local corresponds to master time
+// sync_base_tick plus sync_base_frac cycles. From there, the local clock
+// is scaled by (1 + sync_freq * 2^-24).
+volatile bool sync_model_valid = false;
+uint32_t sync_base_local = 0;
+uint32_t sync_base_tick = 0;
+int32_t sync_base_frac = 0;
+int32_t sync_freq = 0;
+
+// Slave loop filter state.
+int32_t sync_freq_int = 0;
+int32_t sync_phase_error = 0;
+uint8_t sync_lock_count = 0;
+
+// Slave pulse tracking and frame decoding.
+bool sync_have_prev = false;
+uint32_t sync_prev_rise = 0;
+bool sync_tick_known = false;
+uint32_t sync_pulse_tick = 0;
+bool sync_candidate_valid = false;
+uint32_t sync_candidate_tick = 0;
+bool sync_frame_valid = false;
+uint8_t sync_decode_pos = 0;
+uint32_t sync_decode_bits = 0;
+
+
+
+//
+// Private prototypes
+
+// Ends any master pulse in progress, driving the sync output low.
+
+void ClearSyncOutput(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    PORTD &= ~SYNC_OUTPUT_MASK;
+    sync_pulse_high = false;
+  }
+}
+
+
+
+// Converts a capture timer value to master time, using the current model.
+// "frac" gets the number of cycles past the returned tick.
+// This must be called with interrupts off.
+uint32_t PredictSyncTime_ISR(uint32_t local_time, int32_t &frac);
+
+// Moves the model's reference point, without changing its prediction.
+// This must be called with interrupts off.
+void RebaseSync_ISR(uint32_t local_time);
+
+// Processes one captured sync pulse.
+void HandleSyncPulse(uint32_t rise_time, uint32_t width);
+
+// Updates the timebase model with a pulse whose master time is known.
+void DisciplineSync(uint32_t rise_time, uint32_t master_tick, bool force_step);
+
+// Limits a frequency correction to the allowed range.
+int32_t ClampSyncFreq(int32_t freq);
+
+
+
+//
+// Functions
+
+
+// Selects off, master, or slave mode.
+// Returns false if the capture timer is busy with something else.
+
+bool SetSyncRole(sync_role_t role)
+{
+  sync_role_t old_role;
+
+#if SELFTEST_ENABLE
+  if ( (SYNC_ROLE_SLAVE == role) && IsSelfTestActive() )
+    return false;
+#endif
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    old_role = sync_role;
+
+    // Stop whatever we were doing.
+    PORTD &= ~SYNC_OUTPUT_MASK;
+    sync_pulse_high = false;
+    if (SYNC_ROLE_MASTER == role)
+      DDRD |= SYNC_OUTPUT_MASK;
+    else
+      DDRD &= ~SYNC_OUTPUT_MASK;
+
+    sync_role = role;
+    sync_state =
+      (SYNC_ROLE_SLAVE == role) ? SYNC_STATE_SEARCHING : SYNC_STATE_IDLE;
+
+    sync_next_pulse = Timer_Query_ISR() + 1;
+    sync_frame_pos = 0;
+
+    sync_have_rise = false;
+    sync_pulse_head = 0;
+    sync_pulse_count = 0;
+
+    sync_model_valid = false;
+    sync_freq = 0;
+    sync_freq_int = 0;
+    sync_phase_error = 0;
+    sync_lock_count = 0;
+
+    sync_have_prev = false;
+    sync_tick_known = false;
+    sync_candidate_valid = false;
+    sync_frame_valid = false;
+  }
+
+  if (SYNC_ROLE_SLAVE == role)
+  {
+    SetCaptureSource(CAPTURE_PIN);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      SetCaptureEdge_ISR(true);
+    }
+  }
+  else if (SYNC_ROLE_SLAVE == old_role)
+    SetCaptureSource(CAPTURE_OFF);
+
+  return true;
+}
+
+
+
+// Queries sync state.
+
+void QuerySyncStatus(sync_status_t &status)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    status.role = sync_role;
+    status.state = sync_state;
+    status.phase_error = sync_phase_error;
+    status.freq_ppb = sync_freq;
+    status.tick_offset = GetEventTime_ISR() - Timer_Query_ISR();
+  }
+
+  // 10^9 / 2^24 is 59.605.
+  status.freq_ppb = (status.freq_ppb * 59605L) / 1000;
+}
+
+
+
+// Restarts master pulse timing from the current time, after the local
+// clock is reset or the sync tasklet is re-enabled.
+
+void ResetSync(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    // Slaves will see a new timestamp at the next marker, and step to it.
+    sync_next_pulse = Timer_Query_ISR() + 1;
+    sync_frame_pos = 0;
+  }
+}
+
+
+
+// Converts a capture timer value to master time, using the current model.
+// "frac" gets the number of cycles past the returned tick.
+// This must be called with interrupts off.
+
+uint32_t PredictSyncTime_ISR(uint32_t local_time, int32_t &frac)
+{
+  int32_t elapsed, total, ticks;
+
+  // This is normally positive, but the main loop can process a capture
+  // after rebasing to a later time.
+  elapsed = (int32_t) (local_time - sync_base_local);
+
+  // The model is rebased at least once per second, so this can't overflow.
+  total = sync_base_frac + elapsed
+    + (((elapsed >> 8) * sync_freq) >> (SYNC_FREQ_SHIFT - 8));
+
+  ticks = total / SYNC_CYCLES_PER_TICK;
+  frac = total - (ticks * SYNC_CYCLES_PER_TICK);
+  if (0 > frac)
+  {
+    frac += SYNC_CYCLES_PER_TICK;
+    ticks--;
+  }
+
+  return sync_base_tick + ticks;
+}
+
+
+
+// Moves the model's reference point, without changing its prediction.
+// This must be called with interrupts off.
+
+void RebaseSync_ISR(uint32_t local_time)
+{
+  int32_t frac;
+
+  sync_base_tick = PredictSyncTime_ISR(local_time, frac);
+  sync_base_frac = frac;
+  sync_base_local = local_time;
+}
+
+
+
+// Returns the timestamp to report events with, in ticks.
+// Slaves that have acquired the master's time return that; everything
+// else returns local time.
+// This must be called with interrupts off.
+
+uint32_t GetEventTime_ISR(void)
+{
+  int32_t frac;
+
+  if ( (SYNC_ROLE_SLAVE == sync_role) && sync_model_valid )
+    return PredictSyncTime_ISR(GetCaptureTime_ISR(), frac);
+
+  return Timer_Query_ISR();
+}
+
+
+
+// Performs interrupt-driven master pulse output.
+// This should be called as early in the timer interrupt as possible.
+
+void PollSync_ISR(void)
+{
+  uint32_t this_time;
+  uint8_t width;
+
+  if (SYNC_ROLE_MASTER != sync_role)
+    return;
+
+  this_time = Timer_Query_ISR();
+
+  if (IsTimeReached(this_time, sync_next_pulse))
+  {
+    // The leading edge is the timing reference, so it goes first.
+    PORTD |= SYNC_OUTPUT_MASK;
+    sync_pulse_high = true;
+
+    if (0 == sync_frame_pos)
+    {
+      width = SYNC_MARKER_TICKS;
+      sync_frame_bits = this_time;
+    }
+    else
+    {
+      width = 1 + (sync_frame_bits & 0x01);
+      sync_frame_bits >>= 1;
+    }
+
+    sync_pulse_end = this_time + width;
+
+    sync_frame_pos++;
+    if (SYNC_FRAME_BITS < sync_frame_pos)
+      sync_frame_pos = 0;
+
+    sync_next_pulse += SYNC_PERIOD_TICKS;
+  }
+  else if ( sync_pulse_high && IsTimeReached(this_time, sync_pulse_end) )
+  {
+    PORTD &= ~SYNC_OUTPUT_MASK;
+    sync_pulse_high = false;
+  }
+}
+
+
+
+// Notes an input capture event, timestamped with the capture timer.
+// This must be called with interrupts off.
+
+void NoteSyncCapture_ISR(uint32_t capture_time, bool is_rising)
+{
+  uint8_t idx;
+
+  if (SYNC_ROLE_SLAVE != sync_role)
+    return;
+
+  if (is_rising)
+  {
+    sync_rise_time = capture_time;
+    sync_have_rise = true;
+  }
+  else if (sync_have_rise)
+  {
+    sync_have_rise = false;
+
+    if (sync_pulse_count < SYNC_PULSE_QUEUE_SIZE)
+    {
+      idx = sync_pulse_head + sync_pulse_count;
+      if (SYNC_PULSE_QUEUE_SIZE <= idx)
+        idx -= SYNC_PULSE_QUEUE_SIZE;
+
+      sync_pulses[idx].rise_time = sync_rise_time;
+      sync_pulses[idx].width = capture_time - sync_rise_time;
+      sync_pulse_count++;
+    }
+  }
+}
+
+
+
+// Limits a frequency correction to the allowed range.
+
+int32_t ClampSyncFreq(int32_t freq)
+{
+  if (SYNC_MAX_FREQ < freq)
+    freq = SYNC_MAX_FREQ;
+  if (-SYNC_MAX_FREQ > freq)
+    freq = -SYNC_MAX_FREQ;
+
+  return freq;
+}
+
+
+
+// Updates the timebase model with a pulse whose master time is known.
+
+void DisciplineSync(uint32_t rise_time, uint32_t master_tick, bool force_step)
+{
+  uint32_t predicted_tick;
+  int32_t frac, tick_error, phase_error, freq_error;
+  bool stepped;
+
+  predicted_tick = 0;
+  frac = 0;
+  stepped = false;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (force_step || (!sync_model_valid))
+    {
+      sync_base_local = rise_time;
+      sync_base_tick = master_tick;
+      sync_base_frac = 0;
+      sync_model_valid = true;
+      stepped = true;
+    }
+    else
+    {
+      predicted_tick = PredictSyncTime_ISR(rise_time, frac);
+      sync_base_local = rise_time;
+      sync_base_tick = predicted_tick;
+      sync_base_frac = frac;
+    }
+  }
+
+  if (stepped)
+  {
+    sync_phase_error = 0;
+    sync_lock_count = 0;
+    sync_state = SYNC_STATE_TRACKING;
+    return;
+  }
+
+  // Positive errors mean that we're behind the master.
+  tick_error = (int32_t) (master_tick - predicted_tick);
+  phase_error = SYNC_STEP_CYCLES + 1;
+  if ( (-1000 < tick_error) && (1000 > tick_error) )
+    phase_error = (tick_error * SYNC_CYCLES_PER_TICK) - frac;
+
+  sync_phase_error = phase_error;
+
+  if ( (SYNC_STEP_CYCLES < phase_error) || (-SYNC_STEP_CYCLES > phase_error) )
+  {
+    // Either the master was reset or we lost count of its pulses.
+    // Keep the model running, and step when the next frame says where
+    // we are.
+    sync_tick_known = false;
+    sync_candidate_valid = false;
+    sync_lock_count = 0;
+    sync_state = SYNC_STATE_SEARCHING;
+    return;
+  }
+
+  // PI loop filter. The proportional term removes the phase error over
+  // about four periods; the integral term tracks crystal frequency offset.
+  freq_error = (int32_t)
+    ( (((int64_t) phase_error) << SYNC_FREQ_SHIFT) / SYNC_PERIOD_CYCLES );
+  sync_freq_int = ClampSyncFreq(sync_freq_int + (freq_error / 16));
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    sync_freq = ClampSyncFreq(sync_freq_int + (freq_error / 4));
+  }
+
+  if ( (SYNC_LOCK_CYCLES >= phase_error) && (-SYNC_LOCK_CYCLES <= phase_error) )
+  {
+    if (4 > sync_lock_count)
+      sync_lock_count++;
+  }
+  else
+    sync_lock_count = 0;
+
+  sync_state =
+    (4 <= sync_lock_count) ? SYNC_STATE_LOCKED : SYNC_STATE_TRACKING;
+}
+
+
+
+// Processes one captured sync pulse.
+
+void HandleSyncPulse(uint32_t rise_time, uint32_t width)
+{
+  uint32_t steps, decoded_tick;
+  int32_t frac, tick_error;
+  bool decoded, force_step;
+
+  // Count periods since the last pulse, in case some were missed.
+  steps = 1;
+  if (sync_have_prev)
+  {
+    steps = (rise_time - sync_prev_rise + (SYNC_PERIOD_CYCLES / 2))
+      / SYNC_PERIOD_CYCLES;
+
+    // Glitches closer than half a period are ignored.
+    if (0 == steps)
+      return;
+  }
+  sync_prev_rise = rise_time;
+  sync_have_prev = true;
+
+  if (sync_tick_known)
+    sync_pulse_tick += steps * SYNC_PERIOD_TICKS;
+  if (sync_candidate_valid)
+    sync_candidate_tick += steps * SYNC_PERIOD_TICKS;
+
+  // Frame decoding. Widths are 1, 2, or 3 ticks.
+  decoded = false;
+  decoded_tick = 0;
+  if (width >= (uint32_t) (SYNC_CYCLES_PER_TICK * 5 / 2))
+  {
+    sync_frame_valid = true;
+    sync_decode_pos = 0;
+    sync_decode_bits = 0;
+  }
+  else if (sync_frame_valid)
+  {
+    if (1 != steps)
+      sync_frame_valid = false;
+    else
+    {
+      if (width >= (uint32_t) (SYNC_CYCLES_PER_TICK * 3 / 2))
+        sync_decode_bits |= (1ul << sync_decode_pos);
+
+      sync_decode_pos++;
+      if (SYNC_FRAME_BITS <= sync_decode_pos)
+      {
+        decoded = true;
+        decoded_tick = sync_decode_bits
+          + (SYNC_FRAME_BITS * SYNC_PERIOD_TICKS);
+        sync_frame_valid = false;
+      }
+    }
+  }
+
+  // A frame that disagrees with our count has to be confirmed by the next
+  // one, so that a corrupted bit doesn't cause a step.
+  force_step = false;
+  if (decoded)
+  {
+    if (sync_tick_known && (decoded_tick == sync_pulse_tick))
+      sync_candidate_valid = false;
+    else if ( (!sync_tick_known)
+      || (sync_candidate_valid && (decoded_tick == sync_candidate_tick)) )
+    {
+      force_step = sync_model_valid;
+      sync_tick_known = true;
+      sync_pulse_tick = decoded_tick;
+      sync_candidate_valid = false;
+    }
+    else
+    {
+      sync_candidate_valid = true;
+      sync_candidate_tick = decoded_tick;
+    }
+  }
+
+  // A reacquired slave only steps if the frame disagrees with the model.
+  if (force_step)
+  {
+    force_step = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      tick_error = (int32_t) (sync_pulse_tick
+        - PredictSyncTime_ISR(rise_time, frac));
+    }
+    if ( (-1 > tick_error) || (1 < tick_error) )
+      force_step = true;
+  }
+
+  if (sync_tick_known)
+    DisciplineSync(rise_time, sync_pulse_tick, force_step);
+}
+
+
+
+// Polling entry point for disciplining the slave timebase.
+
+void PollSync(void)
+{
+  sync_pulse_t pulse;
+  bool have_pulse;
+  uint32_t this_time;
+
+  if (SYNC_ROLE_SLAVE != sync_role)
+    return;
+
+  do
+  {
+    have_pulse = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      if (0 < sync_pulse_count)
+      {
+        have_pulse = true;
+        pulse = sync_pulses[sync_pulse_head];
+        sync_pulse_head++;
+        if (SYNC_PULSE_QUEUE_SIZE <= sync_pulse_head)
+          sync_pulse_head = 0;
+        sync_pulse_count--;
+      }
+    }
+
+    if (have_pulse)
+      HandleSyncPulse(pulse.rise_time, pulse.width);
+  }
+  while (have_pulse);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    this_time = GetCaptureTime_ISR();
+
+    // Keep the model's elapsed time short, so that the fixed-point math
+    // in PredictSyncTime_ISR() doesn't overflow during holdover.
+    if ( sync_model_valid && ((this_time - sync_base_local) > CPU_SPEED) )
+      RebaseSync_ISR(this_time);
+  }
+
+  if (sync_have_prev)
+  {
+    if ( (this_time - sync_prev_rise)
+      > (SYNC_HOLDOVER_PERIODS * SYNC_PERIOD_CYCLES) )
+    {
+      if ( (SYNC_STATE_TRACKING == sync_state)
+        || (SYNC_STATE_LOCKED == sync_state) )
+        sync_state = SYNC_STATE_HOLDOVER;
+      sync_lock_count = 0;
+      sync_frame_valid = false;
+    }
+
+    // Past this, pulses can't be counted reliably (and the capture timer
+    // will eventually wrap).
+    if ( (this_time - sync_prev_rise) > SYNC_FORGET_CYCLES )
+    {
+      sync_have_prev = false;
+      sync_tick_known = false;
+      sync_candidate_valid = false;
+    }
+  }
+}
+
+
+#else
+
+// Returns the timestamp to report events with, in ticks.
+// Without sync support, this is always local time.
+// This must be called with interrupts off.
+
+uint32_t GetEventTime_ISR(void)
+{
+  return Timer_Query_ISR();
+}
+
+#endif
+
+//
+// This is the end of the file.
@@ -0,0 +1,80 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Multi-box shared timebase (master/slave sync).
+
+
+//
+// Enums
+
+enum sync_role_t
+{
+  SYNC_ROLE_OFF,
+  SYNC_ROLE_MASTER,
+  SYNC_ROLE_SLAVE
+};
+
+enum sync_state_t
+{
+  SYNC_STATE_IDLE,
+  SYNC_STATE_SEARCHING,
+  SYNC_STATE_TRACKING,
+  SYNC_STATE_LOCKED,
+  SYNC_STATE_HOLDOVER
+};
+
+
+//
+// Structures
+
+struct sync_status_t
+{
+  sync_role_t role;
+  sync_state_t state;
+
+  // Master time minus local time, in ticks.
+  int32_t tick_offset;
+
+  // Most recent phase error, in CPU cycles (positive means behind).
+  int32_t phase_error;
+
+  // Frequency correction applied to the local clock, in parts per billion.
+  int32_t freq_ppb;
+};
+
+
+//
+// Functions
+
+// Selects off, master, or slave mode.
+// Returns false if the capture timer is busy with something else.
+bool SetSyncRole(sync_role_t role);
+
+// Queries sync state.
+void QuerySyncStatus(sync_status_t &status);
+
+// Restarts master pulse timing from the current time, after the local
+// clock is reset or the sync tasklet is re-enabled.
+void ResetSync(void);
+
+// Ends any master pulse in progress, driving the sync output low.
+void ClearSyncOutput(void);
+
+// Returns the timestamp to report events with, in ticks.
+// Slaves that have acquired the master's time return that; everything
+// else returns local time.
+// This must be called with interrupts off.
+uint32_t GetEventTime_ISR(void);
+
+// Performs interrupt-driven master pulse output.
+// This should be called as early in the timer interrupt as possible.
+void PollSync_ISR(void);
+
+// Notes an input capture event, timestamped with the capture timer.
+// This must be called with interrupts off.
+void NoteSyncCapture_ISR(uint32_t capture_time, bool is_rising);
+
+// Polling entry point for disciplining the slave timebase.
+void PollSync(void);
+
+
+//
+// This is the end of the file.
@@ -19,6 +19,13 @@ volatile bool strobe_state;
 uint32_t strobe_period = FOB_DEFAULT_STROBE_PERIOD;
 uint32_t strobe_duration = FOB_DEFAULT_STROBE_HOLD;
 
+// Fine period control. If strobe_fine_period is nonzero, it's the period in
+// 1/65536ths of a tick, and the fraction is carried from pulse to pulse.
+// strobe_cycle_period is the length in ticks of the current cycle.
+volatile uint32_t strobe_fine_period = 0;
+uint16_t strobe_frac_accum = 0;
+uint32_t strobe_cycle_period = FOB_DEFAULT_STROBE_PERIOD;
+
 bool task_active = false;
 
 
@@ -36,6 +43,9 @@ void ConfigureTask(uint32_t new_period, uint32_t new_duration)
   strobe_period = new_period;
   strobe_duration = new_duration;
 
+  strobe_cycle_period = new_period;
+  strobe_frac_accum = 0;
+
   strobe_state = false;
   task_active = false;
 }
@@ -52,6 +62,20 @@ void QueryTaskParams(uint32_t &period, uint32_t &duration)
 
 
 
+// Sets the strobe period in 1/65536ths of a tick (0 = use the configured
+// period). This overrides the configured period until it's reset.
+
+void SetTaskFinePeriod(uint32_t period_q16)
+{
+  // A 32-bit write isn't atomic on the AVR.
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    strobe_fine_period = period_q16;
+  }
+}
+
+
+
 // Toggles the task on or off.
 
 void SetTaskActivity(bool is_active)
@@ -76,11 +100,60 @@ bool IsTaskActive(void)
 
 
 
+// Queries whether the task is active and actually being run.
+// The strobe tasklet can be disabled while the task is active.
+
+bool IsTaskRunning(void)
+{
+#if TASKLET_ENABLE
+  if (!IsStrobeTaskletActive())
+    return false;
+#endif
+
+  return task_active;
+}
+
+
+
+// Restarts strobe timing from the current time, leaving activity alone.
+
+void RestartTaskStrobe(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    last_strobe_time = Timer_Query_ISR();
+    strobe_cycle_period = strobe_period;
+    strobe_frac_accum = 0;
+    strobe_state = false;
+  }
+}
+
+
+
+// Turns the strobe output off if it's on, ending the pulse early.
+
+void ClearTaskStrobe(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (strobe_state)
+    {
+      strobe_state = false;
+      SetDIOBits(DIO_REG_OUTPUT, 0x00);
+    }
+  }
+}
+
+
+
 // Performs interrupt-driven updates to task state.
 
 void PollTask_ISR()
 {
   uint32_t this_time;
+#if PLL_ENABLE
+  uint32_t frac_total;
+#endif
 
   if (task_active)
   {
@@ -88,24 +161,49 @@ void PollTask_ISR()
 
     if (strobe_state)
     {
-      if (this_time > last_strobe_time + strobe_duration)
+      if (IsTimePast(this_time, last_strobe_time + strobe_duration))
       {
         // Turn the light off.
 
         strobe_state = false;
+#if SELFTEST_ENABLE
+        NoteStrobeEdge_ISR(false);
+#endif
         SetDIOBits(DIO_REG_OUTPUT, 0x00);
       }
     }
     else
     {
-      if (this_time > last_strobe_time + strobe_period)
+      if (IsTimePast(this_time, last_strobe_time + strobe_cycle_period))
       {
         // Turn the light on, and reset the timeout.
 
         strobe_state = true;
+#if SELFTEST_ENABLE
+        NoteStrobeEdge_ISR(true);
+#endif
         SetDIOBits(DIO_REG_OUTPUT, 0x01);
-
-        last_strobe_time += strobe_period;
+#if PLL_ENABLE
+        NotePLLStrobe_ISR();
+#endif
+
+        last_strobe_time += strobe_cycle_period;
+
+#if PLL_ENABLE
+        // Pick the next cycle's length, carrying the fractional part.
+        if (0 == strobe_fine_period)
+          strobe_cycle_period = strobe_period;
+        else
+        {
+          frac_total = ((uint32_t) strobe_frac_accum)
+            + (strobe_fine_period & 0xffff);
+          strobe_cycle_period = (strobe_fine_period >> 16) + (frac_total >> 16);
+          strobe_frac_accum = frac_total & 0xffff;
+        }
+#else
+        // Only the reference PLL uses fine periods.
+        strobe_cycle_period = strobe_period;
+#endif
       }
     }
   }
@@ -12,12 +12,25 @@ void ConfigureTask(uint32_t new_period, uint32_t new_duration);
 // Queries task configuration.
 void QueryTaskParams(uint32_t &period, uint32_t &duration);
 
+// Sets the strobe period in 1/65536ths of a tick (0 = use the configured
+// period). This overrides the configured period until it's reset.
+void SetTaskFinePeriod(uint32_t period_q16);
+
 // Toggles the task on or off.
 void SetTaskActivity(bool is_active);
 
 // Queries whether the task is active or inactive.
 bool IsTaskActive(void);
 
+// Queries whether the task is active and actually being run.
+bool IsTaskRunning(void);
+
+// Restarts strobe timing from the current time, leaving activity alone.
+void RestartTaskStrobe(void);
+
+// Turns the strobe output off if it's on, ending the pulse early.
+void ClearTaskStrobe(void);
+
 // Performs interrupt-driven updates to task state.
 void PollTask_ISR();
 
@@ -0,0 +1,349 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Cooperative tasklet scheduler.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if TASKLET_ENABLE
+
+//
+// Private macros
+
+// Worst-case ISR hook costs for the built-in tasklets, in CPU cycles.
+// These are generous estimates; "TKL" reports what they actually take.
+#define TASKLET_BUDGET_SYNC 1200
+#define TASKLET_BUDGET_STROBE 600
+#define TASKLET_BUDGET_WAVE 800
+
+// Measured costs saturate at this.
+#define TASKLET_COST_MAX 0xffff
+
+
+
+//
+// Private types
+
+struct tasklet_t
+{
+  const char *name_P;
+  tasklet_hook_t isr_hook;
+  tasklet_hook_t main_hook;
+  tasklet_hook_t start_hook;
+  tasklet_hook_t stop_hook;
+  uint16_t isr_budget;
+
+  bool is_active;
+
+  // Measured worst cases, in CPU cycles, and ISR budget overruns.
+  // Main-loop costs include time spent in interrupts.
+  uint16_t isr_max;
+  uint16_t main_max;
+  uint16_t overruns;
+};
+
+
+
+//
+// Private variables
+
+tasklet_t tasklets[TASKLET_MAX];
+volatile uint8_t tasklet_count = 0;
+
+// Index of the strobe tasklet, for task state queries.
+int strobe_tasklet = -1;
+
+
+
+//
+// Private prototypes
+
+// Returns the total ISR budget of enabled tasklets.
+uint32_t GetActiveTaskletBudget(void);
+
+// Converts a cycle count to a saturated 16-bit cost.
+uint16_t ClampTaskletCost(uint32_t cycles);
+
+
+
+//
+// Functions
+
+
+// Registers the built-in tasklets (all enabled).
+// Sync goes first, as its pulse edges are timing references.
+
+void InitTasklets(void)
+{
+  // Sync and the strobe schedule pulses from their last pulse, so they
+  // restart from "now" when re-enabled rather than catching up, and
+  // drive their outputs low when disabled rather than leaving them lit.
+
+#if SYNC_ENABLE
+  RegisterTasklet(PSTR("sync"), &PollSync_ISR, &PollSync, &ResetSync,
+    &ClearSyncOutput, TASKLET_BUDGET_SYNC);
+#endif
+
+  strobe_tasklet = RegisterTasklet(PSTR("strobe"), &PollTask_ISR, NULL,
+    &RestartTaskStrobe, &ClearTaskStrobe, TASKLET_BUDGET_STROBE);
+
+#if WAVE_ENABLE
+  RegisterTasklet(PSTR("wave"), &PollWave_ISR, NULL, NULL, NULL,
+    TASKLET_BUDGET_WAVE);
+#endif
+
+#if PLL_ENABLE
+  RegisterTasklet(PSTR("pll"), NULL, &PollPLL, NULL, NULL, 0);
+#endif
+}
+
+
+
+// Adds a tasklet.
+// Returns the tasklet's index, or -1 if it doesn't fit.
+
+int RegisterTasklet(const char *name_P, tasklet_hook_t isr_hook,
+  tasklet_hook_t main_hook, tasklet_hook_t start_hook,
+  tasklet_hook_t stop_hook, uint16_t isr_budget)
+{
+  int index;
+
+  if (TASKLET_MAX <= tasklet_count)
+    return -1;
+
+  if (TASKLET_ISR_BUDGET < (GetActiveTaskletBudget() + isr_budget))
+    return -1;
+
+  index = tasklet_count;
+
+  tasklets[index].name_P = name_P;
+  tasklets[index].isr_hook = isr_hook;
+  tasklets[index].main_hook = main_hook;
+  tasklets[index].start_hook = start_hook;
+  tasklets[index].stop_hook = stop_hook;
+  tasklets[index].isr_budget = isr_budget;
+  tasklets[index].is_active = true;
+  tasklets[index].isr_max = 0;
+  tasklets[index].main_max = 0;
+  tasklets[index].overruns = 0;
+
+  // The entry has to be complete before the ISR can see it.
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    tasklet_count++;
+  }
+
+  return index;
+}
+
+
+
+// Enables or disables a tasklet.
+
+bool SetTaskletActivity(uint32_t index, bool is_active)
+{
+  // Check the whole argument, so that e.g. 256 isn't taken as 0.
+  if (tasklet_count <= index)
+    return false;
+
+  if ( is_active && (!tasklets[index].is_active)
+    && ( TASKLET_ISR_BUDGET
+      < (GetActiveTaskletBudget() + tasklets[index].isr_budget) ) )
+    return false;
+
+  // The ISR hook isn't running yet, so it can't race the start hook.
+  if ( is_active && (!tasklets[index].is_active)
+    && (NULL != tasklets[index].start_hook) )
+    (*(tasklets[index].start_hook))();
+
+  // A bool write is atomic.
+  tasklets[index].is_active = is_active;
+
+  // The ISR hook won't run again, so it can't race the stop hook.
+  if ( (!is_active) && (NULL != tasklets[index].stop_hook) )
+    (*(tasklets[index].stop_hook))();
+
+  return true;
+}
+
+
+
+// Enables all tasklets and clears measured costs.
+// Everything that registered fit the budget with everything enabled, so
+// enabling them all again is always safe.
+
+void ResetTasklets(void)
+{
+  uint8_t index;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (index = 0; index < tasklet_count; index++)
+    {
+      if ( (!tasklets[index].is_active)
+        && (NULL != tasklets[index].start_hook) )
+        (*(tasklets[index].start_hook))();
+
+      tasklets[index].is_active = true;
+      tasklets[index].isr_max = 0;
+      tasklets[index].main_max = 0;
+      tasklets[index].overruns = 0;
+    }
+  }
+}
+
+
+
+// Queries whether the strobe tasklet is enabled.
+
+bool IsStrobeTaskletActive(void)
+{
+  return (0 > strobe_tasklet) || tasklets[strobe_tasklet].is_active;
+}
+
+
+
+// Prints each tasklet's state, budget, and measured cost.
+
+void PrintTaskletState(void)
+{
+  uint8_t index;
+  tasklet_t snapshot;
+
+  for (index = 0; index < tasklet_count; index++)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      snapshot = tasklets[index];
+    }
+
+    Link_QueueSend_P(PSTR("TK: "));
+    Link_PrintUInt(index);
+    Link_PrintChar(' ');
+    Link_QueueSend_P(snapshot.name_P);
+    Link_QueueSend_P(snapshot.is_active ? PSTR(" on") : PSTR(" off"));
+    Link_QueueSend_P(PSTR(" bud="));
+    Link_PrintUInt(snapshot.isr_budget);
+    Link_QueueSend_P(PSTR(" isr="));
+    Link_PrintUInt(snapshot.isr_max);
+    Link_QueueSend_P(PSTR(" main="));
+    Link_PrintUInt(snapshot.main_max);
+    Link_QueueSend_P(PSTR(" over="));
+    Link_PrintUInt(snapshot.overruns);
+    Link_QueueSend_P(PSTR("\r\n"));
+  }
+
+  Link_QueueSend_P(PSTR("TK: total bud="));
+  Link_PrintUInt(GetActiveTaskletBudget());
+  Link_PrintChar('/');
+  Link_PrintUInt(TASKLET_ISR_BUDGET);
+  Link_QueueSend_P(PSTR("\r\n"));
+}
+
+
+
+// Returns the total ISR budget of enabled tasklets.
+
+uint32_t GetActiveTaskletBudget(void)
+{
+  uint32_t total;
+  uint8_t index;
+
+  total = 0;
+
+  for (index = 0; index < tasklet_count; index++)
+    if (tasklets[index].is_active)
+      total += tasklets[index].isr_budget;
+
+  return total;
+}
+
+
+
+// Converts a cycle count to a saturated 16-bit cost.
+
+uint16_t ClampTaskletCost(uint32_t cycles)
+{
+  return (TASKLET_COST_MAX < cycles) ? TASKLET_COST_MAX : cycles;
+}
+
+
+
+// Runs enabled ISR hooks.
+// This must be called with interrupts off.
+
+void RunTasklets_ISR(void)
+{
+  uint8_t index;
+  uint32_t start_time;
+  uint16_t cost;
+  tasklet_t *this_tasklet;
+
+  for (index = 0; index < tasklet_count; index++)
+  {
+    this_tasklet = &(tasklets[index]);
+
+    if ( this_tasklet->is_active && (NULL != this_tasklet->isr_hook) )
+    {
+      start_time = GetCaptureTime_ISR();
+      (*(this_tasklet->isr_hook))();
+      cost = ClampTaskletCost(GetCaptureTime_ISR() - start_time);
+
+      if (cost > this_tasklet->isr_max)
+        this_tasklet->isr_max = cost;
+
+      if ( (cost > this_tasklet->isr_budget)
+        && (TASKLET_COST_MAX > this_tasklet->overruns) )
+        this_tasklet->overruns++;
+    }
+  }
+}
+
+
+
+// Runs enabled main-loop hooks.
+
+void PollTasklets(void)
+{
+  uint8_t index, count;
+  uint32_t start_time, end_time;
+  uint16_t cost;
+  tasklet_hook_t hook;
+
+  count = tasklet_count;
+
+  for (index = 0; index < count; index++)
+  {
+    hook = tasklets[index].main_hook;
+
+    if ( tasklets[index].is_active && (NULL != hook) )
+    {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        start_time = GetCaptureTime_ISR();
+      }
+
+      (*hook)();
+
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        end_time = GetCaptureTime_ISR();
+      }
+
+      cost = ClampTaskletCost(end_time - start_time);
+
+      // The ISR doesn't touch this, so no locking is needed.
+      if (cost > tasklets[index].main_max)
+        tasklets[index].main_max = cost;
+    }
+  }
+}
+
+
+#endif
+
+//
+// This is the end of the file.
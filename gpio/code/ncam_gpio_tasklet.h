@@ -0,0 +1,52 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Cooperative tasklet scheduler.
+
+
+//
+// Types
+
+// Tasklet hooks. ISR hooks run from the timer interrupt, with interrupts
+// off, and have to be fast. Main hooks run from the main loop.
+typedef void (*tasklet_hook_t)(void);
+
+
+//
+// Functions
+
+// Registers the built-in tasklets (all enabled).
+void InitTasklets(void);
+
+// Adds a tasklet. The name is a string in flash. The ISR budget is the
+// worst-case number of CPU cycles the ISR hook takes. The start hook (if
+// any) is called when a disabled tasklet is enabled again, to pick up from
+// the current time. The stop hook (if any) is called when the tasklet is
+// disabled, to leave its outputs in a safe state.
+// Returns the tasklet's index, or -1 if the registry is full or the
+// tasklet would put enabled tasklets over TASKLET_ISR_BUDGET.
+int RegisterTasklet(const char *name_P, tasklet_hook_t isr_hook,
+  tasklet_hook_t main_hook, tasklet_hook_t start_hook,
+  tasklet_hook_t stop_hook, uint16_t isr_budget);
+
+// Enables or disables a tasklet.
+// Returns false if there's no such tasklet, or if enabling it would go
+// over TASKLET_ISR_BUDGET.
+bool SetTaskletActivity(uint32_t index, bool is_active);
+
+// Queries whether the strobe tasklet is enabled.
+bool IsStrobeTaskletActive(void);
+
+// Prints each tasklet's state, budget, and measured cost.
+void PrintTaskletState(void);
+
+// Enables all tasklets and clears measured costs.
+void ResetTasklets(void);
+
+// Runs enabled ISR hooks. This must be called with interrupts off.
+void RunTasklets_ISR(void);
+
+// Runs enabled main-loop hooks.
+void PollTasklets(void);
+
+
+//
+// This is the end of the file.
@@ -9,19 +9,182 @@
 #include "ncam_gpio_includes.h"
 
 
+//
+// Private variables
+
+// Number of times the 32-bit tick count has wrapped, and the count as of
+// the last timer interrupt (to detect the wrap).
+volatile uint32_t timebase_epoch = 0;
+volatile uint32_t timebase_last_tick = 0;
+
+
+
+//
+// Private prototypes
+
+// Notes the tick count, counting wraps.
+// This must be called with interrupts off.
+void UpdateTimebase_ISR(void);
+
+
+
 //
 // Functions
 
 
+// Notes the tick count, counting wraps.
+// This must be called with interrupts off.
+
+void UpdateTimebase_ISR(void)
+{
+  uint32_t this_time;
+
+  this_time = Timer_Query_ISR();
+
+  if (this_time < timebase_last_tick)
+    timebase_epoch++;
+
+  timebase_last_tick = this_time;
+}
+
+
+
+// Resets the tick count and the extended timebase.
+
+void ResetTimebase(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    Timer_Reset();
+    timebase_epoch = 0;
+    timebase_last_tick = Timer_Query_ISR();
+  }
+}
+
+
+
+// Returns the local tick count, extended to 64 bits.
+// This must be called with interrupts off.
+
+uint64_t QueryTimebase64_ISR(void)
+{
+  uint32_t this_time, epoch;
+
+  this_time = Timer_Query_ISR();
+  epoch = timebase_epoch;
+
+  // The count may have wrapped since the last timer interrupt (if this is
+  // called from another interrupt, or the timer interrupt is pending).
+  if (this_time < timebase_last_tick)
+    epoch++;
+
+  return (((uint64_t) epoch) << 32) | this_time;
+}
+
+
+
+// Returns the local tick count, extended to 64 bits.
+
+uint64_t QueryTimebase64(void)
+{
+  uint64_t result;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    result = QueryTimebase64_ISR();
+  }
+
+  return result;
+}
+
+
+
+// Returns the event timestamp (see GetEventTime_ISR()), extended to 64
+// bits. This must be called with interrupts off.
+
+uint64_t GetEventTime64_ISR(void)
+{
+  uint64_t local_time;
+
+  // Event time is local time, or a sync master's time that's close to it,
+  // so take the local time's upper bits.
+  local_time = QueryTimebase64_ISR();
+
+  return local_time
+    + (int32_t) (GetEventTime_ISR() - ((uint32_t) local_time));
+}
+
+
+
+// Extends a recent 32-bit local tick value to 64 bits.
+// It has to be within 2^31 ticks (about 24 days) of the present.
+
+uint64_t ExtendLocalTime(uint32_t local_time)
+{
+  uint64_t now;
+
+  now = QueryTimebase64();
+
+  return now + (int32_t) (local_time - ((uint32_t) now));
+}
+
+
+
+// Extends a recent 32-bit event timestamp to 64 bits.
+// It has to be within 2^31 ticks (about 24 days) of the present.
+
+uint64_t ExtendEventTime(uint32_t event_time)
+{
+  uint64_t now;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    now = GetEventTime64_ISR();
+  }
+
+  return now + (int32_t) (event_time - ((uint32_t) now));
+}
+
+
+
 // Timer interrupt callback.
 
 void TimerCallback_ISR(void)
 {
+  // Keep the extended timebase current. This is cheap, and has to happen
+  // at least once per wrap.
+  UpdateTimebase_ISR();
+
+#if FREQ_ENABLE
+  // Gate lengths are measured here, so this goes before anything that
+  // takes a variable amount of time.
+  UpdateFreqGate_ISR();
+#endif
+
   // There's no need for pins to be queried or written via ISR.
   // Direct reads and writes are adequate.
 
+#if TASKLET_ENABLE
+  // Timing duties are registered as tasklets, in priority order.
+  RunTasklets_ISR();
+#elif SYNC_ENABLE
+  // Sync pulse edges are timing references, so they go first.
+  PollSync_ISR();
+#endif
+
+#if defined(__AVR_ATmega32U4__)
+  // Only port B inputs have pin-change interrupts on this chip.
+  PollInputs_ISR();
+#endif
+
+#if !TASKLET_ENABLE
   // Handle application-specific routines. This must be fast.
   PollTask_ISR();
+
+#if WAVE_ENABLE
+  PollWave_ISR();
+#endif
+#endif
 }
 
 
@@ -10,5 +10,51 @@
 void TimerCallback_ISR(void);
 
 
+// Extended timebase.
+// The NeurAVR tick count is 32 bits, and wraps after about 49.7 days.
+// These carry it to 64 bits, for reports and queries.
+
+// Resets the tick count and the extended timebase.
+void ResetTimebase(void);
+
+// Returns the local tick count, extended to 64 bits.
+uint64_t QueryTimebase64(void);
+
+// Returns the local tick count, extended to 64 bits.
+// This must be called with interrupts off.
+uint64_t QueryTimebase64_ISR(void);
+
+// Returns the event timestamp (see GetEventTime_ISR()), extended to 64
+// bits. This must be called with interrupts off.
+uint64_t GetEventTime64_ISR(void);
+
+// Extends a recent 32-bit local tick value to 64 bits.
+// It has to be within 2^31 ticks (about 24 days) of the present.
+uint64_t ExtendLocalTime(uint32_t local_time);
+
+// Extends a recent 32-bit event timestamp to 64 bits.
+// It has to be within 2^31 ticks (about 24 days) of the present.
+uint64_t ExtendEventTime(uint32_t event_time);
+
+
+// Wrap-safe deadline tests for 32-bit tick values. These compare the
+// difference rather than the values, so they work across the wrap as
+// long as the times are within 2^31 ticks of each other. All timing
+// duties should use these rather than comparing ticks directly.
+// They're inline, as they're called from interrupts.
+
+// Returns true if "now" is at or after "deadline".
+inline bool IsTimeReached(uint32_t now, uint32_t deadline)
+{
+  return (0 <= (int32_t) (now - deadline));
+}
+
+// Returns true if "now" is strictly after "deadline".
+inline bool IsTimePast(uint32_t now, uint32_t deadline)
+{
+  return (0 < (int32_t) (now - deadline));
+}
+
+
 //
 // This is the end of the file.
@@ -0,0 +1,620 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Output waveform playback.
+
+
+//
+// Includes
+
+#include "ncam_gpio_includes.h"
+
+
+#if WAVE_ENABLE
+
+//
+// Private macros
+
+// Marker for a valid saved sequence in EEPROM.
+#define WAVE_EEPROM_MAGIC 0x5741
+
+// Largest delay that fits in a buffer entry.
+#define WAVE_MAX_DELAY 0xffff
+
+// Most entries played in one timer tick. Zero-delay entries are all
+// played in the tick they come due, so this keeps a table of them from
+// tying up the timer interrupt.
+#define WAVE_MAX_ENTRIES_PER_TICK WAVE_BUFFER_SIZE
+
+
+
+//
+// Private enums
+
+enum wave_state_t
+{
+  WAVE_IDLE,
+  WAVE_ARMED,
+  WAVE_PLAYING
+};
+
+enum wave_end_t
+{
+  WAVE_END_DONE,
+  WAVE_END_UNDERRUN,
+  WAVE_END_STOPPED
+};
+
+
+
+//
+// Private types
+
+// Each entry waits "delay" ticks after the previous one, then writes
+// "value" to the output bank.
+struct wave_entry_t
+{
+  uint16_t delay;
+  uint8_t value;
+};
+
+struct wave_eeprom_header_t
+{
+  uint16_t magic;
+  uint8_t count;
+  uint8_t streaming;
+  uint32_t loops;
+};
+
+
+
+//
+// Private variables
+
+// Sequence buffer. This is a ring; in streaming mode, entries are removed
+// as they're played so that the host can refill it.
+wave_entry_t wave_buffer[WAVE_BUFFER_SIZE];
+volatile uint8_t wave_head = 0;
+volatile uint8_t wave_count = 0;
+
+// Playback position (relative to wave_head) for table mode.
+volatile uint8_t wave_pos = 0;
+
+// Playback configuration.
+bool wave_streaming = false;
+uint32_t wave_loops = 1;
+uint32_t wave_trigger_mask = 0x01;
+
+// Playback state.
+volatile wave_state_t wave_state = WAVE_IDLE;
+volatile uint32_t wave_next_time;
+volatile uint32_t wave_plays_done;
+// Streaming mode: the host has sent everything it's going to send.
+volatile bool wave_finished = false;
+// Streaming mode: we're waiting for the host to send the next entry.
+volatile bool wave_starved = false;
+
+// Events waiting to be reported by the main loop.
+volatile bool wave_start_pending = false;
+volatile uint32_t wave_start_time;
+volatile bool wave_end_pending = false;
+volatile uint32_t wave_end_time;
+volatile wave_end_t wave_end_reason;
+bool wave_refill_reported = false;
+
+
+
+//
+// Private prototypes
+
+// Checks for a table that would loop forever without time passing.
+// This must be called with interrupts off.
+bool IsWaveTableTimeless_ISR(void);
+
+// Begins playback at the specified time.
+// Returns false (without starting) if the table can't be played.
+bool StartWave_ISR(uint32_t this_time);
+
+// Ends playback, queueing an event report.
+void EndWave_ISR(uint32_t this_time, wave_end_t reason);
+
+// Plays all entries that are due.
+void RunDueWaveEntries_ISR(uint32_t this_time);
+
+
+
+//
+// Functions
+
+
+// Checks for a table that would loop forever without time passing.
+// This must be called with interrupts off.
+
+bool IsWaveTableTimeless_ISR(void)
+{
+  uint8_t idx;
+
+  if ( wave_streaming || (0 < wave_loops) || (0 == wave_count) )
+    return false;
+
+  for (idx = 0; idx < wave_count; idx++)
+    if (0 < wave_buffer[(wave_head + idx) % WAVE_BUFFER_SIZE].delay)
+      return false;
+
+  return true;
+}
+
+
+
+// Begins playback at the specified time.
+// Returns false (without starting) if the table can't be played.
+
+bool StartWave_ISR(uint32_t this_time)
+{
+  if (IsWaveTableTimeless_ISR())
+  {
+    wave_state = WAVE_IDLE;
+    return false;
+  }
+
+  wave_state = WAVE_PLAYING;
+  wave_pos = 0;
+  wave_plays_done = 0;
+
+  wave_start_time = this_time;
+  wave_start_pending = true;
+
+  // The first entry's delay is relative to the start time.
+  wave_starved = (0 == wave_count);
+  if (!wave_starved)
+    wave_next_time = this_time + wave_buffer[wave_head].delay;
+  else
+    wave_next_time = this_time;
+
+  // Anything with zero delay happens right away.
+  RunDueWaveEntries_ISR(this_time);
+
+  return true;
+}
+
+
+
+// Ends playback, queueing an event report.
+
+void EndWave_ISR(uint32_t this_time, wave_end_t reason)
+{
+  wave_state = WAVE_IDLE;
+  wave_starved = false;
+
+  wave_end_time = this_time;
+  wave_end_reason = reason;
+  wave_end_pending = true;
+}
+
+
+
+// Plays all entries that are due.
+
+void RunDueWaveEntries_ISR(uint32_t this_time)
+{
+  uint8_t idx;
+  uint16_t played;
+
+  // Anything still due after this many entries is played next tick.
+  played = 0;
+
+  while ( (WAVE_PLAYING == wave_state) && (!wave_starved)
+    && IsTimeReached(this_time, wave_next_time)
+    && (WAVE_MAX_ENTRIES_PER_TICK > played) )
+  {
+    played++;
+
+    if (0 == wave_count)
+    {
+      // Table mode with an empty table.
+      EndWave_ISR(this_time, WAVE_END_DONE);
+      break;
+    }
+
+    idx = (wave_head + wave_pos) % WAVE_BUFFER_SIZE;
+    SetDIOBits(DIO_REG_OUTPUT, wave_buffer[idx].value);
+
+    if (wave_streaming)
+    {
+      // Consume this entry.
+      wave_head = (wave_head + 1) % WAVE_BUFFER_SIZE;
+      wave_count--;
+
+      if (0 < wave_count)
+        wave_next_time += wave_buffer[wave_head].delay;
+      else if (wave_finished)
+        EndWave_ISR(this_time, WAVE_END_DONE);
+      else
+        // Wait for the host; lateness is checked when the entry arrives.
+        wave_starved = true;
+    }
+    else
+    {
+      wave_pos++;
+      if (wave_pos >= wave_count)
+      {
+        wave_pos = 0;
+        wave_plays_done++;
+
+        if ( (0 < wave_loops) && (wave_plays_done >= wave_loops) )
+          EndWave_ISR(this_time, WAVE_END_DONE);
+      }
+
+      idx = (wave_head + wave_pos) % WAVE_BUFFER_SIZE;
+      wave_next_time += wave_buffer[idx].delay;
+    }
+  }
+}
+
+
+
+// Stops playback and empties the sequence buffer.
+
+void ClearWave(void)
+{
+  SetWaveActivity(WAVE_START_STOP);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    wave_head = 0;
+    wave_count = 0;
+    wave_pos = 0;
+    wave_finished = false;
+  }
+
+  wave_refill_reported = false;
+}
+
+
+
+// Appends an entry to the sequence buffer.
+// The argument is (delay in ticks) * 256 + (output value).
+// Returns false if the buffer is full or the entry is malformed.
+
+bool AppendWaveEntry(uint32_t packed_entry)
+{
+  bool result;
+  uint32_t delay;
+  uint8_t idx;
+  uint32_t this_time;
+
+  result = false;
+  delay = packed_entry >> 8;
+
+  if (WAVE_MAX_DELAY >= delay)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      if (WAVE_BUFFER_SIZE > wave_count)
+      {
+        idx = (wave_head + wave_count) % WAVE_BUFFER_SIZE;
+        wave_buffer[idx].delay = delay;
+        wave_buffer[idx].value = packed_entry & 0xff;
+        wave_count++;
+
+        // If playback was waiting on this entry, schedule it relative to
+        // the previous one. If we're already past that time, the host
+        // didn't keep up.
+        if (wave_starved)
+        {
+          wave_starved = false;
+          wave_next_time += delay;
+
+          this_time = Timer_Query_ISR();
+          if (IsTimePast(this_time, wave_next_time))
+            EndWave_ISR(this_time, WAVE_END_UNDERRUN);
+        }
+
+        result = true;
+      }
+    }
+  }
+
+  return result;
+}
+
+
+
+// Indicates that no more entries will be streamed for this playback.
+
+void FinishWave(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    wave_finished = true;
+
+    // If we were waiting on the host, there's nothing more to wait for.
+    if (wave_starved)
+      EndWave_ISR(Timer_Query_ISR(), WAVE_END_DONE);
+  }
+}
+
+
+
+// Sets the number of times to play the sequence (0 plays forever).
+
+void SetWaveLoops(uint32_t loops)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    wave_loops = loops;
+  }
+}
+
+
+
+// Selects streaming mode (entries are consumed as played) or table mode.
+
+void SetWaveStreaming(bool is_streaming)
+{
+  // Changing modes mid-playback would confuse the buffer bookkeeping.
+  SetWaveActivity(WAVE_START_STOP);
+
+  wave_streaming = is_streaming;
+}
+
+
+
+// Selects the input bit whose rising edge starts triggered playback.
+// Returns false if the bit doesn't exist.
+
+bool SetWaveTrigger(uint32_t bitnum)
+{
+  bool result;
+
+  result = false;
+
+  if (bitnum < ((uint32_t) GetDIOCount(DIO_REG_INPUT)))
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      wave_trigger_mask = 1ul << bitnum;
+    }
+
+    result = true;
+  }
+
+  return result;
+}
+
+
+
+// Starts, arms, or stops playback.
+// Returns false if asked to play a table that loops forever and has no
+// delays (it would never give up the timer interrupt).
+
+bool SetWaveActivity(wave_start_t mode)
+{
+  bool result;
+
+  result = true;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (WAVE_PLAYING == wave_state)
+      EndWave_ISR(Timer_Query_ISR(), WAVE_END_STOPPED);
+
+    wave_state = WAVE_IDLE;
+
+    if (WAVE_START_NOW == mode)
+      result = StartWave_ISR(Timer_Query_ISR());
+    else if (WAVE_START_TRIGGER == mode)
+    {
+      // The table is checked again when the trigger arrives.
+      result = !IsWaveTableTimeless_ISR();
+      if (result)
+        wave_state = WAVE_ARMED;
+    }
+  }
+
+  return result;
+}
+
+
+
+// Saves the sequence buffer and loop count to EEPROM.
+
+void SaveWave(void)
+{
+  wave_eeprom_header_t header;
+  wave_entry_t thisentry;
+  uint8_t idx, count, head;
+  uint16_t addr;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    count = wave_count;
+    head = wave_head;
+  }
+
+  header.magic = WAVE_EEPROM_MAGIC;
+  header.count = count;
+  header.streaming = wave_streaming;
+  header.loops = wave_loops;
+
+  addr = EEPROM_WAVE_ADDR;
+  eeprom_update_block(&header, (void *) addr, sizeof(header));
+  addr += sizeof(header);
+
+  // Store entries in playback order. EEPROM writes are slow, so don't
+  // hold the lock while doing this.
+  for (idx = 0; idx < count; idx++)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      thisentry = wave_buffer[(head + idx) % WAVE_BUFFER_SIZE];
+    }
+
+    eeprom_update_block(&thisentry, (void *) addr, sizeof(thisentry));
+    addr += sizeof(thisentry);
+  }
+}
+
+
+
+// Restores the sequence buffer and loop count from EEPROM.
+// Returns false if nothing valid was saved.
+
+bool LoadWave(void)
+{
+  wave_eeprom_header_t header;
+  uint8_t idx;
+  uint16_t addr;
+  bool result;
+
+  result = false;
+
+  addr = EEPROM_WAVE_ADDR;
+  eeprom_read_block(&header, (const void *) addr, sizeof(header));
+  addr += sizeof(header);
+
+  if ( (WAVE_EEPROM_MAGIC == header.magic)
+    && (WAVE_BUFFER_SIZE >= header.count) )
+  {
+    ClearWave();
+
+    for (idx = 0; idx < header.count; idx++)
+    {
+      eeprom_read_block(&(wave_buffer[idx]), (const void *) addr,
+        sizeof(wave_entry_t));
+      addr += sizeof(wave_entry_t);
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      wave_count = header.count;
+      wave_streaming = (0 != header.streaming);
+      wave_loops = header.loops;
+    }
+
+    result = true;
+  }
+
+  return result;
+}
+
+
+
+// Prints playback state.
+
+void PrintWaveState(void)
+{
+  wave_state_t state;
+  uint8_t count;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    state = wave_state;
+    count = wave_count;
+  }
+
+  Link_QueueSend_P(PSTR("W: state="));
+  if (WAVE_PLAYING == state)
+    Link_QueueSend_P(PSTR("playing"));
+  else if (WAVE_ARMED == state)
+    Link_QueueSend_P(PSTR("armed"));
+  else
+    Link_QueueSend_P(PSTR("idle"));
+
+  Link_QueueSend_P(PSTR(" mode="));
+  Link_QueueSend_P(wave_streaming ? PSTR("stream") : PSTR("table"));
+  Link_QueueSend_P(PSTR(" count="));
+  Link_PrintUInt(count);
+  Link_QueueSend_P(PSTR(" free="));
+  Link_PrintUInt(WAVE_BUFFER_SIZE - count);
+  Link_QueueSend_P(PSTR(" loops="));
+  Link_PrintUInt(wave_loops);
+  Link_QueueSend_P(PSTR("\r\n"));
+}
+
+
+
+// Performs interrupt-driven playback updates.
+
+void PollWave_ISR(void)
+{
+  if (WAVE_PLAYING == wave_state)
+    RunDueWaveEntries_ISR(Timer_Query_ISR());
+}
+
+
+
+// Checks input edges for a playback trigger.
+// This must be called with interrupts off.
+
+void NoteWaveInputEdges_ISR(uint32_t changed, uint32_t new_bits,
+  uint32_t this_time)
+{
+  if ( (WAVE_ARMED == wave_state)
+    && (changed & wave_trigger_mask) && (new_bits & wave_trigger_mask) )
+    StartWave_ISR(this_time);
+}
+
+
+
+// Polling entry point for reporting playback events to the host.
+
+void PollWaveReporting(void)
+{
+  bool start_pending, end_pending, want_refill;
+  uint32_t start_time, end_time;
+  wave_end_t end_reason;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    start_pending = wave_start_pending;
+    start_time = wave_start_time;
+    end_pending = wave_end_pending;
+    end_time = wave_end_time;
+    end_reason = wave_end_reason;
+
+    wave_start_pending = false;
+    wave_end_pending = false;
+
+    // Ask for more data when streaming and at least half empty.
+    want_refill = wave_streaming && (!wave_finished)
+      && (WAVE_PLAYING == wave_state)
+      && (wave_count <= (WAVE_BUFFER_SIZE / 2));
+  }
+
+  // Only ask once each time the buffer drains past the halfway mark.
+  if (!want_refill)
+    wave_refill_reported = false;
+
+  if (start_pending)
+  {
+    Link_QueueSend_P(PSTR("W: start "));
+    Link_PrintUInt64(ExtendLocalTime(start_time));
+    Link_QueueSend_P(PSTR("\r\n"));
+  }
+
+  if (end_pending)
+  {
+    Link_QueueSend_P(PSTR("W: end "));
+    Link_PrintUInt64(ExtendLocalTime(end_time));
+    if (WAVE_END_UNDERRUN == end_reason)
+      Link_QueueSend_P(PSTR(" underrun\r\n"));
+    else if (WAVE_END_STOPPED == end_reason)
+      Link_QueueSend_P(PSTR(" stopped\r\n"));
+    else
+      Link_QueueSend_P(PSTR(" done\r\n"));
+  }
+
+  if (want_refill && (!wave_refill_reported))
+  {
+    wave_refill_reported = true;
+
+    Link_QueueSend_P(PSTR("W: refill "));
+    Link_PrintUInt(WAVE_BUFFER_SIZE - wave_count);
+    Link_QueueSend_P(PSTR("\r\n"));
+  }
+}
+
+
+#endif
+
+//
+// This is the end of the file.
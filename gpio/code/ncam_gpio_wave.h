@@ -0,0 +1,68 @@
+// Attention Circuits Control Laboratory - GPIO device
+// Output waveform playback.
+
+
+//
+// Enums
+
+enum wave_start_t
+{
+  WAVE_START_STOP,
+  WAVE_START_NOW,
+  WAVE_START_TRIGGER
+};
+
+
+//
+// Functions
+
+// Stops playback and empties the sequence buffer.
+void ClearWave(void);
+
+// Appends an entry to the sequence buffer.
+// The argument is (delay in ticks) * 256 + (output value).
+// Returns false if the buffer is full or the entry is malformed.
+bool AppendWaveEntry(uint32_t packed_entry);
+
+// Indicates that no more entries will be streamed for this playback.
+void FinishWave(void);
+
+// Sets the number of times to play the sequence (0 plays forever).
+void SetWaveLoops(uint32_t loops);
+
+// Selects streaming mode (entries are consumed as played) or table mode.
+void SetWaveStreaming(bool is_streaming);
+
+// Selects the input bit whose rising edge starts triggered playback.
+// Returns false if the bit doesn't exist.
+bool SetWaveTrigger(uint32_t bitnum);
+
+// Starts, arms, or stops playback.
+// Returns false if asked to play a table that loops forever and has no
+// delays (it would never give up the timer interrupt).
+bool SetWaveActivity(wave_start_t mode);
+
+// Saves the sequence buffer and loop count to EEPROM.
+void SaveWave(void);
+
+// Restores the sequence buffer and loop count from EEPROM.
+// Returns false if nothing valid was saved.
+bool LoadWave(void);
+
+// Prints playback state.
+void PrintWaveState(void);
+
+// Performs interrupt-driven playback updates.
+void PollWave_ISR(void);
+
+// Checks input edges for a playback trigger.
+// This must be called with interrupts off.
+void NoteWaveInputEdges_ISR(uint32_t changed, uint32_t new_bits,
+  uint32_t this_time);
+
+// Polling entry point for reporting playback events to the host.
+void PollWaveReporting(void);
+
+
+//
+// This is the end of the file.